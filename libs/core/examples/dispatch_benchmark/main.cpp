@@ -0,0 +1,122 @@
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_parser.hpp"
+#include "tone/core/jit.hpp"
+#include "tone/core/tokenizer.hpp"
+#include "tone/core/vm.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+
+using namespace tone::core;
+
+namespace {
+    constexpr std::size_t iterations = 1'000'000;
+    constexpr int rounds = 5;
+
+    struct benchmark_case
+    {
+        const char* name;
+        const char* source;
+    };
+
+    const benchmark_case cases[] = {
+            {"int arithmetic", "(i * j + k * 3 - (i + j) * (k - 7) / 3 + i * 2 - j) % 1000"},
+            {"real arithmetic", "x * y + z * 3.5 - (x + y) * (z - 7.0) / 3.0 + x * 2.0 - y"},
+            {"int comparisons", "i < j && j < k || k >= i && i != k || i == j && j <= k"},
+            {"real comparisons", "x < y && y < z || z >= x && x != z || x == y && y <= z"},
+    };
+
+    node_ptr parse_source(compile_context& context, const char* source)
+    {
+        std::istringstream ss(source);
+        character_source_t input = [&ss]() { return ss.get(); };
+        push_back_stream strm(input);
+        token_iterator it(strm);
+        return parse_expression_tree(context, it, type_registry::get_void_handle(), false, true,
+                                     false);
+    }
+
+    template <typename F>
+    double measure(F&& evaluate)
+    {
+        // Warm up caches and the branch predictor before timing
+        for (std::size_t n = 0; n < iterations / 10; ++n)
+            evaluate();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t n = 0; n < iterations; ++n)
+            evaluate();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / double(iterations);
+    }
+} // namespace
+
+int main()
+{
+    compile_context context;
+    context.enter_function();
+    context.create_param("i", type_registry::get_int_handle());
+    context.create_param("j", type_registry::get_int_handle());
+    context.create_param("k", type_registry::get_int_handle());
+    context.create_param("x", type_registry::get_real_handle());
+    context.create_param("y", type_registry::get_real_handle());
+    context.create_param("z", type_registry::get_real_handle());
+
+    const runtime_value params[] = {std::int64_t(17), std::int64_t(42), std::int64_t(99),
+                                    1.5, 2.25, 3.125};
+
+#if !TONE_THREADED_DISPATCH
+    fmt::print("Threaded dispatch is not available in this build; "
+               "both columns use the switch loop.\n");
+#endif
+    fmt::print("{:<18} {:>12} {:>12} {:>9} {:>12}\n", "expression", "switch ns", "threaded ns",
+               "speedup", "native ns");
+
+    vm machine;
+    for (const auto& c : cases)
+    {
+        try
+        {
+            const node_ptr tree = parse_source(context, c.source);
+            const bytecode code = compile_bytecode(context, *tree);
+            const auto native = compile_native(context, *tree);
+
+            // Alternate the modes and keep the best round of each to reduce noise
+            double switch_ns = std::numeric_limits<double>::max();
+            double threaded_ns = std::numeric_limits<double>::max();
+            double native_ns = std::numeric_limits<double>::max();
+            for (int round = 0; round < rounds; ++round)
+            {
+                switch_ns = std::min(switch_ns, measure([&] {
+                    return machine.run(code, params, dispatch_mode::switch_loop);
+                }));
+                threaded_ns = std::min(threaded_ns, measure([&] {
+                    return machine.run(code, params, dispatch_mode::threaded);
+                }));
+                if (native)
+                {
+                    native_ns = std::min(native_ns, measure([&] {
+                        return (*native)(params, machine.bind_globals(code));
+                    }));
+                }
+            }
+            fmt::print("{:<18} {:>12.2f} {:>12.2f} {:>8.2f}x {:>12}\n", c.name, switch_ns,
+                       threaded_ns, switch_ns / threaded_ns,
+                       native ? fmt::format("{:.2f}", native_ns) : "-");
+        }
+        catch (const error& err)
+        {
+            fmt::print(stderr, "{}: {}\n", c.name, err.what());
+            return 1;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -1,9 +1,11 @@
+#include "tone/core/bytecode_compiler.hpp"
 #include "tone/core/compile_context.hpp"
 #include "tone/core/errors.hpp"
 #include "tone/core/expression_parser.hpp"
 #include "tone/core/expression_tree.hpp"
 #include "tone/core/tokenizer.hpp"
 #include "tone/core/variant_helpers.hpp"
+#include "tone/core/vm.hpp"
 
 #include <fmt/format.h>
 #include <iostream>
@@ -155,6 +157,8 @@ int main()
     context.create_identifier("str5", type_registry::get_str_handle(), true);
     context.create_identifier("str6", type_registry::get_str_handle(), true);
 
+    vm machine;
+
     std::string line;
     do
     {
@@ -172,6 +176,10 @@ int main()
             token_iterator it(strm);
             node_ptr n = parse_expression_tree(context, it, type_registry::get_void_handle(), false, true, false);
             fmt::print("Parsed expression: {}\n", dump_node(n));
+
+            bytecode code = compile_bytecode(context, *n);
+            fmt::print("Bytecode:\n{}", dump_bytecode(code));
+            fmt::print("Result: {}\n", dump_runtime_value(machine.run(code)));
         }
         catch(const error& err)
         {
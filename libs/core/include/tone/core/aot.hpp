@@ -0,0 +1,130 @@
+#pragma once
+
+#include "tone/core/expression_tree.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/vm.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// Module ABI
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Layout of the entry-point table exported by generated modules. These mirror the C
+    // declarations emitted by `generate_aot_source`; any change to either side must bump
+    // `aot_abi_version` and the exported symbol name.
+    constexpr std::uint32_t aot_abi_version = 1;
+    constexpr const char* aot_module_symbol = "tone_module_v1";
+
+    enum class aot_type : std::uint8_t
+    {
+        none,
+        int_type,
+        real_type,
+        bool_type,
+    };
+
+    union aot_value
+    {
+        std::int64_t i;
+        double r;
+        std::uint8_t b;
+    };
+
+    struct aot_error_site
+    {
+        const char* message;
+        std::uint32_t line_number;
+        std::uint32_t char_index;
+    };
+
+    // Returns 0, or the 1-based index of the error site that stopped evaluation
+    using aot_entry_point = int (*)(const aot_value* params, aot_value* globals,
+                                    aot_value* result);
+
+    struct aot_entry
+    {
+        const char* name;
+        aot_entry_point function;
+        std::uint32_t param_count;
+        const std::uint8_t* param_types;
+        std::uint32_t global_count;
+        const std::uint32_t* globals;
+        std::uint32_t error_site_count;
+        const aot_error_site* error_sites;
+        std::uint8_t result_type;
+    };
+
+    struct aot_module
+    {
+        std::uint32_t abi_version;
+        std::uint32_t entry_count;
+        const aot_entry* entries;
+        std::uint32_t global_count;
+        const std::uint8_t* global_types;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// Source generation
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct aot_source_entry
+    {
+        std::string name;
+        const node* root;
+    };
+
+    // Translates type-checked trees over `int`, `real` and `bool` values to a self-contained C99
+    // translation unit exporting `aot_module_symbol`
+    std::string generate_aot_source(const compile_context& context,
+                                    std::span<const aot_source_entry> entries);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `aot_library` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class aot_library;
+
+    class aot_function
+    {
+    public:
+        [[nodiscard]] std::string_view name() const;
+        [[nodiscard]] type_handle result_type() const;
+
+        // Reads and writes the globals of `machine`, like `vm::run`
+        runtime_value operator()(vm& machine, std::span<const runtime_value> params = {}) const;
+
+    private:
+        friend class aot_library;
+        aot_function(const aot_entry& entry, std::span<const type_handle> global_types);
+
+        const aot_entry* _entry;
+        std::span<const type_handle> _global_types;
+    };
+
+    // Functions found in a library are only valid while it stays loaded
+    class aot_library
+    {
+    public:
+        explicit aot_library(const std::string& path);
+        aot_library(const aot_library&) = delete;
+        aot_library& operator=(const aot_library&) = delete;
+        aot_library(aot_library&& other) noexcept;
+        aot_library& operator=(aot_library&& other) noexcept;
+        ~aot_library();
+
+        [[nodiscard]] std::optional<aot_function> find(std::string_view name) const;
+        [[nodiscard]] std::vector<std::string_view> entry_names() const;
+
+    private:
+        void* _handle;
+        const aot_module* _module;
+        std::vector<type_handle> _global_types;
+    };
+} // namespace tone::core
\ No newline at end of file
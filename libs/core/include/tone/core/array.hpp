@@ -0,0 +1,153 @@
+#pragma once
+
+#include "tone/core/str.hpp"
+#include "tone/core/type.hpp"
+
+#include <cstdint>
+#include <span>
+#include <utility>
+
+namespace tone::core {
+    enum class element_kind : std::uint8_t
+    {
+        int_element,
+        real_element,
+        bool_element,
+        str_element,
+        array_element,
+    };
+
+    // How an array of the array type `type_id` stores its elements; throws
+    // `std::invalid_argument` for anything else
+    element_kind element_kind_of(type_handle type_id);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `array` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Typed array value that fits in one pointer. `int` and `real` elements are stored unboxed
+    // and contiguously, `bool` elements are packed 64 to a word, and `str` and nested array
+    // elements are owned handles. Arrays are reference values: copies, slices and the VM share
+    // the same elements, so a write through one is seen by all. Storage is reference counted but
+    // not synchronized.
+    //
+    // A slice is a view into the array it was taken from and follows it when it grows; the
+    // elements it can see shrink with the source. Growing a view first copies the elements it
+    // sees into storage of its own. A zero handle is an empty array without a type.
+    //
+    // A borrowed array sees `int` or `real` elements owned by the host instead, see
+    // `view_scope`. Scripts can't store to the elements of a read-only one, and the host can't
+    // grow it.
+    class array
+    {
+    public:
+        array() = default;
+        // `size` default elements of the array type `type_id`. The elements of an array of
+        // arrays are distinct empty arrays.
+        explicit array(type_handle type_id, std::size_t size = 0);
+        array(const array& other);
+        array(array&& other) noexcept;
+        array& operator=(const array& other);
+        array& operator=(array&& other) noexcept;
+        ~array();
+
+        // Null for a default constructed array
+        [[nodiscard]] type_handle type_id() const;
+        [[nodiscard]] type_handle element_type() const;
+        [[nodiscard]] element_kind kind() const;
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] bool empty() const;
+        [[nodiscard]] bool is_view() const;
+        [[nodiscard]] bool is_borrowed() const;
+        [[nodiscard]] bool is_read_only() const;
+        // Whether nothing else, not even a view, refers to the storage
+        [[nodiscard]] bool is_unique() const;
+
+        // Bounds-checked element access; throws `std::out_of_range` for a bad index and
+        // `std::logic_error` when the array holds another kind of element or is read-only
+        [[nodiscard]] std::int64_t get_int(std::size_t index) const;
+        [[nodiscard]] double get_real(std::size_t index) const;
+        [[nodiscard]] bool get_bool(std::size_t index) const;
+        [[nodiscard]] str get_str(std::size_t index) const;
+        [[nodiscard]] array get_array(std::size_t index) const;
+        void set_int(std::size_t index, std::int64_t value);
+        void set_real(std::size_t index, double value);
+        void set_bool(std::size_t index, bool value);
+        void set_str(std::size_t index, str value);
+        void set_array(std::size_t index, array value);
+
+        // Amortized constant time
+        void push_int(std::int64_t value);
+        void push_real(double value);
+        void push_bool(bool value);
+        void push_str(str value);
+        void push_array(array value);
+        void reserve(std::size_t capacity);
+        void resize(std::size_t size);
+
+        // The unboxed elements of an `int` or `real` array, empty for any other kind. Valid until
+        // the array or the array it views grows.
+        [[nodiscard]] std::span<std::int64_t> ints();
+        [[nodiscard]] std::span<const std::int64_t> ints() const;
+        [[nodiscard]] std::span<double> reals();
+        [[nodiscard]] std::span<const double> reals() const;
+        // The packed words of a `bool` array, element `i` being bit `i % 64` of word `i / 64`.
+        // Empty for any other kind and for views that don't start on a word boundary. Bits past
+        // the size are unspecified.
+        [[nodiscard]] std::span<std::uint64_t> bool_words();
+        [[nodiscard]] std::span<const std::uint64_t> bool_words() const;
+
+        // A view of up to `count` elements from `pos`; throws `std::out_of_range` when `pos` is
+        // past the end
+        [[nodiscard]] array slice(std::size_t pos, std::size_t count = std::size_t(-1)) const;
+
+        // An `int` or `real` array of the array type `type_id` over `size` elements at `data`,
+        // which must stay valid until `own` is called on it or on an array sharing its storage
+        static array borrow(type_handle type_id, void* data, std::size_t size, bool read_only);
+        // Copies the elements a borrowed array sees into storage of its own, which every array
+        // sharing them then sees too; does nothing for other arrays
+        void own();
+
+        // Arrays compare by identity: equal when they see the same elements of the same storage
+        bool operator==(const array& other) const;
+
+        // Handle interop for untagged storage such as `value_slot`, as for `str`
+        [[nodiscard]] void* handle() const;
+        [[nodiscard]] void* release();
+        static array adopt(void* handle);
+        static array share(const void* handle);
+
+        // Unchecked element access for the VM, which checks `index < size(handle)` itself. The
+        // `str` and array handles returned by `load_str` and `load_array` are borrowed, the ones
+        // given to `store_str` and `store_array` are consumed.
+        static std::size_t size(const void* handle);
+        static bool is_read_only(const void* handle);
+        static std::int64_t load_int(const void* handle, std::size_t index);
+        static double load_real(const void* handle, std::size_t index);
+        static bool load_bool(const void* handle, std::size_t index);
+        static const void* load_str(const void* handle, std::size_t index);
+        static const void* load_array(const void* handle, std::size_t index);
+        static void store_int(const void* handle, std::size_t index, std::int64_t value);
+        static void store_real(const void* handle, std::size_t index, double value);
+        static void store_bool(const void* handle, std::size_t index, bool value);
+        static void store_str(const void* handle, std::size_t index, void* value);
+        static void store_array(const void* handle, std::size_t index, void* value);
+
+    private:
+        struct storage;
+
+        static storage* allocate(type_handle type_id);
+        static void add_ref(storage* s);
+        static void release_ref(storage* s);
+        static void destroy_elements(storage* s, std::size_t first, std::size_t last);
+        static void fill_default(storage* s, std::size_t first, std::size_t last);
+        // The storage owning the element at `index` of `handle`, and its position there
+        static std::pair<storage*, std::size_t> locate(const void* handle, std::size_t index);
+
+        void check(std::size_t index, element_kind expected) const;
+        void detach();
+        std::size_t grow();
+
+        storage* _storage = nullptr;
+    };
+} // namespace tone::core
\ No newline at end of file
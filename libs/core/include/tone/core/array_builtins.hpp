@@ -0,0 +1,21 @@
+#pragma once
+
+#include "tone/core/compile_context.hpp"
+
+namespace tone::core {
+    // Declares host functions over `int` and `real` arrays that run on the active
+    // `simd_kernels`. There are no overloads, so each is declared once per element type with the
+    // type as a suffix, as in `add_int` and `add_real`:
+    //
+    //   add, sub, mul, div              elementwise, into a new array
+    //   equal, not_equal, less,         elementwise, into a new `bool` array
+    //   less_equal, greater, greater_equal
+    //   sum, min, max                   reductions; `min` and `max` of an empty array are errors
+    //   dot                             sum of the elementwise products
+    //   prefix_sum                      running totals, into a new array
+    //   filter                          the elements whose `bool` is set in a mask
+    //
+    // Binary functions and `filter` need operands of the same length. Integer division by zero
+    // is an error, as in scripts.
+    void declare_array_builtins(compile_context& context);
+} // namespace tone::core
\ No newline at end of file
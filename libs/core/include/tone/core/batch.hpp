@@ -0,0 +1,105 @@
+#pragma once
+
+#include "tone/core/expression_tree.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace tone::core {
+    // The values of one identifier for every row of a batch
+    using column = std::variant<std::span<const std::int64_t>, std::span<const double>,
+                                std::span<const bool>>;
+    using column_bindings = std::unordered_map<std::string, column>;
+    // Receives one result per row
+    using output_column =
+            std::variant<std::span<std::int64_t>, std::span<double>, std::span<bool>>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `batch_expression` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // An expression evaluated over many rows at once. Each operation runs over a block of rows
+    // with the `simd_kernels` before the next one starts, so the per-row cost is a few vector
+    // instructions rather than a trip through the interpreter. `bool` intermediates are kept
+    // as bit masks.
+    //
+    // Results match the VM's row by row. Integer division by zero is a runtime error at the
+    // division, whichever row it happens in.
+    class batch_expression
+    {
+    public:
+        // Plans a side-effect free tree over `int`, `real` and `bool` identifiers and literals.
+        // Identifiers are bound to columns by name when evaluating. Throws a compiler error for
+        // anything else.
+        explicit batch_expression(const node& root);
+
+        [[nodiscard]] type_handle result_type() const;
+        // The identifiers every evaluation has to bind, with the column type each needs
+        [[nodiscard]] const std::vector<std::pair<std::string, type_handle>>& inputs() const;
+
+        // Evaluates the first `rows` rows of `columns` into `out`, which must hold the result
+        // type and at least `rows` elements. Throws `std::invalid_argument` for a missing,
+        // mistyped or short column.
+        void evaluate(const column_bindings& columns, std::size_t rows, output_column out) const;
+        // Writes the indices of the rows for which a `bool` expression is true to `out`, in
+        // order, and returns how many there are. `out` needs room for `rows` indices.
+        std::size_t select(const column_bindings& columns, std::size_t rows,
+                           std::span<std::uint32_t> out) const;
+
+    private:
+        enum class op_code : std::uint8_t;
+
+        // A temp of the plan, or the column bound to one of its inputs
+        struct operand
+        {
+            bool is_input;
+            std::uint32_t index;
+        };
+        struct planned
+        {
+            operand where;
+            type_handle type_id;
+        };
+        struct step
+        {
+            op_code op;
+            operand dst;
+            operand lhs;
+            operand rhs;
+            std::size_t line_number;
+            std::size_t char_index;
+        };
+
+        planned plan(const node& n);
+        planned plan_converted(const node& n, type_handle type_id);
+        planned plan_identifier(const node& n);
+        planned plan_literal(const node& n);
+        planned plan_binary(const node& n, type_handle operand_type, type_handle type_id,
+                            op_code op);
+        planned emit(op_code op, const node& origin, const planned& lhs, const planned& rhs,
+                     type_handle type_id);
+        std::uint32_t allocate_temp();
+        void release(const planned& value);
+
+        // The first element of every input's column, checked against `rows`
+        std::vector<const char*> bind(const column_bindings& columns, std::size_t rows) const;
+        // Runs every step over the rows from `first`, returning where the result is
+        const void* run_block(const std::vector<const char*>& bound, std::size_t first,
+                              std::size_t count, std::uint64_t* temps) const;
+        std::vector<std::uint64_t> make_temps() const;
+
+        type_handle _result_type;
+        operand _result;
+        std::vector<std::pair<std::string, type_handle>> _inputs;
+        std::vector<step> _steps;
+        // Literals, by the temp they fill before the first block
+        std::vector<std::pair<std::uint32_t, std::uint64_t>> _constants;
+        std::vector<std::uint32_t> _free_temps;
+        std::uint32_t _temp_count = 0;
+    };
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "tone/core/host_function.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/type.hpp"
+#include "tone/core/value_slot.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    enum class opcode : std::uint16_t
+    {
+        // Control flow
+        ret,
+        jump,
+        jump_if_false,
+        jump_if_true,
+
+        // Data movement
+        load_const,
+        move,
+        load_global,
+        store_global,
+        load_const_str,
+        move_str,
+        load_global_str,
+        store_global_str,
+        move_array,
+        load_global_array,
+        store_global_array,
+
+        // Conversions
+        int_to_real,
+        int_to_bool,
+        int_to_str,
+        real_to_int,
+        real_to_bool,
+        real_to_str,
+
+        // Integer arithmetic
+        add_int,
+        sub_int,
+        mul_int,
+        div_int,
+        mod_int,
+        neg_int,
+        inc_int,
+        dec_int,
+
+        // Integer bitwise
+        bitwise_not,
+        bitwise_and,
+        bitwise_or,
+        bitwise_xor,
+        shift_l,
+        shift_r,
+
+        // Real arithmetic
+        add_real,
+        sub_real,
+        mul_real,
+        div_real,
+        mod_real,
+        neg_real,
+        inc_real,
+        dec_real,
+
+        // String operations
+        concat_str,
+        concat_n,
+        append_str,
+        append_global_str,
+
+        // Array element access, bounds-checked
+        index_int,
+        index_real,
+        index_bool,
+        index_str,
+        index_array,
+        store_index_int,
+        store_index_real,
+        store_index_bool,
+        store_index_str,
+        store_index_array,
+
+        // Host function calls (wide)
+        call,
+
+        // Integer comparisons
+        equal_int,
+        not_equal_int,
+        less_int,
+        greater_int,
+        less_equal_int,
+        greater_equal_int,
+
+        // Real comparisons
+        equal_real,
+        not_equal_real,
+        less_real,
+        greater_real,
+        less_equal_real,
+        greater_equal_real,
+
+        // Logical operations
+        logical_not,
+
+        // Superinstructions - arithmetic with a constant operand
+        add_int_k,
+        sub_int_k,
+        mul_int_k,
+        div_int_k,
+        mod_int_k,
+        add_real_k,
+        sub_real_k,
+        mul_real_k,
+        div_real_k,
+        mod_real_k,
+
+        // Superinstructions - comparison with a constant operand
+        equal_int_k,
+        not_equal_int_k,
+        less_int_k,
+        greater_int_k,
+        less_equal_int_k,
+        greater_equal_int_k,
+        equal_real_k,
+        not_equal_real_k,
+        less_real_k,
+        greater_real_k,
+        less_equal_real_k,
+        greater_equal_real_k,
+
+        // Superinstructions - comparison and conditional jump (wide)
+        equal_int_branch,
+        not_equal_int_branch,
+        less_int_branch,
+        greater_int_branch,
+        less_equal_int_branch,
+        greater_equal_int_branch,
+        equal_real_branch,
+        not_equal_real_branch,
+        less_real_branch,
+        greater_real_branch,
+        less_equal_real_branch,
+        greater_equal_real_branch,
+
+        // Superinstructions - comparison with a constant and conditional jump (wide)
+        equal_int_k_branch,
+        not_equal_int_k_branch,
+        less_int_k_branch,
+        greater_int_k_branch,
+        less_equal_int_k_branch,
+        greater_equal_int_k_branch,
+        equal_real_k_branch,
+        not_equal_real_k_branch,
+        less_real_k_branch,
+        greater_real_k_branch,
+        less_equal_real_k_branch,
+        greater_equal_real_k_branch,
+    };
+    constexpr std::size_t opcode_count = std::size_t(opcode::greater_equal_real_k_branch) + 1;
+
+    // Wide instructions continue their operands in the following word, whose opcode is unused
+    struct instruction
+    {
+        opcode op;
+        std::uint16_t a;
+        std::uint16_t b;
+        std::uint16_t c;
+    };
+    static_assert(sizeof(instruction) == 8);
+
+    struct opcode_info
+    {
+        std::string_view name;
+        // One character per operand field, continuing into the next word for wide instructions:
+        //  'd' destination register, 'r' source register, 'm' modified register,
+        //  'k' constant, 'g' global, 'j' jump target, 'b' boolean flag, 'f' host function,
+        //  's' first of a run of source registers whose length is the following 'n' field
+        std::string_view operands;
+
+        auto operator<=>(const opcode_info&) const = default;
+    };
+
+    const opcode_info& get_opcode_info(opcode op);
+    std::size_t instruction_width(opcode op);
+
+    struct source_location
+    {
+        std::size_t line_number;
+        std::size_t char_index;
+    };
+
+    struct bytecode
+    {
+        std::vector<instruction> code;
+        std::vector<source_location> locations;
+        std::vector<runtime_value> constants;
+        // `constants` as the VM reads them; str slots borrow the strings in `constants`
+        std::vector<value_slot> constant_slots;
+        // Owned by the compile context the code was compiled with
+        std::vector<const host_function*> functions;
+
+        // Frame layout: parameters, then locals, then temporaries
+        std::uint16_t param_count = 0;
+        std::uint16_t local_count = 0;
+        std::uint16_t register_count = 0;
+        std::vector<type_handle> slot_types;
+        // Registers holding str values, released when the frame exits. A register never holds
+        // both str and other values.
+        std::vector<std::uint16_t> str_registers;
+        // As `str_registers`, for array values
+        std::vector<std::uint16_t> array_registers;
+
+        std::vector<type_handle> global_types;
+        // The name each of `global_types` was declared with, empty for those the code doesn't use
+        std::vector<std::string> global_names;
+        type_handle result_type_id = nullptr;
+    };
+
+    // What the VM reads of compiled code, which needn't be held in a `bytecode`; a mapped
+    // `bytecode_image` is run in place through one. Converts from the `bytecode` it views.
+    struct bytecode_view
+    {
+        bytecode_view() = default;
+        bytecode_view(const bytecode& code);
+
+        std::span<const instruction> code;
+        std::span<const source_location> locations;
+        std::span<const value_slot> constant_slots;
+        std::span<const host_function* const> functions;
+
+        std::uint16_t param_count = 0;
+        std::uint16_t local_count = 0;
+        std::uint16_t register_count = 0;
+        std::span<const type_handle> slot_types;
+        std::span<const std::uint16_t> str_registers;
+        std::span<const std::uint16_t> array_registers;
+
+        std::span<const type_handle> global_types;
+        type_handle result_type_id = nullptr;
+    };
+
+    std::string dump_opcode(opcode op);
+    std::string dump_bytecode(const bytecode& code);
+} // namespace tone::core
\ No newline at end of file
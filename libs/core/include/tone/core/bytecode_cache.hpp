@@ -0,0 +1,71 @@
+#pragma once
+
+#include "tone/core/bytecode_image.hpp"
+#include "tone/core/compiled_expression.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace tone::core {
+    class compile_context;
+
+    struct bytecode_cache_stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        // Compiled code that couldn't be stored, which is still returned
+        std::uint64_t write_failures;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `bytecode_cache` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Compiled expressions kept as image files in a directory, so they survive the process and
+    // are shared by every process using the directory. A file is named by a hash of what decides
+    // the code: the compiler and image versions, the globals and host functions of the context,
+    // the parameters and the source. The full key is saved as the image's tag and compared on
+    // load, so a hash collision is a miss rather than the wrong code.
+    //
+    // Files are written under a temporary name and renamed into place, so a reader sees a
+    // whole image or none, and never changed once there; processes racing to compile the same
+    // source write identical files. Unreadable or stale files are recompiled and replaced.
+    // Nothing is ever deleted.
+    //
+    // Calls are serialized, as the context isn't thread-safe; nothing else may use it while
+    // the cache does.
+    class bytecode_cache
+    {
+    public:
+        // Creates `directory` if it doesn't exist. Throws `std::filesystem::filesystem_error`
+        // when that fails.
+        bytecode_cache(compile_context& context, std::filesystem::path directory);
+        bytecode_cache(const bytecode_cache&) = delete;
+        bytecode_cache& operator=(const bytecode_cache&) = delete;
+
+        // The code of `source` compiled as a `compiled_expression` over `params`, which are
+        // passed to `vm::run_slots` in order. Compiles on a miss, which throws as the
+        // `compiled_expression` constructor does.
+        bytecode_image get(std::string_view source, std::span<const expression_param> params);
+
+        [[nodiscard]] bytecode_cache_stats stats() const;
+        [[nodiscard]] const std::filesystem::path& directory() const;
+
+    private:
+        std::string make_key(std::string_view source,
+                             std::span<const expression_param> params) const;
+        bool store(const std::filesystem::path& path, std::span<const std::byte> bytes) const;
+
+        compile_context& _context;
+        std::filesystem::path _directory;
+        std::mutex _mutex;
+        std::atomic<std::uint64_t> _hits = 0;
+        std::atomic<std::uint64_t> _misses = 0;
+        std::atomic<std::uint64_t> _write_failures = 0;
+    };
+} // namespace tone::core
\ No newline at end of file
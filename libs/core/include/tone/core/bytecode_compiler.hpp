@@ -0,0 +1,16 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+#include "tone/core/expression_tree.hpp"
+#include "tone/core/peephole.hpp"
+
+namespace tone::core {
+    class compile_context;
+
+    // Bumped whenever a source can compile to different code than before, so code cached by an
+    // earlier compiler is told apart
+    constexpr std::uint32_t bytecode_compiler_version = 1;
+
+    bytecode compile_bytecode(const compile_context& context, const node& root,
+                              const fusion_options& fusions = {});
+} // namespace tone::core
\ No newline at end of file
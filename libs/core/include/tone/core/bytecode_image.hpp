@@ -0,0 +1,106 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+#include "tone/core/mapped_file.hpp"
+#include "tone/core/str.hpp"
+#include "tone/core/view_scope.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+    class vm;
+
+    // Version of the image layout written by `save_bytecode_image`; images of any other
+    // version are refused when loaded
+    constexpr std::uint32_t bytecode_image_version = 3;
+
+    // Lays `code` out as a position-independent image for `bytecode_image`, carrying `tag` for
+    // whoever stores it to recognize it by. Throws `std::invalid_argument` for code with array
+    // constants, which have no image form.
+    std::vector<std::byte> save_bytecode_image(const bytecode& code, std::string_view tag = {});
+    // As `save_bytecode_image`, also saving every global `machine` holds and the declarations
+    // of the globals of `context`, for `bytecode_image::restore_globals`. Strings and arrays are
+    // saved with their elements, and arrays shared between globals or elements are restored
+    // shared. Views are saved as the elements they see and borrowed arrays as their own.
+    std::vector<std::byte> save_bytecode_snapshot(const bytecode& code, const vm& machine,
+                                                  const compile_context& context,
+                                                  std::string_view tag = {});
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `bytecode_image` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Compiled code run straight from the bytes of an image, usually a mapped file. The
+    // instructions, source map and register lists are used in place. Loading only resolves
+    // what refers outside the image against a compile context: the interned type table, the
+    // host functions and globals by name, and the constant pool, whose strings borrow their
+    // characters from the image. Its cost is independent of the size of the code.
+    //
+    // A snapshot image also holds the globals of a VM that ran initialization, which replace
+    // running it again. Loading one declares the globals it holds that the context doesn't, as
+    // the initialization would have.
+    //
+    // Images are trusted like compiled code: their layout is checked when loaded but their
+    // instructions aren't.
+    class bytecode_image
+    {
+    public:
+        // Uses `bytes`, which must be 8-byte aligned, in place; they must stay valid and
+        // unchanged while the image lives. Throws `std::invalid_argument` for bytes that aren't
+        // an image of this version and for types, host functions or globals that `context`
+        // doesn't declare as the code was compiled with. `context` must be at global scope.
+        bytecode_image(std::span<const std::byte> bytes, compile_context& context);
+        // Maps the file at `path` as a `mapped_file`. Throws `std::runtime_error` when it can't be
+        // opened.
+        static bytecode_image map_file(const std::string& path, compile_context& context);
+        // Loads a copy of `bytes`, which needn't be aligned or outlive the image
+        static bytecode_image copy(std::span<const std::byte> bytes, compile_context& context);
+
+        bytecode_image(const bytecode_image&) = delete;
+        bytecode_image& operator=(const bytecode_image&) = delete;
+        bytecode_image(bytecode_image&&) noexcept = default;
+        bytecode_image& operator=(bytecode_image&& other) noexcept;
+
+        // Valid while the image lives
+        [[nodiscard]] const bytecode_view& view() const;
+        // The tag the image was saved with
+        [[nodiscard]] std::string_view tag() const;
+
+        // Whether this is a snapshot holding globals
+        [[nodiscard]] bool has_globals() const;
+        // Sets the globals of `machine` to the values of a snapshot. Strings are lent from the
+        // image, and copied when the image goes while they're still held. Throws
+        // `std::invalid_argument` for a malformed snapshot.
+        void restore_globals(vm& machine);
+
+    private:
+        bytecode_image() = default;
+
+        void load(compile_context& context);
+        [[nodiscard]] type_handle type_at(std::uint32_t index) const;
+
+        std::span<const std::byte> _bytes;
+        // The file or buffer behind `_bytes` when the image owns it
+        mapped_file _file;
+        std::vector<std::uint64_t> _buffer;
+
+        std::vector<type_handle> _types;
+        std::vector<type_handle> _slot_types;
+        std::vector<type_handle> _global_types;
+        std::vector<const host_function*> _functions;
+        std::vector<value_slot> _constant_slots;
+        // What's lent from `_bytes`, so declared after what owns them
+        std::unique_ptr<view_scope> _lent;
+        // Those of the constants, let go before `_lent` copies what's still held
+        std::vector<str> _strs;
+        std::string_view _tag;
+        bool _has_globals = false;
+        bytecode_view _view;
+    };
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "tone/core/bytecode_image.hpp"
+#include "tone/core/mapped_file.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+
+    constexpr std::uint32_t bytecode_library_version = 1;
+
+    struct library_program
+    {
+        std::string name;
+        const bytecode* code;
+    };
+
+    // Packs `programs` into one library file for `bytecode_library`, each as a bytecode image.
+    // Throws `std::invalid_argument` for a name used twice and as `save_bytecode_image` does.
+    std::vector<std::byte> save_bytecode_library(std::span<const library_program> programs);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `bytecode_library` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Many compiled programs in one mapped file, for hosts running many worker processes over
+    // the same scripts. Everything that is the same in every process stays in the file and is
+    // shared through the page cache: the code, source maps, constant data, type tables and
+    // symbol names. A process only holds what refers to itself, which is resolved for a
+    // program the first time it's used: its interned types, host functions and constant slots.
+    // Mutable state, such as globals, stays in the `vm` that runs the code.
+    //
+    // Finding programs is thread-safe, though the context mustn't be used by anything else while
+    // a program is first resolved in it.
+    class bytecode_library
+    {
+    public:
+        // Throws `std::runtime_error` when the file at `path` can't be opened and
+        // `std::invalid_argument` when it isn't a library of this version
+        bytecode_library(compile_context& context, const std::string& path);
+        bytecode_library(const bytecode_library&) = delete;
+        bytecode_library& operator=(const bytecode_library&) = delete;
+
+        // Every program in the library, in name order
+        [[nodiscard]] std::vector<std::string_view> names() const;
+        // The program called `name`, valid while the library lives, or null when there's none.
+        // Throws as the `bytecode_image` constructor does when it's first resolved.
+        const bytecode_view* find(std::string_view name);
+
+    private:
+        struct program
+        {
+            std::string_view name;
+            std::span<const std::byte> bytes;
+            std::unique_ptr<bytecode_image> image;
+        };
+
+        compile_context& _context;
+        mapped_file _file;
+        std::mutex _mutex;
+        // By name
+        std::vector<program> _programs;
+    };
+} // namespace tone::core
\ No newline at end of file
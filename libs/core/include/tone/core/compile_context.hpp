@@ -1,26 +1,143 @@
 #pragma once
 
+#include "tone/core/host_function.hpp"
 #include "tone/core/identifier.hpp"
+#include "tone/core/native_binding.hpp"
 #include "tone/core/type.hpp"
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 namespace tone::core {
     class compile_context
     {
     public:
         compile_context();
 
+        // A context sharing the globals, host functions and types of this one, with scopes of
+        // its own, so that function bodies can be compiled in both on different threads at
+        // once. Nothing may declare globals while a fork compiles, and declaring one in a fork
+        // throws `std::logic_error`.
+        [[nodiscard]] compile_context fork() const;
+        // As above, with the globals `visible` rejects hidden from `find`. It's called on every
+        // global found, with the name it was looked up by.
+        using visibility = std::function<bool(const std::string& name, const identifier_info&)>;
+        [[nodiscard]] compile_context fork(visibility visible) const;
+
         type_handle get_type_handle(const type& ty);
         const identifier_info* find(const std::string& name) const;
         const identifier_info* create_identifier(std::string name, type_handle type_id, bool is_constant);
         const identifier_info* create_param(std::string name, type_handle type_id);
 
+        // Declares a constant global named after `fn` that calls it. Compiled code refers to
+        // the function, so it must not outlive this context.
+        const identifier_info* create_function(host_function fn);
+        // Null unless `info` was declared by `create_function`
+        const host_function* find_function(const identifier_info& info) const;
+        // Gives the function declared as `info` by `create_function` the signature and entry
+        // point of `fn`, keeping its global, for code being reloaded. Code compiled before
+        // calls the function replaced, which is handed back so it can be kept until that code
+        // is done; code compiled to call it must be compiled again before it runs anew. Throws
+        // `std::invalid_argument` when `info` isn't a function of this context or `fn` is
+        // named differently.
+        std::unique_ptr<host_function> redefine_function(const identifier_info& info,
+                                                         host_function fn);
+        // Declares a constant global `name` that calls `fn`, typed from its signature. Its
+        // parameter and result types are those of `binding_traits`, and non-const lvalue
+        // reference parameters are by-reference ones.
+        template <typename R, typename... Args>
+        const identifier_info* bind(std::string name, R (*fn)(Args...));
+        // As above, calling `Fn` directly rather than through a pointer
+        template <auto Fn>
+        const identifier_info* bind(std::string name);
+        // Every global and host function declared, in index order
+        [[nodiscard]] std::vector<std::pair<std::string, const identifier_info*>> globals() const;
+        // The globals and host functions declared, one per line in index order. Any source
+        // compiles to the same code in contexts whose dumps are equal.
+        [[nodiscard]] std::string dump_globals() const;
+        // Changes whenever a global is declared or a function redefined, even to the signature
+        // it had before. Code compiled at one generation still calls what it was compiled to
+        // call while the generation stays the same.
+        [[nodiscard]] std::uint64_t generation() const;
+
+        // Shared by the context and its forks. Holding it shared while compiling in a fork and
+        // exclusively while redefining functions lets code be reloaded as other code compiles.
+        [[nodiscard]] std::shared_mutex& declaration_mutex() const;
+
         void enter_scope();
         bool leave_scope();
         void enter_function();
     private:
-        global_identifier_lookup _globals;
+        // Everything but scopes, shared with forks
+        struct global_view
+        {
+            global_identifier_lookup globals;
+            type_registry types;
+            // Boxed, so compiled code can keep calling a function that's been redefined
+            std::unordered_map<const identifier_info*, std::unique_ptr<host_function>> functions;
+            std::shared_mutex declaration_mutex;
+            std::atomic<std::uint64_t> generation = 0;
+        };
+
+        compile_context(std::shared_ptr<global_view> shared, bool is_fork, visibility visible);
+
+        template <typename R, typename... Args>
+        type_handle get_function_type_handle();
+        template <auto Fn, typename R, typename... Args>
+        const identifier_info* bind_direct(std::string name, R (*)(Args...));
+
+        std::shared_ptr<global_view> _shared;
+        bool _is_fork;
+        visibility _visible;
         function_identifier_lookup* _params;
         std::unique_ptr<local_identifier_lookup> _locals;
-        type_registry _types;
     };
+
+    template <typename R, typename... Args>
+    type_handle compile_context::get_function_type_handle()
+    {
+        using namespace binding_detail;
+        type_handle return_type_id = type_registry::get_void_handle();
+        if constexpr (!std::is_void_v<R>)
+            return_type_id = get_type_handle(binding_traits<value_type<R>>::describe());
+        return get_type_handle(function_type{
+                return_type_id,
+                {function_type::param{get_type_handle(binding_traits<value_type<Args>>::describe()),
+                                      by_ref<Args>}...}});
+    }
+
+    template <typename R, typename... Args>
+    const identifier_info* compile_context::bind(std::string name, R (*fn)(Args...))
+    {
+        const auto entry = [](const host_function& self, value_slot* args) {
+            const auto target = reinterpret_cast<R (*)(Args...)>(self.target());
+            return binding_detail::invoke<R, Args...>(target, args,
+                                                      std::index_sequence_for<Args...>{});
+        };
+        return create_function(host_function(std::move(name),
+                                             get_function_type_handle<R, Args...>(), entry,
+                                             reinterpret_cast<const void*>(fn)));
+    }
+
+    template <auto Fn>
+    const identifier_info* compile_context::bind(std::string name)
+    {
+        return bind_direct<Fn>(std::move(name), Fn);
+    }
+
+    template <auto Fn, typename R, typename... Args>
+    const identifier_info* compile_context::bind_direct(std::string name, R (*)(Args...))
+    {
+        const auto entry = [](const host_function&, value_slot* args) {
+            return binding_detail::invoke<R, Args...>(Fn, args, std::index_sequence_for<Args...>{});
+        };
+        return create_function(
+                host_function(std::move(name), get_function_type_handle<R, Args...>(), entry));
+    }
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/type.hpp"
+#include "tone/core/value_slot.hpp"
+#include "tone/core/vm.hpp"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+
+    struct expression_param
+    {
+        std::string name;
+        type_handle type_id;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `compiled_expression` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // An expression compiled once over named parameters and evaluated many times with different
+    // arguments. The arguments are a flat array of slots, a parameter's being at the index
+    // `slot` gives it, which is its position in the declaration. Evaluating neither allocates
+    // nor looks anything up by name, so an argument array can be built once and have its slots
+    // overwritten between evaluations.
+    //
+    // The expression also sees the globals and host functions of the context it was compiled
+    // in. Compiled code refers to the host functions, so it must not outlive the context.
+    class compiled_expression
+    {
+    public:
+        // Parses and compiles `source` in a function scope of `context` with `params` declared
+        // in order, leaving the context at global scope afterwards as it must be before. Throws
+        // the errors of parsing and compiling, and `std::invalid_argument` for a parameter
+        // declared twice.
+        compiled_expression(compile_context& context, std::vector<expression_param> params,
+                            std::string_view source);
+        // As above, for `source` found at `line_number` and `char_index` of a larger text, so
+        // errors give positions in that text
+        compiled_expression(compile_context& context, std::vector<expression_param> params,
+                            std::string_view source, std::size_t line_number,
+                            std::size_t char_index);
+
+        [[nodiscard]] type_handle result_type() const;
+        [[nodiscard]] const std::vector<expression_param>& params() const;
+        // Throws `std::invalid_argument` when no parameter is called `name`
+        [[nodiscard]] std::size_t slot(std::string_view name) const;
+        [[nodiscard]] const bytecode& code() const;
+        // Moves the source positions errors give by `lines` and `chars`, for when text before
+        // the source was edited but the source itself wasn't
+        void shift_locations(std::ptrdiff_t lines, std::ptrdiff_t chars);
+
+        // `args` holds a slot per parameter, each holding its declared type. They are only read;
+        // strings and arrays in them stay owned by the caller. Throws `std::invalid_argument`
+        // when there are fewer slots than parameters.
+        runtime_value evaluate(vm& machine, std::span<const value_slot> args) const;
+
+    private:
+        std::vector<expression_param> _params;
+        bytecode _code;
+    };
+} // namespace tone::core
\ No newline at end of file
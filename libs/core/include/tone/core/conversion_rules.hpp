@@ -2,6 +2,23 @@
 
 #include "tone/core/type.hpp"
 
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
 namespace tone::core {
     bool is_convertable(type_handle type_from, bool lvalue_from, type_handle type_to, bool lvalue_to);
-}
\ No newline at end of file
+
+    // The int a real converts to: truncated toward zero and clamped to the int range, with NaN
+    // giving 0. Every backend converts this way so that no real is left to a C++ cast.
+    inline std::int64_t truncate_to_int(double value)
+    {
+        if (std::isnan(value))
+            return 0;
+        if (value >= 9223372036854775808.0)
+            return std::numeric_limits<std::int64_t>::max();
+        if (value < -9223372036854775808.0)
+            return std::numeric_limits<std::int64_t>::min();
+        return std::int64_t(value);
+    }
+}
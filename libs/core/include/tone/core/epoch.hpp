@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `epoch_guard` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Epoch-based reclamation of what threads may still be using after it's replaced, such as
+    // the compiled body of a function that's reloaded while calls to it run. Readers hold a
+    // guard while they use what they loaded; a writer swaps in the replacement, then retires
+    // the old object, which is freed once every guard that was alive when it was retired is
+    // gone. Guards nest, and only the outermost on a thread costs more than a counter.
+    //
+    // There's one set of epochs for the process, so objects retired anywhere wait for guards
+    // anywhere. Holding a guard while blocking on something that waits for a retired object to
+    // be freed deadlocks.
+    class epoch_guard
+    {
+    public:
+        epoch_guard();
+        epoch_guard(const epoch_guard&) = delete;
+        epoch_guard& operator=(const epoch_guard&) = delete;
+        ~epoch_guard();
+
+        // Drops `object` once no guard alive now is, which may be at once. It must already be
+        // unreachable for guards made from now on.
+        static void retire(std::shared_ptr<const void> object);
+        // Drops the retired objects no guard can still be using, giving how many are left
+        static std::size_t reclaim();
+    };
+} // namespace tone::core
\ No newline at end of file
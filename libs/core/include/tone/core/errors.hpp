@@ -31,6 +31,7 @@ namespace tone::core {
     error compiler_error(std::string_view message, size_t line_number, size_t char_index);
     error syntax_error(std::string_view message, size_t line_number, size_t char_index);
     error semantic_error(std::string_view message, size_t line_number, size_t char_index);
+    error runtime_error(std::string_view message, size_t line_number, size_t char_index);
 
     error undeclared_error(std::string_view undeclared, size_t line_number, size_t char_index);
     error wrong_type_error(std::string_view source, std::string_view destination, bool lvalue,
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "tone/core/compiled_expression.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+
+    struct expression_cache_options
+    {
+        // Most expressions kept at once, split evenly between the shards
+        std::size_t capacity = 4096;
+        // Lookups of keys in different shards never wait for each other
+        std::size_t shard_count = 16;
+    };
+
+    struct expression_cache_stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+        std::size_t size;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `expression_cache` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Thread-safe cache of `compiled_expression`s compiled in one context, keyed by the source
+    // text, the names and types of the parameters and the context's `generation`, which together
+    // decide what a source means there. Declaring a global or redefining a function drops the
+    // expressions compiled before, as they may call a function that's been replaced. Each shard
+    // evicts its least recently used expression when full.
+    //
+    // A hit takes only the lock of its shard and doesn't allocate. Misses compile one at a time,
+    // as the context isn't thread-safe; nothing else may use it while the cache does.
+    class expression_cache
+    {
+    public:
+        explicit expression_cache(compile_context& context,
+                                  const expression_cache_options& options = {});
+        expression_cache(const expression_cache&) = delete;
+        expression_cache& operator=(const expression_cache&) = delete;
+
+        // The expression for `source` over `params`, compiled on a miss, which throws as the
+        // `compiled_expression` constructor does. It stays valid once evicted while it's held.
+        std::shared_ptr<const compiled_expression> get(std::string_view source,
+                                                       std::span<const expression_param> params);
+
+        [[nodiscard]] expression_cache_stats stats() const;
+        void clear();
+
+    private:
+        struct key
+        {
+            std::string source;
+            std::vector<expression_param> params;
+            std::uint64_t generation;
+            std::size_t hash;
+        };
+        // A lookup's key, borrowed from the caller
+        struct key_view
+        {
+            std::string_view source;
+            std::span<const expression_param> params;
+            std::uint64_t generation;
+            std::size_t hash;
+        };
+        struct key_hash
+        {
+            using is_transparent = void;
+            std::size_t operator()(const key& k) const
+            {
+                return k.hash;
+            }
+            std::size_t operator()(const key_view& k) const
+            {
+                return k.hash;
+            }
+        };
+        struct key_equal
+        {
+            using is_transparent = void;
+            bool operator()(const key_view& l, const key_view& r) const;
+            bool operator()(const key& l, const key& r) const;
+            bool operator()(const key_view& l, const key& r) const;
+            bool operator()(const key& l, const key_view& r) const;
+        };
+        struct entry
+        {
+            std::shared_ptr<const compiled_expression> expression;
+            // Position in the shard's recency list
+            std::list<const key*>::iterator use;
+        };
+        struct shard
+        {
+            std::mutex mutex;
+            std::unordered_map<key, entry, key_hash, key_equal> entries;
+            // Most recently used first
+            std::list<const key*> uses;
+            std::atomic<std::uint64_t> hits = 0;
+            std::atomic<std::uint64_t> misses = 0;
+            std::atomic<std::uint64_t> evictions = 0;
+        };
+
+        static std::size_t hash_key(std::string_view source,
+                                    std::span<const expression_param> params,
+                                    std::uint64_t generation);
+
+        compile_context& _context;
+        std::mutex _compile_mutex;
+        // The context's generation when last looked up
+        std::atomic<std::uint64_t> _generation;
+        std::size_t _shard_capacity;
+        std::vector<std::unique_ptr<shard>> _shards;
+    };
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "tone/core/type.hpp"
+#include "tone/core/value_slot.hpp"
+
+#include <string>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `host_function` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // A function implemented by the host that scripts call like any other, see
+    // `compile_context::create_function` and `compile_context::bind`. The arguments are the
+    // caller's registers, typed by the parameters of the function type, and are borrowed. The
+    // argument of a by-reference parameter is stored back to the caller's variable or element
+    // after the call, so the entry point may update it in place; a str it replaces there must
+    // be released. The result slot owns any str or array it holds.
+    //
+    // Errors are reported by throwing. The VM turns any exception but a tone `error` into a
+    // runtime error at the call.
+    class host_function
+    {
+    public:
+        using entry_point = value_slot (*)(const host_function& self, value_slot* args);
+
+        // `type_id` must be a function type; `target` is for `entry` to use as it likes
+        host_function(std::string name, type_handle type_id, entry_point entry,
+                      const void* target = nullptr);
+
+        [[nodiscard]] const std::string& name() const;
+        [[nodiscard]] type_handle type_id() const;
+        [[nodiscard]] type_handle result_type() const;
+        [[nodiscard]] value_tag result_tag() const;
+        [[nodiscard]] entry_point entry() const;
+        [[nodiscard]] const void* target() const;
+
+        value_slot operator()(value_slot* args) const
+        {
+            return _entry(*this, args);
+        }
+
+    private:
+        std::string _name;
+        type_handle _type_id;
+        entry_point _entry;
+        const void* _target;
+        value_tag _result_tag;
+    };
+} // namespace tone::core
\ No newline at end of file
@@ -32,7 +32,12 @@ namespace tone::core {
                                                          bool is_constant) = 0;
         virtual ~identifier_lookup();
 
+        // Every identifier declared in this scope, in no particular order
+        [[nodiscard]] const std::unordered_map<std::string, identifier_info>& idents() const;
+
     protected:
+        // Gives `name` another type in place, keeping its index and constness
+        void retype_ident(const std::string& name, type_handle type_id);
         const identifier_info* insert_ident(std::string name, type_handle type_id,
                                             std::size_t index, bool is_global, bool is_constant);
 
@@ -47,6 +52,8 @@ namespace tone::core {
     public:
         const identifier_info* create_identifier(std::string name, type_handle type_id,
                                                  bool is_constant) override;
+        // Gives the global `name` another type, keeping its index and constness
+        void retype(const std::string& name, type_handle type_id);
     };
 
     class local_identifier_lookup : public identifier_lookup
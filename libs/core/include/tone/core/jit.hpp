@@ -0,0 +1,108 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+#include "tone/core/expression_tree.hpp"
+#include "tone/core/identifier.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/value_slot.hpp"
+#include "tone/core/vm.hpp"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tone::core {
+#if TONE_JIT
+    constexpr bool jit_available = true;
+#else
+    constexpr bool jit_available = false;
+#endif
+
+    // Identifiers referenced by a node tree, captured so it can be compiled after the
+    // compile context has moved on
+    using identifier_snapshot = std::unordered_map<std::string, identifier_info>;
+
+    identifier_snapshot capture_identifiers(const compile_context& context, const node& root);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `native_function` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class native_function
+    {
+    public:
+        native_function(const native_function&) = delete;
+        native_function& operator=(const native_function&) = delete;
+        native_function(native_function&& other) noexcept;
+        native_function& operator=(native_function&& other) noexcept;
+        ~native_function();
+
+        [[nodiscard]] type_handle result_type() const;
+        [[nodiscard]] std::size_t code_size() const;
+
+        // Whether `params` has the count and types the machine code was compiled for
+        [[nodiscard]] bool accepts(std::span<const runtime_value> params) const;
+
+        // `globals` must be bound for the compiled tree, see `vm::bind_globals`
+        runtime_value operator()(std::span<const runtime_value> params,
+                                 const value_slot* globals) const;
+
+    private:
+        using entry_point = std::uint64_t (*)(const runtime_value* params,
+                                              const value_slot* globals);
+
+        native_function(std::span<const std::uint8_t> machine_code, type_handle result_type,
+                        std::vector<std::size_t> param_indices);
+
+        friend std::optional<native_function> compile_native(const identifier_snapshot&,
+                                                             const node&);
+
+        void* _memory;
+        std::size_t _size;
+        std::size_t _code_size;
+        entry_point _entry;
+        type_handle _result_type;
+        std::vector<std::size_t> _param_indices;
+    };
+
+    // Compiles a side-effect free tree over `int`/`real`/`bool` params and globals to x86-64
+    // machine code. Returns nothing when the tree uses anything else or the JIT is unavailable.
+    std::optional<native_function> compile_native(const identifier_snapshot& identifiers,
+                                                  const node& root);
+    std::optional<native_function> compile_native(const compile_context& context,
+                                                  const node& root);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `tiered_expression` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    struct tiering_options
+    {
+        // The call on which the expression is compiled to native code
+        std::size_t threshold = 1000;
+        bool enabled = jit_available;
+    };
+
+    class tiered_expression
+    {
+    public:
+        tiered_expression(const compile_context& context, node_ptr root,
+                          const tiering_options& options = {});
+
+        runtime_value run(vm& machine, std::span<const runtime_value> params = {});
+
+        [[nodiscard]] const bytecode& code() const;
+        [[nodiscard]] bool is_native() const;
+        [[nodiscard]] std::size_t call_count() const;
+
+    private:
+        node_ptr _root;
+        identifier_snapshot _identifiers;
+        bytecode _code;
+        std::optional<native_function> _native;
+        tiering_options _options;
+        std::size_t _calls;
+    };
+} // namespace tone::core
\ No newline at end of file
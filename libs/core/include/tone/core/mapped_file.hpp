@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `mapped_file` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // The bytes of a file, mapped read-only and shared where mapping is available and read into
+    // memory otherwise. Mapped pages come from the page cache, so every process mapping the same
+    // file holds one copy of it between them. The bytes are 8-byte aligned and stay where they
+    // are when the file is moved.
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        // Throws `std::runtime_error` when the file can't be opened or mapped
+        explicit mapped_file(const std::string& path);
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        mapped_file(mapped_file&& other) noexcept;
+        mapped_file& operator=(mapped_file&& other) noexcept;
+        ~mapped_file();
+
+        [[nodiscard]] std::span<const std::byte> bytes() const;
+
+    private:
+        void unmap();
+
+        std::span<const std::byte> _bytes;
+        void* _mapping = nullptr;
+        std::vector<std::uint64_t> _buffer;
+    };
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "tone/core/script_module.hpp"
+#include "tone/core/thread_pool.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+
+    // The source of the module `name`, throwing when there's none
+    using module_reader = std::function<std::string(const std::string& name)>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `module_cache` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Modules loaded by name into one context, each once however many scripts import it. Meant
+    // to be kept for the life of the process, so every script compiled in the context shares
+    // the modules and their compiled bodies.
+    //
+    // Loading a module reads it and everything it imports that isn't loaded yet, then loads
+    // them in waves: each wave holds the modules whose imports are all in earlier ones. The
+    // modules of a wave are declared one after another and, with `compile_mode::strict`, their
+    // bodies then compiled together on the pool, before the next wave is declared.
+    //
+    // Reloading a module after its source was edited keeps what compiled code still fits, in it
+    // and in the modules calling it; see `script_module::reload`.
+    //
+    // Loading and reloading are thread-safe, though nothing else may declare globals in the
+    // context meanwhile.
+    class module_cache
+    {
+    public:
+        module_cache(compile_context& context, module_reader reader,
+                     compile_mode mode = compile_mode::lazy);
+        module_cache(const module_cache&) = delete;
+        module_cache& operator=(const module_cache&) = delete;
+
+        // The module `name`, loaded with what it imports if it isn't yet. Throws
+        // `std::invalid_argument` for modules importing each other, what the reader throws, and
+        // the errors of loading a module with its name added. Modules loaded before an error
+        // stay loaded, including any whose bodies failed to compile.
+        script_module& load(const std::string& name, thread_pool& pool);
+        // As above, for many modules at once
+        std::vector<script_module*> load(std::span<const std::string> names, thread_pool& pool);
+        // Reads the loaded module `name` again and reloads it, loading imports it gained, then
+        // drops the bodies of other modules calling a function it changed. `recompiled` lists
+        // the bodies dropped in every module. Throws as `load` does and `std::invalid_argument`
+        // when `name` isn't loaded. Calls into the modules may go on meanwhile, as they may
+        // for `script_module::reload`.
+        reload_result reload(const std::string& name, thread_pool& pool);
+        // Null unless `name` is loaded
+        [[nodiscard]] script_module* find(const std::string& name) const;
+
+    private:
+        using named_module = std::pair<const std::string*, script_module*>;
+
+        struct pending
+        {
+            std::string source;
+            std::vector<std::string> imports;
+            // Waves are numbered from 1
+            std::size_t wave = 0;
+        };
+
+        // Reads `name` and what it imports into `found`, unless they're loaded already, giving
+        // the wave of `name` or 0 when it's loaded. `path` holds the imports leading to it.
+        std::size_t discover(const std::string& name, std::map<std::string, pending>& found,
+                             std::vector<std::string>& path);
+        // Whether `from` imports `to`, directly or not, among the modules loaded and `found`,
+        // adding the imports leading there to `path`
+        bool leads_to(const std::string& from, const std::string& to,
+                      const std::map<std::string, pending>& found,
+                      std::vector<std::string>& path) const;
+        // Declares the modules `found` wave by wave, compiling each wave in strict mode
+        void load_waves(std::map<std::string, pending>& found, std::size_t waves,
+                        thread_pool& pool);
+        void compile(std::span<const named_module> modules, thread_pool& pool);
+        std::unique_ptr<script_module> declare(const std::string& name, pending& module);
+
+        compile_context& _context;
+        module_reader _reader;
+        compile_mode _mode;
+        mutable std::mutex _mutex;
+        std::map<std::string, std::unique_ptr<script_module>, std::less<>> _modules;
+    };
+} // namespace tone::core
\ No newline at end of file
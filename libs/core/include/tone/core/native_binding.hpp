@@ -0,0 +1,194 @@
+#pragma once
+
+#include "tone/core/array.hpp"
+#include "tone/core/host_function.hpp"
+#include "tone/core/str.hpp"
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `binding_traits` struct
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // How a C++ parameter or result type of a function given to `compile_context::bind` maps to
+    // a script type and a value slot. `load` reads an argument, `store` writes a result to an
+    // empty slot and `update` replaces what a slot holds. `std::int64_t`, `double`, `bool` and
+    // `str` map to `int`, `real`, `bool` and `str`; spans of `std::int64_t` and `double` see
+    // the elements of an `int` or `real` array in place and can only be parameters taken by
+    // value.
+    template <typename T>
+    struct binding_traits
+    {
+        static_assert(sizeof(T) == 0, "Type can't be passed between scripts and the host");
+    };
+
+    template <>
+    struct binding_traits<std::int64_t>
+    {
+        static type describe()
+        {
+            return *type_registry::get_int_handle();
+        }
+        static std::int64_t load(const value_slot& slot)
+        {
+            return slot.as_int();
+        }
+        static void store(value_slot& slot, std::int64_t value)
+        {
+            slot.set_int(value);
+        }
+        static void update(value_slot& slot, std::int64_t value)
+        {
+            slot.set_int(value);
+        }
+    };
+
+    template <>
+    struct binding_traits<double>
+    {
+        static type describe()
+        {
+            return *type_registry::get_real_handle();
+        }
+        static double load(const value_slot& slot)
+        {
+            return slot.as_real();
+        }
+        static void store(value_slot& slot, double value)
+        {
+            slot.set_real(value);
+        }
+        static void update(value_slot& slot, double value)
+        {
+            slot.set_real(value);
+        }
+    };
+
+    template <>
+    struct binding_traits<bool>
+    {
+        static type describe()
+        {
+            return *type_registry::get_bool_handle();
+        }
+        static bool load(const value_slot& slot)
+        {
+            return slot.as_bool();
+        }
+        static void store(value_slot& slot, bool value)
+        {
+            slot.set_bool(value);
+        }
+        static void update(value_slot& slot, bool value)
+        {
+            slot.set_bool(value);
+        }
+    };
+
+    template <>
+    struct binding_traits<str>
+    {
+        static type describe()
+        {
+            return *type_registry::get_str_handle();
+        }
+        static str load(const value_slot& slot)
+        {
+            return str::share(slot.as_str());
+        }
+        static void store(value_slot& slot, str value)
+        {
+            slot.set_str(value.release());
+        }
+        static void update(value_slot& slot, str value)
+        {
+            str::adopt(slot.owned_str());
+            slot.set_str(value.release());
+        }
+    };
+
+    template <typename T>
+        requires std::is_same_v<std::remove_const_t<T>, std::int64_t> ||
+                 std::is_same_v<std::remove_const_t<T>, double>
+    struct binding_traits<std::span<T>>
+    {
+        static type describe()
+        {
+            if constexpr (std::is_same_v<std::remove_const_t<T>, std::int64_t>)
+                return array_type{type_registry::get_int_handle()};
+            else
+                return array_type{type_registry::get_real_handle()};
+        }
+        // The argument register keeps the array alive for the call
+        static std::span<T> load(const value_slot& slot)
+        {
+            auto arr = array::share(slot.as_array());
+            if (!std::is_const_v<T> && arr.is_read_only())
+                throw std::invalid_argument("Array is read-only");
+            if constexpr (std::is_same_v<std::remove_const_t<T>, std::int64_t>)
+                return arr.ints();
+            else
+                return arr.reals();
+        }
+    };
+
+    namespace binding_detail {
+        template <typename A>
+        using value_type = std::remove_cvref_t<A>;
+
+        // Non-const lvalue references are by-reference parameters
+        template <typename A>
+        constexpr bool by_ref = std::is_lvalue_reference_v<A> &&
+                                !std::is_const_v<std::remove_reference_t<A>>;
+
+        template <typename A>
+        constexpr bool is_span = false;
+        template <typename T>
+        constexpr bool is_span<std::span<T>> = true;
+
+        template <typename A>
+        decltype(auto) pass(value_type<A>& value)
+        {
+            if constexpr (by_ref<A>)
+                return (value);
+            else
+                return std::move(value);
+        }
+
+        template <typename A>
+        void write_back(value_slot& slot, value_type<A>& value)
+        {
+            // A span already writes to the array's elements, and has nothing to store back
+            static_assert(!by_ref<A> || !is_span<value_type<A>>,
+                          "Span parameters must be passed by value, not by reference");
+            if constexpr (by_ref<A> && !is_span<value_type<A>>)
+                binding_traits<value_type<A>>::update(slot, std::move(value));
+        }
+
+        // Unpacks the argument slots straight into a call of `fn`
+        template <typename R, typename... Args, typename F, std::size_t... I>
+        value_slot invoke(F fn, value_slot* args, std::index_sequence<I...>)
+        {
+            std::tuple<value_type<Args>...> values{
+                    binding_traits<value_type<Args>>::load(args[I])...};
+
+            value_slot result{};
+            if constexpr (std::is_void_v<R>)
+                fn(pass<Args>(std::get<I>(values))...);
+            else
+            {
+                binding_traits<value_type<R>>::store(result,
+                                                     fn(pass<Args>(std::get<I>(values))...));
+            }
+
+            (write_back<Args>(args[I], std::get<I>(values)), ...);
+            return result;
+        }
+    } // namespace binding_detail
+} // namespace tone::core
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+
+namespace tone::core {
+    struct fusion_options
+    {
+        // `load_const` feeding arithmetic or a comparison, e.g. `a + 1`, `i < n`
+        bool constant_operands = true;
+        // A comparison feeding `jump_if_false`/`jump_if_true`, as emitted for `&&` and `||`
+        bool compare_and_branch = true;
+    };
+
+    void fuse_superinstructions(bytecode& code, const fusion_options& options = {});
+} // namespace tone::core
\ No newline at end of file
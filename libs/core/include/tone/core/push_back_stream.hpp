@@ -9,6 +9,9 @@ namespace tone::core {
     {
     public:
         explicit push_back_stream(const character_source_t& input = null_character_source);
+        // Counts from a position other than the start, for input taken from the middle of a text
+        push_back_stream(const character_source_t& input, std::size_t line_number,
+                         std::size_t char_index);
 
         character_t operator()();
 
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "tone/core/array.hpp"
+#include "tone/core/str.hpp"
+#include "tone/core/type.hpp"
+
+#include <cstdint>
+#include <variant>
+
+namespace tone::core {
+    using runtime_value = std::variant<std::int64_t, double, bool, str, array>;
+
+    runtime_value default_value(type_handle type_id);
+
+    std::string dump_runtime_value(const runtime_value& value);
+} // namespace tone::core
\ No newline at end of file
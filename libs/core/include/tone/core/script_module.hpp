@@ -0,0 +1,218 @@
+#pragma once
+
+#include "tone/core/compiled_expression.hpp"
+#include "tone/core/identifier.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/thread_pool.hpp"
+#include "tone/core/type.hpp"
+#include "tone/core/vm.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    class compile_context;
+
+    enum class compile_mode
+    {
+        // Bodies are compiled the first time their function is called
+        lazy,
+        // Bodies are compiled with the module, so any error in one is found up front. To do so
+        // in parallel, load lazily and call `script_module::compile_all`.
+        strict,
+    };
+
+    // A global a compiled body refers to, and the type it had then
+    struct global_dependency
+    {
+        std::string name;
+        type_handle type_id;
+    };
+
+    // What reloading a module changed
+    struct reload_result
+    {
+        // Functions whose compiled bodies were dropped to compile again, because they were
+        // edited or refer to a global whose type changed
+        std::vector<std::string> recompiled;
+        // Functions added, removed or given another signature. Code compiled elsewhere that
+        // calls them must be compiled again.
+        std::vector<std::string> changed_signatures;
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `script_module` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Functions defined in script, each written as
+    //
+    //     fn int add(int a, int b) { a + b }
+    //
+    // with a result type, typed parameters and an expression for a body; types are `void`,
+    // `int`, `real`, `bool` and `str` followed by any number of `[]`. Every function is declared
+    // in the context as a constant global that expressions and other bodies call like a host
+    // function, running on the VM that calls it.
+    //
+    // Definitions may be preceded by imports of other modules, each written as `import name;`.
+    // Bodies see the host's globals and functions, those of their own module and those of the
+    // modules it's given as imports, but not other modules'. See `module_cache` for loading
+    // modules by name. All modules share the globals of the context, so their functions' names
+    // must differ.
+    //
+    // Loading a module only finds where each body ends, so a large module whose functions are
+    // mostly never called costs little more than reading it. A body is parsed, checked and
+    // compiled when its function is first called, unless the module is compiled strictly, and
+    // its errors give positions in the module source. A body that fails to compile throws the
+    // same error on every call until the module is reloaded or its stale bodies invalidated.
+    //
+    // Compiling a body records the globals it refers to. Reloading the module after an edit
+    // only compiles again the functions whose definitions changed and those referring to a
+    // function whose signature changed, so editing one function of a large module is cheap.
+    //
+    // Reloading is meant for a host that keeps running: calls may go on during a reload, and
+    // any call that started before it finishes on the code it started with, while calls
+    // made after a function is swapped run its new version. Code replaced is freed through
+    // `epoch_guard` once no call can still be running it. Globals keep their indices, so a VM
+    // keeps the value of every global whose type is unchanged.
+    //
+    // Each body compiles in its own fork of the context, so bodies compile in parallel and
+    // calling is thread-safe. Code compiled by the host in the context must hold the
+    // declaration mutex shared while compiling if modules may be loaded or reloaded meanwhile.
+    // The functions declared refer to the module, so it must outlive any use of them.
+    class script_module
+    {
+    public:
+        // Throws the errors of parsing definitions and a semantic error for a name already
+        // declared, before declaring any function. `compile_mode::strict` throws those of
+        // compiling bodies too, after which the functions stay declared but mustn't be used.
+        script_module(compile_context& context, std::string source,
+                      compile_mode mode = compile_mode::lazy,
+                      std::vector<const script_module*> imports = {});
+        script_module(const script_module&) = delete;
+        script_module& operator=(const script_module&) = delete;
+        ~script_module();
+
+        // The names imported by `source`, in order, without loading anything. Throws the errors
+        // of parsing the imports.
+        static std::vector<std::string> read_imports(std::string_view source);
+
+        // The names the source imports, in order
+        [[nodiscard]] const std::vector<std::string>& imports() const;
+        // Every function defined, in definition order
+        [[nodiscard]] std::vector<std::string_view> names() const;
+        [[nodiscard]] bool is_compiled(std::string_view name) const;
+        // The body of `name`, compiled now if it wasn't yet, which a reload may free unless an
+        // `epoch_guard` is held. Throws `std::invalid_argument` when no function is called
+        // `name` and the errors of compiling the body.
+        const compiled_expression& compile(std::string_view name);
+        // Compiles every body not compiled yet, spread over the workers of `pool`. Throws the
+        // error of the first body in definition order that fails, once all have been tried.
+        void compile_all(thread_pool& pool);
+
+        // The globals the body of `name` referred to when it was compiled, none when it isn't
+        [[nodiscard]] std::vector<global_dependency> dependencies(std::string_view name) const;
+        // Those of every compiled body, each global once
+        [[nodiscard]] std::vector<global_dependency> dependencies() const;
+
+        // Replaces the source of the module, as the constructor reads it, keeping the compiled
+        // bodies of the functions whose definitions and dependencies are unchanged. Functions
+        // added are declared, and the ones given another signature redeclared; ones removed
+        // stay declared but hidden from bodies. Code still calling a function removed or
+        // redeclared runs its last definition, compiled then if it wasn't yet, and the
+        // declarations replaced are kept for it until `retire_replaced`. Throws as the
+        // constructor does before changing anything, though `compile_mode::strict` compiles
+        // what needs it last. Waits for bodies compiling, but not for calls running.
+        reload_result reload(std::string source, std::vector<const script_module*> imports = {});
+        // Drops the compiled bodies referring to a global whose type changed or that they no
+        // longer see, such as a function another module reloaded, and gives their names. Bodies
+        // that failed to compile are tried again when next called.
+        std::vector<std::string> invalidate_stale();
+        // Frees the declarations reloads replaced once no call can still be running them. Every
+        // module importing this one must have had `invalidate_stale` called since the reload,
+        // and code the host compiled calling them must have been compiled again, as those may
+        // call them otherwise; `module_cache::reload` does this itself.
+        void retire_replaced();
+
+        // Runs `name` with `args` on `machine`, compiling it first if needed. A `void` function
+        // gives whatever its body evaluates to. Throws as `compile` does,
+        // `std::invalid_argument` for the wrong number of arguments, and as `vm::run` does.
+        runtime_value call(vm& machine, std::string_view name,
+                           std::span<const runtime_value> args = {});
+
+    private:
+        struct function
+        {
+            script_module* owner;
+            std::string name;
+            type_handle result_type;
+            std::vector<expression_param> params;
+            // Changed only under the mutex once declared. The body is between the braces in
+            // `source`, starting at the position given.
+            std::shared_ptr<const std::string> source;
+            std::string_view body;
+            std::size_t line_number;
+            std::size_t char_index;
+            // Where the definition starts, for errors about it
+            std::size_t def_line;
+            std::size_t def_char;
+            // Reloaded away; still declared or kept with the replaced ones, as code may call it
+            std::atomic<bool> removed = false;
+            // Set under the mutex when the body is compiled, and only swapped by reloading
+            std::mutex mutex;
+            std::unique_ptr<compiled_expression> compiled;
+            std::atomic<const compiled_expression*> ready = nullptr;
+            std::vector<global_dependency> dependencies;
+            // Set instead when the body fails to compile, so calls throw again without waiting
+            // for the module; dropped with stale bodies, as it may compile then
+            std::unique_ptr<const std::exception_ptr> failure;
+            std::atomic<const std::exception_ptr*> failed = nullptr;
+        };
+
+        struct parsed
+        {
+            std::vector<std::string> imports;
+            std::vector<std::unique_ptr<function>> functions;
+        };
+
+        static value_slot call_entry(const host_function& self, value_slot* args);
+
+        // Reads the imports and definitions of `source`, throwing for a name `taken` accepts
+        parsed parse(std::shared_ptr<const std::string> source,
+                     const std::function<bool(const std::string&)>& taken);
+        type_handle function_type_id(const function& fn);
+
+        // These need `_mutex` held, shared at least
+        function& find(std::string_view name) const;
+        const compiled_expression& compile(function& fn);
+        // Needs the declaration mutex held too
+        std::vector<std::string> drop_stale();
+        // These need the mutex of `fn` held
+        static void retire_compiled(function& fn);
+        static void retire_failure(function& fn);
+        // Whether bodies of this module may refer to `info`
+        bool sees(const identifier_info& info) const;
+        // Whether `info` is one of the functions of this module
+        bool owns(const identifier_info& info) const;
+
+        compile_context& _context;
+        // Held exclusively while reloading, and shared to read what reloading changes
+        mutable std::shared_mutex _mutex;
+        std::vector<std::string> _import_names;
+        std::vector<const script_module*> _imports;
+        // Definitions stay put, as the functions declared point at them; removed ones last
+        std::vector<std::unique_ptr<function>> _functions;
+        // Declarations and definitions replaced by giving a function another signature, which
+        // bodies compiled before may still call
+        std::vector<std::shared_ptr<const void>> _replaced;
+        compile_mode _mode;
+    };
+} // namespace tone::core
\ No newline at end of file
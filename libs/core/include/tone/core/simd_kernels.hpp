@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tone::core {
+#if TONE_SIMD
+    constexpr bool simd_available = true;
+#else
+    constexpr bool simd_available = false;
+#endif
+
+    enum class simd_level
+    {
+        scalar,
+        sse,
+        avx2,
+        avx512,
+    };
+
+    // The best level the CPU and OS support, `scalar` when built without TONE_SIMD
+    [[nodiscard]] simd_level supported_simd_level();
+    [[nodiscard]] simd_level active_simd_level();
+    // Picks the kernels `get_simd_kernels` returns from now on, capped at the supported level.
+    // Meant for tests and benchmarks; not synchronized with threads using the kernels.
+    void set_simd_level(simd_level level);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `simd_kernels` struct
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Bulk operations over `n` unboxed elements, implemented once for each `simd_level`.
+    // Integer arithmetic wraps around like the VM's. Masks hold one bit per element, 64 to a word
+    // as in `bool` arrays; comparisons write whole words, clearing the bits past `n`.
+    //
+    // Reductions over reals add up lanes separately, so their results can differ in the last
+    // bits from a loop's and between levels.
+    struct simd_kernels
+    {
+        template <typename T>
+        using binary = void (*)(const T* l, const T* r, T* out, std::size_t n);
+        template <typename T>
+        using compare = void (*)(const T* l, const T* r, std::uint64_t* mask, std::size_t n);
+        template <typename T>
+        using reduce = T (*)(const T* in, std::size_t n);
+        template <typename T>
+        using dot_product = T (*)(const T* l, const T* r, std::size_t n);
+
+        binary<std::int64_t> add_int;
+        binary<std::int64_t> sub_int;
+        binary<std::int64_t> mul_int;
+        binary<double> add_real;
+        binary<double> sub_real;
+        binary<double> mul_real;
+        binary<double> div_real;
+
+        // `greater` and `greater_equal` are `less` and `less_equal` with the operands swapped
+        compare<std::int64_t> equal_int;
+        compare<std::int64_t> not_equal_int;
+        compare<std::int64_t> less_int;
+        compare<std::int64_t> less_equal_int;
+        compare<double> equal_real;
+        compare<double> not_equal_real;
+        compare<double> less_real;
+        compare<double> less_equal_real;
+
+        // `min` and `max` need `n > 0`
+        reduce<std::int64_t> sum_int;
+        reduce<std::int64_t> min_int;
+        reduce<std::int64_t> max_int;
+        reduce<double> sum_real;
+        reduce<double> min_real;
+        reduce<double> max_real;
+        dot_product<std::int64_t> dot_int;
+        dot_product<double> dot_real;
+
+        // Copies the 8-byte elements whose mask bit is set to `out`, returning how many
+        std::size_t (*filter)(const std::uint64_t* in, const std::uint64_t* mask, std::size_t n,
+                              std::uint64_t* out);
+    };
+
+    // The kernels for the active level
+    [[nodiscard]] const simd_kernels& get_simd_kernels();
+
+    // Prefix sums depend on the previous element, so they stay scalar at every level
+    void prefix_sum_int(const std::int64_t* in, std::int64_t* out, std::size_t n);
+    void prefix_sum_real(const double* in, double* out, std::size_t n);
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <compare>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `str` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Immutable string value that fits in one pointer. Strings of up to `max_inline` Latin-1
+    // characters are stored in the handle itself and never allocate; longer ones share an
+    // atomically reference-counted buffer that caches its hash. Slices share their source's
+    // characters instead of copying them. A zero handle is the empty string. A borrowed string
+    // sees characters owned by the host instead, see `view_scope`; slicing one copies.
+    //
+    // The only mutation is `append`, which is invisible to other owners: it writes in place only
+    // when nothing else refers to the buffer.
+    class str
+    {
+    public:
+        static constexpr std::size_t max_inline = sizeof(void*) - 1;
+
+        // Inline strings are decoded into one of these to be viewed
+        using inline_buffer = std::array<char16_t, max_inline>;
+
+        str() = default;
+        explicit str(std::u16string_view text);
+        str(const str& other);
+        str(str&& other) noexcept;
+        str& operator=(const str& other);
+        str& operator=(str&& other) noexcept;
+        ~str();
+
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] bool empty() const;
+        [[nodiscard]] bool is_inline() const;
+        [[nodiscard]] bool is_borrowed() const;
+        // Whether nothing else refers to the buffer; inline strings have none
+        [[nodiscard]] bool is_unique() const;
+        [[nodiscard]] char16_t operator[](std::size_t index) const;
+        [[nodiscard]] std::size_t hash() const;
+
+        // The characters stay valid while both this `str` and `scratch` live
+        [[nodiscard]] std::u16string_view view(inline_buffer& scratch) const;
+        [[nodiscard]] std::u16string to_u16string() const;
+
+        // Shares the characters of long strings; short results are stored inline
+        [[nodiscard]] str substr(std::size_t pos,
+                                 std::size_t count = std::u16string_view::npos) const;
+
+        bool operator==(const str& other) const;
+        std::strong_ordering operator<=>(const str& other) const;
+
+        // Appends in place when this is the only owner of a buffer with room left, otherwise
+        // moves to a new buffer with room to grow, so repeated appends take amortized linear time
+        void append(std::u16string_view text);
+
+        static str concat(std::u16string_view l, std::u16string_view r);
+
+        // A string over `text`, which must stay valid and unchanged until `own` is called on it
+        // or on a string sharing it. Text that fits inline is copied there instead.
+        static str borrow(std::u16string_view text);
+        // Copies borrowed characters into a buffer of the string's own, which every string
+        // sharing them then sees too; does nothing for other strings
+        void own();
+
+        // Handle interop for untagged storage such as `value_slot`. `release` gives up ownership
+        // of the handle and `adopt` takes it back; `share` adds an owner to a handle still held
+        // elsewhere and `view` reads one without owning it.
+        [[nodiscard]] void* handle() const;
+        [[nodiscard]] void* release();
+        static str adopt(void* handle);
+        static str share(const void* handle);
+        static std::u16string_view view(const void* handle, inline_buffer& scratch);
+        static std::size_t size(const void* handle);
+        // Consumes `handle` unless it throws; `text` may point into the string itself
+        [[nodiscard]] static void* append(void* handle, std::u16string_view text);
+
+        class builder;
+
+    private:
+        struct buffer
+        {
+            std::atomic<std::uint32_t> refs;
+            std::uint32_t size;
+            std::uint32_t capacity;
+            // Zero until first computed
+            std::atomic<std::size_t> hash;
+            const char16_t* data;
+            // The buffer owning `data` when this one is a slice
+            buffer* source;
+
+            [[nodiscard]] char16_t* own_data();
+            // Neither in the buffer itself nor in a source, see `borrow`
+            [[nodiscard]] bool is_borrowed() const;
+        };
+
+        static buffer* allocate(std::size_t size, std::size_t capacity = 0);
+        static void add_ref(buffer* buf);
+        static void release_ref(buffer* buf);
+
+        [[nodiscard]] buffer* heap() const;
+
+        std::uintptr_t _handle = 0;
+    };
+
+    // Builds a string whose final size is known up front with at most one allocation
+    class str::builder
+    {
+    public:
+        explicit builder(std::size_t size);
+        builder(const builder&) = delete;
+        builder& operator=(const builder&) = delete;
+        ~builder();
+
+        void append(std::u16string_view text);
+        void append(const void* handle);
+        [[nodiscard]] str finish();
+
+    private:
+        buffer* _buffer = nullptr;
+        inline_buffer _chars{};
+        std::size_t _size = 0;
+    };
+} // namespace tone::core
+
+template <>
+struct std::hash<tone::core::str>
+{
+    std::size_t operator()(const tone::core::str& s) const
+    {
+        return s.hash();
+    }
+};
\ No newline at end of file
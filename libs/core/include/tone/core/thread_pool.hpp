@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `thread_pool` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Worker threads running batches of independent tasks. Each worker has a queue it takes its
+    // own tasks from the back of, and when that runs dry it steals from the front of the
+    // others', so uneven tasks still keep every worker busy. The thread running a batch works on
+    // tasks too until the batch is done, so tasks may run batches of their own.
+    class thread_pool
+    {
+    public:
+        using task = std::function<void()>;
+
+        // One worker fewer than the hardware has threads, as whoever runs a batch helps
+        static std::size_t default_thread_count();
+
+        // With no workers, batches run on the thread running them
+        explicit thread_pool(std::size_t thread_count = default_thread_count());
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        // Mustn't be destroyed while a batch runs
+        ~thread_pool();
+
+        [[nodiscard]] std::size_t thread_count() const;
+
+        // Runs every task, in any order and on any thread, and returns once all have. When some
+        // throw, the others still run, then the exception of the first in `tasks` is rethrown.
+        void run(std::span<const task> tasks);
+
+    private:
+        struct batch
+        {
+            std::mutex mutex;
+            std::condition_variable done;
+            std::size_t remaining;
+            std::vector<std::exception_ptr> errors;
+        };
+
+        struct job
+        {
+            const task* fn;
+            batch* owner;
+            std::size_t index;
+        };
+
+        struct queue
+        {
+            std::mutex mutex;
+            std::deque<job> jobs;
+        };
+
+        void work(std::size_t index);
+        // Takes from the back of the queue of worker `first` when it's `own` and the front
+        // otherwise, then steals from the front of the others'
+        bool take(std::size_t first, bool own, job& out);
+        static void execute(const job& j);
+
+        std::vector<std::unique_ptr<queue>> _queues;
+        std::vector<std::thread> _threads;
+        std::mutex _wake_mutex;
+        std::condition_variable _wake;
+        std::atomic<std::size_t> _queued = 0;
+        bool _stopping = false;
+    };
+} // namespace tone::core
\ No newline at end of file
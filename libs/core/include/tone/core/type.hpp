@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <variant>
 #include <vector>
 #include <set>
@@ -39,6 +40,7 @@ namespace tone::core {
     };
 
 
+    // Interns types, so equal types have equal handles. Getting handles is thread-safe.
     class type_registry
     {
     public:
@@ -56,6 +58,7 @@ namespace tone::core {
         {
             bool operator()(const type& lhs, const type& rhs) const;
         };
+        std::mutex _mutex;
         std::set<type, type_less> _types;
 
         static type _void_type;
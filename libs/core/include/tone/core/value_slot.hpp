@@ -0,0 +1,153 @@
+#pragma once
+
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/type.hpp"
+
+#include <cstdint>
+
+namespace tone::core {
+    enum class value_tag : std::uint8_t
+    {
+        none,
+        int_value,
+        real_value,
+        bool_value,
+        str_value,
+        array_value,
+    };
+
+    value_tag tag_of(type_handle type_id);
+
+    [[noreturn]] void throw_tag_mismatch(value_tag expected, value_tag actual);
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `value_slot` struct
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // One untagged 8-byte VM value. The register, global or constant holding it has a static
+    // type that says which member is live, so nothing is checked at run time. A zeroed slot is
+    // the default value of every type, including the empty `str`, except for arrays: the VM
+    // gives array slots an empty array of their type before running.
+    //
+    // Building with TONE_TAGGED_VALUES adds a tag to every slot and checks it on each access.
+    struct value_slot
+    {
+        union
+        {
+            std::int64_t i;
+            double r;
+            bool b;
+            void* p;
+        };
+#if TONE_TAGGED_VALUES
+        value_tag tag = value_tag::none;
+#endif
+
+        [[nodiscard]] std::int64_t as_int() const
+        {
+            check(value_tag::int_value);
+            return i;
+        }
+        [[nodiscard]] double as_real() const
+        {
+            check(value_tag::real_value);
+            return r;
+        }
+        [[nodiscard]] bool as_bool() const
+        {
+            check(value_tag::bool_value);
+            return b;
+        }
+        // A `str` handle, see `str::view` and `str::share`
+        [[nodiscard]] const void* as_str() const
+        {
+            check(value_tag::str_value);
+            return p;
+        }
+        // An `array` handle, see `array::share` and the element accessors of `array`
+        [[nodiscard]] const void* as_array() const
+        {
+            check(value_tag::array_value);
+            return p;
+        }
+
+        void set_int(std::int64_t value)
+        {
+            i = value;
+            mark(value_tag::int_value);
+        }
+        void set_real(double value)
+        {
+            r = value;
+            mark(value_tag::real_value);
+        }
+        void set_bool(bool value)
+        {
+            // Clear the upper bytes so a slot compares equal by bits to any other `bool` slot
+            i = 0;
+            b = value;
+            mark(value_tag::bool_value);
+        }
+        // The slot owns `handle` afterwards; whatever str it held before is not released
+        void set_str(void* handle)
+        {
+            p = handle;
+            mark(value_tag::str_value);
+        }
+        // As `set_str`, for an `array` handle
+        void set_array(void* handle)
+        {
+            p = handle;
+            mark(value_tag::array_value);
+        }
+
+        // The str handle this slot owns, null when it was never written. Unlike `as_str`, a
+        // slot that was never written is accepted in tagged builds.
+        [[nodiscard]] void* owned_str() const
+        {
+#if TONE_TAGGED_VALUES
+            if (tag != value_tag::none && tag != value_tag::str_value)
+                throw_tag_mismatch(value_tag::str_value, tag);
+#endif
+            return p;
+        }
+        // As `owned_str`, for an `array` handle
+        [[nodiscard]] void* owned_array() const
+        {
+#if TONE_TAGGED_VALUES
+            if (tag != value_tag::none && tag != value_tag::array_value)
+                throw_tag_mismatch(value_tag::array_value, tag);
+#endif
+            return p;
+        }
+
+        // Tags a zeroed slot with its type's default value
+        void mark_default(type_handle type_id)
+        {
+            mark(tag_of(type_id));
+        }
+
+    private:
+        void check([[maybe_unused]] value_tag expected) const
+        {
+#if TONE_TAGGED_VALUES
+            if (tag != expected)
+                throw_tag_mismatch(expected, tag);
+#endif
+        }
+        void mark([[maybe_unused]] value_tag value)
+        {
+#if TONE_TAGGED_VALUES
+            tag = value;
+#endif
+        }
+    };
+
+    // Strings and arrays are shared, not copied; one stored by `make_slot` is owned by the
+    // returned slot
+    value_slot make_slot(const runtime_value& value);
+    runtime_value slot_value(const value_slot& slot, type_handle type_id);
+
+    // Type of the alternative `value` holds
+    type_handle runtime_type(const runtime_value& value);
+} // namespace tone::core
\ No newline at end of file
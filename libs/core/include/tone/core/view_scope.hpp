@@ -0,0 +1,52 @@
+#pragma once
+
+#include "tone/core/array.hpp"
+#include "tone/core/str.hpp"
+#include "tone/core/type.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace tone::core {
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `view_scope` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Lends host memory to scripts without copying it: `int` and `real` arrays over the host's
+    // elements and `str` values over its characters, to give to `vm::set_global` or as run
+    // parameters. The memory has to outlive the scope.
+    //
+    // Ending the scope copies the elements and characters of the values that a script, global
+    // or the host still holds into storage of their own, so those stay valid afterwards, and
+    // lets go of the rest without copying. It must not end while a script using them runs.
+    class view_scope
+    {
+    public:
+        view_scope() = default;
+        view_scope(const view_scope&) = delete;
+        view_scope& operator=(const view_scope&) = delete;
+        ~view_scope();
+
+        // Arrays of the array type `type_id` over `elements`; throws `std::invalid_argument` when
+        // it has another element type. Scripts can't store to the elements of these.
+        [[nodiscard]] array view(type_handle type_id, std::span<const std::int64_t> elements);
+        [[nodiscard]] array view(type_handle type_id, std::span<const double> elements);
+        // As above, for elements that scripts may store to
+        [[nodiscard]] array writable_view(type_handle type_id, std::span<std::int64_t> elements);
+        [[nodiscard]] array writable_view(type_handle type_id, std::span<double> elements);
+        // The characters must not change while the scope lasts
+        [[nodiscard]] str view(std::u16string_view text);
+
+        // Ends the scope before it's destroyed, after which it can lend memory again
+        void end();
+
+    private:
+        array borrow(type_handle type_id, element_kind kind, void* data, std::size_t size,
+                     bool read_only);
+
+        std::vector<array> _arrays;
+        std::vector<str> _strs;
+    };
+} // namespace tone::core
\ No newline at end of file
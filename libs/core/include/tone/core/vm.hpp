@@ -0,0 +1,63 @@
+#pragma once
+
+#include "tone/core/bytecode.hpp"
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/value_slot.hpp"
+
+#include <span>
+#include <vector>
+
+namespace tone::core {
+    enum class dispatch_mode
+    {
+        switch_loop,
+        threaded,
+    };
+
+#if TONE_THREADED_DISPATCH
+    constexpr dispatch_mode default_dispatch_mode = dispatch_mode::threaded;
+#else
+    constexpr dispatch_mode default_dispatch_mode = dispatch_mode::switch_loop;
+#endif
+
+    class vm
+    {
+    public:
+        vm();
+        vm(const vm&) = delete;
+        vm& operator=(const vm&) = delete;
+        vm(vm&& other) noexcept;
+        vm& operator=(vm&& other) noexcept;
+        ~vm();
+
+        [[nodiscard]] runtime_value global(std::size_t index) const;
+        void set_global(std::size_t index, const runtime_value& value);
+        // Globals are numbered from 0 up to this; ones never set have a null type
+        [[nodiscard]] std::size_t global_count() const;
+        [[nodiscard]] type_handle global_type(std::size_t index) const;
+
+        runtime_value run(const bytecode_view& code, std::span<const runtime_value> params = {},
+                          dispatch_mode mode = default_dispatch_mode);
+        // As `run`, with parameters already in slots holding their declared types. Nothing is
+        // checked or converted, and strings and arrays are shared with the caller.
+        runtime_value run_slots(const bytecode_view& code, std::span<const value_slot> params,
+                                dispatch_mode mode = default_dispatch_mode);
+
+        // The VM whose `run` or `run_slots` this thread is in, the innermost when runs nest;
+        // null outside of them. Host functions use it to run more code on their caller's VM.
+        static vm* running();
+
+        // Makes every global `code` reads hold a value of its declared type
+        value_slot* bind_globals(const bytecode_view& code);
+        value_slot* bind_globals(std::span<const type_handle> global_types);
+
+    private:
+        void reset_global(std::size_t index, type_handle type_id);
+
+        // Globals are stored untagged; `_global_types` says what each slot holds
+        std::vector<value_slot> _globals;
+        std::vector<type_handle> _global_types;
+        // Runs of this VM in progress, counting ones its code started through host functions
+        std::size_t _depth = 0;
+    };
+} // namespace tone::core
\ No newline at end of file
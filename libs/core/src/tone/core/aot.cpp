@@ -0,0 +1,834 @@
+#include "tone/core/aot.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <utility>
+
+#if __has_include(<dlfcn.h>)
+#include <dlfcn.h>
+#define TONE_HAS_DLOPEN 1
+#endif
+
+namespace tone::core {
+    static_assert(sizeof(aot_value) == 8);
+
+    namespace {
+        constexpr std::string_view module_prelude = R"(/* Generated by tone, do not edit */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define TONE_EXPORT __declspec(dllexport)
+#else
+#define TONE_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef union tone_value
+{
+    int64_t i;
+    double r;
+    uint8_t b;
+} tone_value;
+
+typedef struct tone_error_site
+{
+    const char* message;
+    uint32_t line_number;
+    uint32_t char_index;
+} tone_error_site;
+
+typedef struct tone_entry
+{
+    const char* name;
+    int (*function)(const tone_value* p, tone_value* g, tone_value* result);
+    uint32_t param_count;
+    const uint8_t* param_types;
+    uint32_t global_count;
+    const uint32_t* globals;
+    uint32_t error_site_count;
+    const tone_error_site* error_sites;
+    uint8_t result_type;
+} tone_entry;
+
+typedef struct tone_module
+{
+    uint32_t abi_version;
+    uint32_t entry_count;
+    const tone_entry* entries;
+    uint32_t global_count;
+    const uint8_t* global_types;
+} tone_module;
+
+#define TONE_WRAP(op, a, b) ((int64_t)((uint64_t)(a) op (uint64_t)(b)))
+
+static int64_t tone_real_to_int(double value)
+{
+    if (value != value)
+        return 0;
+    if (value >= 9223372036854775808.0)
+        return INT64_MAX;
+    if (value < -9223372036854775808.0)
+        return INT64_MIN;
+    return (int64_t)value;
+}
+)";
+
+        aot_type to_aot_type(type_handle type_id)
+        {
+            if (type_id == type_registry::get_int_handle())
+                return aot_type::int_type;
+            if (type_id == type_registry::get_real_handle())
+                return aot_type::real_type;
+            if (type_id == type_registry::get_bool_handle())
+                return aot_type::bool_type;
+            return aot_type::none;
+        }
+
+        type_handle from_aot_type(std::uint8_t type)
+        {
+            switch (aot_type(type))
+            {
+            case aot_type::int_type:
+                return type_registry::get_int_handle();
+            case aot_type::real_type:
+                return type_registry::get_real_handle();
+            case aot_type::bool_type:
+                return type_registry::get_bool_handle();
+            default:
+                return nullptr;
+            }
+        }
+
+        const char* c_type(type_handle type_id)
+        {
+            switch (to_aot_type(type_id))
+            {
+            case aot_type::real_type:
+                return "double";
+            case aot_type::bool_type:
+                return "bool";
+            default:
+                return "int64_t";
+            }
+        }
+
+        const char* value_field(type_handle type_id)
+        {
+            switch (to_aot_type(type_id))
+            {
+            case aot_type::real_type:
+                return "r";
+            case aot_type::bool_type:
+                return "b";
+            default:
+                return "i";
+            }
+        }
+
+        template <typename T>
+        std::string c_array(std::string_view type, std::string_view name,
+                            const std::vector<T>& values)
+        {
+            // C has no empty arrays, so the table refers to a null pointer instead
+            if (values.empty())
+                return {};
+            std::string out = fmt::format("static const {} {}[] = {{", type, name);
+            for (const auto& value : values)
+                out += fmt::format("{}, ", value);
+            out += "};\n";
+            return out;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        /// `entry_generator` class
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+        class entry_generator
+        {
+        public:
+            entry_generator(const compile_context& context,
+                            std::map<std::size_t, type_handle>& global_types, std::string symbol)
+                : _context(context)
+                , _global_types(global_types)
+                , _symbol(std::move(symbol))
+                , _next_temp(0)
+                , _indent(1)
+            {}
+
+            // Returns the function definition and the tables describing it
+            std::string generate(const aot_source_entry& entry)
+            {
+                const auto& root = *entry.root;
+                const auto result_type = root.get_type_id();
+                if (to_aot_type(result_type) == aot_type::none)
+                {
+                    throw compiler_error(fmt::format("Entry '{}' must return int, real or bool",
+                                                     entry.name),
+                                         root.line_number(), root.char_index());
+                }
+
+                scan(root);
+                const auto result = compile_node(root);
+                line(fmt::format("result->{} = {};", value_field(result_type), result));
+                line("return 0;");
+
+                std::string out;
+                out += fmt::format("static int {}(const tone_value* p, tone_value* g, "
+                                   "tone_value* result)\n{{\n",
+                                   _symbol);
+                out += "    (void)p;\n    (void)g;\n";
+                for (const auto& [slot, type_id] : _params)
+                {
+                    out += fmt::format("    {} a{} = p[{}].{};\n", c_type(type_id), slot, slot,
+                                       value_field(type_id));
+                }
+                for (const auto& [slot, type_id] : _locals)
+                    out += fmt::format("    {} l{} = 0;\n", c_type(type_id), slot);
+                out += _body;
+                out += "}\n";
+
+                std::vector<int> param_types(_params.empty() ? 0 : _params.rbegin()->first + 1);
+                for (const auto& [slot, type_id] : _params)
+                    param_types[slot] = int(to_aot_type(type_id));
+
+                out += c_array("uint8_t", _symbol + "_params", param_types);
+                out += c_array("uint32_t", _symbol + "_globals", _globals);
+                if (!_error_sites.empty())
+                {
+                    out += fmt::format("static const tone_error_site {}_errors[] = {{", _symbol);
+                    for (const auto& site : _error_sites)
+                        out += site + ", ";
+                    out += "};\n";
+                }
+                out += '\n';
+
+                _table_row = fmt::format(
+                        "{{\"{}\", {}, {}, {}, {}, {}, {}, {}, {}}}", entry.name, _symbol,
+                        param_types.size(), param_types.empty() ? "0" : _symbol + "_params",
+                        _globals.size(), _globals.empty() ? "0" : _symbol + "_globals",
+                        _error_sites.size(), _error_sites.empty() ? "0" : _symbol + "_errors",
+                        int(to_aot_type(result_type)));
+                return out;
+            }
+
+            [[nodiscard]] const std::string& table_row() const
+            {
+                return _table_row;
+            }
+
+        private:
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Identifiers
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            const identifier_info& resolve(const node& n) const
+            {
+                const auto& name = std::get<identifier>(n.get_value()).name;
+                if (const auto info = _context.find(name))
+                    return *info;
+                throw undeclared_error(name, n.line_number(), n.char_index());
+            }
+
+            void scan(const node& n)
+            {
+                if (n.is_identifier())
+                {
+                    const auto& info = resolve(n);
+                    check_type(info.type_id(), n);
+                    const auto idx = std::ptrdiff_t(info.index());
+                    if (info.is_global())
+                    {
+                        _global_types[info.index()] = info.type_id();
+                        if (std::ranges::find(_globals, info.index()) == _globals.end())
+                            _globals.push_back(info.index());
+                    }
+                    else if (idx < 0)
+                    {
+                        _params[std::size_t(-idx) - 1] = info.type_id();
+                    }
+                    else
+                    {
+                        _locals[std::size_t(idx)] = info.type_id();
+                    }
+                }
+                for (const auto& child : n.get_children())
+                    scan(*child);
+            }
+
+            std::string location(const node& n) const
+            {
+                const auto& info = resolve(n);
+                const auto idx = std::ptrdiff_t(info.index());
+                if (info.is_global())
+                    return fmt::format("g[{}].{}", info.index(), value_field(info.type_id()));
+                if (idx < 0)
+                    return fmt::format("a{}", std::size_t(-idx) - 1);
+                return fmt::format("l{}", idx);
+            }
+
+            static void check_type(type_handle type_id, const node& n)
+            {
+                if (to_aot_type(type_id) == aot_type::none)
+                {
+                    throw compiler_error(fmt::format("Values of type '{}' are not supported by "
+                                                     "the AOT compiler",
+                                                     dump_type_handle(type_id)),
+                                         n.line_number(), n.char_index());
+                }
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Emission helpers
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            void line(std::string_view text)
+            {
+                _body.append(std::size_t(_indent) * 4, ' ');
+                _body += text;
+                _body += '\n';
+            }
+
+            std::string temp(type_handle type_id, std::string_view value)
+            {
+                const auto name = fmt::format("t{}", _next_temp++);
+                line(fmt::format("{} {} = {};", c_type(type_id), name, value));
+                return name;
+            }
+
+            void check_divisor(std::string_view divisor, const node& n)
+            {
+                _error_sites.push_back(fmt::format("{{\"Division by zero\", {}, {}}}",
+                                                   n.line_number(), n.char_index()));
+                line(fmt::format("if ({} == 0) return {};", divisor, _error_sites.size()));
+            }
+
+            static std::string literal(const node& n)
+            {
+                const auto& value = n.get_value();
+                if (const auto* i = std::get_if<std::int64_t>(&value))
+                {
+                    if (*i == std::numeric_limits<std::int64_t>::min())
+                        return "INT64_MIN";
+                    return fmt::format("INT64_C({})", *i);
+                }
+                if (const auto* d = std::get_if<double>(&value))
+                    return fmt::format("{:a}", *d);
+                if (const auto* b = std::get_if<bool>(&value))
+                    return *b ? "true" : "false";
+                throw compiler_error("Strings are not supported by the AOT compiler",
+                                     n.line_number(), n.char_index());
+            }
+
+            std::string convert(std::string value, type_handle from, type_handle to,
+                                const node& n)
+            {
+                if (from == to || to == type_registry::get_void_handle())
+                    return value;
+
+                const auto f = to_aot_type(from);
+                const auto t = to_aot_type(to);
+                if (f == aot_type::int_type && t == aot_type::real_type)
+                    return temp(to, fmt::format("(double){}", value));
+                if (f == aot_type::int_type && t == aot_type::bool_type)
+                    return temp(to, fmt::format("{} != 0", value));
+                if (f == aot_type::real_type && t == aot_type::int_type)
+                    return temp(to, fmt::format("tone_real_to_int({})", value));
+                if (f == aot_type::real_type && t == aot_type::bool_type)
+                    return temp(to, fmt::format("{} != 0.0", value));
+                throw wrong_type_error(dump_type_handle(from), dump_type_handle(to), false,
+                                       n.line_number(), n.char_index());
+            }
+
+            std::string compile_converted(const node& n, type_handle type_id)
+            {
+                return convert(compile_node(n), n.get_type_id(), type_id, n);
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Expressions
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            std::string compile_node(const node& n)
+            {
+                check_type(n.get_type_id(), n);
+                if (n.is_identifier())
+                    return temp(n.get_type_id(), location(n));
+                if (!n.is_node_operation())
+                    return literal(n);
+
+                const auto& children = n.get_children();
+                const auto type_id = n.get_type_id();
+
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::param:
+                case node_operation::unary_plus:
+                    return compile_node(*children[0]);
+
+                case node_operation::pre_increment:
+                case node_operation::pre_decrement:
+                case node_operation::assign:
+                case node_operation::add_assign:
+                case node_operation::sub_assign:
+                case node_operation::mul_assign:
+                case node_operation::div_assign:
+                case node_operation::mod_assign:
+                    return temp(type_id, compile_lvalue(n));
+
+                case node_operation::post_increment:
+                case node_operation::post_decrement: {
+                    const bool increment = std::get<node_operation>(n.get_value()) ==
+                                           node_operation::post_increment;
+                    const auto loc = compile_lvalue(*children[0]);
+                    const auto old_value = temp(type_id, loc);
+                    line(fmt::format("{} = {};", loc, step(loc, type_id, increment)));
+                    return old_value;
+                }
+
+                case node_operation::unary_minus: {
+                    const auto value = compile_converted(*children[0], type_id);
+                    if (to_aot_type(type_id) == aot_type::real_type)
+                        return temp(type_id, fmt::format("-{}", value));
+                    return temp(type_id, fmt::format("TONE_WRAP(-, 0, {})", value));
+                }
+                case node_operation::bitwise_not:
+                    return temp(type_id, fmt::format("~{}", compile_converted(
+                                                                    *children[0], type_id)));
+                case node_operation::logical_not:
+                    return temp(type_id, fmt::format("!{}", compile_converted(
+                                                                    *children[0], type_id)));
+
+                case node_operation::add:
+                case node_operation::sub:
+                case node_operation::mul:
+                case node_operation::div:
+                case node_operation::mod:
+                case node_operation::bitwise_and:
+                case node_operation::bitwise_or:
+                case node_operation::bitwise_xor:
+                case node_operation::shift_l:
+                case node_operation::shift_r: {
+                    const auto l = compile_converted(*children[0], type_id);
+                    const auto r = compile_converted(*children[1], type_id);
+                    return temp(type_id, arithmetic(n, l, r, type_id));
+                }
+
+                case node_operation::equal:
+                case node_operation::not_equal:
+                case node_operation::less:
+                case node_operation::greater:
+                case node_operation::less_equal:
+                case node_operation::greater_equal: {
+                    const auto operand_type =
+                            to_aot_type(children[0]->get_type_id()) == aot_type::real_type ||
+                                            to_aot_type(children[1]->get_type_id()) ==
+                                                    aot_type::real_type
+                                    ? type_registry::get_real_handle()
+                                    : type_registry::get_int_handle();
+                    const auto l = compile_converted(*children[0], operand_type);
+                    const auto r = compile_converted(*children[1], operand_type);
+                    return temp(type_id, fmt::format("{} {} {}", l, comparison(n), r));
+                }
+
+                case node_operation::logical_and:
+                case node_operation::logical_or: {
+                    const bool is_and =
+                            std::get<node_operation>(n.get_value()) == node_operation::logical_and;
+                    const auto bool_handle = type_registry::get_bool_handle();
+                    const auto result =
+                            temp(bool_handle, compile_converted(*children[0], bool_handle));
+                    line(fmt::format("if ({}{})", is_and ? "" : "!", result));
+                    line("{");
+                    ++_indent;
+                    line(fmt::format("{} = {};", result,
+                                     compile_converted(*children[1], bool_handle)));
+                    --_indent;
+                    line("}");
+                    return result;
+                }
+
+                case node_operation::comma:
+                    for (std::size_t i = 0; i + 1 < children.size(); ++i)
+                        compile_node(*children[i]);
+                    return compile_node(*children.back());
+
+                case node_operation::index:
+                    throw compiler_error("Indexing is not supported by the AOT compiler",
+                                         n.line_number(), n.char_index());
+                case node_operation::call:
+                    throw compiler_error("Calls are not supported by the AOT compiler",
+                                         n.line_number(), n.char_index());
+                }
+                throw compiler_error("Unknown operation", n.line_number(), n.char_index());
+            }
+
+            // Performs the side effects of an lvalue expression and returns where it lives
+            std::string compile_lvalue(const node& n)
+            {
+                if (n.is_identifier())
+                    return location(n);
+
+                const auto& children = n.get_children();
+                const auto type_id = n.get_type_id();
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::param:
+                    return compile_lvalue(*children[0]);
+
+                case node_operation::pre_increment:
+                case node_operation::pre_decrement: {
+                    const bool increment = std::get<node_operation>(n.get_value()) ==
+                                           node_operation::pre_increment;
+                    const auto loc = compile_lvalue(*children[0]);
+                    line(fmt::format("{} = {};", loc, step(loc, type_id, increment)));
+                    return loc;
+                }
+
+                case node_operation::assign: {
+                    const auto loc = compile_lvalue(*children[0]);
+                    line(fmt::format("{} = {};", loc, compile_converted(*children[1], type_id)));
+                    return loc;
+                }
+
+                case node_operation::add_assign:
+                case node_operation::sub_assign:
+                case node_operation::mul_assign:
+                case node_operation::div_assign:
+                case node_operation::mod_assign: {
+                    // The target is read before the right side runs, as the interpreter does
+                    const auto loc = compile_lvalue(*children[0]);
+                    const auto current = temp(type_id, loc);
+                    const auto value = compile_converted(*children[1], type_id);
+                    line(fmt::format("{} = {};", loc, arithmetic(n, current, value, type_id)));
+                    return loc;
+                }
+
+                case node_operation::comma:
+                    for (std::size_t i = 0; i + 1 < children.size(); ++i)
+                        compile_node(*children[i]);
+                    return compile_lvalue(*children.back());
+
+                default:
+                    throw compiler_error("Expression is not an lvalue", n.line_number(),
+                                         n.char_index());
+                }
+            }
+
+            static std::string step(std::string_view loc, type_handle type_id, bool increment)
+            {
+                if (to_aot_type(type_id) == aot_type::real_type)
+                    return fmt::format("{} {} 1.0", loc, increment ? '+' : '-');
+                return fmt::format("TONE_WRAP({}, {}, 1)", increment ? '+' : '-', loc);
+            }
+
+            // Matches the interpreter: integer arithmetic wraps, shifts use the low six bits
+            // and a divisor of -1 can't overflow
+            std::string arithmetic(const node& n, std::string_view l, std::string_view r,
+                                   type_handle type_id)
+            {
+                const bool real = to_aot_type(type_id) == aot_type::real_type;
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::add:
+                case node_operation::add_assign:
+                    if (real)
+                        return fmt::format("{} + {}", l, r);
+                    return fmt::format("TONE_WRAP(+, {}, {})", l, r);
+                case node_operation::sub:
+                case node_operation::sub_assign:
+                    if (real)
+                        return fmt::format("{} - {}", l, r);
+                    return fmt::format("TONE_WRAP(-, {}, {})", l, r);
+                case node_operation::mul:
+                case node_operation::mul_assign:
+                    if (real)
+                        return fmt::format("{} * {}", l, r);
+                    return fmt::format("TONE_WRAP(*, {}, {})", l, r);
+                case node_operation::div:
+                case node_operation::div_assign:
+                    if (real)
+                        return fmt::format("{} / {}", l, r);
+                    check_divisor(r, n);
+                    return fmt::format("{1} == -1 ? TONE_WRAP(-, 0, {0}) : {0} / {1}", l, r);
+                case node_operation::mod:
+                case node_operation::mod_assign:
+                    if (real)
+                        return fmt::format("fmod({}, {})", l, r);
+                    check_divisor(r, n);
+                    return fmt::format("{1} == -1 ? 0 : {0} % {1}", l, r);
+                case node_operation::bitwise_and:
+                    return fmt::format("{} & {}", l, r);
+                case node_operation::bitwise_or:
+                    return fmt::format("{} | {}", l, r);
+                case node_operation::bitwise_xor:
+                    return fmt::format("{} ^ {}", l, r);
+                case node_operation::shift_l:
+                    return fmt::format("(int64_t)((uint64_t){} << ({} & 63))", l, r);
+                case node_operation::shift_r:
+                    return fmt::format("{} >> ({} & 63)", l, r);
+                default:
+                    throw compiler_error("Not an arithmetic operation", n.line_number(),
+                                         n.char_index());
+                }
+            }
+
+            static const char* comparison(const node& n)
+            {
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::equal:
+                    return "==";
+                case node_operation::not_equal:
+                    return "!=";
+                case node_operation::less:
+                    return "<";
+                case node_operation::greater:
+                    return ">";
+                case node_operation::less_equal:
+                    return "<=";
+                default:
+                    return ">=";
+                }
+            }
+
+            const compile_context& _context;
+            std::map<std::size_t, type_handle>& _global_types;
+            std::string _symbol;
+            std::map<std::size_t, type_handle> _params;
+            std::map<std::size_t, type_handle> _locals;
+            std::vector<std::size_t> _globals;
+            std::vector<std::string> _error_sites;
+            std::string _body;
+            std::string _table_row;
+            std::size_t _next_temp;
+            int _indent;
+        };
+    } // namespace
+
+    std::string generate_aot_source(const compile_context& context,
+                                    std::span<const aot_source_entry> entries)
+    {
+        std::string out(module_prelude);
+        out += '\n';
+
+        std::map<std::size_t, type_handle> global_types;
+        std::vector<std::string> rows;
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            for (std::size_t j = 0; j < i; ++j)
+            {
+                if (entries[j].name == entries[i].name)
+                {
+                    throw compiler_error(fmt::format("Duplicate entry '{}'", entries[i].name),
+                                         entries[i].root->line_number(),
+                                         entries[i].root->char_index());
+                }
+            }
+
+            entry_generator generator(context, global_types, fmt::format("tone_entry_{}", i));
+            out += generator.generate(entries[i]);
+            rows.push_back(generator.table_row());
+        }
+
+        std::vector<int> types(global_types.empty() ? 0 : global_types.rbegin()->first + 1);
+        for (const auto& [index, type_id] : global_types)
+            types[index] = int(to_aot_type(type_id));
+        out += c_array("uint8_t", "tone_global_types", types);
+
+        out += "static const tone_entry tone_entries[] = {\n";
+        for (const auto& row : rows)
+            out += fmt::format("    {},\n", row);
+        out += "};\n\n";
+
+        out += fmt::format("static const tone_module tone_module_table = {{{}, {}, tone_entries, "
+                           "{}, {}}};\n\n",
+                           aot_abi_version, rows.size(), types.size(),
+                           types.empty() ? "0" : "tone_global_types");
+        out += fmt::format("TONE_EXPORT const tone_module* {}(void)\n{{\n"
+                           "    return &tone_module_table;\n}}\n",
+                           aot_module_symbol);
+        return out;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `aot_function` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    aot_function::aot_function(const aot_entry& entry, std::span<const type_handle> global_types)
+        : _entry(&entry)
+        , _global_types(global_types)
+    {}
+
+    std::string_view aot_function::name() const
+    {
+        return _entry->name;
+    }
+
+    type_handle aot_function::result_type() const
+    {
+        return from_aot_type(_entry->result_type);
+    }
+
+    runtime_value aot_function::operator()(vm& machine,
+                                           std::span<const runtime_value> params) const
+    {
+        std::vector<aot_value> args(_entry->param_count);
+        for (std::size_t i = 0; i < args.size(); ++i)
+        {
+            const auto type_id = from_aot_type(_entry->param_types[i]);
+            if (!type_id)
+                continue;
+            const runtime_value value = i < params.size() ? params[i] : default_value(type_id);
+            if (value.index() != default_value(type_id).index())
+            {
+                throw runtime_error(fmt::format("Param {} of '{}' must be '{}'", i + 1,
+                                                _entry->name, dump_type_handle(type_id)),
+                                    0, 0);
+            }
+            if (const auto* i64 = std::get_if<std::int64_t>(&value))
+                args[i].i = *i64;
+            else if (const auto* d = std::get_if<double>(&value))
+                args[i].r = *d;
+            else
+                args[i].b = std::get<bool>(value);
+        }
+
+        // The module addresses globals by index, so only the ones it uses are marshalled
+        value_slot* globals = machine.bind_globals(_global_types);
+        std::vector<aot_value> module_globals(_global_types.size());
+        for (std::size_t n = 0; n < _entry->global_count; ++n)
+        {
+            const auto idx = _entry->globals[n];
+            const auto& slot = globals[idx];
+            switch (tag_of(_global_types[idx]))
+            {
+            case value_tag::real_value:
+                module_globals[idx].r = slot.as_real();
+                break;
+            case value_tag::bool_value:
+                module_globals[idx].b = slot.as_bool();
+                break;
+            default:
+                module_globals[idx].i = slot.as_int();
+                break;
+            }
+        }
+
+        aot_value result{};
+        const int status = _entry->function(args.data(), module_globals.data(), &result);
+
+        for (std::size_t n = 0; n < _entry->global_count; ++n)
+        {
+            const auto idx = _entry->globals[n];
+            auto& slot = globals[idx];
+            switch (tag_of(_global_types[idx]))
+            {
+            case value_tag::real_value:
+                slot.set_real(module_globals[idx].r);
+                break;
+            case value_tag::bool_value:
+                slot.set_bool(module_globals[idx].b != 0);
+                break;
+            default:
+                slot.set_int(module_globals[idx].i);
+                break;
+            }
+        }
+
+        if (status > 0 && std::uint32_t(status) <= _entry->error_site_count)
+        {
+            const auto& site = _entry->error_sites[status - 1];
+            throw runtime_error(site.message, site.line_number, site.char_index);
+        }
+
+        switch (aot_type(_entry->result_type))
+        {
+        case aot_type::real_type:
+            return result.r;
+        case aot_type::bool_type:
+            return result.b != 0;
+        default:
+            return result.i;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `aot_library` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    aot_library::aot_library(const std::string& path)
+        : _handle(nullptr)
+        , _module(nullptr)
+    {
+#if TONE_HAS_DLOPEN
+        _handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!_handle)
+            throw error(fmt::format("Can't load compiled module: {}", dlerror()), 0, 0);
+
+        using module_getter = const aot_module* (*)();
+        const auto getter = reinterpret_cast<module_getter>(dlsym(_handle, aot_module_symbol));
+        _module = getter ? getter() : nullptr;
+        if (!_module || _module->abi_version != aot_abi_version)
+        {
+            dlclose(_handle);
+            throw error(fmt::format("'{}' is not a compiled module for ABI version {}", path,
+                                    aot_abi_version),
+                        0, 0);
+        }
+
+        for (std::size_t i = 0; i < _module->global_count; ++i)
+            _global_types.push_back(from_aot_type(_module->global_types[i]));
+#else
+        throw error(fmt::format("Can't load '{}': compiled modules are not supported on this "
+                                "platform",
+                                path),
+                    0, 0);
+#endif
+    }
+
+    aot_library::aot_library(aot_library&& other) noexcept
+        : _handle(std::exchange(other._handle, nullptr))
+        , _module(std::exchange(other._module, nullptr))
+        , _global_types(std::move(other._global_types))
+    {}
+
+    aot_library& aot_library::operator=(aot_library&& other) noexcept
+    {
+        std::swap(_handle, other._handle);
+        std::swap(_module, other._module);
+        std::swap(_global_types, other._global_types);
+        return *this;
+    }
+
+    aot_library::~aot_library()
+    {
+#if TONE_HAS_DLOPEN
+        if (_handle)
+            dlclose(_handle);
+#endif
+    }
+
+    std::optional<aot_function> aot_library::find(std::string_view name) const
+    {
+        for (std::size_t i = 0; i < _module->entry_count; ++i)
+        {
+            if (_module->entries[i].name == name)
+                return aot_function(_module->entries[i], _global_types);
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::string_view> aot_library::entry_names() const
+    {
+        std::vector<std::string_view> names;
+        for (std::size_t i = 0; i < _module->entry_count; ++i)
+            names.emplace_back(_module->entries[i].name);
+        return names;
+    }
+} // namespace tone::core
\ No newline at end of file
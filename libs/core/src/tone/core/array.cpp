@@ -0,0 +1,650 @@
+#include "tone/core/array.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace tone::core {
+    namespace {
+        constexpr std::size_t word_bits = 64;
+
+        // Every kind but `bool` takes one 8-byte word per element
+        std::size_t data_bytes(element_kind kind, std::size_t count)
+        {
+            if (kind == element_kind::bool_element)
+                return (count + word_bits - 1) / word_bits * sizeof(std::uint64_t);
+            return count * sizeof(std::uint64_t);
+        }
+
+        void* allocate_data(element_kind kind, std::size_t count)
+        {
+            void* data = std::malloc(std::max<std::size_t>(data_bytes(kind, count), 1));
+            if (!data)
+                throw std::bad_alloc();
+            return data;
+        }
+    } // namespace
+
+    element_kind element_kind_of(type_handle type_id)
+    {
+        const auto* arr = type_id ? std::get_if<array_type>(type_id) : nullptr;
+        if (!arr)
+            throw std::invalid_argument("Not an array type");
+
+        const auto inner = arr->inner_type_id;
+        if (inner == type_registry::get_int_handle())
+            return element_kind::int_element;
+        if (inner == type_registry::get_real_handle())
+            return element_kind::real_element;
+        if (inner == type_registry::get_bool_handle())
+            return element_kind::bool_element;
+        if (inner == type_registry::get_str_handle())
+            return element_kind::str_element;
+        if (std::holds_alternative<array_type>(*inner))
+            return element_kind::array_element;
+        throw std::invalid_argument(
+                fmt::format("Arrays of {} are not supported", dump_type_handle(inner)));
+    }
+
+    struct array::storage
+    {
+        std::atomic<std::uint32_t> refs;
+        element_kind kind;
+        // `data` belongs to the host, see `borrow`
+        bool borrowed;
+        bool read_only;
+        type_handle type_id;
+        std::size_t size;
+        std::size_t capacity;
+        // Position of a view's first element in its source, zero for owning storage
+        std::size_t offset;
+        // Owned elements, null for a view
+        void* data;
+        // The storage owning the elements when this one is a view, never another view
+        storage* source;
+    };
+
+    array::storage* array::allocate(type_handle type_id)
+    {
+        const auto kind = element_kind_of(type_id);
+        return new storage{{1}, kind, false, false, type_id, 0, 0, 0, nullptr, nullptr};
+    }
+
+    void array::add_ref(storage* s)
+    {
+        s->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void array::release_ref(storage* s)
+    {
+        if (s->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        if (s->source)
+        {
+            release_ref(s->source);
+        }
+        else
+        {
+            destroy_elements(s, 0, s->size);
+            if (!s->borrowed)
+                std::free(s->data);
+        }
+        delete s;
+    }
+
+    void array::destroy_elements(storage* s, std::size_t first, std::size_t last)
+    {
+        auto** handles = static_cast<void**>(s->data);
+        if (s->kind == element_kind::str_element)
+        {
+            for (std::size_t i = first; i < last; ++i)
+                str::adopt(handles[i]);
+        }
+        else if (s->kind == element_kind::array_element)
+        {
+            for (std::size_t i = first; i < last; ++i)
+            {
+                if (handles[i])
+                    release_ref(static_cast<storage*>(handles[i]));
+            }
+        }
+    }
+
+    void array::fill_default(storage* s, std::size_t first, std::size_t last)
+    {
+        switch (s->kind)
+        {
+        case element_kind::bool_element: {
+            // Clear bits up to the next word boundary, then whole words
+            auto* words = static_cast<std::uint64_t*>(s->data);
+            std::size_t i = first;
+            for (; i < last && i % word_bits; ++i)
+                words[i / word_bits] &= ~(std::uint64_t(1) << (i % word_bits));
+            if (i < last)
+                std::memset(words + i / word_bits, 0,
+                            (last - i + word_bits - 1) / word_bits * sizeof(std::uint64_t));
+            break;
+        }
+        case element_kind::array_element: {
+            auto** handles = static_cast<void**>(s->data);
+            const auto inner = std::get<array_type>(*s->type_id).inner_type_id;
+            for (std::size_t i = first; i < last; ++i)
+                handles[i] = allocate(inner);
+            break;
+        }
+        default:
+            std::memset(static_cast<std::uint64_t*>(s->data) + first, 0,
+                        (last - first) * sizeof(std::uint64_t));
+            break;
+        }
+    }
+
+    std::pair<array::storage*, std::size_t> array::locate(const void* handle, std::size_t index)
+    {
+        auto* s = static_cast<storage*>(const_cast<void*>(handle));
+        if (s->source)
+            return {s->source, s->offset + index};
+        return {s, index};
+    }
+
+    array::array(type_handle type_id, std::size_t size)
+        : _storage(allocate(type_id))
+    {
+        resize(size);
+    }
+
+    array::array(const array& other)
+        : _storage(other._storage)
+    {
+        if (_storage)
+            add_ref(_storage);
+    }
+
+    array::array(array&& other) noexcept
+        : _storage(std::exchange(other._storage, nullptr))
+    {}
+
+    array& array::operator=(const array& other)
+    {
+        array copy(other);
+        std::swap(_storage, copy._storage);
+        return *this;
+    }
+
+    array& array::operator=(array&& other) noexcept
+    {
+        std::swap(_storage, other._storage);
+        return *this;
+    }
+
+    array::~array()
+    {
+        if (_storage)
+            release_ref(_storage);
+    }
+
+    type_handle array::type_id() const
+    {
+        return _storage ? _storage->type_id : nullptr;
+    }
+
+    type_handle array::element_type() const
+    {
+        return _storage ? std::get<array_type>(*_storage->type_id).inner_type_id : nullptr;
+    }
+
+    element_kind array::kind() const
+    {
+        if (!_storage)
+            throw std::logic_error("Array has no type");
+        return _storage->kind;
+    }
+
+    std::size_t array::size() const
+    {
+        return size(_storage);
+    }
+
+    bool array::empty() const
+    {
+        return size() == 0;
+    }
+
+    bool array::is_view() const
+    {
+        return _storage && _storage->source;
+    }
+
+    bool array::is_borrowed() const
+    {
+        return _storage && locate(_storage, 0).first->borrowed;
+    }
+
+    bool array::is_read_only() const
+    {
+        return is_read_only(_storage);
+    }
+
+    bool array::is_unique() const
+    {
+        return _storage && _storage->refs.load(std::memory_order_acquire) == 1;
+    }
+
+    void array::check(std::size_t index, element_kind expected) const
+    {
+        if (index >= size())
+            throw std::out_of_range("Array index out of range");
+        if (_storage->kind != expected)
+            throw std::logic_error("Array element has the wrong type");
+    }
+
+    std::int64_t array::get_int(std::size_t index) const
+    {
+        check(index, element_kind::int_element);
+        return load_int(_storage, index);
+    }
+
+    double array::get_real(std::size_t index) const
+    {
+        check(index, element_kind::real_element);
+        return load_real(_storage, index);
+    }
+
+    bool array::get_bool(std::size_t index) const
+    {
+        check(index, element_kind::bool_element);
+        return load_bool(_storage, index);
+    }
+
+    str array::get_str(std::size_t index) const
+    {
+        check(index, element_kind::str_element);
+        return str::share(load_str(_storage, index));
+    }
+
+    array array::get_array(std::size_t index) const
+    {
+        check(index, element_kind::array_element);
+        return share(load_array(_storage, index));
+    }
+
+    void array::set_int(std::size_t index, std::int64_t value)
+    {
+        check(index, element_kind::int_element);
+        if (_storage->read_only)
+            throw std::logic_error("Array is read-only");
+        store_int(_storage, index, value);
+    }
+
+    void array::set_real(std::size_t index, double value)
+    {
+        check(index, element_kind::real_element);
+        if (_storage->read_only)
+            throw std::logic_error("Array is read-only");
+        store_real(_storage, index, value);
+    }
+
+    void array::set_bool(std::size_t index, bool value)
+    {
+        check(index, element_kind::bool_element);
+        store_bool(_storage, index, value);
+    }
+
+    void array::set_str(std::size_t index, str value)
+    {
+        check(index, element_kind::str_element);
+        store_str(_storage, index, value.release());
+    }
+
+    void array::set_array(std::size_t index, array value)
+    {
+        check(index, element_kind::array_element);
+        if (value.type_id() != element_type())
+            throw std::logic_error("Array element has the wrong type");
+        store_array(_storage, index, value.release());
+    }
+
+    void array::detach()
+    {
+        auto* s = _storage;
+        const auto count = size(s);
+        void* data = allocate_data(s->kind, count);
+
+        auto* source = s->source;
+        switch (s->kind)
+        {
+        case element_kind::bool_element: {
+            auto* words = static_cast<std::uint64_t*>(data);
+            std::memset(words, 0, data_bytes(s->kind, count));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (load_bool(s, i))
+                    words[i / word_bits] |= std::uint64_t(1) << (i % word_bits);
+            }
+            break;
+        }
+        case element_kind::str_element:
+        case element_kind::array_element: {
+            auto** handles = static_cast<void**>(data);
+            const auto* from = static_cast<void* const*>(source->data) + s->offset;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                handles[i] = from[i];
+                if (s->kind == element_kind::str_element)
+                    handles[i] = str::share(from[i]).release();
+                else
+                    add_ref(static_cast<storage*>(from[i]));
+            }
+            break;
+        }
+        default:
+            std::memcpy(data, static_cast<const std::uint64_t*>(source->data) + s->offset,
+                        count * sizeof(std::uint64_t));
+            break;
+        }
+
+        s->data = data;
+        s->size = count;
+        s->capacity = count;
+        s->offset = 0;
+        s->source = nullptr;
+        release_ref(source);
+    }
+
+    void array::reserve(std::size_t capacity)
+    {
+        if (!_storage)
+            throw std::logic_error("Array has no type");
+        if (_storage->read_only)
+            throw std::logic_error("Array is read-only");
+        if (_storage->source)
+            detach();
+        if (_storage->borrowed)
+            own();
+        if (capacity <= _storage->capacity)
+            return;
+
+        void* data = std::realloc(_storage->data,
+                                  std::max<std::size_t>(data_bytes(_storage->kind, capacity), 1));
+        if (!data)
+            throw std::bad_alloc();
+        _storage->data = data;
+        _storage->capacity = capacity;
+    }
+
+    void array::resize(std::size_t size)
+    {
+        reserve(size);
+        auto* s = _storage;
+        if (size > s->size)
+            fill_default(s, s->size, size);
+        else
+            destroy_elements(s, size, s->size);
+        s->size = size;
+    }
+
+    std::size_t array::grow()
+    {
+        if (_storage->read_only)
+            throw std::logic_error("Array is read-only");
+        if (_storage->source)
+            detach();
+        if (_storage->size == _storage->capacity)
+            reserve(std::max<std::size_t>(8, 2 * _storage->capacity));
+        return _storage->size++;
+    }
+
+    void array::push_int(std::int64_t value)
+    {
+        if (!_storage || _storage->kind != element_kind::int_element)
+            throw std::logic_error("Array element has the wrong type");
+        const auto index = grow();
+        store_int(_storage, index, value);
+    }
+
+    void array::push_real(double value)
+    {
+        if (!_storage || _storage->kind != element_kind::real_element)
+            throw std::logic_error("Array element has the wrong type");
+        const auto index = grow();
+        store_real(_storage, index, value);
+    }
+
+    void array::push_bool(bool value)
+    {
+        if (!_storage || _storage->kind != element_kind::bool_element)
+            throw std::logic_error("Array element has the wrong type");
+        const auto index = grow();
+        store_bool(_storage, index, value);
+    }
+
+    void array::push_str(str value)
+    {
+        if (!_storage || _storage->kind != element_kind::str_element)
+            throw std::logic_error("Array element has the wrong type");
+        const auto index = grow();
+        static_cast<void**>(_storage->data)[index] = value.release();
+    }
+
+    void array::push_array(array value)
+    {
+        if (!_storage || _storage->kind != element_kind::array_element ||
+            value.type_id() != element_type())
+            throw std::logic_error("Array element has the wrong type");
+        const auto index = grow();
+        static_cast<void**>(_storage->data)[index] = value.release();
+    }
+
+    std::span<std::int64_t> array::ints()
+    {
+        if (!_storage || _storage->kind != element_kind::int_element)
+            return {};
+        const auto [owner, first] = locate(_storage, 0);
+        return {static_cast<std::int64_t*>(owner->data) + first, size()};
+    }
+
+    std::span<const std::int64_t> array::ints() const
+    {
+        return const_cast<array*>(this)->ints();
+    }
+
+    std::span<double> array::reals()
+    {
+        if (!_storage || _storage->kind != element_kind::real_element)
+            return {};
+        const auto [owner, first] = locate(_storage, 0);
+        return {static_cast<double*>(owner->data) + first, size()};
+    }
+
+    std::span<const double> array::reals() const
+    {
+        return const_cast<array*>(this)->reals();
+    }
+
+    std::span<std::uint64_t> array::bool_words()
+    {
+        if (!_storage || _storage->kind != element_kind::bool_element)
+            return {};
+        const auto [owner, first] = locate(_storage, 0);
+        if (first % word_bits)
+            return {};
+        return {static_cast<std::uint64_t*>(owner->data) + first / word_bits,
+                (size() + word_bits - 1) / word_bits};
+    }
+
+    std::span<const std::uint64_t> array::bool_words() const
+    {
+        return const_cast<array*>(this)->bool_words();
+    }
+
+    array array::slice(std::size_t pos, std::size_t count) const
+    {
+        const auto length = size();
+        if (pos > length)
+            throw std::out_of_range("Array slice out of range");
+        if (!_storage)
+            return {};
+
+        const auto [owner, first] = locate(_storage, pos);
+        add_ref(owner);
+        const auto view_size = std::min(count, length - pos);
+        return adopt(new storage{{1}, _storage->kind, false, _storage->read_only,
+                                 _storage->type_id, view_size, 0, first, nullptr, owner});
+    }
+
+    array array::borrow(type_handle type_id, void* data, std::size_t size, bool read_only)
+    {
+        const auto kind = element_kind_of(type_id);
+        if (kind != element_kind::int_element && kind != element_kind::real_element)
+            throw std::invalid_argument("Only int and real arrays can be borrowed");
+
+        auto result = adopt(allocate(type_id));
+        auto* s = result._storage;
+        s->borrowed = true;
+        s->read_only = read_only;
+        s->data = data;
+        s->size = size;
+        s->capacity = size;
+        return result;
+    }
+
+    void array::own()
+    {
+        if (!_storage)
+            return;
+        auto* s = _storage->source ? _storage->source : _storage;
+        if (!s->borrowed)
+            return;
+
+        void* data = allocate_data(s->kind, s->size);
+        std::memcpy(data, s->data, data_bytes(s->kind, s->size));
+        s->data = data;
+        s->capacity = s->size;
+        s->borrowed = false;
+    }
+
+    bool array::operator==(const array& other) const
+    {
+        if (_storage == other._storage)
+            return true;
+        if (!_storage || !other._storage || size() != other.size())
+            return false;
+        return locate(_storage, 0) == locate(other._storage, 0);
+    }
+
+    void* array::handle() const
+    {
+        return _storage;
+    }
+
+    void* array::release()
+    {
+        return std::exchange(_storage, nullptr);
+    }
+
+    array array::adopt(void* handle)
+    {
+        array result;
+        result._storage = static_cast<storage*>(handle);
+        return result;
+    }
+
+    array array::share(const void* handle)
+    {
+        array result;
+        result._storage = static_cast<storage*>(const_cast<void*>(handle));
+        if (result._storage)
+            add_ref(result._storage);
+        return result;
+    }
+
+    std::size_t array::size(const void* handle)
+    {
+        const auto* s = static_cast<const storage*>(handle);
+        if (!s)
+            return 0;
+        if (!s->source)
+            return s->size;
+        // A view only sees what is left of its source
+        const auto available = s->source->size > s->offset ? s->source->size - s->offset : 0;
+        return std::min(s->size, available);
+    }
+
+    bool array::is_read_only(const void* handle)
+    {
+        const auto* s = static_cast<const storage*>(handle);
+        return s && s->read_only;
+    }
+
+    std::int64_t array::load_int(const void* handle, std::size_t index)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        return static_cast<const std::int64_t*>(owner->data)[pos];
+    }
+
+    double array::load_real(const void* handle, std::size_t index)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        return static_cast<const double*>(owner->data)[pos];
+    }
+
+    bool array::load_bool(const void* handle, std::size_t index)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        return (static_cast<const std::uint64_t*>(owner->data)[pos / word_bits] >>
+                (pos % word_bits)) &
+               1;
+    }
+
+    const void* array::load_str(const void* handle, std::size_t index)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        return static_cast<void* const*>(owner->data)[pos];
+    }
+
+    const void* array::load_array(const void* handle, std::size_t index)
+    {
+        return load_str(handle, index);
+    }
+
+    void array::store_int(const void* handle, std::size_t index, std::int64_t value)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        static_cast<std::int64_t*>(owner->data)[pos] = value;
+    }
+
+    void array::store_real(const void* handle, std::size_t index, double value)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        static_cast<double*>(owner->data)[pos] = value;
+    }
+
+    void array::store_bool(const void* handle, std::size_t index, bool value)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        auto& word = static_cast<std::uint64_t*>(owner->data)[pos / word_bits];
+        const auto bit = std::uint64_t(1) << (pos % word_bits);
+        word = value ? word | bit : word & ~bit;
+    }
+
+    void array::store_str(const void* handle, std::size_t index, void* value)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        auto& element = static_cast<void**>(owner->data)[pos];
+        // Released last, as `value` may be the same string
+        str::adopt(std::exchange(element, value));
+    }
+
+    void array::store_array(const void* handle, std::size_t index, void* value)
+    {
+        const auto [owner, pos] = locate(handle, index);
+        auto& element = static_cast<void**>(owner->data)[pos];
+        if (auto* old = static_cast<storage*>(std::exchange(element, value)))
+            release_ref(old);
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include "tone/core/array_builtins.hpp"
+
+#include "tone/core/array.hpp"
+#include "tone/core/simd_kernels.hpp"
+
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace tone::core {
+    namespace {
+        template <typename T>
+        std::span<T> elements(array& arr)
+        {
+            if constexpr (std::is_same_v<T, std::int64_t>)
+                return arr.ints();
+            else
+                return arr.reals();
+        }
+
+        template <typename T>
+        void set_result(value_slot& slot, T value)
+        {
+            if constexpr (std::is_same_v<T, std::int64_t>)
+                slot.set_int(value);
+            else
+                slot.set_real(value);
+        }
+
+        value_slot array_result(array&& arr)
+        {
+            value_slot result;
+            result.set_array(arr.release());
+            return result;
+        }
+
+        void check_lengths(const array& l, const array& r)
+        {
+            if (l.size() != r.size())
+                throw std::invalid_argument("Arrays have different lengths");
+        }
+
+        // The packed bits of a `bool` array, copied when it is a view not starting on a word
+        std::vector<std::uint64_t> mask_words(const array& mask)
+        {
+            std::vector<std::uint64_t> words((mask.size() + 63) / 64);
+            for (std::size_t i = 0; i < mask.size(); ++i)
+                words[i / 64] |= std::uint64_t(mask.get_bool(i)) << (i % 64);
+            return words;
+        }
+
+        template <typename T, simd_kernels::binary<T> simd_kernels::*kernel>
+        value_slot binary(const host_function& self, value_slot* args)
+        {
+            auto l = array::share(args[0].as_array());
+            auto r = array::share(args[1].as_array());
+            check_lengths(l, r);
+
+            array out(self.result_type(), l.size());
+            (get_simd_kernels().*kernel)(elements<T>(l).data(), elements<T>(r).data(),
+                                         elements<T>(out).data(), l.size());
+            return array_result(std::move(out));
+        }
+
+        // Vector units have no 64-bit integer division, so this is a plain loop
+        value_slot div_int(const host_function& self, value_slot* args)
+        {
+            auto l = array::share(args[0].as_array());
+            auto r = array::share(args[1].as_array());
+            check_lengths(l, r);
+
+            array out(self.result_type(), l.size());
+            const auto dividends = l.ints();
+            const auto divisors = r.ints();
+            const auto quotients = out.ints();
+            for (std::size_t i = 0; i < quotients.size(); ++i)
+            {
+                if (divisors[i] == 0)
+                    throw std::domain_error("Division by zero");
+                quotients[i] = divisors[i] == -1
+                                       ? std::int64_t(0 - std::uint64_t(dividends[i]))
+                                       : dividends[i] / divisors[i];
+            }
+            return array_result(std::move(out));
+        }
+
+        template <typename T, simd_kernels::compare<T> simd_kernels::*kernel, bool swapped>
+        value_slot compare(const host_function& self, value_slot* args)
+        {
+            auto l = array::share(args[swapped ? 1 : 0].as_array());
+            auto r = array::share(args[swapped ? 0 : 1].as_array());
+            check_lengths(l, r);
+
+            array out(self.result_type(), l.size());
+            (get_simd_kernels().*kernel)(elements<T>(l).data(), elements<T>(r).data(),
+                                         out.bool_words().data(), l.size());
+            return array_result(std::move(out));
+        }
+
+        template <typename T, simd_kernels::reduce<T> simd_kernels::*kernel, bool needs_elements>
+        value_slot reduce(const host_function& self, value_slot* args)
+        {
+            auto in = array::share(args[0].as_array());
+            if (needs_elements && in.empty())
+                throw std::invalid_argument(self.name() + " of an empty array");
+
+            value_slot result;
+            set_result(result, (get_simd_kernels().*kernel)(elements<T>(in).data(), in.size()));
+            return result;
+        }
+
+        template <typename T, simd_kernels::dot_product<T> simd_kernels::*kernel>
+        value_slot dot(const host_function&, value_slot* args)
+        {
+            auto l = array::share(args[0].as_array());
+            auto r = array::share(args[1].as_array());
+            check_lengths(l, r);
+
+            value_slot result;
+            set_result(result, (get_simd_kernels().*kernel)(elements<T>(l).data(),
+                                                            elements<T>(r).data(), l.size()));
+            return result;
+        }
+
+        template <typename T>
+        value_slot prefix_sum(const host_function& self, value_slot* args)
+        {
+            auto in = array::share(args[0].as_array());
+            array out(self.result_type(), in.size());
+            if constexpr (std::is_same_v<T, std::int64_t>)
+                prefix_sum_int(in.ints().data(), out.ints().data(), in.size());
+            else
+                prefix_sum_real(in.reals().data(), out.reals().data(), in.size());
+            return array_result(std::move(out));
+        }
+
+        template <typename T>
+        value_slot filter(const host_function& self, value_slot* args)
+        {
+            auto in = array::share(args[0].as_array());
+            const auto mask = array::share(args[1].as_array());
+            check_lengths(in, mask);
+
+            std::vector<std::uint64_t> copied;
+            auto words = mask.bool_words();
+            if (words.empty() && !mask.empty())
+            {
+                copied = mask_words(mask);
+                words = copied;
+            }
+
+            array out(self.result_type(), in.size());
+            const auto* from = reinterpret_cast<const std::uint64_t*>(elements<T>(in).data());
+            auto* to = reinterpret_cast<std::uint64_t*>(elements<T>(out).data());
+            out.resize(get_simd_kernels().filter(from, words.data(), in.size(), to));
+            return array_result(std::move(out));
+        }
+
+        // The `int` and `real` variants of a builtin, and the types they are declared with
+        struct builtin
+        {
+            const char* name;
+            host_function::entry_point int_entry;
+            host_function::entry_point real_entry;
+            // Elementwise functions return arrays, others the element
+            bool returns_array;
+            // Comparisons return `bool` arrays
+            bool returns_mask;
+            std::size_t arity;
+            // The second parameter is a `bool` array
+            bool takes_mask;
+        };
+
+        // clang-format off
+        const builtin builtins[] = {
+            {"add", binary<std::int64_t, &simd_kernels::add_int>, binary<double, &simd_kernels::add_real>, true, false, 2, false},
+            {"sub", binary<std::int64_t, &simd_kernels::sub_int>, binary<double, &simd_kernels::sub_real>, true, false, 2, false},
+            {"mul", binary<std::int64_t, &simd_kernels::mul_int>, binary<double, &simd_kernels::mul_real>, true, false, 2, false},
+            {"div", div_int, binary<double, &simd_kernels::div_real>, true, false, 2, false},
+            {"equal", compare<std::int64_t, &simd_kernels::equal_int, false>, compare<double, &simd_kernels::equal_real, false>, true, true, 2, false},
+            {"not_equal", compare<std::int64_t, &simd_kernels::not_equal_int, false>, compare<double, &simd_kernels::not_equal_real, false>, true, true, 2, false},
+            {"less", compare<std::int64_t, &simd_kernels::less_int, false>, compare<double, &simd_kernels::less_real, false>, true, true, 2, false},
+            {"less_equal", compare<std::int64_t, &simd_kernels::less_equal_int, false>, compare<double, &simd_kernels::less_equal_real, false>, true, true, 2, false},
+            {"greater", compare<std::int64_t, &simd_kernels::less_int, true>, compare<double, &simd_kernels::less_real, true>, true, true, 2, false},
+            {"greater_equal", compare<std::int64_t, &simd_kernels::less_equal_int, true>, compare<double, &simd_kernels::less_equal_real, true>, true, true, 2, false},
+            {"sum", reduce<std::int64_t, &simd_kernels::sum_int, false>, reduce<double, &simd_kernels::sum_real, false>, false, false, 1, false},
+            {"min", reduce<std::int64_t, &simd_kernels::min_int, true>, reduce<double, &simd_kernels::min_real, true>, false, false, 1, false},
+            {"max", reduce<std::int64_t, &simd_kernels::max_int, true>, reduce<double, &simd_kernels::max_real, true>, false, false, 1, false},
+            {"dot", dot<std::int64_t, &simd_kernels::dot_int>, dot<double, &simd_kernels::dot_real>, false, false, 2, false},
+            {"prefix_sum", prefix_sum<std::int64_t>, prefix_sum<double>, true, false, 1, false},
+            {"filter", filter<std::int64_t>, filter<double>, true, false, 2, true},
+        };
+        // clang-format on
+    } // namespace
+
+    void declare_array_builtins(compile_context& context)
+    {
+        const auto int_type = type_registry::get_int_handle();
+        const auto bool_array = context.get_type_handle(array_type{type_registry::get_bool_handle()});
+
+        for (const auto element : {int_type, type_registry::get_real_handle()})
+        {
+            const auto is_int = element == int_type;
+            const auto element_array = context.get_type_handle(array_type{element});
+
+            for (const auto& b : builtins)
+            {
+                function_type fn{b.returns_mask    ? bool_array
+                                 : b.returns_array ? element_array
+                                                   : element,
+                                 {{element_array, false}}};
+                if (b.arity == 2)
+                    fn.param_type_id.push_back({b.takes_mask ? bool_array : element_array, false});
+
+                auto name = std::string(b.name) + (is_int ? "_int" : "_real");
+                context.create_function(host_function(std::move(name), context.get_type_handle(fn),
+                                                      is_int ? b.int_entry : b.real_entry));
+            }
+        }
+    }
+} // namespace tone::core
\ No newline at end of file
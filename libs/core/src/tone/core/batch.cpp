@@ -0,0 +1,647 @@
+#include "tone/core/batch.hpp"
+#include "tone/core/conversion_rules.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/simd_kernels.hpp"
+#include "tone/core/variant_helpers.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+namespace tone::core {
+    namespace {
+        // Rows per block: a multiple of 64 so masks fill whole words, and few enough that the
+        // temps of a block stay in cache between operations
+        constexpr std::size_t block_rows = 1024;
+
+        bool is_int(type_handle type_id)
+        {
+            return type_id == type_registry::get_int_handle();
+        }
+        bool is_real(type_handle type_id)
+        {
+            return type_id == type_registry::get_real_handle();
+        }
+        bool is_bool(type_handle type_id)
+        {
+            return type_id == type_registry::get_bool_handle();
+        }
+
+        error unsupported(const node& n)
+        {
+            return compiler_error("Expression can't be evaluated in batches", n.line_number(),
+                                  n.char_index());
+        }
+
+        std::size_t mask_words(std::size_t count)
+        {
+            return (count + 63) / 64;
+        }
+
+        bool mask_bit(const std::uint64_t* mask, std::size_t i)
+        {
+            return (mask[i / 64] >> (i % 64)) & 1;
+        }
+
+        // Sets bit `i` of `mask` to `pred(i)` for the first `count` bits
+        template <typename Pred>
+        void fill_mask(std::uint64_t* mask, std::size_t count, Pred pred)
+        {
+            for (std::size_t base = 0; base < count; base += 64)
+            {
+                const auto end = std::min<std::size_t>(64, count - base);
+                std::uint64_t bits = 0;
+                for (std::size_t i = 0; i < end; ++i)
+                    bits |= std::uint64_t(pred(base + i)) << i;
+                mask[base / 64] = bits;
+            }
+        }
+
+        template <typename T, typename U, typename Op>
+        void transform(void* out, const void* l, const void* r, std::size_t count, Op op)
+        {
+            auto* o = static_cast<T*>(out);
+            const auto* a = static_cast<const U*>(l);
+            const auto* b = static_cast<const U*>(r);
+            for (std::size_t i = 0; i < count; ++i)
+                o[i] = op(a[i], b[i]);
+        }
+
+        template <typename Op>
+        void transform_mask(void* out, const void* l, const void* r, std::size_t count, Op op)
+        {
+            transform<std::uint64_t, std::uint64_t>(out, l, r, mask_words(count), op);
+        }
+    } // namespace
+
+    enum class batch_expression::op_code : std::uint8_t
+    {
+        pack_bool,
+
+        int_to_real,
+        int_to_bool,
+        real_to_int,
+        real_to_bool,
+        bool_to_int,
+        bool_to_real,
+
+        add_int,
+        sub_int,
+        mul_int,
+        div_int,
+        mod_int,
+        neg_int,
+        bitwise_not,
+        bitwise_and,
+        bitwise_or,
+        bitwise_xor,
+        shift_l,
+        shift_r,
+
+        add_real,
+        sub_real,
+        mul_real,
+        div_real,
+        mod_real,
+        neg_real,
+
+        // `greater` and `greater_equal` swap the operands of `less` and `less_equal`
+        equal_int,
+        not_equal_int,
+        less_int,
+        less_equal_int,
+        equal_real,
+        not_equal_real,
+        less_real,
+        less_equal_real,
+
+        logical_not,
+        logical_and,
+        logical_or,
+    };
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// Planning
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    batch_expression::batch_expression(const node& root)
+        : _result_type(root.get_type_id())
+    {
+        const auto result = plan(root);
+        _result = result.where;
+    }
+
+    batch_expression::planned batch_expression::plan(const node& n)
+    {
+        if (n.is_identifier())
+            return plan_identifier(n);
+        if (!n.is_node_operation())
+            return plan_literal(n);
+
+        const auto type_id = n.get_type_id();
+        if (!is_int(type_id) && !is_real(type_id) && !is_bool(type_id))
+            throw unsupported(n);
+
+        const auto& children = n.get_children();
+        const auto int_type = type_registry::get_int_handle();
+        const auto real_type = type_registry::get_real_handle();
+        const auto bool_type = type_registry::get_bool_handle();
+        const bool real = is_real(type_id);
+
+        switch (const auto op = std::get<node_operation>(n.get_value()))
+        {
+        case node_operation::param:
+        case node_operation::unary_plus:
+            return plan(*children[0]);
+
+        case node_operation::unary_minus: {
+            const auto value = plan_converted(*children[0], type_id);
+            return emit(real ? op_code::neg_real : op_code::neg_int, n, value, value, type_id);
+        }
+        case node_operation::bitwise_not: {
+            const auto value = plan_converted(*children[0], int_type);
+            return emit(op_code::bitwise_not, n, value, value, type_id);
+        }
+        case node_operation::logical_not: {
+            const auto value = plan_converted(*children[0], bool_type);
+            return emit(op_code::logical_not, n, value, value, type_id);
+        }
+
+        case node_operation::add:
+            return plan_binary(n, type_id, type_id, real ? op_code::add_real : op_code::add_int);
+        case node_operation::sub:
+            return plan_binary(n, type_id, type_id, real ? op_code::sub_real : op_code::sub_int);
+        case node_operation::mul:
+            return plan_binary(n, type_id, type_id, real ? op_code::mul_real : op_code::mul_int);
+        case node_operation::div:
+            return plan_binary(n, type_id, type_id, real ? op_code::div_real : op_code::div_int);
+        case node_operation::mod:
+            return plan_binary(n, type_id, type_id, real ? op_code::mod_real : op_code::mod_int);
+        case node_operation::bitwise_and:
+            return plan_binary(n, int_type, type_id, op_code::bitwise_and);
+        case node_operation::bitwise_or:
+            return plan_binary(n, int_type, type_id, op_code::bitwise_or);
+        case node_operation::bitwise_xor:
+            return plan_binary(n, int_type, type_id, op_code::bitwise_xor);
+        case node_operation::shift_l:
+            return plan_binary(n, int_type, type_id, op_code::shift_l);
+        case node_operation::shift_r:
+            return plan_binary(n, int_type, type_id, op_code::shift_r);
+
+        case node_operation::equal:
+        case node_operation::not_equal:
+        case node_operation::less:
+        case node_operation::greater:
+        case node_operation::less_equal:
+        case node_operation::greater_equal: {
+            // Compared as reals when either side is one, as ints otherwise
+            const bool real_operands =
+                    is_real(children[0]->get_type_id()) || is_real(children[1]->get_type_id());
+            const auto operand_type = real_operands ? real_type : int_type;
+            const auto lhs = plan_converted(*children[0], operand_type);
+            const auto rhs = plan_converted(*children[1], operand_type);
+
+            op_code code;
+            bool swap = false;
+            switch (op)
+            {
+            case node_operation::equal:
+                code = real_operands ? op_code::equal_real : op_code::equal_int;
+                break;
+            case node_operation::not_equal:
+                code = real_operands ? op_code::not_equal_real : op_code::not_equal_int;
+                break;
+            case node_operation::less:
+            case node_operation::greater:
+                code = real_operands ? op_code::less_real : op_code::less_int;
+                swap = op == node_operation::greater;
+                break;
+            default:
+                code = real_operands ? op_code::less_equal_real : op_code::less_equal_int;
+                swap = op == node_operation::greater_equal;
+                break;
+            }
+            return swap ? emit(code, n, rhs, lhs, type_id) : emit(code, n, lhs, rhs, type_id);
+        }
+
+        // Both sides are free of side effects, so there is nothing to short-circuit
+        case node_operation::logical_and:
+            return plan_binary(n, bool_type, type_id, op_code::logical_and);
+        case node_operation::logical_or:
+            return plan_binary(n, bool_type, type_id, op_code::logical_or);
+
+        case node_operation::comma:
+            // Only the last operand is evaluated, but all of them have to be supported
+            for (std::size_t i = 0; i + 1 < children.size(); ++i)
+            {
+                const auto mark = _steps.size();
+                release(plan(*children[i]));
+                _steps.resize(mark);
+            }
+            return plan(*children.back());
+
+        default:
+            throw unsupported(n);
+        }
+    }
+
+    batch_expression::planned batch_expression::plan_converted(const node& n, type_handle type_id)
+    {
+        const auto value = plan(n);
+        const auto from = value.type_id;
+        if (from == type_id)
+            return value;
+
+        op_code code;
+        if (is_int(from) && is_real(type_id))
+            code = op_code::int_to_real;
+        else if (is_int(from) && is_bool(type_id))
+            code = op_code::int_to_bool;
+        else if (is_real(from) && is_int(type_id))
+            code = op_code::real_to_int;
+        else if (is_real(from) && is_bool(type_id))
+            code = op_code::real_to_bool;
+        else if (is_bool(from) && is_int(type_id))
+            code = op_code::bool_to_int;
+        else if (is_bool(from) && is_real(type_id))
+            code = op_code::bool_to_real;
+        else
+            throw unsupported(n);
+        return emit(code, n, value, value, type_id);
+    }
+
+    batch_expression::planned batch_expression::plan_identifier(const node& n)
+    {
+        const auto type_id = n.get_type_id();
+        if (!is_int(type_id) && !is_real(type_id) && !is_bool(type_id))
+            throw unsupported(n);
+
+        const auto& name = std::get<identifier>(n.get_value()).name;
+        const auto it = std::find_if(_inputs.begin(), _inputs.end(), [&](const auto& input) {
+            return input.first == name;
+        });
+        const auto index = std::uint32_t(it - _inputs.begin());
+        if (it == _inputs.end())
+            _inputs.emplace_back(name, type_id);
+
+        const planned input{{true, index}, type_id};
+        // Operations take `bool`s as masks, while columns hold them one to a byte
+        if (is_bool(type_id))
+            return emit(op_code::pack_bool, n, input, input, type_id);
+        return input;
+    }
+
+    batch_expression::planned batch_expression::plan_literal(const node& n)
+    {
+        const auto& value = n.get_value();
+        std::uint64_t bits;
+        if (const auto* i = std::get_if<std::int64_t>(&value))
+            bits = std::uint64_t(*i);
+        else if (const auto* d = std::get_if<double>(&value))
+            bits = std::bit_cast<std::uint64_t>(*d);
+        else if (const auto* b = std::get_if<bool>(&value))
+            bits = *b ? ~std::uint64_t(0) : 0;
+        else
+            throw unsupported(n);
+
+        // Constant temps are filled once and never reused
+        const auto temp = _temp_count++;
+        _constants.emplace_back(temp, bits);
+        return {{false, temp}, n.get_type_id()};
+    }
+
+    batch_expression::planned batch_expression::plan_binary(const node& n,
+                                                             type_handle operand_type,
+                                                             type_handle type_id, op_code op)
+    {
+        const auto& children = n.get_children();
+        const auto lhs = plan_converted(*children[0], operand_type);
+        const auto rhs = plan_converted(*children[1], operand_type);
+        return emit(op, n, lhs, rhs, type_id);
+    }
+
+    // The result gets a temp of its own, since a mask and the elements it was computed from
+    // don't line up in memory
+    batch_expression::planned batch_expression::emit(op_code op, const node& origin,
+                                                     const planned& lhs, const planned& rhs,
+                                                     type_handle type_id)
+    {
+        const operand dst{false, allocate_temp()};
+        _steps.push_back({op, dst, lhs.where, rhs.where, origin.line_number(),
+                          origin.char_index()});
+        release(lhs);
+        release(rhs);
+        return {dst, type_id};
+    }
+
+    std::uint32_t batch_expression::allocate_temp()
+    {
+        if (_free_temps.empty())
+            return _temp_count++;
+        const auto temp = _free_temps.back();
+        _free_temps.pop_back();
+        return temp;
+    }
+
+    void batch_expression::release(const planned& value)
+    {
+        const auto temp = value.where.index;
+        if (value.where.is_input ||
+            std::find(_free_temps.begin(), _free_temps.end(), temp) != _free_temps.end())
+            return;
+        const bool is_constant =
+                std::any_of(_constants.begin(), _constants.end(), [&](const auto& constant) {
+                    return constant.first == temp;
+                });
+        if (!is_constant)
+            _free_temps.push_back(temp);
+    }
+
+    type_handle batch_expression::result_type() const
+    {
+        return _result_type;
+    }
+
+    const std::vector<std::pair<std::string, type_handle>>& batch_expression::inputs() const
+    {
+        return _inputs;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// Evaluation
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void batch_expression::evaluate(const column_bindings& columns, std::size_t rows,
+                                    output_column out) const
+    {
+        // clang-format off
+        const bool matches = std::visit(overloaded{
+            [&](std::span<std::int64_t> o) { return is_int(_result_type) && o.size() >= rows; },
+            [&](std::span<double> o) { return is_real(_result_type) && o.size() >= rows; },
+            [&](std::span<bool> o) { return is_bool(_result_type) && o.size() >= rows; },
+        }, out);
+        // clang-format on
+        if (!matches)
+            throw std::invalid_argument("Output column doesn't fit the result");
+
+        const auto bound = bind(columns, rows);
+        auto temps = make_temps();
+        for (std::size_t first = 0; first < rows; first += block_rows)
+        {
+            const auto count = std::min(block_rows, rows - first);
+            const auto* result = run_block(bound, first, count, temps.data());
+
+            // clang-format off
+            std::visit(overloaded{
+                [&](std::span<bool> o) {
+                    const auto* mask = static_cast<const std::uint64_t*>(result);
+                    for (std::size_t i = 0; i < count; ++i)
+                        o[first + i] = mask_bit(mask, i);
+                },
+                [&](auto o) {
+                    std::memcpy(o.data() + first, result, count * sizeof(std::uint64_t));
+                },
+            }, out);
+            // clang-format on
+        }
+    }
+
+    std::size_t batch_expression::select(const column_bindings& columns, std::size_t rows,
+                                         std::span<std::uint32_t> out) const
+    {
+        if (!is_bool(_result_type))
+            throw std::invalid_argument("Only bool expressions select rows");
+        if (out.size() < rows)
+            throw std::invalid_argument("Selection doesn't have room for every row");
+        if (rows > std::size_t(std::numeric_limits<std::uint32_t>::max()) + 1)
+            throw std::invalid_argument("Too many rows to select from");
+
+        const auto bound = bind(columns, rows);
+        auto temps = make_temps();
+        std::size_t selected = 0;
+        for (std::size_t first = 0; first < rows; first += block_rows)
+        {
+            const auto count = std::min(block_rows, rows - first);
+            const auto* mask =
+                    static_cast<const std::uint64_t*>(run_block(bound, first, count, temps.data()));
+            for (std::size_t word = 0; word < mask_words(count); ++word)
+            {
+                auto bits = mask[word];
+                if (count - word * 64 < 64)
+                    bits &= (std::uint64_t(1) << (count - word * 64)) - 1;
+                for (; bits; bits &= bits - 1)
+                    out[selected++] = std::uint32_t(first + word * 64 + std::countr_zero(bits));
+            }
+        }
+        return selected;
+    }
+
+    std::vector<const char*> batch_expression::bind(const column_bindings& columns,
+                                                    std::size_t rows) const
+    {
+        std::vector<const char*> bound;
+        bound.reserve(_inputs.size());
+        for (const auto& [name, type_id] : _inputs)
+        {
+            const auto it = columns.find(name);
+            if (it == columns.end())
+                throw std::invalid_argument(fmt::format("No column is bound to `{}`", name));
+
+            // clang-format off
+            const auto [data, size, fits] = std::visit(overloaded{
+                [&](std::span<const std::int64_t> c) {
+                    return std::tuple{reinterpret_cast<const char*>(c.data()), c.size(), is_int(type_id)};
+                },
+                [&](std::span<const double> c) {
+                    return std::tuple{reinterpret_cast<const char*>(c.data()), c.size(), is_real(type_id)};
+                },
+                [&](std::span<const bool> c) {
+                    return std::tuple{reinterpret_cast<const char*>(c.data()), c.size(), is_bool(type_id)};
+                },
+            }, it->second);
+            // clang-format on
+            if (!fits)
+                throw std::invalid_argument(
+                        fmt::format("Column `{}` should hold {}", name, dump_type_handle(type_id)));
+            if (size < rows)
+                throw std::invalid_argument(fmt::format("Column `{}` is too short", name));
+            bound.push_back(data);
+        }
+        return bound;
+    }
+
+    std::vector<std::uint64_t> batch_expression::make_temps() const
+    {
+        std::vector<std::uint64_t> temps(_temp_count * block_rows);
+        for (const auto& [temp, bits] : _constants)
+            std::fill_n(temps.data() + temp * block_rows, block_rows, bits);
+        return temps;
+    }
+
+    const void* batch_expression::run_block(const std::vector<const char*>& bound,
+                                            std::size_t first, std::size_t count,
+                                            std::uint64_t* temps) const
+    {
+        const auto& kernels = get_simd_kernels();
+        const auto address = [&](const operand& o) -> void* {
+            if (!o.is_input)
+                return temps + o.index * block_rows;
+            const auto width = is_bool(_inputs[o.index].second) ? sizeof(bool)
+                                                                : sizeof(std::uint64_t);
+            return const_cast<char*>(bound[o.index] + first * width);
+        };
+
+        for (const auto& s : _steps)
+        {
+            auto* d = address(s.dst);
+            const auto* l = address(s.lhs);
+            const auto* r = address(s.rhs);
+            const auto* li = static_cast<const std::int64_t*>(l);
+            const auto* ri = static_cast<const std::int64_t*>(r);
+            const auto* lr = static_cast<const double*>(l);
+            const auto* rr = static_cast<const double*>(r);
+            auto* di = static_cast<std::int64_t*>(d);
+            auto* dr = static_cast<double*>(d);
+            auto* mask = static_cast<std::uint64_t*>(d);
+            const auto* lm = static_cast<const std::uint64_t*>(l);
+
+            // clang-format off
+            switch (s.op)
+            {
+            case op_code::pack_bool: {
+                const auto* bools = static_cast<const bool*>(l);
+                fill_mask(mask, count, [&](std::size_t i) { return bools[i]; });
+                break;
+            }
+
+            case op_code::int_to_real:
+                transform<double, std::int64_t>(d, l, l, count, [](auto a, auto) { return double(a); });
+                break;
+            case op_code::int_to_bool:
+                fill_mask(mask, count, [&](std::size_t i) { return li[i] != 0; });
+                break;
+            case op_code::real_to_int:
+                transform<std::int64_t, double>(d, l, l, count, [](auto a, auto) { return truncate_to_int(a); });
+                break;
+            case op_code::real_to_bool:
+                fill_mask(mask, count, [&](std::size_t i) { return lr[i] != 0.0; });
+                break;
+            case op_code::bool_to_int:
+                for (std::size_t i = 0; i < count; ++i)
+                    di[i] = mask_bit(lm, i);
+                break;
+            case op_code::bool_to_real:
+                for (std::size_t i = 0; i < count; ++i)
+                    dr[i] = mask_bit(lm, i);
+                break;
+
+            case op_code::add_int:
+                kernels.add_int(li, ri, di, count);
+                break;
+            case op_code::sub_int:
+                kernels.sub_int(li, ri, di, count);
+                break;
+            case op_code::mul_int:
+                kernels.mul_int(li, ri, di, count);
+                break;
+            case op_code::div_int:
+            case op_code::mod_int: {
+                const bool is_div = s.op == op_code::div_int;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    if (ri[i] == 0)
+                        throw runtime_error("Division by zero", s.line_number, s.char_index);
+                    if (ri[i] == -1)
+                        di[i] = is_div ? std::int64_t(0 - std::uint64_t(li[i])) : 0;
+                    else
+                        di[i] = is_div ? li[i] / ri[i] : li[i] % ri[i];
+                }
+                break;
+            }
+            case op_code::neg_int:
+                transform<std::int64_t, std::int64_t>(d, l, l, count, [](auto a, auto) { return std::int64_t(0 - std::uint64_t(a)); });
+                break;
+            case op_code::bitwise_not:
+                transform<std::int64_t, std::int64_t>(d, l, l, count, [](auto a, auto) { return ~a; });
+                break;
+            case op_code::bitwise_and:
+                transform<std::int64_t, std::int64_t>(d, l, r, count, [](auto a, auto b) { return a & b; });
+                break;
+            case op_code::bitwise_or:
+                transform<std::int64_t, std::int64_t>(d, l, r, count, [](auto a, auto b) { return a | b; });
+                break;
+            case op_code::bitwise_xor:
+                transform<std::int64_t, std::int64_t>(d, l, r, count, [](auto a, auto b) { return a ^ b; });
+                break;
+            case op_code::shift_l:
+                transform<std::int64_t, std::int64_t>(d, l, r, count, [](auto a, auto b) { return std::int64_t(std::uint64_t(a) << (b & 63)); });
+                break;
+            case op_code::shift_r:
+                transform<std::int64_t, std::int64_t>(d, l, r, count, [](auto a, auto b) { return a >> (b & 63); });
+                break;
+
+            case op_code::add_real:
+                kernels.add_real(lr, rr, dr, count);
+                break;
+            case op_code::sub_real:
+                kernels.sub_real(lr, rr, dr, count);
+                break;
+            case op_code::mul_real:
+                kernels.mul_real(lr, rr, dr, count);
+                break;
+            case op_code::div_real:
+                kernels.div_real(lr, rr, dr, count);
+                break;
+            case op_code::mod_real:
+                transform<double, double>(d, l, r, count, [](auto a, auto b) { return std::fmod(a, b); });
+                break;
+            case op_code::neg_real:
+                transform<double, double>(d, l, l, count, [](auto a, auto) { return -a; });
+                break;
+
+            case op_code::equal_int:
+                kernels.equal_int(li, ri, mask, count);
+                break;
+            case op_code::not_equal_int:
+                kernels.not_equal_int(li, ri, mask, count);
+                break;
+            case op_code::less_int:
+                kernels.less_int(li, ri, mask, count);
+                break;
+            case op_code::less_equal_int:
+                kernels.less_equal_int(li, ri, mask, count);
+                break;
+            case op_code::equal_real:
+                kernels.equal_real(lr, rr, mask, count);
+                break;
+            case op_code::not_equal_real:
+                kernels.not_equal_real(lr, rr, mask, count);
+                break;
+            case op_code::less_real:
+                kernels.less_real(lr, rr, mask, count);
+                break;
+            case op_code::less_equal_real:
+                kernels.less_equal_real(lr, rr, mask, count);
+                break;
+
+            case op_code::logical_not:
+                transform_mask(d, l, l, count, [](auto a, auto) { return ~a; });
+                break;
+            case op_code::logical_and:
+                transform_mask(d, l, r, count, [](auto a, auto b) { return a & b; });
+                break;
+            case op_code::logical_or:
+                transform_mask(d, l, r, count, [](auto a, auto b) { return a | b; });
+                break;
+            }
+            // clang-format on
+        }
+        return address(_result);
+    }
+} // namespace tone::core
\ No newline at end of file
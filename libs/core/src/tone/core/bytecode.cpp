@@ -0,0 +1,249 @@
+#include "tone/core/bytecode.hpp"
+#include "tone/core/lookup.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <string_view>
+
+namespace tone::core {
+    namespace {
+        const lookup<opcode, opcode_info> opcode_info_map{
+                // Control flow
+                {opcode::ret, {"ret", "r"}},
+                {opcode::jump, {"jump", "j"}},
+                {opcode::jump_if_false, {"jump_if_false", "rj"}},
+                {opcode::jump_if_true, {"jump_if_true", "rj"}},
+
+                // Data movement
+                {opcode::load_const, {"load_const", "dk"}},
+                {opcode::move, {"move", "dr"}},
+                {opcode::load_global, {"load_global", "dg"}},
+                {opcode::store_global, {"store_global", "gr"}},
+                {opcode::load_const_str, {"load_const_str", "dk"}},
+                {opcode::move_str, {"move_str", "dr"}},
+                {opcode::load_global_str, {"load_global_str", "dg"}},
+                {opcode::store_global_str, {"store_global_str", "gr"}},
+                {opcode::move_array, {"move_array", "dr"}},
+                {opcode::load_global_array, {"load_global_array", "dg"}},
+                {opcode::store_global_array, {"store_global_array", "gr"}},
+
+                // Conversions
+                {opcode::int_to_real, {"int_to_real", "dr"}},
+                {opcode::int_to_bool, {"int_to_bool", "dr"}},
+                {opcode::int_to_str, {"int_to_str", "dr"}},
+                {opcode::real_to_int, {"real_to_int", "dr"}},
+                {opcode::real_to_bool, {"real_to_bool", "dr"}},
+                {opcode::real_to_str, {"real_to_str", "dr"}},
+
+                // Integer arithmetic
+                {opcode::add_int, {"add_int", "drr"}},
+                {opcode::sub_int, {"sub_int", "drr"}},
+                {opcode::mul_int, {"mul_int", "drr"}},
+                {opcode::div_int, {"div_int", "drr"}},
+                {opcode::mod_int, {"mod_int", "drr"}},
+                {opcode::neg_int, {"neg_int", "dr"}},
+                {opcode::inc_int, {"inc_int", "m"}},
+                {opcode::dec_int, {"dec_int", "m"}},
+
+                // Integer bitwise
+                {opcode::bitwise_not, {"bitwise_not", "dr"}},
+                {opcode::bitwise_and, {"bitwise_and", "drr"}},
+                {opcode::bitwise_or, {"bitwise_or", "drr"}},
+                {opcode::bitwise_xor, {"bitwise_xor", "drr"}},
+                {opcode::shift_l, {"shift_l", "drr"}},
+                {opcode::shift_r, {"shift_r", "drr"}},
+
+                // Real arithmetic
+                {opcode::add_real, {"add_real", "drr"}},
+                {opcode::sub_real, {"sub_real", "drr"}},
+                {opcode::mul_real, {"mul_real", "drr"}},
+                {opcode::div_real, {"div_real", "drr"}},
+                {opcode::mod_real, {"mod_real", "drr"}},
+                {opcode::neg_real, {"neg_real", "dr"}},
+                {opcode::inc_real, {"inc_real", "m"}},
+                {opcode::dec_real, {"dec_real", "m"}},
+
+                // String operations
+                {opcode::concat_str, {"concat_str", "drr"}},
+                {opcode::concat_n, {"concat_n", "dsn"}},
+                {opcode::append_str, {"append_str", "mr"}},
+                {opcode::append_global_str, {"append_global_str", "gr"}},
+                {opcode::index_int, {"index_int", "drr"}},
+                {opcode::index_real, {"index_real", "drr"}},
+                {opcode::index_bool, {"index_bool", "drr"}},
+                {opcode::index_str, {"index_str", "drr"}},
+                {opcode::index_array, {"index_array", "drr"}},
+                {opcode::store_index_int, {"store_index_int", "rrr"}},
+                {opcode::store_index_real, {"store_index_real", "rrr"}},
+                {opcode::store_index_bool, {"store_index_bool", "rrr"}},
+                {opcode::store_index_str, {"store_index_str", "rrr"}},
+                {opcode::store_index_array, {"store_index_array", "rrr"}},
+                {opcode::call, {"call", "dsnf"}},
+
+                // Integer comparisons
+                {opcode::equal_int, {"equal_int", "drr"}},
+                {opcode::not_equal_int, {"not_equal_int", "drr"}},
+                {opcode::less_int, {"less_int", "drr"}},
+                {opcode::greater_int, {"greater_int", "drr"}},
+                {opcode::less_equal_int, {"less_equal_int", "drr"}},
+                {opcode::greater_equal_int, {"greater_equal_int", "drr"}},
+
+                // Real comparisons
+                {opcode::equal_real, {"equal_real", "drr"}},
+                {opcode::not_equal_real, {"not_equal_real", "drr"}},
+                {opcode::less_real, {"less_real", "drr"}},
+                {opcode::greater_real, {"greater_real", "drr"}},
+                {opcode::less_equal_real, {"less_equal_real", "drr"}},
+                {opcode::greater_equal_real, {"greater_equal_real", "drr"}},
+
+                // Logical operations
+                {opcode::logical_not, {"logical_not", "dr"}},
+
+                // Superinstructions - arithmetic with a constant operand
+                {opcode::add_int_k, {"add_int_k", "drk"}},
+                {opcode::sub_int_k, {"sub_int_k", "drk"}},
+                {opcode::mul_int_k, {"mul_int_k", "drk"}},
+                {opcode::div_int_k, {"div_int_k", "drk"}},
+                {opcode::mod_int_k, {"mod_int_k", "drk"}},
+                {opcode::add_real_k, {"add_real_k", "drk"}},
+                {opcode::sub_real_k, {"sub_real_k", "drk"}},
+                {opcode::mul_real_k, {"mul_real_k", "drk"}},
+                {opcode::div_real_k, {"div_real_k", "drk"}},
+                {opcode::mod_real_k, {"mod_real_k", "drk"}},
+
+                // Superinstructions - comparison with a constant operand
+                {opcode::equal_int_k, {"equal_int_k", "drk"}},
+                {opcode::not_equal_int_k, {"not_equal_int_k", "drk"}},
+                {opcode::less_int_k, {"less_int_k", "drk"}},
+                {opcode::greater_int_k, {"greater_int_k", "drk"}},
+                {opcode::less_equal_int_k, {"less_equal_int_k", "drk"}},
+                {opcode::greater_equal_int_k, {"greater_equal_int_k", "drk"}},
+                {opcode::equal_real_k, {"equal_real_k", "drk"}},
+                {opcode::not_equal_real_k, {"not_equal_real_k", "drk"}},
+                {opcode::less_real_k, {"less_real_k", "drk"}},
+                {opcode::greater_real_k, {"greater_real_k", "drk"}},
+                {opcode::less_equal_real_k, {"less_equal_real_k", "drk"}},
+                {opcode::greater_equal_real_k, {"greater_equal_real_k", "drk"}},
+
+                // Superinstructions - comparison and conditional jump (wide)
+                {opcode::equal_int_branch, {"equal_int_branch", "drrjb"}},
+                {opcode::not_equal_int_branch, {"not_equal_int_branch", "drrjb"}},
+                {opcode::less_int_branch, {"less_int_branch", "drrjb"}},
+                {opcode::greater_int_branch, {"greater_int_branch", "drrjb"}},
+                {opcode::less_equal_int_branch, {"less_equal_int_branch", "drrjb"}},
+                {opcode::greater_equal_int_branch, {"greater_equal_int_branch", "drrjb"}},
+                {opcode::equal_real_branch, {"equal_real_branch", "drrjb"}},
+                {opcode::not_equal_real_branch, {"not_equal_real_branch", "drrjb"}},
+                {opcode::less_real_branch, {"less_real_branch", "drrjb"}},
+                {opcode::greater_real_branch, {"greater_real_branch", "drrjb"}},
+                {opcode::less_equal_real_branch, {"less_equal_real_branch", "drrjb"}},
+                {opcode::greater_equal_real_branch, {"greater_equal_real_branch", "drrjb"}},
+
+                // Superinstructions - comparison with a constant and conditional jump (wide)
+                {opcode::equal_int_k_branch, {"equal_int_k_branch", "drkjb"}},
+                {opcode::not_equal_int_k_branch, {"not_equal_int_k_branch", "drkjb"}},
+                {opcode::less_int_k_branch, {"less_int_k_branch", "drkjb"}},
+                {opcode::greater_int_k_branch, {"greater_int_k_branch", "drkjb"}},
+                {opcode::less_equal_int_k_branch, {"less_equal_int_k_branch", "drkjb"}},
+                {opcode::greater_equal_int_k_branch, {"greater_equal_int_k_branch", "drkjb"}},
+                {opcode::equal_real_k_branch, {"equal_real_k_branch", "drkjb"}},
+                {opcode::not_equal_real_k_branch, {"not_equal_real_k_branch", "drkjb"}},
+                {opcode::less_real_k_branch, {"less_real_k_branch", "drkjb"}},
+                {opcode::greater_real_k_branch, {"greater_real_k_branch", "drkjb"}},
+                {opcode::less_equal_real_k_branch, {"less_equal_real_k_branch", "drkjb"}},
+                {opcode::greater_equal_real_k_branch, {"greater_equal_real_k_branch", "drkjb"}},
+        };
+    } // namespace
+
+    const opcode_info& get_opcode_info(opcode op)
+    {
+        static const opcode_info invalid{"!!INVALID!!", ""};
+        auto it = opcode_info_map.find(op);
+        return it != opcode_info_map.end() ? it->second : invalid;
+    }
+
+    std::size_t instruction_width(opcode op)
+    {
+        return std::max<std::size_t>(1, (get_opcode_info(op).operands.size() + 2) / 3);
+    }
+
+    std::string dump_opcode(opcode op)
+    {
+        return std::string(get_opcode_info(op).name);
+    }
+
+    bytecode_view::bytecode_view(const bytecode& code)
+        : code(code.code)
+        , locations(code.locations)
+        , constant_slots(code.constant_slots)
+        , functions(code.functions)
+        , param_count(code.param_count)
+        , local_count(code.local_count)
+        , register_count(code.register_count)
+        , slot_types(code.slot_types)
+        , str_registers(code.str_registers)
+        , array_registers(code.array_registers)
+        , global_types(code.global_types)
+        , result_type_id(code.result_type_id)
+    {}
+
+    std::string dump_bytecode(const bytecode& code)
+    {
+        std::string s = fmt::format("params: {}, locals: {}, registers: {}, constants: {}\n",
+                                    code.param_count, code.local_count, code.register_count,
+                                    code.constants.size());
+
+        for (std::size_t ip = 0; ip < code.code.size(); ip += instruction_width(code.code[ip].op))
+        {
+            const auto& info = get_opcode_info(code.code[ip].op);
+
+            s += fmt::format("  {:04}  {:<28}", ip, info.name);
+
+            const char* sep = "";
+            std::uint16_t run_start = 0;
+            for (std::size_t i = 0; i < info.operands.size(); ++i)
+            {
+                const instruction& word = code.code[ip + i / 3];
+                const std::uint16_t operand = i % 3 == 0 ? word.a : i % 3 == 1 ? word.b : word.c;
+                switch (info.operands[i])
+                {
+                case 'd':
+                case 'r':
+                case 'm':
+                    s += fmt::format("{}r{}", sep, operand);
+                    break;
+                case 's':
+                    run_start = operand;
+                    s += fmt::format("{}r{}", sep, operand);
+                    break;
+                case 'n':
+                    // Closes the run opened by the preceding 's', which is empty for a call
+                    // without arguments
+                    if (operand != 1)
+                        s += operand ? fmt::format("..r{}", run_start + operand - 1) : " (empty)";
+                    continue;
+                case 'g':
+                    s += fmt::format("{}g{}", sep, operand);
+                    break;
+                case 'j':
+                    s += fmt::format("{}@{:04}", sep, operand);
+                    break;
+                case 'k':
+                    s += fmt::format("{}k{} ({})", sep, operand,
+                                     dump_runtime_value(code.constants[operand]));
+                    break;
+                case 'b':
+                    s += fmt::format("{}{}", sep, operand != 0);
+                    break;
+                case 'f':
+                    s += fmt::format("{}f{} ({})", sep, operand, code.functions[operand]->name());
+                    break;
+                }
+                sep = ", ";
+            }
+            s += "\n";
+        }
+        return s;
+    }
+} // namespace tone::core
\ No newline at end of file
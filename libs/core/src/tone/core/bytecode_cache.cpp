@@ -0,0 +1,109 @@
+#include "tone/core/bytecode_cache.hpp"
+
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+
+#include <fmt/format.h>
+
+#include <fstream>
+#include <random>
+
+namespace tone::core {
+    namespace {
+        // FNV-1a, which unlike `std::hash` names the same key the same in every build
+        std::uint64_t hash_key(std::string_view key)
+        {
+            std::uint64_t hash = 0xcbf29ce484222325;
+            for (const char c : key)
+            {
+                hash ^= std::uint8_t(c);
+                hash *= 0x100000001b3;
+            }
+            return hash;
+        }
+    } // namespace
+
+    bytecode_cache::bytecode_cache(compile_context& context, std::filesystem::path directory)
+        : _context(context)
+        , _directory(std::move(directory))
+    {
+        std::filesystem::create_directories(_directory);
+    }
+
+    bytecode_image bytecode_cache::get(std::string_view source,
+                                       std::span<const expression_param> params)
+    {
+        std::lock_guard lock(_mutex);
+        const auto key = make_key(source, params);
+        const auto path = _directory / fmt::format("{:016x}.tbc", hash_key(key));
+
+        try
+        {
+            auto image = bytecode_image::map_file(path.string(), _context);
+            if (image.tag() == key)
+            {
+                ++_hits;
+                return image;
+            }
+        }
+        catch (const std::exception&)
+        {
+            // Missing, cut short or of another image version: compiled again below
+        }
+
+        ++_misses;
+        const compiled_expression expression(_context, {params.begin(), params.end()}, source);
+        const auto bytes = save_bytecode_image(expression.code(), key);
+        if (!store(path, bytes))
+            ++_write_failures;
+        return bytecode_image::copy(bytes, _context);
+    }
+
+    bytecode_cache_stats bytecode_cache::stats() const
+    {
+        return {_hits.load(), _misses.load(), _write_failures.load()};
+    }
+
+    const std::filesystem::path& bytecode_cache::directory() const
+    {
+        return _directory;
+    }
+
+    std::string bytecode_cache::make_key(std::string_view source,
+                                         std::span<const expression_param> params) const
+    {
+        auto key = fmt::format("compiler {}, image {}\n", bytecode_compiler_version,
+                               bytecode_image_version);
+        key += _context.dump_globals();
+        for (const auto& param : params)
+            key += fmt::format("param {}: {}\n", param.name, dump_type_handle(param.type_id));
+        key += "source\n";
+        key += source;
+        return key;
+    }
+
+    bool bytecode_cache::store(const std::filesystem::path& path,
+                               std::span<const std::byte> bytes) const
+    {
+        // Unique among the processes sharing the directory, so no one else writes to it
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        auto temp = path;
+        temp += fmt::format(".{:016x}.tmp", random());
+
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+            if (out.flush())
+            {
+                out.close();
+                std::error_code error;
+                std::filesystem::rename(temp, path, error);
+                if (!error)
+                    return true;
+            }
+        }
+        std::error_code ignored;
+        std::filesystem::remove(temp, ignored);
+        return false;
+    }
+} // namespace tone::core
\ No newline at end of file
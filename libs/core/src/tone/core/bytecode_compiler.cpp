@@ -0,0 +1,1006 @@
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/conversion_rules.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/variant_helpers.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <span>
+
+namespace tone::core {
+    namespace {
+        struct lvalue_location
+        {
+            bool is_global;
+            // Global index or register, or for an element the register holding its array
+            std::uint16_t index;
+            type_handle type_id;
+            bool is_element = false;
+            // Register holding the element's index
+            std::uint16_t element_index = 0;
+        };
+
+        bool is_str(type_handle type_id)
+        {
+            return type_id == type_registry::get_str_handle();
+        }
+
+        bool is_array(type_handle type_id)
+        {
+            return type_id && std::holds_alternative<array_type>(*type_id);
+        }
+
+        class bytecode_compiler
+        {
+        public:
+            explicit bytecode_compiler(const compile_context& context)
+                : _context(context)
+                , _next_temp(0)
+            {}
+
+            bytecode compile(const node& root)
+            {
+                scan(root);
+
+                _code.param_count = operand(_max_param, root);
+                _code.local_count = operand(_max_local, root);
+                _code.slot_types.resize(_code.param_count + _code.local_count);
+                for (const auto& [info, type_id] : _slots)
+                    _code.slot_types[slot_register(*info)] = type_id;
+                _register_types = _code.slot_types;
+                _next_temp = _code.param_count + _code.local_count;
+                _code.register_count = _next_temp;
+
+                const auto result = compile_node(root);
+                emit(opcode::ret, result, 0, 0, root);
+                _code.result_type_id = root.get_type_id();
+
+                for (std::size_t reg = 0; reg < _register_types.size(); ++reg)
+                {
+                    if (is_str(_register_types[reg]))
+                        _code.str_registers.push_back(std::uint16_t(reg));
+                    else if (is_array(_register_types[reg]))
+                        _code.array_registers.push_back(std::uint16_t(reg));
+                }
+                build_constant_slots();
+                return std::move(_code);
+            }
+
+        private:
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Identifiers and frame layout
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            const identifier_info& resolve(const node& n) const
+            {
+                const auto& name = std::get<identifier>(n.get_value()).name;
+                if (const auto info = _context.find(name))
+                    return *info;
+                throw undeclared_error(name, n.line_number(), n.char_index());
+            }
+
+            void scan(const node& n)
+            {
+                if (n.is_identifier())
+                {
+                    const auto& info = resolve(n);
+                    if (info.is_global())
+                    {
+                        const auto idx = info.index();
+                        if (_code.global_types.size() <= idx)
+                        {
+                            _code.global_types.resize(idx + 1, nullptr);
+                            _code.global_names.resize(idx + 1);
+                        }
+                        _code.global_types[idx] = info.type_id();
+                        _code.global_names[idx] = std::get<identifier>(n.get_value()).name;
+                    }
+                    else
+                    {
+                        const auto idx = std::ptrdiff_t(info.index());
+                        if (idx < 0)
+                            _max_param = std::max(_max_param, std::size_t(-idx));
+                        else
+                            _max_local = std::max(_max_local, std::size_t(idx));
+                        _slots.emplace_back(&info, info.type_id());
+                    }
+                }
+                for (const auto& child : n.get_children())
+                    scan(*child);
+            }
+
+            // Parameters occupy the bottom of the frame in declaration order, followed by locals
+            // (whose indices start at 1), followed by temporaries.
+            std::uint16_t slot_register(const identifier_info& info) const
+            {
+                const auto idx = std::ptrdiff_t(info.index());
+                if (idx < 0)
+                    return std::uint16_t(-idx - 1);
+                return std::uint16_t(_code.param_count + idx - 1);
+            }
+
+            lvalue_location identifier_location(const node& n) const
+            {
+                const auto& info = resolve(n);
+                if (info.is_global())
+                    return {true, operand(info.index(), n), info.type_id()};
+                return {false, slot_register(info), info.type_id()};
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Emission helpers
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            static std::uint16_t operand(std::size_t value, const node& n)
+            {
+                if (value > std::numeric_limits<std::uint16_t>::max())
+                {
+                    throw compiler_error("Expression is too large to compile", n.line_number(),
+                                         n.char_index());
+                }
+                return std::uint16_t(value);
+            }
+
+            std::size_t emit(opcode op, std::uint16_t a, std::uint16_t b, std::uint16_t c,
+                             const node& n)
+            {
+                _code.code.push_back({op, a, b, c});
+                _code.locations.push_back({n.line_number(), n.char_index()});
+                return _code.code.size() - 1;
+            }
+
+            void patch_jump(std::size_t ip, const node& n)
+            {
+                auto& inst = _code.code[ip];
+                const auto target = operand(_code.code.size(), n);
+                if (inst.op == opcode::jump)
+                    inst.a = target;
+                else
+                    inst.b = target;
+            }
+
+            std::uint16_t allocate_temp(type_handle type_id, const node& n)
+            {
+                return allocate_temps(type_id, 1, n);
+            }
+
+            // Allocates `count` consecutive registers and returns the first. The VM releases
+            // strings and arrays by register, so a register that held one is never reused for
+            // another type or the other way around.
+            std::uint16_t allocate_temps(type_handle type_id, std::size_t count, const node& n)
+            {
+                const std::vector<type_handle> types(count, type_id);
+                return allocate_temps(types, n);
+            }
+
+            // As above, with one register for each of `types`
+            std::uint16_t allocate_temps(std::span<const type_handle> types, const node& n)
+            {
+                const auto compatible = [&](std::size_t reg, type_handle type_id) {
+                    return reg >= _register_types.size() ||
+                           (is_str(_register_types[reg]) == is_str(type_id) &&
+                            is_array(_register_types[reg]) == is_array(type_id));
+                };
+
+                auto first = _next_temp;
+                for (std::size_t i = 0; i < types.size(); ++i)
+                {
+                    if (!compatible(first + i, types[i]))
+                    {
+                        // Start over past the conflicting register
+                        first += i + 1;
+                        i = std::size_t(-1);
+                    }
+                }
+                const auto end = first + types.size();
+                operand(end, n);
+
+                for (std::size_t reg = _register_types.size(); reg < end; ++reg)
+                    _register_types.push_back(types[reg - first]);
+                _next_temp = end;
+                _code.register_count = std::max<std::uint16_t>(_code.register_count, _next_temp);
+                return std::uint16_t(first);
+            }
+
+            std::uint16_t add_constant(runtime_value value, const node& n)
+            {
+                const auto it = std::find(_code.constants.begin(), _code.constants.end(), value);
+                if (it != _code.constants.end())
+                    return std::uint16_t(it - _code.constants.begin());
+                _code.constants.push_back(std::move(value));
+                return operand(_code.constants.size() - 1, n);
+            }
+
+            // String constants stay owned by `constants`; their slots only borrow them
+            void build_constant_slots()
+            {
+                for (const auto& value : _code.constants)
+                {
+                    if (const auto* s = std::get_if<str>(&value))
+                    {
+                        value_slot slot{};
+                        slot.set_str(s->handle());
+                        _code.constant_slots.push_back(slot);
+                    }
+                    else
+                    {
+                        _code.constant_slots.push_back(make_slot(value));
+                    }
+                }
+            }
+
+            std::uint16_t load(lvalue_location loc, const node& n)
+            {
+                if (!loc.is_global && !loc.is_element)
+                    return loc.index;
+                const auto reg = allocate_temp(loc.type_id, n);
+                if (loc.is_element)
+                    emit(index_opcode(loc.type_id, n), reg, loc.index, loc.element_index, n);
+                else
+                    emit(load_global_opcode(loc.type_id), reg, loc.index, 0, n);
+                return reg;
+            }
+
+            void store(lvalue_location loc, std::uint16_t reg, const node& n)
+            {
+                if (loc.is_element)
+                    emit(store_index_opcode(loc.type_id, n), loc.index, loc.element_index, reg, n);
+                else if (loc.is_global)
+                    emit(store_global_opcode(loc.type_id), loc.index, reg, 0, n);
+                else if (loc.index != reg)
+                    emit(move_opcode(loc.type_id), loc.index, reg, 0, n);
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Conversions
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            std::uint16_t convert(std::uint16_t reg, type_handle from, type_handle to,
+                                  const node& n)
+            {
+                if (from == to || to == type_registry::get_void_handle())
+                    return reg;
+
+                opcode op;
+                if (from == type_registry::get_int_handle() && to == type_registry::get_real_handle())
+                    op = opcode::int_to_real;
+                else if (from == type_registry::get_int_handle() && to == type_registry::get_bool_handle())
+                    op = opcode::int_to_bool;
+                else if (from == type_registry::get_int_handle() && to == type_registry::get_str_handle())
+                    op = opcode::int_to_str;
+                else if (from == type_registry::get_real_handle() && to == type_registry::get_int_handle())
+                    op = opcode::real_to_int;
+                else if (from == type_registry::get_real_handle() && to == type_registry::get_bool_handle())
+                    op = opcode::real_to_bool;
+                else if (from == type_registry::get_real_handle() && to == type_registry::get_str_handle())
+                    op = opcode::real_to_str;
+                else
+                    throw wrong_type_error(dump_type_handle(from), dump_type_handle(to), false,
+                                           n.line_number(), n.char_index());
+
+                const auto dst = allocate_temp(to, n);
+                emit(op, dst, reg, 0, n);
+                return dst;
+            }
+
+            // Numeric literals are converted here so they stay eligible for constant operands
+            std::optional<runtime_value> convert_literal(const node& n, type_handle type_id)
+            {
+                if (n.is_identifier() || n.is_node_operation())
+                    return std::nullopt;
+
+                const auto& value = n.get_value();
+                if (const auto* i = std::get_if<std::int64_t>(&value))
+                {
+                    if (type_id == type_registry::get_real_handle())
+                        return double(*i);
+                    if (type_id == type_registry::get_bool_handle())
+                        return *i != 0;
+                }
+                else if (const auto* d = std::get_if<double>(&value))
+                {
+                    if (type_id == type_registry::get_int_handle())
+                        return truncate_to_int(*d);
+                    if (type_id == type_registry::get_bool_handle())
+                        return *d != 0.0;
+                }
+                return std::nullopt;
+            }
+
+            std::uint16_t compile_converted(const node& n, type_handle type_id)
+            {
+                if (auto value = convert_literal(n, type_id))
+                {
+                    const auto reg = allocate_temp(type_id, n);
+                    emit(opcode::load_const, reg, add_constant(std::move(*value), n), 0, n);
+                    return reg;
+                }
+
+                const auto mark = _next_temp;
+                const auto reg = compile_node(n);
+                if (n.get_type_id() == type_id || type_id == type_registry::get_void_handle())
+                    return reg;
+                // The converted value can take the place of the unconverted one
+                _next_temp = mark;
+                return convert(reg, n.get_type_id(), type_id, n);
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Expressions
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            std::uint16_t compile_node(const node& n)
+            {
+                if (n.is_identifier())
+                    return load(identifier_location(n), n);
+
+                if (!n.is_node_operation())
+                {
+                    const auto reg = allocate_temp(n.get_type_id(), n);
+                    // clang-format off
+                    const auto k = std::visit(overloaded {
+                        [&](const std::u16string& value) { return add_constant(str(value), n); },
+                        [&](std::int64_t value) { return add_constant(value, n); },
+                        [&](double value) { return add_constant(value, n); },
+                        [&](bool value) { return add_constant(value, n); },
+                        [&](const auto&) -> std::uint16_t {
+                            throw compiler_error("Invalid constant", n.line_number(), n.char_index());
+                        }
+                    }, n.get_value());
+                    // clang-format on
+                    emit(is_str(n.get_type_id()) ? opcode::load_const_str : opcode::load_const, reg,
+                         k, 0, n);
+                    return reg;
+                }
+
+                const auto& children = n.get_children();
+                const auto type_id = n.get_type_id();
+
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::param:
+                case node_operation::unary_plus:
+                    return compile_node(*children[0]);
+
+                case node_operation::pre_increment:
+                case node_operation::pre_decrement:
+                case node_operation::assign:
+                case node_operation::add_assign:
+                case node_operation::sub_assign:
+                case node_operation::mul_assign:
+                case node_operation::div_assign:
+                case node_operation::mod_assign:
+                    return load(compile_lvalue(n), n);
+
+                case node_operation::post_increment:
+                case node_operation::post_decrement:
+                    return compile_post_step(n);
+
+                case node_operation::unary_minus:
+                    return compile_unary(is_real(type_id) ? opcode::neg_real : opcode::neg_int,
+                                         *children[0], type_id, n);
+                case node_operation::bitwise_not:
+                    return compile_unary(opcode::bitwise_not, *children[0],
+                                         type_registry::get_int_handle(), n);
+                case node_operation::logical_not:
+                    return compile_unary(opcode::logical_not, *children[0],
+                                         type_registry::get_bool_handle(), n);
+
+                case node_operation::add:
+                    if (is_str(type_id))
+                        return compile_concat(n);
+                    return compile_binary(arithmetic_opcode(n, type_id), *children[0],
+                                          *children[1], type_id, n);
+                case node_operation::sub:
+                case node_operation::mul:
+                case node_operation::div:
+                case node_operation::mod:
+                case node_operation::bitwise_and:
+                case node_operation::bitwise_or:
+                case node_operation::bitwise_xor:
+                case node_operation::shift_l:
+                case node_operation::shift_r:
+                    return compile_binary(arithmetic_opcode(n, type_id), *children[0],
+                                          *children[1], type_id, n);
+
+                case node_operation::equal:
+                case node_operation::not_equal:
+                case node_operation::less:
+                case node_operation::greater:
+                case node_operation::less_equal:
+                case node_operation::greater_equal: {
+                    const auto operand_type = is_real(children[0]->get_type_id()) ||
+                                                              is_real(children[1]->get_type_id())
+                                                      ? type_registry::get_real_handle()
+                                                      : type_registry::get_int_handle();
+                    return compile_binary(comparison_opcode(n, operand_type), *children[0],
+                                          *children[1], operand_type, n);
+                }
+
+                case node_operation::logical_and:
+                case node_operation::logical_or:
+                    return compile_logical(n);
+
+                case node_operation::comma: {
+                    for (std::size_t i = 0; i + 1 < children.size(); ++i)
+                        compile_discarded(*children[i]);
+                    return compile_node(*children.back());
+                }
+
+                case node_operation::index:
+                    return load(compile_lvalue(n), n);
+                case node_operation::call:
+                    return compile_call(n);
+                }
+                throw compiler_error("Unknown operation", n.line_number(), n.char_index());
+            }
+
+            // Evaluates `n` for its side effects only
+            void compile_discarded(const node& n)
+            {
+                const auto mark = _next_temp;
+                if (n.is_lvalue() && n.is_node_operation())
+                    compile_lvalue(n);
+                else
+                    compile_node(n);
+                _next_temp = mark;
+            }
+
+            std::uint16_t compile_unary(opcode op, const node& child, type_handle operand_type,
+                                        const node& n)
+            {
+                const auto mark = _next_temp;
+                const auto src = compile_converted(child, operand_type);
+                _next_temp = mark;
+                const auto dst = allocate_temp(n.get_type_id(), n);
+                emit(op, dst, src, 0, n);
+                return dst;
+            }
+
+            std::uint16_t compile_binary(opcode op, const node& lhs, const node& rhs,
+                                         type_handle operand_type, const node& n)
+            {
+                const auto mark = _next_temp;
+                const auto l = hold(compile_converted(lhs, operand_type), operand_type, rhs, n);
+                const auto r = compile_converted(rhs, operand_type);
+                _next_temp = mark;
+                const auto dst = allocate_temp(n.get_type_id(), n);
+                emit(op, dst, l, r, n);
+                return dst;
+            }
+
+            // Flattens a chain of str additions such as `a + b + c + d` into one `concat_n`, which
+            // sizes the result once instead of allocating every intermediate string
+            std::uint16_t compile_concat(const node& n)
+            {
+                std::vector<const node*> parts;
+                collect_concat_parts(n, parts);
+                const auto str_handle = type_registry::get_str_handle();
+                if (parts.size() == 2)
+                    return compile_binary(opcode::concat_str, *parts[0], *parts[1], str_handle, n);
+
+                // The operands have to sit in consecutive registers, so each part is compiled
+                // starting at its own register and only moved there when it ends up elsewhere
+                const auto mark = _next_temp;
+                const auto first = allocate_temps(str_handle, parts.size(), n);
+                for (std::size_t i = 0; i < parts.size(); ++i)
+                {
+                    const auto target = std::uint16_t(first + i);
+                    _next_temp = target;
+                    const auto reg = compile_converted(*parts[i], str_handle);
+                    if (reg != target)
+                        emit(opcode::move_str, target, reg, 0, n);
+                }
+
+                _next_temp = mark;
+                const auto dst = allocate_temp(str_handle, n);
+                emit(opcode::concat_n, dst, first, operand(parts.size(), n), n);
+                return dst;
+            }
+
+            static void collect_concat_parts(const node& n, std::vector<const node*>& parts)
+            {
+                for (const auto& child : n.get_children())
+                {
+                    const node* part = child.get();
+                    while (part->is_node_operation() &&
+                           std::get<node_operation>(part->get_value()) == node_operation::param)
+                    {
+                        part = part->get_children()[0].get();
+                    }
+
+                    if (part->is_node_operation() && is_str(part->get_type_id()) &&
+                        std::get<node_operation>(part->get_value()) == node_operation::add)
+                    {
+                        collect_concat_parts(*part, parts);
+                    }
+                    else
+                    {
+                        parts.push_back(child.get());
+                    }
+                }
+            }
+
+            // Arguments are passed in consecutive registers, like the parts of `concat_n`
+            std::uint16_t compile_call(const node& n)
+            {
+                const auto& children = n.get_children();
+                const node* callee = children[0].get();
+                while (callee->is_node_operation() &&
+                       std::get<node_operation>(callee->get_value()) == node_operation::param)
+                {
+                    callee = callee->get_children()[0].get();
+                }
+                const host_function* fn =
+                        callee->is_identifier() ? _context.find_function(resolve(*callee)) : nullptr;
+                if (!fn)
+                {
+                    throw compiler_error("Only host functions can be called", n.line_number(),
+                                         n.char_index());
+                }
+
+                const auto& params = std::get<function_type>(*fn->type_id()).param_type_id;
+                std::vector<type_handle> types;
+                for (const auto& param : params)
+                    types.push_back(param.type_id);
+
+                // By-reference arguments are written back after the call, so their locations
+                // are worked out first and kept below the argument registers
+                std::vector<std::optional<lvalue_location>> refs(params.size());
+                for (std::size_t i = 0; i < params.size(); ++i)
+                {
+                    if (params[i].by_ref)
+                        refs[i] = compile_lvalue(*children[i + 1]);
+                }
+                const bool has_refs =
+                        std::any_of(refs.begin(), refs.end(), [](const auto& ref) { return ref; });
+
+                const auto mark = _next_temp;
+                const auto first = allocate_temps(types, n);
+                for (std::size_t i = 0; i < types.size(); ++i)
+                {
+                    const auto target = std::uint16_t(first + i);
+                    _next_temp = target;
+                    const auto reg = refs[i] ? load(*refs[i], n)
+                                             : compile_converted(*children[i + 1], types[i]);
+                    if (reg != target)
+                        emit(move_opcode(types[i]), target, reg, 0, n);
+                }
+
+                // The result can't overwrite the registers written back from
+                _next_temp = has_refs ? std::uint16_t(first + types.size()) : mark;
+                const auto dst = allocate_temp(n.get_type_id(), n);
+                emit(opcode::call, dst, first, operand(types.size(), n), n);
+                emit(opcode::call, add_function(fn, n), 0, 0, n);
+                for (std::size_t i = 0; i < refs.size(); ++i)
+                {
+                    if (refs[i])
+                        store(*refs[i], std::uint16_t(first + i), n);
+                }
+                return dst;
+            }
+
+            std::uint16_t add_function(const host_function* fn, const node& n)
+            {
+                auto& functions = _code.functions;
+                const auto it = std::find(functions.begin(), functions.end(), fn);
+                if (it != functions.end())
+                    return std::uint16_t(it - functions.begin());
+                functions.push_back(fn);
+                return operand(functions.size() - 1, n);
+            }
+
+            // A conditional jump out of a condition, and the value it leaves in the result
+            // register when taken
+            struct exit_jump
+            {
+                std::size_t ip;
+                bool value;
+            };
+
+            // Chains of `&&` and `||` are compiled as one sequence of tests. Every operand but
+            // the last jumps straight to the end when it decides the result, and `!` flips which
+            // way the test jumps instead of computing a value.
+            std::uint16_t compile_logical(const node& n)
+            {
+                const bool is_and =
+                        std::get<node_operation>(n.get_value()) == node_operation::logical_and;
+                const auto bool_handle = type_registry::get_bool_handle();
+                const auto& children = n.get_children();
+
+                const auto dst = allocate_temp(bool_handle, n);
+                // `a && b` is decided early when `a` is false, `a || b` when it's true
+                const bool decided = !is_and;
+                std::vector<exit_jump> exits;
+                compile_condition(*children[0], decided, dst, exits);
+
+                _next_temp = dst;
+                const auto r = compile_converted(*children[1], bool_handle);
+                if (dst != r)
+                    emit(opcode::move, dst, r, 0, n);
+
+                // Tests under an odd number of `!` jump holding the opposite of the result
+                std::vector<std::size_t> flipped;
+                for (const auto& exit : exits)
+                {
+                    if (exit.value == decided)
+                        patch_jump(exit.ip, n);
+                    else
+                        flipped.push_back(exit.ip);
+                }
+                if (!flipped.empty())
+                {
+                    const auto over = emit(opcode::jump, 0, 0, 0, n);
+                    for (const auto ip : flipped)
+                        patch_jump(ip, n);
+                    emit(opcode::logical_not, dst, dst, 0, n);
+                    patch_jump(over, n);
+                }
+
+                _next_temp = dst + 1;
+                return dst;
+            }
+
+            // Emits tests of `n` that jump when it is `jump_when` and fall through otherwise.
+            // Each operand tested is left in `dst`.
+            void compile_condition(const node& n, bool jump_when, std::uint16_t dst,
+                                   std::vector<exit_jump>& exits)
+            {
+                const auto& children = n.get_children();
+                const auto is = [&](node_operation op) {
+                    return n.is_node_operation() && std::get<node_operation>(n.get_value()) == op;
+                };
+                if (is(node_operation::param))
+                    return compile_condition(*children[0], jump_when, dst, exits);
+                if (is(node_operation::logical_not))
+                    return compile_condition(*children[0], !jump_when, dst, exits);
+
+                if (is(node_operation::logical_and) || is(node_operation::logical_or))
+                {
+                    // Either operand decides `a && b` being false and `a || b` being true
+                    if (is(node_operation::logical_and) != jump_when)
+                    {
+                        compile_condition(*children[0], jump_when, dst, exits);
+                        compile_condition(*children[1], jump_when, dst, exits);
+                        return;
+                    }
+
+                    // Otherwise the right operand decides, unless the left one already has
+                    std::vector<exit_jump> skips;
+                    compile_condition(*children[0], !jump_when, dst, skips);
+                    compile_condition(*children[1], jump_when, dst, exits);
+                    for (const auto& skip : skips)
+                        patch_jump(skip.ip, n);
+                    return;
+                }
+
+                _next_temp = dst;
+                const auto value = compile_converted(n, type_registry::get_bool_handle());
+                if (value != dst)
+                    emit(opcode::move, dst, value, 0, n);
+                const auto ip =
+                        emit(jump_when ? opcode::jump_if_true : opcode::jump_if_false, dst, 0, 0, n);
+                exits.push_back({ip, jump_when});
+            }
+
+            std::uint16_t compile_post_step(const node& n)
+            {
+                const bool increment =
+                        std::get<node_operation>(n.get_value()) == node_operation::post_increment;
+                const auto op = step_opcode(n.get_type_id(), increment);
+
+                const auto loc = compile_lvalue(*n.get_children()[0]);
+                if (loc.is_global || loc.is_element)
+                {
+                    const auto old_value = load(loc, n);
+                    const auto updated = allocate_temp(n.get_type_id(), n);
+                    emit(opcode::move, updated, old_value, 0, n);
+                    emit(op, updated, 0, 0, n);
+                    store(loc, updated, n);
+                    _next_temp = old_value + 1;
+                    return old_value;
+                }
+
+                const auto old_value = allocate_temp(n.get_type_id(), n);
+                emit(opcode::move, old_value, loc.index, 0, n);
+                emit(op, loc.index, 0, 0, n);
+                return old_value;
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Lvalues
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            // Operands are read left to right. A global is loaded into a temporary when it's
+            // read, but a variable is read from its own register only when the instruction using
+            // it runs, so it's copied first when what's evaluated in between may write it.
+            std::uint16_t hold(std::uint16_t reg, type_handle type_id, const node& later,
+                               const node& n)
+            {
+                if (reg >= _code.param_count + _code.local_count || !writes_variables(later))
+                    return reg;
+                const auto copy = allocate_temp(type_id, n);
+                emit(move_opcode(type_id), copy, reg, 0, n);
+                return copy;
+            }
+
+            bool writes_variables(const node& n) const
+            {
+                if (n.is_node_operation())
+                {
+                    switch (std::get<node_operation>(n.get_value()))
+                    {
+                    // Host functions write their by-reference arguments back
+                    case node_operation::call: {
+                        const node* callee = n.get_children()[0].get();
+                        while (callee->is_node_operation() &&
+                               std::get<node_operation>(callee->get_value()) ==
+                                       node_operation::param)
+                        {
+                            callee = callee->get_children()[0].get();
+                        }
+                        const auto fn = callee->is_identifier()
+                                                ? _context.find_function(resolve(*callee))
+                                                : nullptr;
+                        if (!fn)
+                            break;
+                        const auto& params = std::get<function_type>(*fn->type_id()).param_type_id;
+                        if (std::any_of(params.begin(), params.end(),
+                                        [](const auto& param) { return param.by_ref; }))
+                            return true;
+                        break;
+                    }
+                    case node_operation::pre_increment:
+                    case node_operation::pre_decrement:
+                    case node_operation::post_increment:
+                    case node_operation::post_decrement:
+                    case node_operation::assign:
+                    case node_operation::add_assign:
+                    case node_operation::sub_assign:
+                    case node_operation::mul_assign:
+                    case node_operation::div_assign:
+                    case node_operation::mod_assign:
+                        return true;
+                    default:
+                        break;
+                    }
+                }
+                const auto& children = n.get_children();
+                return std::any_of(children.begin(), children.end(), [this](const auto& child) {
+                    return writes_variables(*child);
+                });
+            }
+
+            // `s += x` appends in place while the variable holds the only reference to its
+            // string, so building one piece by piece doesn't copy it every time. The right side
+            // is evaluated first, which is only equivalent when it doesn't write variables.
+            lvalue_location compile_append(const node& n, lvalue_location loc)
+            {
+                const auto mark = _next_temp;
+                const auto value = compile_converted(*n.get_children()[1],
+                                                     type_registry::get_str_handle());
+                emit(loc.is_global ? opcode::append_global_str : opcode::append_str, loc.index,
+                     value, 0, n);
+                _next_temp = mark;
+                return loc;
+            }
+
+            lvalue_location compile_lvalue(const node& n)
+            {
+                if (n.is_identifier())
+                    return identifier_location(n);
+
+                if (n.is_node_operation())
+                {
+                    const auto& children = n.get_children();
+                    const auto type_id = n.get_type_id();
+
+                    switch (std::get<node_operation>(n.get_value()))
+                    {
+                    case node_operation::pre_increment:
+                    case node_operation::pre_decrement: {
+                        const bool increment = std::get<node_operation>(n.get_value()) ==
+                                               node_operation::pre_increment;
+                        const auto loc = compile_lvalue(*children[0]);
+                        const auto mark = _next_temp;
+                        const auto reg = load(loc, n);
+                        emit(step_opcode(type_id, increment), reg, 0, 0, n);
+                        store(loc, reg, n);
+                        _next_temp = mark;
+                        return loc;
+                    }
+                    case node_operation::assign: {
+                        const auto loc = compile_lvalue(*children[0]);
+                        const auto mark = _next_temp;
+                        store(loc, compile_converted(*children[1], type_id), n);
+                        _next_temp = mark;
+                        return loc;
+                    }
+                    case node_operation::add_assign:
+                    case node_operation::sub_assign:
+                    case node_operation::mul_assign:
+                    case node_operation::div_assign:
+                    case node_operation::mod_assign: {
+                        const auto loc = compile_lvalue(*children[0]);
+                        if (is_str(type_id) && !loc.is_element && !writes_variables(*children[1]))
+                            return compile_append(n, loc);
+                        const auto mark = _next_temp;
+                        const auto current = hold(load(loc, n), type_id, *children[1], n);
+                        const auto value = compile_converted(*children[1], type_id);
+                        emit(arithmetic_opcode(n, type_id), current, current, value, n);
+                        store(loc, current, n);
+                        _next_temp = mark;
+                        return loc;
+                    }
+                    case node_operation::comma: {
+                        for (std::size_t i = 0; i + 1 < children.size(); ++i)
+                            compile_discarded(*children[i]);
+                        return compile_lvalue(*children.back());
+                    }
+                    // Arrays are reference values, so the element can be written through a
+                    // temporary holding the array
+                    case node_operation::index: {
+                        const auto arr = hold(compile_node(*children[0]),
+                                              children[0]->get_type_id(), *children[1], n);
+                        const auto index =
+                                compile_converted(*children[1], type_registry::get_int_handle());
+                        return {false, arr, type_id, true, index};
+                    }
+                    default:
+                        break;
+                    }
+                }
+                throw compiler_error("Expression is not assignable", n.line_number(),
+                                     n.char_index());
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Opcode selection
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            static bool is_real(type_handle type_id)
+            {
+                return type_id == type_registry::get_real_handle();
+            }
+
+            static opcode move_opcode(type_handle type_id)
+            {
+                if (is_str(type_id))
+                    return opcode::move_str;
+                return is_array(type_id) ? opcode::move_array : opcode::move;
+            }
+
+            static opcode load_global_opcode(type_handle type_id)
+            {
+                if (is_str(type_id))
+                    return opcode::load_global_str;
+                return is_array(type_id) ? opcode::load_global_array : opcode::load_global;
+            }
+
+            static opcode store_global_opcode(type_handle type_id)
+            {
+                if (is_str(type_id))
+                    return opcode::store_global_str;
+                return is_array(type_id) ? opcode::store_global_array : opcode::store_global;
+            }
+
+            static opcode index_opcode(type_handle type_id, const node& n)
+            {
+                if (type_id == type_registry::get_int_handle())
+                    return opcode::index_int;
+                if (is_real(type_id))
+                    return opcode::index_real;
+                if (type_id == type_registry::get_bool_handle())
+                    return opcode::index_bool;
+                if (is_str(type_id))
+                    return opcode::index_str;
+                if (is_array(type_id))
+                    return opcode::index_array;
+                throw compiler_error("Arrays of this type are not supported", n.line_number(),
+                                     n.char_index());
+            }
+
+            static opcode store_index_opcode(type_handle type_id, const node& n)
+            {
+                switch (index_opcode(type_id, n))
+                {
+                case opcode::index_real:
+                    return opcode::store_index_real;
+                case opcode::index_bool:
+                    return opcode::store_index_bool;
+                case opcode::index_str:
+                    return opcode::store_index_str;
+                case opcode::index_array:
+                    return opcode::store_index_array;
+                default:
+                    return opcode::store_index_int;
+                }
+            }
+
+            static opcode step_opcode(type_handle type_id, bool increment)
+            {
+                if (is_real(type_id))
+                    return increment ? opcode::inc_real : opcode::dec_real;
+                return increment ? opcode::inc_int : opcode::dec_int;
+            }
+
+            static opcode arithmetic_opcode(const node& n, type_handle type_id)
+            {
+                const bool real = is_real(type_id);
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::add:
+                case node_operation::add_assign:
+                    if (type_id == type_registry::get_str_handle())
+                        return opcode::concat_str;
+                    return real ? opcode::add_real : opcode::add_int;
+                case node_operation::sub:
+                case node_operation::sub_assign:
+                    return real ? opcode::sub_real : opcode::sub_int;
+                case node_operation::mul:
+                case node_operation::mul_assign:
+                    return real ? opcode::mul_real : opcode::mul_int;
+                case node_operation::div:
+                case node_operation::div_assign:
+                    return real ? opcode::div_real : opcode::div_int;
+                case node_operation::mod:
+                case node_operation::mod_assign:
+                    return real ? opcode::mod_real : opcode::mod_int;
+                case node_operation::bitwise_and:
+                    return opcode::bitwise_and;
+                case node_operation::bitwise_or:
+                    return opcode::bitwise_or;
+                case node_operation::bitwise_xor:
+                    return opcode::bitwise_xor;
+                case node_operation::shift_l:
+                    return opcode::shift_l;
+                case node_operation::shift_r:
+                    return opcode::shift_r;
+                default:
+                    throw compiler_error("Not an arithmetic operation", n.line_number(),
+                                         n.char_index());
+                }
+            }
+
+            static opcode comparison_opcode(const node& n, type_handle operand_type)
+            {
+                const bool real = is_real(operand_type);
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::equal:
+                    return real ? opcode::equal_real : opcode::equal_int;
+                case node_operation::not_equal:
+                    return real ? opcode::not_equal_real : opcode::not_equal_int;
+                case node_operation::less:
+                    return real ? opcode::less_real : opcode::less_int;
+                case node_operation::greater:
+                    return real ? opcode::greater_real : opcode::greater_int;
+                case node_operation::less_equal:
+                    return real ? opcode::less_equal_real : opcode::less_equal_int;
+                case node_operation::greater_equal:
+                    return real ? opcode::greater_equal_real : opcode::greater_equal_int;
+                default:
+                    throw compiler_error("Not a comparison", n.line_number(), n.char_index());
+                }
+            }
+
+            const compile_context& _context;
+            bytecode _code;
+            std::size_t _next_temp;
+            std::size_t _max_param = 0;
+            std::size_t _max_local = 0;
+            std::vector<std::pair<const identifier_info*, type_handle>> _slots;
+            std::vector<type_handle> _register_types;
+        };
+    } // namespace
+
+    bytecode compile_bytecode(const compile_context& context, const node& root,
+                              const fusion_options& fusions)
+    {
+        bytecode code = bytecode_compiler(context).compile(root);
+        fuse_superinstructions(code, fusions);
+        return code;
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,834 @@
+#include "tone/core/bytecode_image.hpp"
+
+#include "tone/core/compile_context.hpp"
+#include "tone/core/variant_helpers.hpp"
+#include "tone/core/vm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace tone::core {
+    namespace {
+        // Every section is an array of one of these, starting at an offset from the start of the
+        // image aligned for its element type, so the image can be used wherever it's mapped
+        struct image_section
+        {
+            std::uint64_t offset;
+            std::uint64_t count;
+        };
+
+        constexpr std::array<char, 8> image_magic = {'T', 'O', 'N', 'E', 'B', 'C', '\r', '\n'};
+        // Reads back differently on a machine of the other byte order
+        constexpr std::uint32_t image_byte_order = 0x01020304;
+        constexpr std::uint32_t no_type = 0xffffffff;
+
+        struct image_header
+        {
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint16_t param_count;
+            std::uint16_t local_count;
+            std::uint16_t register_count;
+            std::uint16_t padding;
+            std::uint32_t result_type;
+
+            image_section types;
+            image_section params;
+            image_section code;
+            image_section locations;
+            image_section constants;
+            image_section chars;
+            image_section names;
+            image_section functions;
+            image_section slot_types;
+            image_section str_registers;
+            image_section array_registers;
+            image_section globals;
+            image_section tag;
+
+            // Of snapshots only
+            image_section declared_globals;
+            image_section global_values;
+            image_section arrays;
+            image_section words;
+            image_section elements;
+        };
+
+        enum class image_type_kind : std::uint32_t
+        {
+            primitive,
+            array,
+            function,
+        };
+
+        // Types refer to each other by their index in the type table, inner types first
+        struct image_type
+        {
+            image_type_kind kind;
+            // The `primitive_type`, the element type or the return type
+            std::uint32_t inner;
+            std::uint32_t first_param;
+            std::uint32_t param_count;
+        };
+
+        struct image_param
+        {
+            std::uint32_t type;
+            std::uint32_t by_ref;
+        };
+
+        enum class image_constant_kind : std::uint32_t
+        {
+            int_value,
+            real_value,
+            bool_value,
+            str_value,
+            // Only in snapshots, for a global never set and an array
+            none_value,
+            array_value,
+        };
+
+        struct image_constant
+        {
+            image_constant_kind kind;
+            // Characters of a str, which start at index `bits` of the chars section. An array is
+            // the one at index `bits` of the arrays section.
+            std::uint32_t size;
+            std::uint64_t bits;
+        };
+
+        // An array of a snapshot. `int` and `real` elements, and `bool` ones packed 64 to a
+        // word, start at index `first` of the words section, and others at index `first` of the
+        // elements section. Arrays only contain ones before them.
+        struct image_array
+        {
+            std::uint32_t type;
+            std::uint32_t padding;
+            std::uint64_t size;
+            std::uint64_t first;
+        };
+
+        enum image_symbol_flags : std::uint32_t
+        {
+            constant_symbol = 1,
+            host_symbol = 2,
+        };
+
+        // A host function or global, named by a range of the names section
+        struct image_symbol
+        {
+            std::uint32_t name_offset;
+            std::uint32_t name_size;
+            std::uint32_t type;
+            std::uint32_t flags;
+        };
+
+        static_assert(sizeof(source_location) == 2 * sizeof(std::uint64_t));
+
+        class image_writer
+        {
+        public:
+            image_writer(const bytecode& code, std::string_view tag)
+                : _code(code)
+                , _tag(tag)
+            {}
+
+            void add_globals(const vm& machine, const compile_context& context)
+            {
+                for (const auto& [name, info] : context.globals())
+                {
+                    std::uint32_t flags = 0;
+                    if (info->is_constant())
+                        flags |= constant_symbol;
+                    if (context.find_function(*info))
+                        flags |= host_symbol;
+                    _declared_globals.push_back(symbol(name, info->type_id(), flags));
+                }
+                for (std::size_t i = 0; i < machine.global_count(); ++i)
+                {
+                    // Host functions have a slot, but nothing is kept in it
+                    const auto type_id = machine.global_type(i);
+                    if (!type_id || std::holds_alternative<function_type>(*type_id))
+                        _global_values.push_back({image_constant_kind::none_value, 0, 0});
+                    else
+                        _global_values.push_back(value(machine.global(i)));
+                }
+            }
+
+            std::vector<std::byte> write()
+            {
+                image_header header{};
+                header.magic = image_magic;
+                header.version = bytecode_image_version;
+                header.byte_order = image_byte_order;
+                header.param_count = _code.param_count;
+                header.local_count = _code.local_count;
+                header.register_count = _code.register_count;
+                header.result_type = intern(_code.result_type_id);
+
+                std::vector<image_constant> constants;
+                for (const auto& value : _code.constants)
+                    constants.push_back(constant(value));
+                std::vector<image_symbol> functions;
+                for (const auto* fn : _code.functions)
+                    functions.push_back(symbol(fn->name(), fn->type_id()));
+                std::vector<image_symbol> globals;
+                for (std::size_t i = 0; i < _code.global_types.size(); ++i)
+                {
+                    const auto& name = i < _code.global_names.size() ? _code.global_names[i]
+                                                                     : std::string();
+                    globals.push_back(symbol(name, _code.global_types[i]));
+                }
+                std::vector<std::uint32_t> slot_types;
+                for (const auto type_id : _code.slot_types)
+                    slot_types.push_back(intern(type_id));
+
+                _bytes.resize(sizeof(image_header));
+                header.code = append(std::span(_code.code));
+                header.locations = append(std::span(_code.locations));
+                header.str_registers = append(std::span(_code.str_registers));
+                header.array_registers = append(std::span(_code.array_registers));
+                header.slot_types = append(std::span(slot_types));
+                header.constants = append(std::span(constants));
+                header.functions = append(std::span(functions));
+                header.globals = append(std::span(globals));
+                header.declared_globals = append(std::span(_declared_globals));
+                header.global_values = append(std::span(_global_values));
+                header.arrays = append(std::span(_arrays));
+                header.words = append(std::span(_words));
+                header.elements = append(std::span(_elements));
+                // Interned last, as everything above may add types
+                header.types = append(std::span(_types));
+                header.params = append(std::span(_params));
+                header.chars = append(std::span(_chars));
+                header.names = append(std::span(_names));
+                header.tag = append(std::span(_tag));
+                std::memcpy(_bytes.data(), &header, sizeof(header));
+                return std::move(_bytes);
+            }
+
+        private:
+            template <typename T>
+            image_section append(std::span<const T> values)
+            {
+                const auto offset = (_bytes.size() + alignof(std::uint64_t) - 1) /
+                                    alignof(std::uint64_t) * alignof(std::uint64_t);
+                _bytes.resize(offset + values.size_bytes());
+                if (!values.empty())
+                    std::memcpy(_bytes.data() + offset, values.data(), values.size_bytes());
+                return {offset, values.size()};
+            }
+            template <typename T>
+            image_section append(std::span<T> values)
+            {
+                return append(std::span<const T>(values));
+            }
+
+            std::uint32_t intern(type_handle type_id)
+            {
+                if (!type_id)
+                    return no_type;
+                if (const auto it = _type_indices.find(type_id); it != _type_indices.end())
+                    return it->second;
+
+                image_type entry{};
+                // clang-format off
+                std::visit(overloaded {
+                    [&](primitive_type value) {
+                        entry = {image_type_kind::primitive, std::uint32_t(value), 0, 0};
+                    },
+                    [&](const array_type& value) {
+                        entry = {image_type_kind::array, intern(value.inner_type_id), 0, 0};
+                    },
+                    [&](const function_type& value) {
+                        std::vector<image_param> params;
+                        for (const auto& param : value.param_type_id)
+                            params.push_back({intern(param.type_id), param.by_ref});
+                        entry = {image_type_kind::function, intern(value.return_type_id),
+                                 std::uint32_t(_params.size()), std::uint32_t(params.size())};
+                        _params.insert(_params.end(), params.begin(), params.end());
+                    }
+                }, *type_id);
+                // clang-format on
+
+                const auto index = std::uint32_t(_types.size());
+                _types.push_back(entry);
+                _type_indices.emplace(type_id, index);
+                return index;
+            }
+
+            image_constant constant(const runtime_value& value)
+            {
+                // clang-format off
+                return std::visit(overloaded {
+                    [](std::int64_t v) {
+                        return image_constant{image_constant_kind::int_value, 0,
+                                              std::uint64_t(v)};
+                    },
+                    [](double v) {
+                        std::uint64_t bits;
+                        std::memcpy(&bits, &v, sizeof(bits));
+                        return image_constant{image_constant_kind::real_value, 0, bits};
+                    },
+                    [](bool v) {
+                        return image_constant{image_constant_kind::bool_value, 0,
+                                              std::uint64_t(v)};
+                    },
+                    [&](const str& v) {
+                        const auto text = v.to_u16string();
+                        const image_constant result{image_constant_kind::str_value,
+                                                    std::uint32_t(text.size()),
+                                                    std::uint64_t(_chars.size())};
+                        _chars.insert(_chars.end(), text.begin(), text.end());
+                        return result;
+                    },
+                    [](const array&) -> image_constant {
+                        throw std::invalid_argument("Array constants can't be saved in an image");
+                    }
+                }, value);
+                // clang-format on
+            }
+
+            image_constant value(const runtime_value& v)
+            {
+                if (const auto* arr = std::get_if<array>(&v))
+                    return {image_constant_kind::array_value, 0, add_array(*arr)};
+                return constant(v);
+            }
+
+            std::uint64_t add_array(const array& arr)
+            {
+                if (const auto it = _array_indices.find(arr.handle()); it != _array_indices.end())
+                    return it->second;
+
+                image_array entry{intern(arr.type_id()), 0, arr.size(), 0};
+                if (arr.type_id())
+                {
+                    switch (arr.kind())
+                    {
+                    case element_kind::int_element:
+                        entry.first = _words.size();
+                        for (const auto v : arr.ints())
+                            _words.push_back(std::uint64_t(v));
+                        break;
+                    case element_kind::real_element:
+                        entry.first = _words.size();
+                        for (const auto v : arr.reals())
+                        {
+                            std::uint64_t bits;
+                            std::memcpy(&bits, &v, sizeof(bits));
+                            _words.push_back(bits);
+                        }
+                        break;
+                    case element_kind::bool_element:
+                        entry.first = _words.size();
+                        _words.resize(_words.size() + (arr.size() + 63) / 64);
+                        for (std::size_t i = 0; i < arr.size(); ++i)
+                        {
+                            _words[entry.first + i / 64] |= std::uint64_t(arr.get_bool(i))
+                                                            << i % 64;
+                        }
+                        break;
+                    default: {
+                        // Nested arrays are added first, so elements are added as a whole after
+                        std::vector<image_constant> elements;
+                        for (std::size_t i = 0; i < arr.size(); ++i)
+                        {
+                            if (arr.kind() == element_kind::str_element)
+                                elements.push_back(constant(arr.get_str(i)));
+                            else
+                                elements.push_back(value(arr.get_array(i)));
+                        }
+                        entry.first = _elements.size();
+                        _elements.insert(_elements.end(), elements.begin(), elements.end());
+                        break;
+                    }
+                    }
+                }
+
+                const auto index = std::uint64_t(_arrays.size());
+                _arrays.push_back(entry);
+                _array_indices.emplace(arr.handle(), index);
+                return index;
+            }
+
+            image_symbol symbol(const std::string& name, type_handle type_id,
+                                std::uint32_t flags = 0)
+            {
+                const image_symbol result{std::uint32_t(_names.size()),
+                                          std::uint32_t(name.size()), intern(type_id), flags};
+                _names.insert(_names.end(), name.begin(), name.end());
+                return result;
+            }
+
+            const bytecode& _code;
+            std::string_view _tag;
+            std::vector<std::byte> _bytes;
+            std::vector<image_type> _types;
+            std::vector<image_param> _params;
+            std::unordered_map<type_handle, std::uint32_t> _type_indices;
+            std::vector<char16_t> _chars;
+            std::vector<char> _names;
+
+            std::vector<image_symbol> _declared_globals;
+            std::vector<image_constant> _global_values;
+            std::vector<image_array> _arrays;
+            std::unordered_map<const void*, std::uint64_t> _array_indices;
+            std::vector<std::uint64_t> _words;
+            std::vector<image_constant> _elements;
+        };
+
+        [[noreturn]] void throw_malformed()
+        {
+            throw std::invalid_argument("Malformed bytecode image");
+        }
+
+        template <typename T>
+        std::span<const T> section(std::span<const std::byte> bytes, const image_section& s)
+        {
+            if (s.offset % alignof(T) || s.offset > bytes.size() ||
+                s.count > (bytes.size() - s.offset) / sizeof(T))
+                throw_malformed();
+            return {reinterpret_cast<const T*>(bytes.data() + s.offset), std::size_t(s.count)};
+        }
+
+        image_header read_header(std::span<const std::byte> bytes)
+        {
+            if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(std::uint64_t))
+                throw std::invalid_argument("Bytecode image isn't 8-byte aligned");
+            image_header header;
+            if (bytes.size() < sizeof(header))
+                throw_malformed();
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            if (header.magic != image_magic || header.byte_order != image_byte_order)
+                throw std::invalid_argument("Not a bytecode image for this machine");
+            if (header.version != bytecode_image_version)
+                throw std::invalid_argument("Unsupported bytecode image version");
+            return header;
+        }
+
+        std::string name_of(std::span<const char> names, const image_symbol& symbol)
+        {
+            if (symbol.name_offset > names.size() ||
+                symbol.name_size > names.size() - symbol.name_offset)
+                throw_malformed();
+            return std::string(names.data() + symbol.name_offset, symbol.name_size);
+        }
+
+        // The VM trusts code to be as the compiler emits it, so code read from a file is checked
+        // once: every opcode is known, every operand is in range of the frame and the sections
+        // loaded, and every jump lands on an instruction
+        void check_code(const bytecode_view& view)
+        {
+            const auto registers = std::size_t(view.register_count);
+            if (view.param_count > registers || view.slot_types.size() > registers)
+                throw_malformed();
+            for (const auto reg : view.str_registers)
+            {
+                if (reg >= registers)
+                    throw_malformed();
+            }
+            for (const auto reg : view.array_registers)
+            {
+                if (reg >= registers)
+                    throw_malformed();
+            }
+
+            const auto code = view.code;
+            std::vector<bool> starts(code.size() + 1);
+            std::vector<std::size_t> targets;
+            std::size_t last = 0;
+            for (std::size_t ip = 0; ip < code.size(); ip += instruction_width(code[ip].op))
+            {
+                const auto op = code[ip].op;
+                if (std::size_t(op) >= opcode_count || code.size() - ip < instruction_width(op))
+                    throw_malformed();
+                starts[ip] = true;
+                last = ip;
+
+                const auto& info = get_opcode_info(op);
+                std::size_t run_start = 0;
+                std::size_t run_size = 0;
+                for (std::size_t i = 0; i < info.operands.size(); ++i)
+                {
+                    const auto& word = code[ip + i / 3];
+                    const std::size_t operand = i % 3 == 0 ? word.a : i % 3 == 1 ? word.b : word.c;
+                    bool in_range = true;
+                    switch (info.operands[i])
+                    {
+                    case 'd':
+                    case 'r':
+                    case 'm':
+                        in_range = operand < registers;
+                        break;
+                    case 's':
+                        run_start = operand;
+                        break;
+                    case 'n':
+                        run_size = operand;
+                        in_range = run_start <= registers && operand <= registers - run_start;
+                        break;
+                    case 'k':
+                        in_range = operand < view.constant_slots.size();
+                        break;
+                    case 'g':
+                        in_range = operand < view.global_types.size();
+                        break;
+                    case 'j':
+                        targets.push_back(operand);
+                        break;
+                    case 'f': {
+                        // The arguments are the run before it, as many as the function takes
+                        in_range = operand < view.functions.size();
+                        if (in_range)
+                        {
+                            const auto type_id = view.functions[operand]->type_id();
+                            const auto fn = std::get_if<function_type>(type_id);
+                            in_range = fn && fn->param_type_id.size() == run_size;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                    }
+                    if (!in_range)
+                        throw_malformed();
+                }
+            }
+
+            // Nothing may run off the end
+            if (code.empty() || (code[last].op != opcode::ret && code[last].op != opcode::jump))
+                throw_malformed();
+            for (const auto target : targets)
+            {
+                if (target >= code.size() || !starts[target])
+                    throw_malformed();
+            }
+        }
+    } // namespace
+
+    std::vector<std::byte> save_bytecode_image(const bytecode& code, std::string_view tag)
+    {
+        return image_writer(code, tag).write();
+    }
+
+    std::vector<std::byte> save_bytecode_snapshot(const bytecode& code, const vm& machine,
+                                                  const compile_context& context,
+                                                  std::string_view tag)
+    {
+        image_writer writer(code, tag);
+        writer.add_globals(machine, context);
+        return writer.write();
+    }
+
+    bytecode_image::bytecode_image(std::span<const std::byte> bytes, compile_context& context)
+        : _bytes(bytes)
+    {
+        load(context);
+    }
+
+    bytecode_image bytecode_image::map_file(const std::string& path, compile_context& context)
+    {
+        bytecode_image image;
+        image._file = mapped_file(path);
+        image._bytes = image._file.bytes();
+        image.load(context);
+        return image;
+    }
+
+    bytecode_image bytecode_image::copy(std::span<const std::byte> bytes,
+                                        compile_context& context)
+    {
+        bytecode_image image;
+        image._buffer.resize((bytes.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+        if (!bytes.empty())
+            std::memcpy(image._buffer.data(), bytes.data(), bytes.size());
+        image._bytes = {reinterpret_cast<const std::byte*>(image._buffer.data()), bytes.size()};
+        image.load(context);
+        return image;
+    }
+
+    bytecode_image& bytecode_image::operator=(bytecode_image&& other) noexcept
+    {
+        if (this != &other)
+        {
+            // What was lent from the old bytes is copied while they're still there
+            _strs = std::move(other._strs);
+            _lent = std::move(other._lent);
+            _bytes = other._bytes;
+            _file = std::move(other._file);
+            _buffer = std::move(other._buffer);
+            _types = std::move(other._types);
+            _slot_types = std::move(other._slot_types);
+            _global_types = std::move(other._global_types);
+            _functions = std::move(other._functions);
+            _constant_slots = std::move(other._constant_slots);
+            _tag = other._tag;
+            _has_globals = other._has_globals;
+            _view = other._view;
+        }
+        return *this;
+    }
+
+    const bytecode_view& bytecode_image::view() const
+    {
+        return _view;
+    }
+
+    std::string_view bytecode_image::tag() const
+    {
+        return _tag;
+    }
+
+    void bytecode_image::load(compile_context& context)
+    {
+        const auto header = read_header(_bytes);
+        _lent = std::make_unique<view_scope>();
+
+        // Types only refer to the ones before them
+        const auto params = section<image_param>(_bytes, header.params);
+        for (const auto& entry : section<image_type>(_bytes, header.types))
+        {
+            switch (entry.kind)
+            {
+            case image_type_kind::primitive:
+                if (entry.inner > std::uint32_t(primitive_type::str))
+                    throw_malformed();
+                _types.push_back(context.get_type_handle(primitive_type(entry.inner)));
+                break;
+            case image_type_kind::array:
+                _types.push_back(context.get_type_handle(array_type{type_at(entry.inner)}));
+                break;
+            case image_type_kind::function: {
+                if (entry.first_param > params.size() ||
+                    entry.param_count > params.size() - entry.first_param)
+                    throw_malformed();
+                function_type fn{type_at(entry.inner), {}};
+                for (const auto& param : params.subspan(entry.first_param, entry.param_count))
+                    fn.param_type_id.push_back({type_at(param.type), param.by_ref != 0});
+                _types.push_back(context.get_type_handle(fn));
+                break;
+            }
+            default:
+                throw_malformed();
+            }
+        }
+
+        for (const auto index : section<std::uint32_t>(_bytes, header.slot_types))
+            _slot_types.push_back(type_at(index));
+
+        // A snapshot's globals are declared as the initialization it replaces did
+        _has_globals = header.global_values.count != 0;
+        const auto names = section<char>(_bytes, header.names);
+        const auto declared = section<image_symbol>(_bytes, header.declared_globals);
+        for (std::size_t i = 0; i < declared.size(); ++i)
+        {
+            const auto name = name_of(names, declared[i]);
+            const auto type_id = type_at(declared[i].type);
+            const auto* info = context.find(name);
+            if (!info && (declared[i].flags & host_symbol))
+                throw std::invalid_argument("Host function '" + name + "' isn't declared");
+            if (!info)
+            {
+                info = context.create_identifier(name, type_id,
+                                                 declared[i].flags & constant_symbol);
+            }
+            if (!info || !info->is_global() || info->index() != i || info->type_id() != type_id)
+                throw std::invalid_argument("Global '" + name + "' isn't declared as saved");
+        }
+
+        for (const auto& symbol : section<image_symbol>(_bytes, header.functions))
+        {
+            const auto name = name_of(names, symbol);
+            const auto* info = context.find(name);
+            const auto* fn = info ? context.find_function(*info) : nullptr;
+            if (!fn || fn->type_id() != type_at(symbol.type))
+                throw std::invalid_argument("Host function '" + name + "' isn't declared");
+            _functions.push_back(fn);
+        }
+
+        const auto globals = section<image_symbol>(_bytes, header.globals);
+        for (std::size_t i = 0; i < globals.size(); ++i)
+        {
+            const auto type_id = type_at(globals[i].type);
+            _global_types.push_back(type_id);
+            if (!type_id)
+                continue;
+            const auto name = name_of(names, globals[i]);
+            const auto* info = context.find(name);
+            if (!info || !info->is_global() || info->index() != i || info->type_id() != type_id)
+                throw std::invalid_argument("Global '" + name + "' isn't declared as compiled");
+        }
+
+        const auto chars = section<char16_t>(_bytes, header.chars);
+        for (const auto& constant : section<image_constant>(_bytes, header.constants))
+        {
+            value_slot slot{};
+            switch (constant.kind)
+            {
+            case image_constant_kind::int_value:
+                slot.set_int(std::int64_t(constant.bits));
+                break;
+            case image_constant_kind::real_value: {
+                double value;
+                std::memcpy(&value, &constant.bits, sizeof(value));
+                slot.set_real(value);
+                break;
+            }
+            case image_constant_kind::bool_value:
+                slot.set_bool(constant.bits != 0);
+                break;
+            case image_constant_kind::str_value: {
+                if (constant.bits > chars.size() || constant.size > chars.size() - constant.bits)
+                    throw_malformed();
+                _strs.push_back(_lent->view({chars.data() + constant.bits, constant.size}));
+                slot.set_str(_strs.back().handle());
+                break;
+            }
+            default:
+                throw_malformed();
+            }
+            _constant_slots.push_back(slot);
+        }
+
+        const auto tag = section<char>(_bytes, header.tag);
+        _tag = {tag.data(), tag.size()};
+
+        _view.code = section<instruction>(_bytes, header.code);
+        _view.locations = section<source_location>(_bytes, header.locations);
+        if (_view.locations.size() != _view.code.size())
+            throw_malformed();
+        _view.constant_slots = _constant_slots;
+        _view.functions = _functions;
+        _view.param_count = header.param_count;
+        _view.local_count = header.local_count;
+        _view.register_count = header.register_count;
+        _view.slot_types = _slot_types;
+        _view.str_registers = section<std::uint16_t>(_bytes, header.str_registers);
+        _view.array_registers = section<std::uint16_t>(_bytes, header.array_registers);
+        _view.global_types = _global_types;
+        _view.result_type_id = type_at(header.result_type);
+        check_code(_view);
+    }
+
+    bool bytecode_image::has_globals() const
+    {
+        return _has_globals;
+    }
+
+    void bytecode_image::restore_globals(vm& machine)
+    {
+        const auto header = read_header(_bytes);
+        const auto chars = section<char16_t>(_bytes, header.chars);
+        const auto words = section<std::uint64_t>(_bytes, header.words);
+        const auto elements = section<image_constant>(_bytes, header.elements);
+
+        const auto lend = [&](const image_constant& value) {
+            if (value.kind != image_constant_kind::str_value || value.bits > chars.size() ||
+                value.size > chars.size() - value.bits)
+                throw_malformed();
+            return _lent->view({chars.data() + value.bits, value.size});
+        };
+        const auto in_range = [](std::uint64_t first, std::uint64_t count, std::size_t size) {
+            return first <= size && count <= size - first;
+        };
+
+        std::vector<array> arrays;
+        const auto array_at = [&](const image_constant& value) {
+            if (value.kind != image_constant_kind::array_value || value.bits >= arrays.size())
+                throw_malformed();
+            return arrays[value.bits];
+        };
+        for (const auto& entry : section<image_array>(_bytes, header.arrays))
+        {
+            const auto type_id = type_at(entry.type);
+            if (!type_id)
+            {
+                arrays.emplace_back();
+                continue;
+            }
+            if (!std::holds_alternative<array_type>(*type_id))
+                throw_malformed();
+
+            const auto kind = element_kind_of(type_id);
+            const auto word_count = kind == element_kind::bool_element ? (entry.size + 63) / 64
+                                                                       : entry.size;
+            if (kind == element_kind::str_element || kind == element_kind::array_element
+                        ? !in_range(entry.first, entry.size, elements.size())
+                        : !in_range(entry.first, word_count, words.size()))
+                throw_malformed();
+
+            array arr(type_id, entry.size);
+            const auto copy_words = [&](void* target) {
+                if (word_count)
+                    std::memcpy(target, words.data() + entry.first, word_count * sizeof(words[0]));
+            };
+            switch (kind)
+            {
+            case element_kind::int_element:
+                copy_words(arr.ints().data());
+                break;
+            case element_kind::real_element:
+                copy_words(arr.reals().data());
+                break;
+            case element_kind::bool_element:
+                copy_words(arr.bool_words().data());
+                break;
+            case element_kind::str_element:
+                for (std::size_t i = 0; i < entry.size; ++i)
+                    arr.set_str(i, lend(elements[entry.first + i]));
+                break;
+            case element_kind::array_element:
+                for (std::size_t i = 0; i < entry.size; ++i)
+                    arr.set_array(i, array_at(elements[entry.first + i]));
+                break;
+            }
+            arrays.push_back(std::move(arr));
+        }
+
+        const auto values = section<image_constant>(_bytes, header.global_values);
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            const auto& value = values[i];
+            switch (value.kind)
+            {
+            case image_constant_kind::none_value:
+                break;
+            case image_constant_kind::int_value:
+                machine.set_global(i, std::int64_t(value.bits));
+                break;
+            case image_constant_kind::real_value: {
+                double real;
+                std::memcpy(&real, &value.bits, sizeof(real));
+                machine.set_global(i, real);
+                break;
+            }
+            case image_constant_kind::bool_value:
+                machine.set_global(i, value.bits != 0);
+                break;
+            case image_constant_kind::str_value:
+                machine.set_global(i, lend(value));
+                break;
+            case image_constant_kind::array_value:
+                machine.set_global(i, array_at(value));
+                break;
+            default:
+                throw_malformed();
+            }
+        }
+    }
+
+    type_handle bytecode_image::type_at(std::uint32_t index) const
+    {
+        if (index == no_type)
+            return nullptr;
+        if (index >= _types.size())
+            throw_malformed();
+        return _types[index];
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "tone/core/bytecode_library.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace tone::core {
+    namespace {
+        constexpr std::array<char, 8> library_magic = {'T', 'O', 'N', 'E', 'L', 'I', 'B', '\n'};
+        constexpr std::uint32_t library_byte_order = 0x01020304;
+
+        struct library_header
+        {
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            std::uint32_t byte_order;
+            std::uint64_t program_count;
+            // Offsets of the program table and of the names, from the start of the library
+            std::uint64_t programs_offset;
+            std::uint64_t names_offset;
+            std::uint64_t names_size;
+        };
+
+        struct library_entry
+        {
+            std::uint32_t name_offset;
+            std::uint32_t name_size;
+            // Of the program's image, which is 8-byte aligned
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        constexpr std::size_t align(std::size_t offset)
+        {
+            return (offset + alignof(std::uint64_t) - 1) / alignof(std::uint64_t) *
+                   alignof(std::uint64_t);
+        }
+
+        [[noreturn]] void throw_malformed()
+        {
+            throw std::invalid_argument("Malformed bytecode library");
+        }
+    } // namespace
+
+    std::vector<std::byte> save_bytecode_library(std::span<const library_program> programs)
+    {
+        std::vector<const library_program*> sorted;
+        for (const auto& p : programs)
+            sorted.push_back(&p);
+        std::sort(sorted.begin(), sorted.end(), [](const auto* l, const auto* r) {
+            return l->name < r->name;
+        });
+        const auto duplicate = std::adjacent_find(sorted.begin(), sorted.end(), [](auto l, auto r) {
+            return l->name == r->name;
+        });
+        if (duplicate != sorted.end())
+            throw std::invalid_argument("Program '" + (*duplicate)->name + "' saved twice");
+
+        library_header header{};
+        header.magic = library_magic;
+        header.version = bytecode_library_version;
+        header.byte_order = library_byte_order;
+        header.program_count = sorted.size();
+        header.programs_offset = align(sizeof(header));
+
+        std::string names;
+        std::vector<library_entry> entries;
+        std::vector<std::vector<std::byte>> images;
+        auto offset = header.programs_offset + sorted.size() * sizeof(library_entry);
+        for (const auto* p : sorted)
+        {
+            images.push_back(save_bytecode_image(*p->code));
+            offset = align(offset);
+            entries.push_back({std::uint32_t(names.size()), std::uint32_t(p->name.size()),
+                               offset, images.back().size()});
+            names += p->name;
+            offset += images.back().size();
+        }
+        header.names_offset = offset;
+        header.names_size = names.size();
+
+        std::vector<std::byte> bytes(offset + names.size());
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        if (!entries.empty())
+        {
+            std::memcpy(bytes.data() + header.programs_offset, entries.data(),
+                        entries.size() * sizeof(library_entry));
+        }
+        for (std::size_t i = 0; i < images.size(); ++i)
+            std::memcpy(bytes.data() + entries[i].offset, images[i].data(), images[i].size());
+        std::memcpy(bytes.data() + header.names_offset, names.data(), names.size());
+        return bytes;
+    }
+
+    bytecode_library::bytecode_library(compile_context& context, const std::string& path)
+        : _context(context)
+        , _file(path)
+    {
+        const auto bytes = _file.bytes();
+        library_header header;
+        if (bytes.size() < sizeof(header))
+            throw_malformed();
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (header.magic != library_magic || header.byte_order != library_byte_order)
+            throw std::invalid_argument("Not a bytecode library for this machine");
+        if (header.version != bytecode_library_version)
+            throw std::invalid_argument("Unsupported bytecode library version");
+        if (header.programs_offset % alignof(library_entry) ||
+            header.programs_offset > bytes.size() ||
+            header.program_count >
+                    (bytes.size() - header.programs_offset) / sizeof(library_entry) ||
+            header.names_offset > bytes.size() ||
+            header.names_size > bytes.size() - header.names_offset)
+            throw_malformed();
+
+        const std::string_view names(reinterpret_cast<const char*>(bytes.data()) +
+                                             header.names_offset,
+                                     header.names_size);
+        const auto* entries =
+                reinterpret_cast<const library_entry*>(bytes.data() + header.programs_offset);
+        for (std::size_t i = 0; i < header.program_count; ++i)
+        {
+            const auto& entry = entries[i];
+            if (entry.name_offset > names.size() ||
+                entry.name_size > names.size() - entry.name_offset ||
+                entry.offset > bytes.size() || entry.size > bytes.size() - entry.offset)
+                throw_malformed();
+            _programs.push_back({names.substr(entry.name_offset, entry.name_size),
+                                 bytes.subspan(entry.offset, entry.size), nullptr});
+        }
+        if (!std::is_sorted(_programs.begin(), _programs.end(), [](const auto& l, const auto& r) {
+                return l.name < r.name;
+            }))
+            throw_malformed();
+    }
+
+    std::vector<std::string_view> bytecode_library::names() const
+    {
+        std::vector<std::string_view> result;
+        for (const auto& p : _programs)
+            result.push_back(p.name);
+        return result;
+    }
+
+    const bytecode_view* bytecode_library::find(std::string_view name)
+    {
+        const auto it = std::lower_bound(_programs.begin(), _programs.end(), name,
+                                         [](const auto& p, std::string_view n) {
+                                             return p.name < n;
+                                         });
+        if (it == _programs.end() || it->name != name)
+            return nullptr;
+
+        std::lock_guard lock(_mutex);
+        if (!it->image)
+            it->image = std::make_unique<bytecode_image>(it->bytes, _context);
+        return &it->image->view();
+    }
+} // namespace tone::core
\ No newline at end of file
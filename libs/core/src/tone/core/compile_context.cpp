@@ -1,14 +1,36 @@
 #include "tone/core/compile_context.hpp"
 
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
 namespace tone::core {
 
     compile_context::compile_context()
-        : _params(nullptr)
+        : compile_context(std::make_shared<global_view>(), false, nullptr)
+    {
+    }
+    compile_context::compile_context(std::shared_ptr<global_view> shared, bool is_fork,
+                                     visibility visible)
+        : _shared(std::move(shared))
+        , _is_fork(is_fork)
+        , _visible(std::move(visible))
+        , _params(nullptr)
     {
     }
+    compile_context compile_context::fork() const
+    {
+        return compile_context(_shared, true, _visible);
+    }
+    compile_context compile_context::fork(visibility visible) const
+    {
+        return compile_context(_shared, true, std::move(visible));
+    }
     type_handle compile_context::get_type_handle(const type& ty)
     {
-        return _types.get_handle(ty);
+        return _shared->types.get_handle(ty);
     }
     const identifier_info* compile_context::find(const std::string& name) const
     {
@@ -17,19 +39,86 @@ namespace tone::core {
             if (const auto ident = _locals->find(name))
                 return ident;
         }
-        return _globals.find(name);
+        const auto ident = _shared->globals.find(name);
+        return ident && (!_visible || _visible(name, *ident)) ? ident : nullptr;
     }
     const identifier_info*
     compile_context::create_identifier(std::string name, type_handle type_id, bool is_constant)
     {
         if (_locals)
             return _locals->create_identifier(std::move(name), type_id, is_constant);
-        return _globals.create_identifier(std::move(name), type_id, is_constant);
+        if (_is_fork)
+            throw std::logic_error("Globals can't be declared in a fork");
+        const auto info = _shared->globals.create_identifier(std::move(name), type_id, is_constant);
+        if (info)
+            ++_shared->generation;
+        return info;
     }
     const identifier_info* compile_context::create_param(std::string name, type_handle type_id)
     {
         return _params->create_param(std::move(name), type_id);
     }
+    const identifier_info* compile_context::create_function(host_function fn)
+    {
+        if (_is_fork)
+            throw std::logic_error("Globals can't be declared in a fork");
+        const auto info = _shared->globals.create_identifier(fn.name(), fn.type_id(), true);
+        if (info)
+        {
+            _shared->functions.emplace(info, std::make_unique<host_function>(std::move(fn)));
+            ++_shared->generation;
+        }
+        return info;
+    }
+    const host_function* compile_context::find_function(const identifier_info& info) const
+    {
+        const auto it = _shared->functions.find(&info);
+        return it != _shared->functions.end() ? it->second.get() : nullptr;
+    }
+    std::unique_ptr<host_function> compile_context::redefine_function(const identifier_info& info,
+                                                                      host_function fn)
+    {
+        if (_is_fork)
+            throw std::logic_error("Globals can't be declared in a fork");
+        const auto it = _shared->functions.find(&info);
+        if (it == _shared->functions.end())
+            throw std::invalid_argument("Not a function of this context");
+        if (it->second->name() != fn.name())
+            throw std::invalid_argument("Function '" + fn.name() + "' is named differently");
+        _shared->globals.retype(fn.name(), fn.type_id());
+        ++_shared->generation;
+        return std::exchange(it->second, std::make_unique<host_function>(std::move(fn)));
+    }
+    std::uint64_t compile_context::generation() const
+    {
+        return _shared->generation.load();
+    }
+    std::shared_mutex& compile_context::declaration_mutex() const
+    {
+        return _shared->declaration_mutex;
+    }
+    std::vector<std::pair<std::string, const identifier_info*>> compile_context::globals() const
+    {
+        std::vector<std::pair<std::string, const identifier_info*>> result;
+        for (const auto& [name, info] : _shared->globals.idents())
+            result.emplace_back(name, &info);
+        std::sort(result.begin(), result.end(), [](const auto& l, const auto& r) {
+            return l.second->index() < r.second->index();
+        });
+        return result;
+    }
+    std::string compile_context::dump_globals() const
+    {
+        std::string s;
+        for (const auto& [name, info] : globals())
+        {
+            s += fmt::format("{} {}: {}{}{}\n", info->index(), name,
+                             dump_type_handle(info->type_id()),
+                             info->is_constant() ? " const" : "",
+                             find_function(*info) ? " host" : "");
+        }
+        return s;
+    }
     void compile_context::enter_scope()
     {
         _locals = std::make_unique<local_identifier_lookup>(std::move(_locals));
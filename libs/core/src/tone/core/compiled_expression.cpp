@@ -0,0 +1,113 @@
+#include "tone/core/compiled_expression.hpp"
+
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_parser.hpp"
+#include "tone/core/tokenizer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tone::core {
+    namespace {
+        // Leaves the function scope of the parameters however compiling ends
+        class function_scope
+        {
+        public:
+            explicit function_scope(compile_context& context)
+                : _context(context)
+            {
+                _context.enter_function();
+            }
+            ~function_scope()
+            {
+                _context.leave_scope();
+            }
+            function_scope(const function_scope&) = delete;
+            function_scope& operator=(const function_scope&) = delete;
+
+        private:
+            compile_context& _context;
+        };
+
+        node_ptr parse_source(compile_context& context, std::string_view source,
+                              std::size_t line_number, std::size_t char_index)
+        {
+            std::size_t pos = 0;
+            character_source_t input = [source, &pos]() -> character_t {
+                return pos < source.size() ? character_t(source[pos++]) : -1;
+            };
+            push_back_stream strm(input, line_number, char_index);
+            token_iterator it(strm);
+            auto root = parse_expression_tree(context, it, type_registry::get_void_handle(), false,
+                                              true, false);
+            if (!it->is_eof())
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            return root;
+        }
+    } // namespace
+
+    compiled_expression::compiled_expression(compile_context& context,
+                                             std::vector<expression_param> params,
+                                             std::string_view source)
+        : compiled_expression(context, std::move(params), source, 0, 0)
+    {}
+
+    compiled_expression::compiled_expression(compile_context& context,
+                                             std::vector<expression_param> params,
+                                             std::string_view source, std::size_t line_number,
+                                             std::size_t char_index)
+        : _params(std::move(params))
+    {
+        function_scope scope(context);
+        for (auto it = _params.begin(); it != _params.end(); ++it)
+        {
+            if (std::any_of(_params.begin(), it, [&](const auto& p) { return p.name == it->name; }))
+                throw std::invalid_argument("Parameter '" + it->name + "' declared twice");
+            context.create_param(it->name, it->type_id);
+        }
+        _code = compile_bytecode(context, *parse_source(context, source, line_number, char_index));
+    }
+
+    type_handle compiled_expression::result_type() const
+    {
+        return _code.result_type_id;
+    }
+
+    const std::vector<expression_param>& compiled_expression::params() const
+    {
+        return _params;
+    }
+
+    std::size_t compiled_expression::slot(std::string_view name) const
+    {
+        const auto it = std::find_if(_params.begin(), _params.end(),
+                                     [&](const auto& p) { return p.name == name; });
+        if (it == _params.end())
+            throw std::invalid_argument("No parameter '" + std::string(name) + "'");
+        return std::size_t(it - _params.begin());
+    }
+
+    const bytecode& compiled_expression::code() const
+    {
+        return _code;
+    }
+
+    void compiled_expression::shift_locations(std::ptrdiff_t lines, std::ptrdiff_t chars)
+    {
+        for (auto& location : _code.locations)
+        {
+            location.line_number += lines;
+            location.char_index += chars;
+        }
+    }
+
+    runtime_value compiled_expression::evaluate(vm& machine, std::span<const value_slot> args) const
+    {
+        if (args.size() < _params.size())
+            throw std::invalid_argument("Too few arguments");
+        return machine.run_slots(_code, args);
+    }
+} // namespace tone::core
\ No newline at end of file
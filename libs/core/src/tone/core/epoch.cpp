@@ -0,0 +1,152 @@
+#include "tone/core/epoch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace tone::core {
+    namespace {
+        // A thread that has held a guard, with the epoch it entered its outermost guard in
+        struct participant
+        {
+            // 0 while the thread holds no guard
+            std::atomic<std::uint64_t> epoch = 0;
+            bool in_use = false;
+        };
+
+        struct retired
+        {
+            std::uint64_t epoch;
+            std::shared_ptr<const void> object;
+        };
+
+        struct domain
+        {
+            std::atomic<std::uint64_t> epoch = 1;
+            std::atomic<std::size_t> pending = 0;
+            std::mutex mutex;
+            // Never freed, so threads needn't lock to publish their epoch; reused once a thread
+            // that had one exits
+            std::vector<std::unique_ptr<participant>> participants;
+            std::vector<retired> retired_objects;
+        };
+
+        domain& get_domain()
+        {
+            static domain instance;
+            return instance;
+        }
+
+        struct thread_state
+        {
+            participant* self = nullptr;
+            std::size_t depth = 0;
+
+            ~thread_state()
+            {
+                if (!self)
+                    return;
+                auto& d = get_domain();
+                std::lock_guard lock(d.mutex);
+                self->in_use = false;
+            }
+        };
+
+        thread_local thread_state current;
+
+        participant& join(domain& d)
+        {
+            std::lock_guard lock(d.mutex);
+            const auto it = std::find_if(d.participants.begin(), d.participants.end(),
+                                         [](const auto& p) { return !p->in_use; });
+            auto& p = it != d.participants.end()
+                              ? **it
+                              : *d.participants.emplace_back(std::make_unique<participant>());
+            p.in_use = true;
+            return p;
+        }
+
+        // Moves what can be dropped out of `d`, which must be locked
+        std::vector<retired> collect(domain& d)
+        {
+            // Pairs with the fence of a guard being made: either its thread loads what the
+            // writer swapped in, or its epoch is seen here
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto oldest = std::numeric_limits<std::uint64_t>::max();
+            for (const auto& p : d.participants)
+            {
+                const auto epoch = p->epoch.load();
+                if (epoch != 0)
+                    oldest = std::min(oldest, epoch);
+            }
+
+            // An object retired in epoch `e` was unreachable before the epoch moved past `e`,
+            // so only guards entered in `e` or before may hold it
+            std::vector<retired> free;
+            const auto keep = std::partition(
+                    d.retired_objects.begin(), d.retired_objects.end(),
+                    [&](const retired& r) { return r.epoch >= oldest; });
+            std::move(keep, d.retired_objects.end(), std::back_inserter(free));
+            d.retired_objects.erase(keep, d.retired_objects.end());
+            d.pending = d.retired_objects.size();
+            return free;
+        }
+    } // namespace
+
+    epoch_guard::epoch_guard()
+    {
+        if (current.depth++ > 0)
+            return;
+        auto& d = get_domain();
+        if (!current.self)
+            current.self = &join(d);
+        current.self->epoch.store(d.epoch.load());
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    epoch_guard::~epoch_guard()
+    {
+        if (--current.depth > 0)
+            return;
+        current.self->epoch.store(0, std::memory_order_release);
+
+        // Left behind by a writer that found this thread in a guard
+        auto& d = get_domain();
+        if (d.pending.load(std::memory_order_relaxed) == 0)
+            return;
+        std::vector<retired> free;
+        if (std::unique_lock lock(d.mutex, std::try_to_lock); lock)
+            free = collect(d);
+    }
+
+    void epoch_guard::retire(std::shared_ptr<const void> object)
+    {
+        if (!object)
+            return;
+        auto& d = get_domain();
+        const auto epoch = d.epoch.fetch_add(1);
+        {
+            std::lock_guard lock(d.mutex);
+            d.retired_objects.push_back({epoch, std::move(object)});
+        }
+        reclaim();
+    }
+
+    std::size_t epoch_guard::reclaim()
+    {
+        auto& d = get_domain();
+        std::vector<retired> free;
+        std::size_t left;
+        {
+            std::lock_guard lock(d.mutex);
+            free = collect(d);
+            left = d.retired_objects.size();
+        }
+        // Dropped unlocked, as a destructor may retire more
+        return left;
+    }
+} // namespace tone::core
\ No newline at end of file
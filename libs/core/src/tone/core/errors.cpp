@@ -62,6 +62,13 @@ namespace tone::core {
         return {std::move(error_message), line_number, char_index};
     }
 
+    error runtime_error(std::string_view message, size_t line_number, size_t char_index)
+    {
+        std::string error_message("Runtime error: ");
+        error_message += message;
+        return {std::move(error_message), line_number, char_index};
+    }
+
     error undeclared_error(std::string_view undeclared, size_t line_number, size_t char_index)
     {
         std::string message("Undeclared identifier '");
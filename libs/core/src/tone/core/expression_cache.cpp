@@ -0,0 +1,149 @@
+#include "tone/core/expression_cache.hpp"
+#include "tone/core/compile_context.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+namespace tone::core {
+    namespace {
+        std::size_t combine(std::size_t seed, std::size_t value)
+        {
+            return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+        }
+
+        bool same_params(std::span<const expression_param> l, std::span<const expression_param> r)
+        {
+            return std::equal(l.begin(), l.end(), r.begin(), r.end(),
+                              [](const auto& a, const auto& b) {
+                                  return a.type_id == b.type_id && a.name == b.name;
+                              });
+        }
+    } // namespace
+
+    bool expression_cache::key_equal::operator()(const key_view& l, const key_view& r) const
+    {
+        return l.hash == r.hash && l.generation == r.generation && l.source == r.source &&
+               same_params(l.params, r.params);
+    }
+
+    bool expression_cache::key_equal::operator()(const key& l, const key& r) const
+    {
+        return (*this)(key_view{l.source, l.params, l.generation, l.hash},
+                       key_view{r.source, r.params, r.generation, r.hash});
+    }
+
+    bool expression_cache::key_equal::operator()(const key_view& l, const key& r) const
+    {
+        return (*this)(l, key_view{r.source, r.params, r.generation, r.hash});
+    }
+
+    bool expression_cache::key_equal::operator()(const key& l, const key_view& r) const
+    {
+        return (*this)(key_view{l.source, l.params, l.generation, l.hash}, r);
+    }
+
+    expression_cache::expression_cache(compile_context& context,
+                                       const expression_cache_options& options)
+        : _context(context)
+        , _generation(context.generation())
+    {
+        const auto shard_count = std::max<std::size_t>(options.shard_count, 1);
+        _shard_capacity =
+                std::max<std::size_t>((options.capacity + shard_count - 1) / shard_count, 1);
+        for (std::size_t i = 0; i < shard_count; ++i)
+            _shards.push_back(std::make_unique<shard>());
+    }
+
+    std::size_t expression_cache::hash_key(std::string_view source,
+                                           std::span<const expression_param> params,
+                                           std::uint64_t generation)
+    {
+        auto h = combine(std::hash<std::string_view>()(source), std::size_t(generation));
+        for (const auto& param : params)
+        {
+            h = combine(h, std::hash<std::string_view>()(param.name));
+            h = combine(h, std::hash<type_handle>()(param.type_id));
+        }
+        return h;
+    }
+
+    std::shared_ptr<const compiled_expression> expression_cache::get(
+            std::string_view source, std::span<const expression_param> params)
+    {
+        const auto generation = _context.generation();
+        // Expressions of an older generation can't be found any more, so they're dropped rather
+        // than left to be evicted
+        if (_generation.load(std::memory_order_relaxed) != generation &&
+            _generation.exchange(generation) != generation)
+        {
+            clear();
+        }
+
+        const key_view lookup{source, params, generation, hash_key(source, params, generation)};
+        // The low bits pick the bucket within a shard, so shards are picked by the high ones
+        auto& s = *_shards[std::rotl(lookup.hash, 17) % _shards.size()];
+        {
+            std::lock_guard lock(s.mutex);
+            if (const auto it = s.entries.find(lookup); it != s.entries.end())
+            {
+                s.uses.splice(s.uses.begin(), s.uses, it->second.use);
+                s.hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.expression;
+            }
+        }
+        s.misses.fetch_add(1, std::memory_order_relaxed);
+
+        // Compiled outside the shard's lock so its hits don't wait for it
+        std::shared_ptr<const compiled_expression> expression;
+        {
+            std::lock_guard lock(_compile_mutex);
+            expression = std::make_shared<const compiled_expression>(
+                    _context, std::vector<expression_param>(params.begin(), params.end()),
+                    source);
+        }
+
+        std::lock_guard lock(s.mutex);
+        // Another thread may have compiled the same expression meanwhile
+        if (const auto it = s.entries.find(lookup); it != s.entries.end())
+            return it->second.expression;
+
+        if (s.entries.size() >= _shard_capacity)
+        {
+            s.entries.erase(*s.uses.back());
+            s.uses.pop_back();
+            s.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        key stored{std::string(source),
+                   std::vector<expression_param>(params.begin(), params.end()), generation,
+                   lookup.hash};
+        const auto it = s.entries.emplace(std::move(stored), entry{expression, {}}).first;
+        s.uses.push_front(&it->first);
+        it->second.use = s.uses.begin();
+        return expression;
+    }
+
+    expression_cache_stats expression_cache::stats() const
+    {
+        expression_cache_stats result{};
+        for (const auto& s : _shards)
+        {
+            result.hits += s->hits.load(std::memory_order_relaxed);
+            result.misses += s->misses.load(std::memory_order_relaxed);
+            result.evictions += s->evictions.load(std::memory_order_relaxed);
+            std::lock_guard lock(s->mutex);
+            result.size += s->entries.size();
+        }
+        return result;
+    }
+
+    void expression_cache::clear()
+    {
+        for (const auto& s : _shards)
+        {
+            std::lock_guard lock(s->mutex);
+            s->entries.clear();
+            s->uses.clear();
+        }
+    }
+} // namespace tone::core
\ No newline at end of file
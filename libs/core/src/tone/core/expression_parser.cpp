@@ -316,7 +316,7 @@ namespace tone::core {
                                                       it->get_char_index());
                     }
 
-                    if (!operator_stack.empty() && is_evaluated_before(operator_stack.top(), oi))
+                    while (!operator_stack.empty() && is_evaluated_before(operator_stack.top(), oi))
                     {
                         pop_one_operator(operator_stack, operand_stack, context,
                                          it->get_line_number(), it->get_char_index());
@@ -81,6 +81,14 @@ namespace tone::core {
                     _children[0]->check_conversion(int_handle, false);
                     break;
                 case node_operation::add:
+                    if (_children[0]->_type_id == str_handle)
+                    {
+                        _type_id = str_handle;
+                        _lvalue = false;
+                        _children[1]->check_conversion(str_handle, false);
+                        break;
+                    }
+                    [[fallthrough]];
                 case node_operation::sub:
                 case node_operation::mul:
                 case node_operation::div:
@@ -125,6 +133,15 @@ namespace tone::core {
                     _children[1]->check_conversion(_type_id, false);
                     break;
                 case node_operation::add_assign:
+                    if (_children[0]->_type_id == str_handle)
+                    {
+                        _type_id = str_handle;
+                        _lvalue = true;
+                        _children[0]->check_conversion(str_handle, true);
+                        _children[1]->check_conversion(str_handle, false);
+                        break;
+                    }
+                    [[fallthrough]];
                 case node_operation::sub_assign:
                 case node_operation::mul_assign:
                 case node_operation::div_assign:
@@ -171,11 +188,6 @@ namespace tone::core {
                         }
                         for (std::size_t i = 0; i < fn->param_type_id.size(); ++i)
                         {
-                            if (_children[i + 1]->is_lvalue() && !fn->param_type_id[i].by_ref)
-                            {
-                                throw semantic_error("Function doesn't recieve the argument by reference",
-                                    _children[i + 1]->_line_number, _children[i + 1]->_char_index);
-                            }
                             _children[i + 1]->check_conversion(fn->param_type_id[i].type_id, fn->param_type_id[i].by_ref);
                         }
                     }
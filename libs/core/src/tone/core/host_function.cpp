@@ -0,0 +1,47 @@
+#include "tone/core/host_function.hpp"
+
+#include <stdexcept>
+
+namespace tone::core {
+    host_function::host_function(std::string name, type_handle type_id, entry_point entry,
+                                 const void* target)
+        : _name(std::move(name))
+        , _type_id(type_id)
+        , _entry(entry)
+        , _target(target)
+    {
+        if (!type_id || !std::holds_alternative<function_type>(*type_id))
+            throw std::invalid_argument("Host functions need a function type");
+        _result_tag = tag_of(result_type());
+    }
+
+    const std::string& host_function::name() const
+    {
+        return _name;
+    }
+
+    type_handle host_function::type_id() const
+    {
+        return _type_id;
+    }
+
+    type_handle host_function::result_type() const
+    {
+        return std::get<function_type>(*_type_id).return_type_id;
+    }
+
+    value_tag host_function::result_tag() const
+    {
+        return _result_tag;
+    }
+
+    host_function::entry_point host_function::entry() const
+    {
+        return _entry;
+    }
+
+    const void* host_function::target() const
+    {
+        return _target;
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -39,6 +39,17 @@ namespace tone::core {
     }
     identifier_lookup::~identifier_lookup() = default;
 
+    const std::unordered_map<std::string, identifier_info>& identifier_lookup::idents() const
+    {
+        return _idents;
+    }
+
+    void identifier_lookup::retype_ident(const std::string& name, type_handle type_id)
+    {
+        auto& info = _idents.at(name);
+        info = identifier_info(type_id, info.index(), info.is_global(), info.is_constant());
+    }
+
     const identifier_info* identifier_lookup::insert_ident(std::string name, type_handle type_id,
                                                            std::size_t index, bool is_global,
                                                            bool is_constant)
@@ -64,6 +75,11 @@ namespace tone::core {
         return insert_ident(name, type_id, idents_size(), true, is_constant);
     }
 
+    void global_identifier_lookup::retype(const std::string& name, type_handle type_id)
+    {
+        retype_ident(name, type_id);
+    }
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     /// `local_identifier_lookup` class
     ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,889 @@
+#include "tone/core/jit.hpp"
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+
+#include <bit>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if TONE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace tone::core {
+    namespace {
+        // Thrown while compiling a tree the JIT can't handle; the caller keeps interpreting
+        struct unsupported_tree
+        {};
+
+        template <typename T>
+        std::int32_t value_offset()
+        {
+            static const auto offset = [] {
+                const runtime_value value{T{}};
+                return std::int32_t(reinterpret_cast<const char*>(std::get_if<T>(&value)) -
+                                    reinterpret_cast<const char*>(&value));
+            }();
+            return offset;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        /// `x64_assembler` class
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+        // Emits the handful of x86-64 instructions the native compiler needs. Integer values live
+        // in rax (rcx for a right operand), reals in xmm0 (xmm1), the params and globals arrays
+        // stay in rdi and rsi for the whole function.
+        class x64_assembler
+        {
+        public:
+            enum base_register : std::uint8_t
+            {
+                globals_base = 6, // rsi
+                params_base = 7,  // rdi
+            };
+
+            enum condition : std::uint8_t
+            {
+                cond_above_equal = 0x3,
+                cond_equal = 0x4,
+                cond_not_equal = 0x5,
+                cond_above = 0x7,
+                cond_parity = 0xA,
+                cond_no_parity = 0xB,
+                cond_less = 0xC,
+                cond_greater_equal = 0xD,
+                cond_less_equal = 0xE,
+                cond_greater = 0xF,
+            };
+
+            [[nodiscard]] const std::vector<std::uint8_t>& bytes() const
+            {
+                return _bytes;
+            }
+
+            // `reg` selects rax/xmm0 (0) or rcx/xmm1 (1)
+            void load_int(std::uint8_t reg, base_register base, std::int32_t disp)
+            {
+                emit({0x48, 0x8B});
+                memory_operand(reg, base, disp);
+            }
+            void load_real(std::uint8_t reg, base_register base, std::int32_t disp)
+            {
+                emit({0xF2, 0x0F, 0x10});
+                memory_operand(reg, base, disp);
+            }
+            void load_bool(std::uint8_t reg, base_register base, std::int32_t disp)
+            {
+                emit({0x0F, 0xB6});
+                memory_operand(reg, base, disp);
+            }
+
+            void load_int_constant(std::uint8_t reg, std::int64_t value)
+            {
+                if (value >= INT32_MIN && value <= INT32_MAX)
+                {
+                    emit({0x48, 0xC7, std::uint8_t(0xC0 | reg)});
+                    emit_int32(std::int32_t(value));
+                }
+                else
+                {
+                    emit({0x48, std::uint8_t(0xB8 | reg)});
+                    for (int i = 0; i < 8; ++i)
+                        _bytes.push_back(std::uint8_t(std::uint64_t(value) >> (i * 8)));
+                }
+            }
+            void load_real_constant(std::uint8_t reg, double value)
+            {
+                load_int_constant(reg, std::bit_cast<std::int64_t>(value));
+                int_bits_to_real(reg);
+            }
+
+            // movq xmmN, rN / movq rax, xmm0
+            void int_bits_to_real(std::uint8_t reg)
+            {
+                emit({0x66, 0x48, 0x0F, 0x6E, std::uint8_t(0xC0 | reg << 3 | reg)});
+            }
+            void real_bits_to_int()
+            {
+                emit({0x66, 0x48, 0x0F, 0x7E, 0xC0});
+            }
+
+            void push_int()
+            {
+                emit({0x50});
+            }
+            void push_real()
+            {
+                real_bits_to_int();
+                push_int();
+            }
+            // Moves the right operand to rcx and pops the left one into rax
+            void pop_int_operands()
+            {
+                emit({0x48, 0x89, 0xC1, 0x58});
+            }
+            // Moves the right operand to xmm1 and pops the left one into xmm0
+            void pop_real_operands()
+            {
+                emit({0x66, 0x0F, 0x28, 0xC8, 0x58});
+                int_bits_to_real(0);
+            }
+
+            // rax op= rcx
+            void add_int()
+            {
+                emit({0x48, 0x01, 0xC8});
+            }
+            void sub_int()
+            {
+                emit({0x48, 0x29, 0xC8});
+            }
+            void mul_int()
+            {
+                emit({0x48, 0x0F, 0xAF, 0xC1});
+            }
+            void and_int()
+            {
+                emit({0x48, 0x21, 0xC8});
+            }
+            void or_int()
+            {
+                emit({0x48, 0x09, 0xC8});
+            }
+            void xor_int()
+            {
+                emit({0x48, 0x31, 0xC8});
+            }
+            void shift_l()
+            {
+                emit({0x48, 0xD3, 0xE0});
+            }
+            void shift_r()
+            {
+                emit({0x48, 0xD3, 0xF8});
+            }
+            // Signed division of rax by rcx, quotient in rax and remainder in rdx
+            void div_int()
+            {
+                emit({0x48, 0x99, 0x48, 0xF7, 0xF9});
+            }
+            void remainder_to_result()
+            {
+                emit({0x48, 0x89, 0xD0});
+            }
+            void neg_int()
+            {
+                emit({0x48, 0xF7, 0xD8});
+            }
+            void not_int()
+            {
+                emit({0x48, 0xF7, 0xD0});
+            }
+            void zero_int()
+            {
+                emit({0x31, 0xC0});
+            }
+            void not_bool()
+            {
+                emit({0x83, 0xF0, 0x01});
+            }
+
+            // xmm0 op= xmm1
+            void add_real()
+            {
+                emit({0xF2, 0x0F, 0x58, 0xC1});
+            }
+            void sub_real()
+            {
+                emit({0xF2, 0x0F, 0x5C, 0xC1});
+            }
+            void mul_real()
+            {
+                emit({0xF2, 0x0F, 0x59, 0xC1});
+            }
+            void div_real()
+            {
+                emit({0xF2, 0x0F, 0x5E, 0xC1});
+            }
+            void neg_real()
+            {
+                real_bits_to_int();
+                emit({0x48, 0x0F, 0xBA, 0xF8, 0x3F});
+                int_bits_to_real(0);
+            }
+
+            void int_to_real()
+            {
+                emit({0xF2, 0x48, 0x0F, 0x2A, 0xC0});
+            }
+            // cvttsd2si gives INT64_MIN for NaN and anything out of range, so the result is
+            // fixed up to match `truncate_to_int`: INT64_MAX from 2^63 up and 0 for NaN
+            void real_to_int()
+            {
+                emit({0xF2, 0x48, 0x0F, 0x2C, 0xC0});
+                load_real_constant(1, 9223372036854775808.0);
+                compare_real(false);
+                load_int_constant(1, INT64_MAX);
+                move_if(cond_above_equal);
+                emit({0x66, 0x0F, 0x2E, 0xC0});
+                load_int_constant(1, 0);
+                move_if(cond_parity);
+            }
+            void int_to_bool()
+            {
+                emit({0x48, 0x85, 0xC0});
+                set(cond_not_equal);
+            }
+            void real_to_bool()
+            {
+                emit({0x66, 0x0F, 0x57, 0xC9});
+                compare_real(false);
+                set_either(cond_not_equal, cond_parity);
+            }
+
+            void compare_int()
+            {
+                emit({0x48, 0x39, 0xC8});
+            }
+            // ucomisd xmm0, xmm1, or xmm1, xmm0 when `swapped`
+            void compare_real(bool swapped)
+            {
+                emit({0x66, 0x0F, 0x2E, std::uint8_t(swapped ? 0xC8 : 0xC1)});
+            }
+
+            // eax = flags satisfy `cond`
+            void set(condition cond)
+            {
+                emit({0x0F, std::uint8_t(0x90 | cond), 0xC0, 0x0F, 0xB6, 0xC0});
+            }
+            void set_both(condition first, condition second)
+            {
+                emit({0x0F, std::uint8_t(0x90 | first), 0xC0});
+                emit({0x0F, std::uint8_t(0x90 | second), 0xC1});
+                emit({0x20, 0xC8, 0x0F, 0xB6, 0xC0});
+            }
+            void set_either(condition first, condition second)
+            {
+                emit({0x0F, std::uint8_t(0x90 | first), 0xC0});
+                emit({0x0F, std::uint8_t(0x90 | second), 0xC1});
+                emit({0x08, 0xC8, 0x0F, 0xB6, 0xC0});
+            }
+
+            // rax = rcx when the flags satisfy `cond`
+            void move_if(condition cond)
+            {
+                emit({0x48, 0x0F, std::uint8_t(0x40 | cond), 0xC1});
+            }
+
+            // Jumps when eax is zero (or non-zero), returns the offset to patch
+            std::size_t jump_if(bool value)
+            {
+                emit({0x85, 0xC0, 0x0F, std::uint8_t(value ? 0x85 : 0x84)});
+                emit_int32(0);
+                return _bytes.size();
+            }
+            void patch_jump(std::size_t end_of_jump)
+            {
+                const auto rel = std::int32_t(_bytes.size() - end_of_jump);
+                std::memcpy(_bytes.data() + end_of_jump - 4, &rel, 4);
+            }
+
+            void ret()
+            {
+                emit({0xC3});
+            }
+
+        private:
+            void emit(std::initializer_list<std::uint8_t> bytes)
+            {
+                _bytes.insert(_bytes.end(), bytes);
+            }
+            void emit_int32(std::int32_t value)
+            {
+                for (int i = 0; i < 4; ++i)
+                    _bytes.push_back(std::uint8_t(std::uint32_t(value) >> (i * 8)));
+            }
+            void memory_operand(std::uint8_t reg, base_register base, std::int32_t disp)
+            {
+                _bytes.push_back(std::uint8_t(0x80 | reg << 3 | base));
+                emit_int32(disp);
+            }
+
+            std::vector<std::uint8_t> _bytes;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+        /// `native_compiler` class
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+        bool is_int(type_handle type_id)
+        {
+            return type_id == type_registry::get_int_handle();
+        }
+        bool is_real(type_handle type_id)
+        {
+            return type_id == type_registry::get_real_handle();
+        }
+        bool is_bool(type_handle type_id)
+        {
+            return type_id == type_registry::get_bool_handle();
+        }
+
+        class native_compiler
+        {
+        public:
+            explicit native_compiler(const identifier_snapshot& identifiers)
+                : _identifiers(identifiers)
+            {}
+
+            void compile(const node& root)
+            {
+                check_type(root.get_type_id());
+                compile_node(root);
+                if (is_real(root.get_type_id()))
+                    _asm.real_bits_to_int();
+                _asm.ret();
+            }
+
+            [[nodiscard]] const std::vector<std::uint8_t>& machine_code() const
+            {
+                return _asm.bytes();
+            }
+
+            [[nodiscard]] std::vector<std::size_t> param_indices() const
+            {
+                std::vector<std::size_t> indices;
+                for (const auto type_id : _param_types)
+                    indices.push_back(type_id ? default_value(type_id).index() : 0);
+                return indices;
+            }
+
+        private:
+            static void check_type(type_handle type_id)
+            {
+                if (!is_int(type_id) && !is_real(type_id) && !is_bool(type_id))
+                    throw unsupported_tree{};
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Operands
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            static bool is_leaf(const node& n)
+            {
+                return !n.is_node_operation();
+            }
+
+            // Loads an identifier or literal into rax/xmm0 (`reg` 0) or rcx/xmm1 (`reg` 1)
+            void load_leaf(const node& n, std::uint8_t reg)
+            {
+                const auto type_id = n.get_type_id();
+                check_type(type_id);
+
+                if (n.is_identifier())
+                {
+                    const auto it = _identifiers.find(std::get<identifier>(n.get_value()).name);
+                    if (it == _identifiers.end())
+                        throw unsupported_tree{};
+                    const auto& info = it->second;
+
+                    auto base = x64_assembler::globals_base;
+                    std::size_t slot = info.index();
+                    if (!info.is_global())
+                    {
+                        // Locals only exist in a frame, which native code doesn't build
+                        const auto idx = std::ptrdiff_t(info.index());
+                        if (idx >= 0)
+                            throw unsupported_tree{};
+                        slot = std::size_t(-idx) - 1;
+                        base = x64_assembler::params_base;
+                        if (_param_types.size() <= slot)
+                            _param_types.resize(slot + 1, nullptr);
+                        _param_types[slot] = type_id;
+                    }
+
+                    // Params are host `runtime_value`s, globals the VM's untagged slots
+                    auto disp = std::int32_t(slot * sizeof(value_slot));
+                    if (base == x64_assembler::params_base)
+                    {
+                        disp = std::int32_t(slot * sizeof(runtime_value));
+                        if (is_int(type_id))
+                            disp += value_offset<std::int64_t>();
+                        else if (is_real(type_id))
+                            disp += value_offset<double>();
+                        else
+                            disp += value_offset<bool>();
+                    }
+
+                    if (is_int(type_id))
+                        _asm.load_int(reg, base, disp);
+                    else if (is_real(type_id))
+                        _asm.load_real(reg, base, disp);
+                    else
+                        _asm.load_bool(reg, base, disp);
+                    return;
+                }
+
+                const auto& value = n.get_value();
+                if (const auto* i = std::get_if<std::int64_t>(&value))
+                    _asm.load_int_constant(reg, *i);
+                else if (const auto* d = std::get_if<double>(&value))
+                    _asm.load_real_constant(reg, *d);
+                else if (const auto* b = std::get_if<bool>(&value))
+                    _asm.load_int_constant(reg, *b);
+                else
+                    throw unsupported_tree{};
+            }
+
+            void convert(type_handle from, type_handle to)
+            {
+                if (from == to)
+                    return;
+                if (is_int(from) && is_real(to))
+                    _asm.int_to_real();
+                else if (is_int(from) && is_bool(to))
+                    _asm.int_to_bool();
+                else if (is_real(from) && is_int(to))
+                    _asm.real_to_int();
+                else if (is_real(from) && is_bool(to))
+                    _asm.real_to_bool();
+                else
+                    throw unsupported_tree{};
+            }
+
+            void compile_converted(const node& n, type_handle type_id)
+            {
+                compile_node(n);
+                convert(n.get_type_id(), type_id);
+            }
+
+            // Leaves the left operand in rax/xmm0 and the right one in rcx/xmm1
+            void compile_operands(const node& lhs, const node& rhs, type_handle type_id)
+            {
+                compile_converted(lhs, type_id);
+                if (is_leaf(rhs) && rhs.get_type_id() == type_id)
+                {
+                    load_leaf(rhs, 1);
+                    return;
+                }
+
+                if (is_real(type_id))
+                    _asm.push_real();
+                else
+                    _asm.push_int();
+                compile_converted(rhs, type_id);
+                if (is_real(type_id))
+                    _asm.pop_real_operands();
+                else
+                    _asm.pop_int_operands();
+            }
+
+            ////////////////////////////////////////////////////////////////////////////////////////
+            /// Expressions
+            ////////////////////////////////////////////////////////////////////////////////////////
+
+            void compile_node(const node& n)
+            {
+                if (is_leaf(n))
+                {
+                    load_leaf(n, 0);
+                    return;
+                }
+
+                const auto& children = n.get_children();
+                const auto type_id = n.get_type_id();
+                check_type(type_id);
+
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::param:
+                case node_operation::unary_plus:
+                    compile_node(*children[0]);
+                    return;
+
+                case node_operation::unary_minus:
+                    compile_converted(*children[0], type_id);
+                    if (is_real(type_id))
+                        _asm.neg_real();
+                    else
+                        _asm.neg_int();
+                    return;
+                case node_operation::bitwise_not:
+                    compile_converted(*children[0], type_registry::get_int_handle());
+                    _asm.not_int();
+                    return;
+                case node_operation::logical_not:
+                    compile_converted(*children[0], type_registry::get_bool_handle());
+                    _asm.not_bool();
+                    return;
+
+                case node_operation::add:
+                case node_operation::sub:
+                case node_operation::mul:
+                case node_operation::bitwise_and:
+                case node_operation::bitwise_or:
+                case node_operation::bitwise_xor:
+                case node_operation::shift_l:
+                case node_operation::shift_r:
+                    compile_operands(*children[0], *children[1], type_id);
+                    compile_arithmetic(n, type_id);
+                    return;
+
+                case node_operation::div:
+                case node_operation::mod:
+                    compile_division(n, type_id);
+                    return;
+
+                case node_operation::equal:
+                case node_operation::not_equal:
+                case node_operation::less:
+                case node_operation::greater:
+                case node_operation::less_equal:
+                case node_operation::greater_equal:
+                    compile_comparison(n);
+                    return;
+
+                case node_operation::logical_and:
+                case node_operation::logical_or: {
+                    const bool is_and =
+                            std::get<node_operation>(n.get_value()) == node_operation::logical_and;
+                    compile_converted(*children[0], type_registry::get_bool_handle());
+                    const auto skip = _asm.jump_if(!is_and);
+                    compile_converted(*children[1], type_registry::get_bool_handle());
+                    _asm.patch_jump(skip);
+                    return;
+                }
+
+                case node_operation::comma:
+                    // Only the last value is kept, but every operand is compiled so that one
+                    // the JIT can't run, such as an assignment, leaves the tree to the VM
+                    for (const auto& child : children)
+                        compile_node(*child);
+                    return;
+
+                default:
+                    throw unsupported_tree{};
+                }
+            }
+
+            void compile_arithmetic(const node& n, type_handle type_id)
+            {
+                const bool real = is_real(type_id);
+                switch (std::get<node_operation>(n.get_value()))
+                {
+                case node_operation::add:
+                    return real ? _asm.add_real() : _asm.add_int();
+                case node_operation::sub:
+                    return real ? _asm.sub_real() : _asm.sub_int();
+                case node_operation::mul:
+                    return real ? _asm.mul_real() : _asm.mul_int();
+                case node_operation::bitwise_and:
+                    return _asm.and_int();
+                case node_operation::bitwise_or:
+                    return _asm.or_int();
+                case node_operation::bitwise_xor:
+                    return _asm.xor_int();
+                case node_operation::shift_l:
+                    return _asm.shift_l();
+                case node_operation::shift_r:
+                    return _asm.shift_r();
+                default:
+                    throw unsupported_tree{};
+                }
+            }
+
+            // Integer division is only compiled for a non-zero literal divisor, since native
+            // code can't raise the interpreter's "Division by zero" error. `fmod` is left to the
+            // interpreter as well.
+            void compile_division(const node& n, type_handle type_id)
+            {
+                const auto& children = n.get_children();
+                const bool is_div = std::get<node_operation>(n.get_value()) == node_operation::div;
+
+                if (is_real(type_id))
+                {
+                    if (!is_div)
+                        throw unsupported_tree{};
+                    compile_operands(*children[0], *children[1], type_id);
+                    _asm.div_real();
+                    return;
+                }
+
+                const auto divisor = constant_divisor(*children[1]);
+                compile_converted(*children[0], type_id);
+                if (divisor == -1)
+                {
+                    if (is_div)
+                        _asm.neg_int();
+                    else
+                        _asm.zero_int();
+                    return;
+                }
+                _asm.load_int_constant(1, divisor);
+                _asm.div_int();
+                if (!is_div)
+                    _asm.remainder_to_result();
+            }
+
+            // An int literal, possibly negated
+            static std::int64_t constant_divisor(const node& n)
+            {
+                const node* literal = &n;
+                bool negate = false;
+                while (literal->is_node_operation())
+                {
+                    const auto op = std::get<node_operation>(literal->get_value());
+                    if (op == node_operation::unary_minus)
+                        negate = !negate;
+                    else if (op != node_operation::param && op != node_operation::unary_plus)
+                        throw unsupported_tree{};
+                    literal = literal->get_children()[0].get();
+                }
+
+                const auto* value = std::get_if<std::int64_t>(&literal->get_value());
+                if (!value || *value == 0)
+                    throw unsupported_tree{};
+                return negate ? std::int64_t(0 - std::uint64_t(*value)) : *value;
+            }
+
+            void compile_comparison(const node& n)
+            {
+                using cond = x64_assembler::condition;
+
+                const auto& children = n.get_children();
+                const bool real = is_real(children[0]->get_type_id()) ||
+                                  is_real(children[1]->get_type_id());
+                compile_operands(*children[0], *children[1],
+                                 real ? type_registry::get_real_handle()
+                                      : type_registry::get_int_handle());
+
+                const auto op = std::get<node_operation>(n.get_value());
+                if (!real)
+                {
+                    _asm.compare_int();
+                    switch (op)
+                    {
+                    case node_operation::equal:
+                        return _asm.set(cond::cond_equal);
+                    case node_operation::not_equal:
+                        return _asm.set(cond::cond_not_equal);
+                    case node_operation::less:
+                        return _asm.set(cond::cond_less);
+                    case node_operation::greater:
+                        return _asm.set(cond::cond_greater);
+                    case node_operation::less_equal:
+                        return _asm.set(cond::cond_less_equal);
+                    default:
+                        return _asm.set(cond::cond_greater_equal);
+                    }
+                }
+
+                // Unordered results set ZF, PF and CF, so `above` conditions are false for NaN
+                // and equality has to check parity
+                switch (op)
+                {
+                case node_operation::equal:
+                    _asm.compare_real(false);
+                    return _asm.set_both(cond::cond_equal, cond::cond_no_parity);
+                case node_operation::not_equal:
+                    _asm.compare_real(false);
+                    return _asm.set_either(cond::cond_not_equal, cond::cond_parity);
+                case node_operation::less:
+                    _asm.compare_real(true);
+                    return _asm.set(cond::cond_above);
+                case node_operation::greater:
+                    _asm.compare_real(false);
+                    return _asm.set(cond::cond_above);
+                case node_operation::less_equal:
+                    _asm.compare_real(true);
+                    return _asm.set(cond::cond_above_equal);
+                default:
+                    _asm.compare_real(false);
+                    return _asm.set(cond::cond_above_equal);
+                }
+            }
+
+            const identifier_snapshot& _identifiers;
+            x64_assembler _asm;
+            std::vector<type_handle> _param_types;
+        };
+
+        void collect_identifiers(const compile_context& context, const node& n,
+                                 identifier_snapshot& identifiers)
+        {
+            if (n.is_identifier())
+            {
+                const auto& name = std::get<identifier>(n.get_value()).name;
+                if (const auto info = context.find(name))
+                    identifiers.emplace(name, *info);
+            }
+            for (const auto& child : n.get_children())
+                collect_identifiers(context, *child, identifiers);
+        }
+    } // namespace
+
+    identifier_snapshot capture_identifiers(const compile_context& context, const node& root)
+    {
+        identifier_snapshot identifiers;
+        collect_identifiers(context, root, identifiers);
+        return identifiers;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `native_function` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    native_function::native_function(std::span<const std::uint8_t> machine_code,
+                                     type_handle result_type,
+                                     std::vector<std::size_t> param_indices)
+        : _memory(nullptr)
+        , _size(0)
+        , _code_size(machine_code.size())
+        , _entry(nullptr)
+        , _result_type(result_type)
+        , _param_indices(std::move(param_indices))
+    {
+#if TONE_JIT
+        // Pages are writable while the code is copied in and executable afterwards, never both
+        const auto page_size = std::size_t(sysconf(_SC_PAGESIZE));
+        _size = (machine_code.size() + page_size - 1) / page_size * page_size;
+        _memory = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (_memory == MAP_FAILED)
+            throw std::bad_alloc();
+        std::memcpy(_memory, machine_code.data(), machine_code.size());
+        if (mprotect(_memory, _size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(_memory, _size);
+            throw std::bad_alloc();
+        }
+        _entry = reinterpret_cast<entry_point>(_memory);
+#endif
+    }
+
+    native_function::native_function(native_function&& other) noexcept
+        : _memory(std::exchange(other._memory, nullptr))
+        , _size(std::exchange(other._size, 0))
+        , _code_size(std::exchange(other._code_size, 0))
+        , _entry(std::exchange(other._entry, nullptr))
+        , _result_type(other._result_type)
+        , _param_indices(std::move(other._param_indices))
+    {}
+
+    native_function& native_function::operator=(native_function&& other) noexcept
+    {
+        std::swap(_memory, other._memory);
+        std::swap(_size, other._size);
+        std::swap(_code_size, other._code_size);
+        std::swap(_entry, other._entry);
+        std::swap(_result_type, other._result_type);
+        std::swap(_param_indices, other._param_indices);
+        return *this;
+    }
+
+    native_function::~native_function()
+    {
+#if TONE_JIT
+        if (_memory)
+            munmap(_memory, _size);
+#endif
+    }
+
+    type_handle native_function::result_type() const
+    {
+        return _result_type;
+    }
+
+    std::size_t native_function::code_size() const
+    {
+        return _code_size;
+    }
+
+    bool native_function::accepts(std::span<const runtime_value> params) const
+    {
+        if (params.size() < _param_indices.size())
+            return false;
+        for (std::size_t i = 0; i < _param_indices.size(); ++i)
+        {
+            if (params[i].index() != _param_indices[i])
+                return false;
+        }
+        return true;
+    }
+
+    runtime_value native_function::operator()(std::span<const runtime_value> params,
+                                              const value_slot* globals) const
+    {
+        const auto bits = _entry(params.data(), globals);
+        if (_result_type == type_registry::get_real_handle())
+            return std::bit_cast<double>(bits);
+        if (_result_type == type_registry::get_bool_handle())
+            return (bits & 1) != 0;
+        return std::int64_t(bits);
+    }
+
+    std::optional<native_function> compile_native(const identifier_snapshot& identifiers,
+                                                  const node& root)
+    {
+        if (!jit_available)
+            return std::nullopt;
+
+        native_compiler compiler(identifiers);
+        try
+        {
+            compiler.compile(root);
+        }
+        catch (const unsupported_tree&)
+        {
+            return std::nullopt;
+        }
+        return native_function(compiler.machine_code(), root.get_type_id(),
+                               compiler.param_indices());
+    }
+
+    std::optional<native_function> compile_native(const compile_context& context,
+                                                  const node& root)
+    {
+        return compile_native(capture_identifiers(context, root), root);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `tiered_expression` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    tiered_expression::tiered_expression(const compile_context& context, node_ptr root,
+                                         const tiering_options& options)
+        : _root(std::move(root))
+        , _identifiers(capture_identifiers(context, *_root))
+        , _code(compile_bytecode(context, *_root))
+        , _options(options)
+        , _calls(0)
+    {}
+
+    runtime_value tiered_expression::run(vm& machine, std::span<const runtime_value> params)
+    {
+        if (++_calls == _options.threshold && _options.enabled)
+            _native = compile_native(_identifiers, *_root);
+
+        if (_native && _native->accepts(params))
+            return (*_native)(params, machine.bind_globals(_code));
+        return machine.run(_code, params);
+    }
+
+    const bytecode& tiered_expression::code() const
+    {
+        return _code;
+    }
+
+    bool tiered_expression::is_native() const
+    {
+        return _native.has_value();
+    }
+
+    std::size_t tiered_expression::call_count() const
+    {
+        return _calls;
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "tone/core/mapped_file.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if TONE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tone::core {
+    mapped_file::mapped_file(const std::string& path)
+    {
+#if TONE_MMAP
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Can't open '" + path + "'");
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            throw std::runtime_error("Can't map '" + path + "'");
+        }
+        const auto size = std::size_t(info.st_size);
+        // Shared so the pages are never copied; files mapped like this mustn't be changed in
+        // place, only replaced
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("Can't map '" + path + "'");
+        _mapping = mapping;
+        _bytes = {static_cast<const std::byte*>(mapping), size};
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+            throw std::runtime_error("Can't open '" + path + "'");
+        const auto size = std::size_t(in.tellg());
+        _buffer.resize((size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(_buffer.data()), std::streamsize(size));
+        _bytes = {reinterpret_cast<const std::byte*>(_buffer.data()), size};
+#endif
+    }
+
+    mapped_file::mapped_file(mapped_file&& other) noexcept
+        : _bytes(std::exchange(other._bytes, {}))
+        , _mapping(std::exchange(other._mapping, nullptr))
+        , _buffer(std::move(other._buffer))
+    {}
+
+    mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            _bytes = std::exchange(other._bytes, {});
+            _mapping = std::exchange(other._mapping, nullptr);
+            _buffer = std::move(other._buffer);
+        }
+        return *this;
+    }
+
+    mapped_file::~mapped_file()
+    {
+        unmap();
+    }
+
+    std::span<const std::byte> mapped_file::bytes() const
+    {
+        return _bytes;
+    }
+
+    void mapped_file::unmap()
+    {
+#if TONE_MMAP
+        if (_mapping)
+            munmap(_mapping, _bytes.size());
+#endif
+        _mapping = nullptr;
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "tone/core/module_cache.hpp"
+
+#include "tone/core/errors.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tone::core {
+    namespace {
+        error in_module(const std::string& name, const error& err)
+        {
+            return error(fmt::format("In module '{}': {}", name, err.what()), err.line_number(),
+                         err.char_index());
+        }
+    } // namespace
+
+    module_cache::module_cache(compile_context& context, module_reader reader, compile_mode mode)
+        : _context(context)
+        , _reader(std::move(reader))
+        , _mode(mode)
+    {}
+
+    script_module& module_cache::load(const std::string& name, thread_pool& pool)
+    {
+        return *load(std::span(&name, 1), pool).front();
+    }
+
+    std::vector<script_module*> module_cache::load(std::span<const std::string> names,
+                                                   thread_pool& pool)
+    {
+        std::lock_guard lock(_mutex);
+
+        std::map<std::string, pending> found;
+        std::vector<std::string> path;
+        std::size_t waves = 0;
+        for (const auto& name : names)
+            waves = std::max(waves, discover(name, found, path));
+
+        load_waves(found, waves, pool);
+
+        std::vector<script_module*> result;
+        for (const auto& name : names)
+            result.push_back(_modules.find(name)->second.get());
+        return result;
+    }
+
+    reload_result module_cache::reload(const std::string& name, thread_pool& pool)
+    {
+        std::lock_guard lock(_mutex);
+        const auto it = _modules.find(name);
+        if (it == _modules.end())
+            throw std::invalid_argument("Module '" + name + "' isn't loaded");
+
+        auto source = _reader(name);
+        std::vector<std::string> imports;
+        try
+        {
+            imports = script_module::read_imports(source);
+        }
+        catch (const error& err)
+        {
+            throw in_module(name, err);
+        }
+
+        // Imports it gained are loaded first, and none may lead back to it
+        std::map<std::string, pending> found;
+        std::vector<std::string> path{name};
+        std::size_t waves = 0;
+        for (const auto& import : imports)
+            waves = std::max(waves, discover(import, found, path));
+        for (const auto& import : imports)
+        {
+            path = {name};
+            if (leads_to(import, name, found, path))
+            {
+                std::string cycle = name;
+                for (auto step = path.begin() + 1; step != path.end(); ++step)
+                    cycle += " -> " + *step;
+                throw std::invalid_argument("Modules import each other: " + cycle);
+            }
+        }
+        load_waves(found, waves, pool);
+
+        auto& module = *it->second;
+        std::vector<const script_module*> imported;
+        for (const auto& import : imports)
+            imported.push_back(_modules.find(import)->second.get());
+        reload_result result;
+        try
+        {
+            result = module.reload(std::move(source), std::move(imported));
+        }
+        catch (const error& err)
+        {
+            throw in_module(name, err);
+        }
+
+        // Bodies elsewhere calling what changed signature; those don't change signature
+        // themselves, so one pass finds them all
+        std::vector<named_module> affected{{&it->first, &module}};
+        for (const auto& [other_name, other] : _modules)
+        {
+            if (other.get() == &module)
+                continue;
+            auto stale = other->invalidate_stale();
+            if (!stale.empty())
+                affected.emplace_back(&other_name, other.get());
+            for (auto& fn : stale)
+                result.recompiled.push_back(std::move(fn));
+        }
+        // None of them can reach what the reload replaced now
+        module.retire_replaced();
+        if (_mode == compile_mode::strict)
+            compile(affected, pool);
+        return result;
+    }
+
+    script_module* module_cache::find(const std::string& name) const
+    {
+        std::lock_guard lock(_mutex);
+        const auto it = _modules.find(name);
+        return it != _modules.end() ? it->second.get() : nullptr;
+    }
+
+    std::size_t module_cache::discover(const std::string& name,
+                                       std::map<std::string, pending>& found,
+                                       std::vector<std::string>& path)
+    {
+        if (const auto it = std::find(path.begin(), path.end(), name); it != path.end())
+        {
+            std::string cycle;
+            for (auto step = it; step != path.end(); ++step)
+                cycle += *step + " -> ";
+            throw std::invalid_argument("Modules import each other: " + cycle + name);
+        }
+        if (_modules.contains(name))
+            return 0;
+        if (const auto it = found.find(name); it != found.end())
+            return it->second.wave;
+
+        pending module;
+        module.source = _reader(name);
+        try
+        {
+            module.imports = script_module::read_imports(module.source);
+        }
+        catch (const error& err)
+        {
+            throw in_module(name, err);
+        }
+
+        path.push_back(name);
+        module.wave = 1;
+        for (const auto& import : module.imports)
+            module.wave = std::max(module.wave, discover(import, found, path) + 1);
+        path.pop_back();
+
+        const auto wave = module.wave;
+        found.emplace(name, std::move(module));
+        return wave;
+    }
+
+    bool module_cache::leads_to(const std::string& from, const std::string& to,
+                                const std::map<std::string, pending>& found,
+                                std::vector<std::string>& path) const
+    {
+        path.push_back(from);
+        if (from == to)
+            return true;
+        const auto pending_it = found.find(from);
+        const auto& imports = pending_it != found.end() ? pending_it->second.imports
+                                                        : _modules.find(from)->second->imports();
+        for (const auto& import : imports)
+        {
+            if (leads_to(import, to, found, path))
+                return true;
+        }
+        path.pop_back();
+        return false;
+    }
+
+    void module_cache::load_waves(std::map<std::string, pending>& found, std::size_t waves,
+                                  thread_pool& pool)
+    {
+        for (std::size_t wave = 1; wave <= waves; ++wave)
+        {
+            std::vector<named_module> declared;
+            for (auto& [name, module] : found)
+            {
+                if (module.wave != wave)
+                    continue;
+                auto loaded = declare(name, module);
+                declared.emplace_back(&name, loaded.get());
+                _modules.emplace(name, std::move(loaded));
+            }
+            if (_mode == compile_mode::strict)
+                compile(declared, pool);
+        }
+    }
+
+    void module_cache::compile(std::span<const named_module> modules, thread_pool& pool)
+    {
+        std::vector<thread_pool::task> tasks;
+        for (const auto& [name, module] : modules)
+        {
+            tasks.emplace_back([name, module, &pool] {
+                try
+                {
+                    module->compile_all(pool);
+                }
+                catch (const error& err)
+                {
+                    throw in_module(*name, err);
+                }
+            });
+        }
+        pool.run(tasks);
+    }
+
+    std::unique_ptr<script_module> module_cache::declare(const std::string& name,
+                                                         pending& module)
+    {
+        std::vector<const script_module*> imports;
+        for (const auto& import : module.imports)
+            imports.push_back(_modules.find(import)->second.get());
+        try
+        {
+            return std::make_unique<script_module>(_context, std::move(module.source),
+                                                   compile_mode::lazy, std::move(imports));
+        }
+        catch (const error& err)
+        {
+            throw in_module(name, err);
+        }
+    }
+} // namespace tone::core
\ No newline at end of file
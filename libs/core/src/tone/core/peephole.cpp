@@ -0,0 +1,277 @@
+#include "tone/core/peephole.hpp"
+#include "tone/core/lookup.hpp"
+
+#include <algorithm>
+
+namespace tone::core {
+    namespace {
+        const lookup<opcode, opcode> constant_forms{
+                {opcode::add_int, opcode::add_int_k},
+                {opcode::sub_int, opcode::sub_int_k},
+                {opcode::mul_int, opcode::mul_int_k},
+                {opcode::div_int, opcode::div_int_k},
+                {opcode::mod_int, opcode::mod_int_k},
+                {opcode::add_real, opcode::add_real_k},
+                {opcode::sub_real, opcode::sub_real_k},
+                {opcode::mul_real, opcode::mul_real_k},
+                {opcode::div_real, opcode::div_real_k},
+                {opcode::mod_real, opcode::mod_real_k},
+                {opcode::equal_int, opcode::equal_int_k},
+                {opcode::not_equal_int, opcode::not_equal_int_k},
+                {opcode::less_int, opcode::less_int_k},
+                {opcode::greater_int, opcode::greater_int_k},
+                {opcode::less_equal_int, opcode::less_equal_int_k},
+                {opcode::greater_equal_int, opcode::greater_equal_int_k},
+                {opcode::equal_real, opcode::equal_real_k},
+                {opcode::not_equal_real, opcode::not_equal_real_k},
+                {opcode::less_real, opcode::less_real_k},
+                {opcode::greater_real, opcode::greater_real_k},
+                {opcode::less_equal_real, opcode::less_equal_real_k},
+                {opcode::greater_equal_real, opcode::greater_equal_real_k},
+        };
+
+        // Constant forms for when the constant is the left operand, e.g. `1 + a` or `0 < i`
+        const lookup<opcode, opcode> swapped_constant_forms{
+                {opcode::add_int, opcode::add_int_k},
+                {opcode::mul_int, opcode::mul_int_k},
+                {opcode::add_real, opcode::add_real_k},
+                {opcode::mul_real, opcode::mul_real_k},
+                {opcode::equal_int, opcode::equal_int_k},
+                {opcode::not_equal_int, opcode::not_equal_int_k},
+                {opcode::less_int, opcode::greater_int_k},
+                {opcode::greater_int, opcode::less_int_k},
+                {opcode::less_equal_int, opcode::greater_equal_int_k},
+                {opcode::greater_equal_int, opcode::less_equal_int_k},
+                {opcode::equal_real, opcode::equal_real_k},
+                {opcode::not_equal_real, opcode::not_equal_real_k},
+                {opcode::less_real, opcode::greater_real_k},
+                {opcode::greater_real, opcode::less_real_k},
+                {opcode::less_equal_real, opcode::greater_equal_real_k},
+                {opcode::greater_equal_real, opcode::less_equal_real_k},
+        };
+
+        const lookup<opcode, opcode> branch_forms{
+                {opcode::equal_int, opcode::equal_int_branch},
+                {opcode::not_equal_int, opcode::not_equal_int_branch},
+                {opcode::less_int, opcode::less_int_branch},
+                {opcode::greater_int, opcode::greater_int_branch},
+                {opcode::less_equal_int, opcode::less_equal_int_branch},
+                {opcode::greater_equal_int, opcode::greater_equal_int_branch},
+                {opcode::equal_real, opcode::equal_real_branch},
+                {opcode::not_equal_real, opcode::not_equal_real_branch},
+                {opcode::less_real, opcode::less_real_branch},
+                {opcode::greater_real, opcode::greater_real_branch},
+                {opcode::less_equal_real, opcode::less_equal_real_branch},
+                {opcode::greater_equal_real, opcode::greater_equal_real_branch},
+                {opcode::equal_int_k, opcode::equal_int_k_branch},
+                {opcode::not_equal_int_k, opcode::not_equal_int_k_branch},
+                {opcode::less_int_k, opcode::less_int_k_branch},
+                {opcode::greater_int_k, opcode::greater_int_k_branch},
+                {opcode::less_equal_int_k, opcode::less_equal_int_k_branch},
+                {opcode::greater_equal_int_k, opcode::greater_equal_int_k_branch},
+                {opcode::equal_real_k, opcode::equal_real_k_branch},
+                {opcode::not_equal_real_k, opcode::not_equal_real_k_branch},
+                {opcode::less_real_k, opcode::less_real_k_branch},
+                {opcode::greater_real_k, opcode::greater_real_k_branch},
+                {opcode::less_equal_real_k, opcode::less_equal_real_k_branch},
+                {opcode::greater_equal_real_k, opcode::greater_equal_real_k_branch},
+        };
+
+        template <typename F>
+        void for_each_operand(instruction* words, F&& f)
+        {
+            const auto& info = get_opcode_info(words[0].op);
+            for (std::size_t i = 0; i < info.operands.size(); ++i)
+            {
+                auto& word = words[i / 3];
+                auto& field = i % 3 == 0 ? word.a : i % 3 == 1 ? word.b : word.c;
+                f(info.operands[i], field);
+            }
+        }
+
+        std::vector<std::size_t> successors(bytecode& code, std::size_t ip)
+        {
+            const auto op = code.code[ip].op;
+            if (op == opcode::ret)
+                return {};
+            if (op == opcode::jump)
+                return {code.code[ip].a};
+
+            std::vector<std::size_t> result{ip + instruction_width(op)};
+            for_each_operand(&code.code[ip], [&](char kind, std::uint16_t target) {
+                if (kind == 'j')
+                    result.push_back(target);
+            });
+            return result;
+        }
+
+        // Registers live after each instruction, indexed by the instruction's first word
+        std::vector<std::vector<bool>> live_registers(bytecode& code)
+        {
+            std::vector<std::size_t> starts;
+            for (std::size_t ip = 0; ip < code.code.size(); ip += instruction_width(code.code[ip].op))
+                starts.push_back(ip);
+
+            const std::vector<bool> none(code.register_count, false);
+            std::vector<std::vector<bool>> live_in(code.code.size() + 1, none);
+            std::vector<std::vector<bool>> live_out(code.code.size() + 1, none);
+
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                for (auto it = starts.rbegin(); it != starts.rend(); ++it)
+                {
+                    const auto ip = *it;
+
+                    std::vector<bool> out = none;
+                    for (const auto next : successors(code, ip))
+                    {
+                        for (std::size_t r = 0; r < out.size(); ++r)
+                            out[r] = out[r] || live_in[next][r];
+                    }
+
+                    std::vector<bool> in = out;
+                    for_each_operand(&code.code[ip], [&](char kind, std::uint16_t reg) {
+                        if (kind == 'd')
+                            in[reg] = false;
+                    });
+                    std::uint16_t run_start = 0;
+                    for_each_operand(&code.code[ip], [&](char kind, std::uint16_t reg) {
+                        if (kind == 'r' || kind == 'm')
+                            in[reg] = true;
+                        else if (kind == 's')
+                            run_start = reg;
+                        else if (kind == 'n')
+                            std::fill_n(in.begin() + run_start, reg, true);
+                    });
+
+                    if (in != live_in[ip] || out != live_out[ip])
+                    {
+                        live_in[ip] = std::move(in);
+                        live_out[ip] = std::move(out);
+                        changed = true;
+                    }
+                }
+            }
+            return live_out;
+        }
+
+        std::vector<bool> jump_targets(bytecode& code)
+        {
+            std::vector<bool> targets(code.code.size() + 1, false);
+            for (std::size_t ip = 0; ip < code.code.size(); ip += instruction_width(code.code[ip].op))
+            {
+                for_each_operand(&code.code[ip], [&](char kind, std::uint16_t target) {
+                    if (kind == 'j')
+                        targets[target] = true;
+                });
+            }
+            return targets;
+        }
+
+        // Rewrites `load_const t, k; op d, x, t` into `op_k d, x, k` when `t` is a temporary that
+        // is not read afterwards, and `load_const t, k; move d, t` into `load_const d, k` (likewise
+        // for the str forms).
+        void fuse_constant_operands(bytecode& code)
+        {
+            const auto live_out = live_registers(code);
+            const auto targets = jump_targets(code);
+            const std::size_t first_temp = code.param_count + code.local_count;
+
+            std::vector<bool> removed(code.code.size(), false);
+            for (std::size_t ip = 0; ip + 1 < code.code.size(); ip += instruction_width(code.code[ip].op))
+            {
+                const auto load = code.code[ip];
+                auto& next = code.code[ip + 1];
+                const auto temp = load.a;
+
+                if (load.op != opcode::load_const && load.op != opcode::load_const_str)
+                    continue;
+                if (temp < first_temp || targets[ip + 1])
+                    continue;
+                if (next.a != temp && live_out[ip + 1][temp])
+                    continue;
+
+                if (next.op == opcode::move && next.b == temp && load.op == opcode::load_const)
+                {
+                    next = {opcode::load_const, next.a, load.b, 0};
+                }
+                else if (next.op == opcode::move_str && next.b == temp)
+                {
+                    next = {opcode::load_const_str, next.a, load.b, 0};
+                }
+                else if (const auto it = constant_forms.find(next.op);
+                         it != constant_forms.end() && next.c == temp && next.b != temp)
+                {
+                    next = {it->second, next.a, next.b, load.b};
+                }
+                else if (const auto it = swapped_constant_forms.find(next.op);
+                         it != swapped_constant_forms.end() && next.b == temp && next.c != temp)
+                {
+                    next = {it->second, next.a, next.c, load.b};
+                }
+                else
+                {
+                    continue;
+                }
+                removed[ip] = true;
+            }
+
+            // Compact the code and retarget jumps; a removed instruction maps to its successor
+            std::vector<std::uint16_t> new_index(code.code.size() + 1);
+            std::vector<instruction> fused_code;
+            std::vector<source_location> fused_locations;
+            for (std::size_t ip = 0; ip < code.code.size(); ++ip)
+            {
+                new_index[ip] = std::uint16_t(fused_code.size());
+                if (!removed[ip])
+                {
+                    fused_code.push_back(code.code[ip]);
+                    fused_locations.push_back(code.locations[ip]);
+                }
+            }
+            new_index[code.code.size()] = std::uint16_t(fused_code.size());
+
+            for (std::size_t ip = 0; ip < fused_code.size(); ip += instruction_width(fused_code[ip].op))
+            {
+                for_each_operand(&fused_code[ip], [&](char kind, std::uint16_t& target) {
+                    if (kind == 'j')
+                        target = new_index[target];
+                });
+            }
+
+            code.code = std::move(fused_code);
+            code.locations = std::move(fused_locations);
+        }
+
+        // Rewrites `cmp d, x, y; jump_if_<v> d, @t` into the wide `cmp_branch d, x, y; @t, v`.
+        // Both forms occupy two words, so no jump needs retargeting.
+        void fuse_compare_and_branch(bytecode& code)
+        {
+            const auto targets = jump_targets(code);
+
+            for (std::size_t ip = 0; ip + 1 < code.code.size(); ip += instruction_width(code.code[ip].op))
+            {
+                auto& compare = code.code[ip];
+                auto& jump = code.code[ip + 1];
+
+                const auto it = branch_forms.find(compare.op);
+                if (it == branch_forms.end() || targets[ip + 1] || jump.a != compare.a)
+                    continue;
+                if (jump.op != opcode::jump_if_false && jump.op != opcode::jump_if_true)
+                    continue;
+
+                compare.op = it->second;
+                jump = {it->second, jump.b, std::uint16_t(jump.op == opcode::jump_if_true), 0};
+            }
+        }
+    } // namespace
+
+    void fuse_superinstructions(bytecode& code, const fusion_options& options)
+    {
+        if (options.constant_operands)
+            fuse_constant_operands(code);
+        if (options.compare_and_branch)
+            fuse_compare_and_branch(code);
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -3,9 +3,14 @@
 namespace tone::core {
 
     push_back_stream::push_back_stream(const character_source_t& input)
+        : push_back_stream(input, 0, 0)
+    {}
+
+    push_back_stream::push_back_stream(const character_source_t& input, std::size_t line_number,
+                                       std::size_t char_index)
         : _input(input)
-        , _line_num(0)
-        , _char_idx(0)
+        , _line_num(line_number)
+        , _char_idx(char_index)
     {}
 
     character_t push_back_stream::operator()()
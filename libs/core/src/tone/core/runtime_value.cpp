@@ -0,0 +1,70 @@
+#include "tone/core/runtime_value.hpp"
+#include "tone/core/variant_helpers.hpp"
+
+#include <algorithm>
+#include <codecvt>
+#include <locale>
+
+#include <fmt/format.h>
+
+namespace tone::core {
+    namespace {
+        // Long arrays are cut short after this many elements
+        constexpr std::size_t max_dumped_elements = 16;
+
+        std::string dump_element(const array& arr, std::size_t index)
+        {
+            switch (arr.kind())
+            {
+            case element_kind::int_element:
+                return dump_runtime_value(arr.get_int(index));
+            case element_kind::real_element:
+                return dump_runtime_value(arr.get_real(index));
+            case element_kind::bool_element:
+                return dump_runtime_value(arr.get_bool(index));
+            case element_kind::str_element:
+                return dump_runtime_value(arr.get_str(index));
+            case element_kind::array_element:
+                return dump_runtime_value(arr.get_array(index));
+            }
+            return {};
+        }
+    } // namespace
+
+    runtime_value default_value(type_handle type_id)
+    {
+        if (type_id == type_registry::get_real_handle())
+            return 0.0;
+        if (type_id == type_registry::get_bool_handle())
+            return false;
+        if (type_id == type_registry::get_str_handle())
+            return str();
+        if (type_id && std::holds_alternative<array_type>(*type_id))
+            return array(type_id);
+        return std::int64_t(0);
+    }
+
+    std::string dump_runtime_value(const runtime_value& value)
+    {
+        // clang-format off
+        return std::visit(overloaded {
+            [](std::int64_t value) { return fmt::format("{}", value); },
+            [](double value) { return fmt::format("{}", value); },
+            [](bool value) { return fmt::format("{}", value); },
+            [](const str& value) {
+                std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
+                return fmt::format("\"{}\"", convert.to_bytes(value.to_u16string()));
+            },
+            [](const array& value) {
+                std::string s = "[";
+                const auto count = std::min(value.size(), max_dumped_elements);
+                for (std::size_t i = 0; i < count; ++i)
+                    s += (i ? ", " : "") + dump_element(value, i);
+                if (count < value.size())
+                    s += fmt::format(", ... ({} elements)", value.size());
+                return s + "]";
+            }
+        }, value);
+        // clang-format on
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,586 @@
+#include "tone/core/script_module.hpp"
+
+#include "tone/core/compile_context.hpp"
+#include "tone/core/epoch.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/tokenizer.hpp"
+
+#include <algorithm>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace tone::core {
+    namespace {
+        void expect(token_iterator& it, reserved_token expected)
+        {
+            if (!it->is_reserved_token() || it->get_reserved_token() != expected)
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            ++it;
+        }
+
+        std::string expect_name(token_iterator& it)
+        {
+            if (!it->is_identifier())
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            std::string name(it->get_identifier());
+            ++it;
+            return name;
+        }
+
+        // A type keyword followed by any number of `[]`
+        type_handle parse_type(compile_context& context, token_iterator& it, bool allow_void)
+        {
+            type_handle type_id = nullptr;
+            if (it->is_reserved_token())
+            {
+                switch (it->get_reserved_token())
+                {
+                case reserved_token::kw_void:
+                    if (allow_void)
+                        type_id = type_registry::get_void_handle();
+                    break;
+                case reserved_token::kw_int:
+                    type_id = type_registry::get_int_handle();
+                    break;
+                case reserved_token::kw_real:
+                    type_id = type_registry::get_real_handle();
+                    break;
+                case reserved_token::kw_bool:
+                    type_id = type_registry::get_bool_handle();
+                    break;
+                case reserved_token::kw_str:
+                    type_id = type_registry::get_str_handle();
+                    break;
+                default:
+                    break;
+                }
+            }
+            if (!type_id)
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            ++it;
+            if (type_id == type_registry::get_void_handle())
+                return type_id;
+            while (it->is_reserved_token() &&
+                   it->get_reserved_token() == reserved_token::open_square)
+            {
+                ++it;
+                expect(it, reserved_token::close_square);
+                type_id = context.get_type_handle(array_type{type_id});
+            }
+            return type_id;
+        }
+
+        // Any number of `import name;`
+        std::vector<std::string> parse_imports(token_iterator& it)
+        {
+            std::vector<std::string> names;
+            while (it->is_identifier() && it->get_identifier() == "import")
+            {
+                ++it;
+                names.push_back(expect_name(it));
+                expect(it, reserved_token::semicolon);
+            }
+            return names;
+        }
+
+        // Reads `source` a byte at a time, then the end of input
+        character_source_t read_source(std::string_view source, std::size_t& pos)
+        {
+            return [source, &pos]() -> character_t {
+                return pos < source.size() ? character_t(source[pos++]) : -1;
+            };
+        }
+    } // namespace
+
+    std::vector<std::string> script_module::read_imports(std::string_view source)
+    {
+        std::size_t pos = 0;
+        const auto input = read_source(source, pos);
+        push_back_stream strm(input);
+        token_iterator it(strm);
+        return parse_imports(it);
+    }
+
+    script_module::script_module(compile_context& context, std::string source, compile_mode mode,
+                                 std::vector<const script_module*> imports)
+        : _context(context)
+        , _imports(std::move(imports))
+        , _mode(mode)
+    {
+        {
+            std::unique_lock declarations(context.declaration_mutex());
+            auto defs = parse(std::make_shared<const std::string>(std::move(source)),
+                              [&](const std::string& name) { return context.find(name); });
+            _import_names = std::move(defs.imports);
+            _functions = std::move(defs.functions);
+
+            // Only once every definition has parsed, so nothing is left declared by a module
+            // that failed to load
+            for (const auto& fn : _functions)
+            {
+                context.create_function(
+                        host_function(fn->name, function_type_id(*fn), call_entry, fn.get()));
+            }
+        }
+
+        if (mode == compile_mode::strict)
+        {
+            for (const auto& fn : _functions)
+                compile(*fn);
+        }
+    }
+
+    // Nothing can be running the code retired by reloads now, so it's freed while the context
+    // it refers to is still there
+    script_module::~script_module()
+    {
+        epoch_guard::reclaim();
+    }
+
+    const std::vector<std::string>& script_module::imports() const
+    {
+        return _import_names;
+    }
+
+    std::vector<std::string_view> script_module::names() const
+    {
+        std::shared_lock lock(_mutex);
+        std::vector<std::string_view> result;
+        for (const auto& fn : _functions)
+        {
+            if (!fn->removed)
+                result.push_back(fn->name);
+        }
+        return result;
+    }
+
+    bool script_module::is_compiled(std::string_view name) const
+    {
+        std::shared_lock lock(_mutex);
+        return find(name).ready.load(std::memory_order_acquire) != nullptr;
+    }
+
+    const compiled_expression& script_module::compile(std::string_view name)
+    {
+        std::shared_lock lock(_mutex);
+        return compile(find(name));
+    }
+
+    void script_module::compile_all(thread_pool& pool)
+    {
+        // Keeps the functions listed alive for the tasks, should a reload replace them
+        epoch_guard guard;
+        std::vector<thread_pool::task> tasks;
+        {
+            std::shared_lock lock(_mutex);
+            for (const auto& fn : _functions)
+            {
+                if (!fn->removed && !fn->ready.load(std::memory_order_acquire))
+                {
+                    tasks.emplace_back([this, f = fn.get()] {
+                        std::shared_lock lock(_mutex);
+                        if (!f->removed)
+                            compile(*f);
+                    });
+                }
+            }
+        }
+        pool.run(tasks);
+    }
+
+    std::vector<global_dependency> script_module::dependencies(std::string_view name) const
+    {
+        std::shared_lock lock(_mutex);
+        auto& fn = find(name);
+        std::lock_guard fn_lock(fn.mutex);
+        return fn.dependencies;
+    }
+
+    std::vector<global_dependency> script_module::dependencies() const
+    {
+        std::shared_lock lock(_mutex);
+        std::vector<global_dependency> result;
+        for (const auto& fn : _functions)
+        {
+            if (fn->removed)
+                continue;
+            std::lock_guard fn_lock(fn->mutex);
+            for (const auto& dep : fn->dependencies)
+            {
+                if (std::none_of(result.begin(), result.end(),
+                                 [&](const auto& other) { return other.name == dep.name; }))
+                    result.push_back(dep);
+            }
+        }
+        return result;
+    }
+
+    reload_result script_module::reload(std::string source,
+                                        std::vector<const script_module*> imports)
+    {
+        reload_result result;
+        {
+            std::unique_lock lock(_mutex);
+            std::unique_lock declarations(_context.declaration_mutex());
+            auto defs = parse(std::make_shared<const std::string>(std::move(source)),
+                              [this](const std::string& name) {
+                                  const auto info = _context.find(name);
+                                  return info && !owns(*info);
+                              });
+
+            std::vector<std::unique_ptr<function>> functions;
+            for (auto& def : defs.functions)
+            {
+                const auto it = std::find_if(_functions.begin(), _functions.end(),
+                                             [&](const auto& fn) { return fn->name == def->name; });
+                if (it == _functions.end())
+                {
+                    _context.create_function(host_function(def->name, function_type_id(*def),
+                                                           call_entry, def.get()));
+                    result.changed_signatures.push_back(def->name);
+                    functions.push_back(std::move(def));
+                    continue;
+                }
+
+                auto fn = std::move(*it);
+                _functions.erase(it);
+                const auto info = _context.find(fn->name);
+                const auto type_id = function_type_id(*def);
+                if (info->type_id() != type_id)
+                {
+                    // Bodies compiled against the old function may still call it, in this
+                    // module until the stale ones are dropped below and in others until they're
+                    // invalidated, so it's kept with its record until `retire_replaced`
+                    result.changed_signatures.push_back(fn->name);
+                    if (fn->ready.load(std::memory_order_relaxed))
+                        result.recompiled.push_back(fn->name);
+                    _replaced.push_back(_context.redefine_function(
+                            *info, host_function(def->name, type_id, call_entry, def.get())));
+                    fn->removed = true;
+                    _replaced.push_back(std::shared_ptr<const function>(std::move(fn)));
+                    functions.push_back(std::move(def));
+                    continue;
+                }
+
+                // The record declared is kept, as compiled code calls it
+                std::lock_guard fn_lock(fn->mutex);
+                if (fn->removed)
+                    result.changed_signatures.push_back(fn->name);
+                const auto same_param = [](const auto& l, const auto& r) {
+                    return l.name == r.name && l.type_id == r.type_id;
+                };
+                const bool unchanged =
+                        !fn->removed && fn->body == def->body &&
+                        std::equal(fn->params.begin(), fn->params.end(), def->params.begin(),
+                                   def->params.end(), same_param);
+                if (fn->compiled && !unchanged)
+                {
+                    retire_compiled(*fn);
+                    result.recompiled.push_back(fn->name);
+                }
+                else if (fn->compiled && (fn->line_number != def->line_number ||
+                                          fn->char_index != def->char_index))
+                {
+                    // Same code, moved by edits above it
+                    auto moved = std::make_unique<compiled_expression>(*fn->compiled);
+                    moved->shift_locations(
+                            std::ptrdiff_t(def->line_number) - std::ptrdiff_t(fn->line_number),
+                            std::ptrdiff_t(def->char_index) - std::ptrdiff_t(fn->char_index));
+                    fn->ready.store(moved.get(), std::memory_order_release);
+                    epoch_guard::retire(std::shared_ptr<const compiled_expression>(
+                            std::exchange(fn->compiled, std::move(moved))));
+                }
+
+                fn->source = std::move(def->source);
+                fn->params = std::move(def->params);
+                fn->body = def->body;
+                fn->line_number = def->line_number;
+                fn->char_index = def->char_index;
+                fn->def_line = def->def_line;
+                fn->def_char = def->def_char;
+                fn->removed = false;
+                functions.push_back(std::move(fn));
+            }
+
+            // What's left was removed, now or by an earlier reload. Each keeps any compiled body
+            // for the code still calling it.
+            for (auto& fn : _functions)
+            {
+                if (!fn->removed)
+                {
+                    fn->removed = true;
+                    result.changed_signatures.push_back(fn->name);
+                }
+                functions.push_back(std::move(fn));
+            }
+
+            _functions = std::move(functions);
+            _import_names = std::move(defs.imports);
+            _imports = std::move(imports);
+            for (auto& name : drop_stale())
+                result.recompiled.push_back(std::move(name));
+        }
+
+        if (_mode == compile_mode::strict)
+        {
+            std::shared_lock lock(_mutex);
+            for (const auto& fn : _functions)
+            {
+                if (!fn->removed)
+                    compile(*fn);
+            }
+        }
+        return result;
+    }
+
+    std::vector<std::string> script_module::invalidate_stale()
+    {
+        std::shared_lock lock(_mutex);
+        std::shared_lock declarations(_context.declaration_mutex());
+        return drop_stale();
+    }
+
+    void script_module::retire_replaced()
+    {
+        std::unique_lock lock(_mutex);
+        for (auto& replaced : _replaced)
+            epoch_guard::retire(std::move(replaced));
+        _replaced.clear();
+    }
+
+    runtime_value script_module::call(vm& machine, std::string_view name,
+                                      std::span<const runtime_value> args)
+    {
+        epoch_guard guard;
+        const compiled_expression* body;
+        {
+            std::shared_lock lock(_mutex);
+            body = &compile(find(name));
+        }
+        if (args.size() != body->params().size())
+        {
+            throw std::invalid_argument("'" + std::string(name) + "' takes " +
+                                        std::to_string(body->params().size()) + " arguments");
+        }
+        return machine.run(body->code(), args);
+    }
+
+    // Entry point of every function declared; runs the body on the VM running its caller. The
+    // guard keeps the body alive should a reload replace it meanwhile.
+    value_slot script_module::call_entry(const host_function& self, value_slot* args)
+    {
+        epoch_guard guard;
+        auto& fn = *static_cast<function*>(const_cast<void*>(self.target()));
+        auto body = fn.ready.load(std::memory_order_acquire);
+        if (!body)
+        {
+            // Without waiting for the module, which a reload may hold for a while
+            if (const auto failure = fn.failed.load(std::memory_order_acquire))
+                std::rethrow_exception(*failure);
+            std::shared_lock lock(fn.owner->_mutex);
+            body = &fn.owner->compile(fn);
+        }
+        vm* machine = vm::running();
+        if (!machine)
+            throw std::logic_error("Script functions can only be called by running code");
+        auto result = machine->run_slots(body->code(), std::span(args, body->params().size()));
+        if (self.result_type() == type_registry::get_void_handle())
+            return value_slot{};
+        return make_slot(result);
+    }
+
+    script_module::parsed script_module::parse(
+            std::shared_ptr<const std::string> source,
+            const std::function<bool(const std::string&)>& taken)
+    {
+        std::size_t pos = 0;
+        const auto input = read_source(*source, pos);
+        push_back_stream strm(input);
+        token_iterator it(strm);
+
+        parsed result;
+        result.imports = parse_imports(it);
+        while (!it->is_eof())
+        {
+            auto fn = std::make_unique<function>();
+            fn->owner = this;
+            fn->source = source;
+            fn->def_line = it->get_line_number();
+            fn->def_char = it->get_char_index();
+            expect(it, reserved_token::kw_fn);
+
+            fn->result_type = parse_type(_context, it, true);
+            fn->name = expect_name(it);
+            expect(it, reserved_token::open_paren);
+            if (!it->is_reserved_token() || it->get_reserved_token() != reserved_token::close_paren)
+            {
+                for (;;)
+                {
+                    const auto type_id = parse_type(_context, it, false);
+                    fn->params.push_back({expect_name(it), type_id});
+                    if (!it->is_reserved_token() ||
+                        it->get_reserved_token() != reserved_token::comma)
+                        break;
+                    ++it;
+                }
+            }
+            expect(it, reserved_token::close_paren);
+
+            // The stream is just past the token the iterator is on, so after an opening brace it
+            // is where the body starts, and after a closing one just beyond where it ends
+            if (!it->is_reserved_token() || it->get_reserved_token() != reserved_token::open_curly)
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            fn->line_number = strm.line_number();
+            fn->char_index = strm.char_index();
+            const auto begin = strm.char_index();
+            for (std::size_t depth = 1; depth > 0;)
+            {
+                ++it;
+                if (it->is_eof())
+                    throw syntax_error("Missing '}' ending the body of '" + fn->name + "'",
+                                       fn->def_line, fn->def_char);
+                if (!it->is_reserved_token())
+                    continue;
+                if (it->get_reserved_token() == reserved_token::open_curly)
+                    ++depth;
+                else if (it->get_reserved_token() == reserved_token::close_curly)
+                    --depth;
+            }
+            fn->body = std::string_view(*source).substr(begin, strm.char_index() - 1 - begin);
+            ++it;
+
+            const auto declared = [&](const auto& other) { return other->name == fn->name; };
+            if (taken(fn->name) ||
+                std::any_of(result.functions.begin(), result.functions.end(), declared))
+                throw semantic_error("'" + fn->name + "' is already declared", fn->def_line,
+                                     fn->def_char);
+            result.functions.push_back(std::move(fn));
+        }
+        return result;
+    }
+
+    type_handle script_module::function_type_id(const function& fn)
+    {
+        std::vector<function_type::param> params;
+        for (const auto& param : fn.params)
+            params.push_back({param.type_id, false});
+        return _context.get_type_handle(function_type{fn.result_type, std::move(params)});
+    }
+
+    script_module::function& script_module::find(std::string_view name) const
+    {
+        const auto it = std::find_if(_functions.begin(), _functions.end(), [&](const auto& fn) {
+            return !fn->removed && fn->name == name;
+        });
+        if (it == _functions.end())
+            throw std::invalid_argument("No function '" + std::string(name) + "'");
+        return **it;
+    }
+
+    const compiled_expression& script_module::compile(function& fn)
+    {
+        if (const auto ready = fn.ready.load(std::memory_order_acquire))
+            return *ready;
+
+        std::shared_lock declarations(_context.declaration_mutex());
+        std::lock_guard lock(fn.mutex);
+        if (fn.failure)
+            std::rethrow_exception(*fn.failure);
+        if (!fn.compiled)
+        {
+            std::vector<global_dependency> dependencies;
+            auto local = _context.fork([&](const std::string& name, const identifier_info& info) {
+                if (!sees(info))
+                    return false;
+                if (std::none_of(dependencies.begin(), dependencies.end(),
+                                 [&](const auto& dep) { return dep.name == name; }))
+                    dependencies.push_back({name, info.type_id()});
+                return true;
+            });
+            std::unique_ptr<compiled_expression> compiled;
+            try
+            {
+                compiled = std::make_unique<compiled_expression>(local, fn.params, fn.body,
+                                                                 fn.line_number, fn.char_index);
+                const auto body_type = compiled->result_type();
+                if (fn.result_type != type_registry::get_void_handle() &&
+                    body_type != fn.result_type)
+                {
+                    throw wrong_type_error(dump_type_handle(body_type),
+                                           dump_type_handle(fn.result_type), false,
+                                           fn.line_number, fn.char_index);
+                }
+            }
+            catch (const error&)
+            {
+                fn.failure = std::make_unique<const std::exception_ptr>(std::current_exception());
+                fn.failed.store(fn.failure.get(), std::memory_order_release);
+                throw;
+            }
+            fn.dependencies = std::move(dependencies);
+            fn.compiled = std::move(compiled);
+            fn.ready.store(fn.compiled.get(), std::memory_order_release);
+        }
+        return *fn.compiled;
+    }
+
+    std::vector<std::string> script_module::drop_stale()
+    {
+        std::vector<std::string> stale;
+        for (const auto& fn : _functions)
+        {
+            std::lock_guard lock(fn->mutex);
+            if (fn->failure)
+                retire_failure(*fn);
+            if (!fn->compiled || fn->removed)
+                continue;
+            const auto changed = [&](const global_dependency& dep) {
+                const auto info = _context.find(dep.name);
+                return !info || !sees(*info) || info->type_id() != dep.type_id;
+            };
+            if (std::any_of(fn->dependencies.begin(), fn->dependencies.end(), changed))
+            {
+                retire_compiled(*fn);
+                stale.push_back(fn->name);
+            }
+        }
+        return stale;
+    }
+
+    void script_module::retire_compiled(function& fn)
+    {
+        fn.ready.store(nullptr, std::memory_order_release);
+        epoch_guard::retire(std::shared_ptr<const compiled_expression>(std::move(fn.compiled)));
+        fn.dependencies.clear();
+    }
+
+    void script_module::retire_failure(function& fn)
+    {
+        fn.failed.store(nullptr, std::memory_order_release);
+        epoch_guard::retire(std::shared_ptr<const std::exception_ptr>(std::move(fn.failure)));
+    }
+
+    bool script_module::sees(const identifier_info& info) const
+    {
+        const auto fn = _context.find_function(info);
+        if (!fn || fn->entry() != call_entry)
+            return true;
+        const auto target = static_cast<const function*>(fn->target());
+        if (target->removed)
+            return false;
+        return target->owner == this ||
+               std::find(_imports.begin(), _imports.end(), target->owner) != _imports.end();
+    }
+
+    bool script_module::owns(const identifier_info& info) const
+    {
+        const auto fn = _context.find_function(info);
+        return fn && fn->entry() == call_entry &&
+               static_cast<const function*>(fn->target())->owner == this;
+    }
+} // namespace tone::core
\ No newline at end of file
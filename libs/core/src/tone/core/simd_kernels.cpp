@@ -0,0 +1,218 @@
+#include "tone/core/simd_kernels.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if TONE_SIMD
+#include <immintrin.h>
+#endif
+
+// Compiles the functions between BEGIN and END for the instruction set `isa`, so each level's
+// kernels can use it without the rest of the library requiring it
+#if TONE_SIMD
+#define TONE_STRINGIFY(x) #x
+#if defined(__clang__)
+#define TONE_TARGET_REGION_BEGIN(isa) \
+    _Pragma(TONE_STRINGIFY(clang attribute push(__attribute__((target(isa))), apply_to = function)))
+#define TONE_TARGET_REGION_END _Pragma("clang attribute pop")
+#else
+#define TONE_TARGET_REGION_BEGIN(isa) \
+    _Pragma("GCC push_options") _Pragma(TONE_STRINGIFY(GCC target(isa)))
+#define TONE_TARGET_REGION_END _Pragma("GCC pop_options")
+#endif
+#endif
+
+namespace tone::core {
+    namespace {
+        // Copies the elements of a 64-element block whose bit is set in `bits`, in order
+        std::size_t compress_by_scan(const std::uint64_t* in, std::uint64_t bits,
+                                     std::uint64_t* out)
+        {
+            std::size_t count = 0;
+            for (; bits; bits &= bits - 1)
+                out[count++] = in[std::countr_zero(bits)];
+            return count;
+        }
+
+        // Single lanes, for CPUs without the instruction sets below and other compilers
+        namespace scalar {
+            constexpr std::size_t lanes = 1;
+            using real_vec = double;
+            using int_vec = std::int64_t;
+            using word_vec = std::uint64_t;
+
+            std::uint64_t to_bits(bool value)
+            {
+                return value;
+            }
+
+            std::size_t compress(const std::uint64_t* in, std::uint64_t bits, std::uint64_t* out)
+            {
+                return compress_by_scan(in, bits, out);
+            }
+
+#include "simd_kernels.inl"
+        } // namespace scalar
+
+#if TONE_SIMD
+        TONE_TARGET_REGION_BEGIN("sse4.2")
+        namespace sse {
+            constexpr std::size_t lanes = 2;
+            typedef double real_vec __attribute__((vector_size(16)));
+            typedef std::int64_t int_vec __attribute__((vector_size(16)));
+            typedef std::uint64_t word_vec __attribute__((vector_size(16)));
+
+            std::uint64_t to_bits(int_vec mask)
+            {
+                return std::uint64_t(_mm_movemask_pd(__m128d(mask)));
+            }
+
+            std::size_t compress(const std::uint64_t* in, std::uint64_t bits, std::uint64_t* out)
+            {
+                return compress_by_scan(in, bits, out);
+            }
+
+#include "simd_kernels.inl"
+        } // namespace sse
+        TONE_TARGET_REGION_END
+
+        TONE_TARGET_REGION_BEGIN("avx2")
+        namespace avx2 {
+            constexpr std::size_t lanes = 4;
+            typedef double real_vec __attribute__((vector_size(32)));
+            typedef std::int64_t int_vec __attribute__((vector_size(32)));
+            typedef std::uint64_t word_vec __attribute__((vector_size(32)));
+
+            std::uint64_t to_bits(int_vec mask)
+            {
+                return std::uint64_t(_mm256_movemask_pd(__m256d(mask)));
+            }
+
+            std::size_t compress(const std::uint64_t* in, std::uint64_t bits, std::uint64_t* out)
+            {
+                return compress_by_scan(in, bits, out);
+            }
+
+#include "simd_kernels.inl"
+        } // namespace avx2
+        TONE_TARGET_REGION_END
+
+        TONE_TARGET_REGION_BEGIN("avx512f")
+        namespace avx512 {
+            constexpr std::size_t lanes = 8;
+            typedef double real_vec __attribute__((vector_size(64)));
+            typedef std::int64_t int_vec __attribute__((vector_size(64)));
+            typedef std::uint64_t word_vec __attribute__((vector_size(64)));
+
+            std::uint64_t to_bits(int_vec mask)
+            {
+                return std::uint64_t(_mm512_test_epi64_mask(__m512i(mask), __m512i(mask)));
+            }
+
+            // Eight elements at a time with the compressing store. The loads are masked too, as
+            // the block can end before the eight elements do.
+            std::size_t compress(const std::uint64_t* in, std::uint64_t bits, std::uint64_t* out)
+            {
+                std::size_t count = 0;
+                for (std::size_t i = 0; bits; i += 8, bits >>= 8)
+                {
+                    const auto selected = __mmask8(bits & 0xff);
+                    _mm512_mask_compressstoreu_epi64(out + count, selected,
+                                                     _mm512_maskz_loadu_epi64(selected, in + i));
+                    count += std::size_t(std::popcount(std::uint8_t(selected)));
+                }
+                return count;
+            }
+
+#include "simd_kernels.inl"
+        } // namespace avx512
+        TONE_TARGET_REGION_END
+#endif
+
+        simd_level detect_simd_level()
+        {
+#if TONE_SIMD
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return simd_level::avx512;
+            if (__builtin_cpu_supports("avx2"))
+                return simd_level::avx2;
+            if (__builtin_cpu_supports("sse4.2"))
+                return simd_level::sse;
+#endif
+            return simd_level::scalar;
+        }
+
+        const simd_kernels& kernels_for(simd_level level)
+        {
+            switch (level)
+            {
+#if TONE_SIMD
+            case simd_level::sse:
+                return sse::kernels;
+            case simd_level::avx2:
+                return avx2::kernels;
+            case simd_level::avx512:
+                return avx512::kernels;
+#endif
+            default:
+                return scalar::kernels;
+            }
+        }
+
+        simd_level& current_level()
+        {
+            static simd_level level = supported_simd_level();
+            return level;
+        }
+
+        const simd_kernels*& current_kernels()
+        {
+            static const simd_kernels* kernels = &kernels_for(current_level());
+            return kernels;
+        }
+    } // namespace
+
+    simd_level supported_simd_level()
+    {
+        static const simd_level level = detect_simd_level();
+        return level;
+    }
+
+    simd_level active_simd_level()
+    {
+        return current_level();
+    }
+
+    void set_simd_level(simd_level level)
+    {
+        current_level() = std::min(level, supported_simd_level());
+        current_kernels() = &kernels_for(current_level());
+    }
+
+    const simd_kernels& get_simd_kernels()
+    {
+        return *current_kernels();
+    }
+
+    void prefix_sum_int(const std::int64_t* in, std::int64_t* out, std::size_t n)
+    {
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            sum += std::uint64_t(in[i]);
+            out[i] = std::int64_t(sum);
+        }
+    }
+
+    void prefix_sum_real(const double* in, double* out, std::size_t n)
+    {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            sum += in[i];
+            out[i] = sum;
+        }
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,322 @@
+// Kernel bodies shared by every level, written once over vectors of `lanes` 8-byte elements.
+// simd_kernels.cpp includes this once per level, inside a namespace compiled for that
+// instruction set which defines `lanes` and the vector types `real_vec`, `int_vec` and
+// `word_vec`, which may be plain scalars when `lanes` is 1. It also defines `to_bits`, which packs
+// the result of a vector comparison into one bit per lane, and `compress`, which copies the
+// elements of a 64-element block whose mask bit is set.
+
+// Independent accumulators, so reductions aren't bound by the latency of one add
+constexpr std::size_t accumulators = 4;
+
+template <typename V, typename T>
+V load(const T* p)
+{
+    V v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <typename V, typename T>
+void store(T* p, V v)
+{
+    std::memcpy(p, &v, sizeof(v));
+}
+
+template <typename T, typename V>
+T lane(const V& v, std::size_t index)
+{
+    if constexpr (lanes == 1)
+        return T(v);
+    else
+        return T(v[index]);
+}
+
+template <typename V, typename T, typename Op>
+void elementwise(const T* l, const T* r, T* out, std::size_t n, Op op)
+{
+    std::size_t i = 0;
+    for (; i + lanes <= n; i += lanes)
+        store(out + i, op(load<V>(l + i), load<V>(r + i)));
+    for (; i < n; ++i)
+        out[i] = op(l[i], r[i]);
+}
+
+template <typename V, typename T, typename Op>
+void compare(const T* l, const T* r, std::uint64_t* mask, std::size_t n, Op op)
+{
+    for (std::size_t base = 0; base < n; base += 64)
+    {
+        const auto count = std::min<std::size_t>(64, n - base);
+        std::uint64_t bits = 0;
+        std::size_t i = 0;
+        for (; i + lanes <= count; i += lanes)
+            bits |= to_bits(op(load<V>(l + base + i), load<V>(r + base + i))) << i;
+        for (; i < count; ++i)
+            bits |= std::uint64_t(op(l[base + i], r[base + i])) << i;
+        mask[base / 64] = bits;
+    }
+}
+
+template <typename V, typename T, typename Op>
+T reduce(const T* in, std::size_t n, T init, Op op)
+{
+    V acc[accumulators];
+    for (auto& a : acc)
+        a = V{} + init;
+
+    std::size_t i = 0;
+    for (; i + accumulators * lanes <= n; i += accumulators * lanes)
+    {
+        for (std::size_t k = 0; k < accumulators; ++k)
+            acc[k] = op(acc[k], load<V>(in + i + k * lanes));
+    }
+    for (; i + lanes <= n; i += lanes)
+        acc[0] = op(acc[0], load<V>(in + i));
+
+    T result = init;
+    for (const auto& a : acc)
+    {
+        for (std::size_t k = 0; k < lanes; ++k)
+            result = op(result, lane<T>(a, k));
+    }
+    for (; i < n; ++i)
+        result = op(result, in[i]);
+    return result;
+}
+
+template <typename V, typename T>
+T dot(const T* l, const T* r, std::size_t n)
+{
+    V acc[accumulators] = {};
+    std::size_t i = 0;
+    for (; i + accumulators * lanes <= n; i += accumulators * lanes)
+    {
+        for (std::size_t k = 0; k < accumulators; ++k)
+        {
+            const auto offset = i + k * lanes;
+            acc[k] += load<V>(l + offset) * load<V>(r + offset);
+        }
+    }
+    for (; i + lanes <= n; i += lanes)
+        acc[0] += load<V>(l + i) * load<V>(r + i);
+
+    T result = 0;
+    for (const auto& a : acc)
+    {
+        for (std::size_t k = 0; k < lanes; ++k)
+            result += lane<T>(a, k);
+    }
+    for (; i < n; ++i)
+        result += l[i] * r[i];
+    return result;
+}
+
+const std::uint64_t* words(const std::int64_t* p)
+{
+    return reinterpret_cast<const std::uint64_t*>(p);
+}
+
+std::uint64_t* words(std::int64_t* p)
+{
+    return reinterpret_cast<std::uint64_t*>(p);
+}
+
+void add_int(const std::int64_t* l, const std::int64_t* r, std::int64_t* out, std::size_t n)
+{
+    elementwise<word_vec>(words(l), words(r), words(out), n, [](auto a, auto b) {
+        return a + b;
+    });
+}
+
+void sub_int(const std::int64_t* l, const std::int64_t* r, std::int64_t* out, std::size_t n)
+{
+    elementwise<word_vec>(words(l), words(r), words(out), n, [](auto a, auto b) {
+        return a - b;
+    });
+}
+
+void mul_int(const std::int64_t* l, const std::int64_t* r, std::int64_t* out, std::size_t n)
+{
+    elementwise<word_vec>(words(l), words(r), words(out), n, [](auto a, auto b) {
+        return a * b;
+    });
+}
+
+void add_real(const double* l, const double* r, double* out, std::size_t n)
+{
+    elementwise<real_vec>(l, r, out, n, [](auto a, auto b) {
+        return a + b;
+    });
+}
+
+void sub_real(const double* l, const double* r, double* out, std::size_t n)
+{
+    elementwise<real_vec>(l, r, out, n, [](auto a, auto b) {
+        return a - b;
+    });
+}
+
+void mul_real(const double* l, const double* r, double* out, std::size_t n)
+{
+    elementwise<real_vec>(l, r, out, n, [](auto a, auto b) {
+        return a * b;
+    });
+}
+
+void div_real(const double* l, const double* r, double* out, std::size_t n)
+{
+    elementwise<real_vec>(l, r, out, n, [](auto a, auto b) {
+        return a / b;
+    });
+}
+
+void equal_int(const std::int64_t* l, const std::int64_t* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<int_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a == b;
+    });
+}
+
+void not_equal_int(const std::int64_t* l, const std::int64_t* r, std::uint64_t* mask,
+                   std::size_t n)
+{
+    compare<int_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a != b;
+    });
+}
+
+void less_int(const std::int64_t* l, const std::int64_t* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<int_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a < b;
+    });
+}
+
+void less_equal_int(const std::int64_t* l, const std::int64_t* r, std::uint64_t* mask,
+                    std::size_t n)
+{
+    compare<int_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a <= b;
+    });
+}
+
+void equal_real(const double* l, const double* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<real_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a == b;
+    });
+}
+
+void not_equal_real(const double* l, const double* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<real_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a != b;
+    });
+}
+
+void less_real(const double* l, const double* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<real_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a < b;
+    });
+}
+
+void less_equal_real(const double* l, const double* r, std::uint64_t* mask, std::size_t n)
+{
+    compare<real_vec>(l, r, mask, n, [](auto a, auto b) {
+        return a <= b;
+    });
+}
+
+std::int64_t sum_int(const std::int64_t* in, std::size_t n)
+{
+    return std::int64_t(reduce<word_vec>(words(in), n, std::uint64_t(0), [](auto a, auto b) {
+        return a + b;
+    }));
+}
+
+std::int64_t min_int(const std::int64_t* in, std::size_t n)
+{
+    return reduce<int_vec>(in, n, in[0], [](auto a, auto b) {
+        return b < a ? b : a;
+    });
+}
+
+std::int64_t max_int(const std::int64_t* in, std::size_t n)
+{
+    return reduce<int_vec>(in, n, in[0], [](auto a, auto b) {
+        return b > a ? b : a;
+    });
+}
+
+double sum_real(const double* in, std::size_t n)
+{
+    return reduce<real_vec>(in, n, 0.0, [](auto a, auto b) {
+        return a + b;
+    });
+}
+
+double min_real(const double* in, std::size_t n)
+{
+    return reduce<real_vec>(in, n, in[0], [](auto a, auto b) {
+        return b < a ? b : a;
+    });
+}
+
+double max_real(const double* in, std::size_t n)
+{
+    return reduce<real_vec>(in, n, in[0], [](auto a, auto b) {
+        return b > a ? b : a;
+    });
+}
+
+std::int64_t dot_int(const std::int64_t* l, const std::int64_t* r, std::size_t n)
+{
+    return std::int64_t(dot<word_vec>(words(l), words(r), n));
+}
+
+double dot_real(const double* l, const double* r, std::size_t n)
+{
+    return dot<real_vec>(l, r, n);
+}
+
+std::size_t filter(const std::uint64_t* in, const std::uint64_t* mask, std::size_t n,
+                   std::uint64_t* out)
+{
+    std::size_t count = 0;
+    for (std::size_t base = 0; base < n; base += 64)
+    {
+        auto bits = mask[base / 64];
+        if (n - base < 64)
+            bits &= (std::uint64_t(1) << (n - base)) - 1;
+        count += compress(in + base, bits, out + count);
+    }
+    return count;
+}
+
+const simd_kernels kernels = {
+        .add_int = add_int,
+        .sub_int = sub_int,
+        .mul_int = mul_int,
+        .add_real = add_real,
+        .sub_real = sub_real,
+        .mul_real = mul_real,
+        .div_real = div_real,
+        .equal_int = equal_int,
+        .not_equal_int = not_equal_int,
+        .less_int = less_int,
+        .less_equal_int = less_equal_int,
+        .equal_real = equal_real,
+        .not_equal_real = not_equal_real,
+        .less_real = less_real,
+        .less_equal_real = less_equal_real,
+        .sum_int = sum_int,
+        .min_int = min_int,
+        .max_int = max_int,
+        .sum_real = sum_real,
+        .min_real = min_real,
+        .max_real = max_real,
+        .dot_int = dot_int,
+        .dot_real = dot_real,
+        .filter = filter,
+};
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "tone/core/str.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace tone::core {
+    namespace {
+        // Inline handles have the low bit set, their length in the rest of the low byte and one
+        // Latin-1 character in each of the following bytes. Buffers are at least 8-byte aligned,
+        // so their addresses never have the low bit set.
+        constexpr std::uintptr_t inline_flag = 1;
+
+        bool is_inline_handle(std::uintptr_t handle)
+        {
+            return handle & inline_flag;
+        }
+
+        std::size_t inline_size(std::uintptr_t handle)
+        {
+            return (handle & 0xff) >> 1;
+        }
+
+        char16_t inline_char(std::uintptr_t handle, std::size_t index)
+        {
+            return char16_t((handle >> (8 * (index + 1))) & 0xff);
+        }
+
+        bool fits_inline(std::u16string_view l, std::u16string_view r = {})
+        {
+            if (l.size() + r.size() > str::max_inline)
+                return false;
+            const auto latin1 = [](char16_t c) {
+                return c < 0x100;
+            };
+            return std::all_of(l.begin(), l.end(), latin1) &&
+                   std::all_of(r.begin(), r.end(), latin1);
+        }
+
+        std::uintptr_t make_inline(std::u16string_view l, std::u16string_view r = {})
+        {
+            const auto size = l.size() + r.size();
+            if (size == 0)
+                return 0;
+
+            auto handle = std::uintptr_t(size << 1) | inline_flag;
+            std::size_t shift = 8;
+            for (const auto part : {l, r})
+            {
+                for (const char16_t c : part)
+                {
+                    handle |= std::uintptr_t(c) << shift;
+                    shift += 8;
+                }
+            }
+            return handle;
+        }
+
+        // FNV-1a over the UTF-16 code units, so inline and heap strings hash alike
+        std::size_t hash_chars(std::u16string_view text)
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (const char16_t c : text)
+            {
+                h = (h ^ (c & 0xff)) * 1099511628211ull;
+                h = (h ^ (c >> 8)) * 1099511628211ull;
+            }
+            // Zero marks a buffer whose hash isn't cached yet
+            return h ? std::size_t(h) : 1;
+        }
+    } // namespace
+
+    char16_t* str::buffer::own_data()
+    {
+        return reinterpret_cast<char16_t*>(this + 1);
+    }
+
+    bool str::buffer::is_borrowed() const
+    {
+        return !source && data != reinterpret_cast<const char16_t*>(this + 1);
+    }
+
+    str::buffer* str::allocate(std::size_t size, std::size_t capacity)
+    {
+        capacity = std::max(size, capacity);
+        if (capacity > std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error("String too long");
+
+        void* memory = ::operator new(sizeof(buffer) + capacity * sizeof(char16_t));
+        auto* buf = new (memory)
+                buffer{{1}, std::uint32_t(size), std::uint32_t(capacity), {0}, nullptr, nullptr};
+        buf->data = buf->own_data();
+        return buf;
+    }
+
+    void str::add_ref(buffer* buf)
+    {
+        buf->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void str::release_ref(buffer* buf)
+    {
+        if (buf->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        if (buf->source)
+            release_ref(buf->source);
+        buf->~buffer();
+        ::operator delete(buf);
+    }
+
+    str::buffer* str::heap() const
+    {
+        if (!_handle || is_inline_handle(_handle))
+            return nullptr;
+        return reinterpret_cast<buffer*>(_handle);
+    }
+
+    str::str(std::u16string_view text)
+    {
+        if (fits_inline(text))
+        {
+            _handle = make_inline(text);
+            return;
+        }
+        auto* buf = allocate(text.size());
+        std::copy(text.begin(), text.end(), buf->own_data());
+        _handle = reinterpret_cast<std::uintptr_t>(buf);
+    }
+
+    str::str(const str& other)
+        : _handle(other._handle)
+    {
+        if (auto* buf = heap())
+            add_ref(buf);
+    }
+
+    str::str(str&& other) noexcept
+        : _handle(std::exchange(other._handle, 0))
+    {}
+
+    str& str::operator=(const str& other)
+    {
+        str copy(other);
+        std::swap(_handle, copy._handle);
+        return *this;
+    }
+
+    str& str::operator=(str&& other) noexcept
+    {
+        std::swap(_handle, other._handle);
+        return *this;
+    }
+
+    str::~str()
+    {
+        if (auto* buf = heap())
+            release_ref(buf);
+    }
+
+    std::size_t str::size() const
+    {
+        if (const auto* buf = heap())
+            return buf->size;
+        return inline_size(_handle);
+    }
+
+    bool str::empty() const
+    {
+        return !_handle;
+    }
+
+    bool str::is_inline() const
+    {
+        return is_inline_handle(_handle);
+    }
+
+    bool str::is_borrowed() const
+    {
+        const auto* buf = heap();
+        return buf && buf->is_borrowed();
+    }
+
+    bool str::is_unique() const
+    {
+        const auto* buf = heap();
+        return buf && buf->refs.load(std::memory_order_acquire) == 1;
+    }
+
+    char16_t str::operator[](std::size_t index) const
+    {
+        if (const auto* buf = heap())
+            return buf->data[index];
+        return inline_char(_handle, index);
+    }
+
+    std::size_t str::hash() const
+    {
+        auto* buf = heap();
+        if (!buf)
+        {
+            inline_buffer scratch;
+            return hash_chars(view(scratch));
+        }
+
+        auto h = buf->hash.load(std::memory_order_relaxed);
+        if (!h)
+        {
+            h = hash_chars({buf->data, buf->size});
+            buf->hash.store(h, std::memory_order_relaxed);
+        }
+        return h;
+    }
+
+    std::u16string_view str::view(inline_buffer& scratch) const
+    {
+        return view(handle(), scratch);
+    }
+
+    std::u16string str::to_u16string() const
+    {
+        inline_buffer scratch;
+        return std::u16string(view(scratch));
+    }
+
+    str str::substr(std::size_t pos, std::size_t count) const
+    {
+        inline_buffer scratch;
+        const auto text = view(scratch);
+        if (pos > text.size())
+            throw std::out_of_range("String slice out of range");
+        const auto part = text.substr(pos, count);
+        if (part.size() == text.size())
+            return *this;
+        if (fits_inline(part))
+            return adopt(reinterpret_cast<void*>(make_inline(part)));
+
+        // Slices always point at the buffer owning the characters, never at another slice. The
+        // host's characters may not outlive the borrowed buffer, so those are copied.
+        auto* source = heap();
+        if (source->source)
+            source = source->source;
+        if (source->is_borrowed())
+            return str(part);
+        add_ref(source);
+
+        auto* slice = allocate(0);
+        slice->size = std::uint32_t(part.size());
+        slice->data = part.data();
+        slice->source = source;
+        return adopt(slice);
+    }
+
+    bool str::operator==(const str& other) const
+    {
+        if (_handle == other._handle)
+            return true;
+        // Inline handles are canonical, so an inline string only equals the same handle
+        if (is_inline() || other.is_inline() || size() != other.size())
+            return false;
+
+        const auto* l = heap();
+        const auto* r = other.heap();
+        const auto lh = l->hash.load(std::memory_order_relaxed);
+        const auto rh = r->hash.load(std::memory_order_relaxed);
+        if (lh && rh && lh != rh)
+            return false;
+        return std::equal(l->data, l->data + l->size, r->data);
+    }
+
+    std::strong_ordering str::operator<=>(const str& other) const
+    {
+        inline_buffer l_scratch;
+        inline_buffer r_scratch;
+        return view(l_scratch).compare(other.view(r_scratch)) <=> 0;
+    }
+
+    void str::append(std::u16string_view text)
+    {
+        _handle = reinterpret_cast<std::uintptr_t>(append(handle(), text));
+    }
+
+    str str::concat(std::u16string_view l, std::u16string_view r)
+    {
+        if (fits_inline(l, r))
+            return adopt(reinterpret_cast<void*>(make_inline(l, r)));
+
+        auto* buf = allocate(l.size() + r.size());
+        std::copy(l.begin(), l.end(), buf->own_data());
+        std::copy(r.begin(), r.end(), buf->own_data() + l.size());
+        return adopt(buf);
+    }
+
+    str str::borrow(std::u16string_view text)
+    {
+        if (fits_inline(text))
+            return str(text);
+        if (text.size() > std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error("String too long");
+
+        // No room to spare, so appends never write to the host's characters
+        auto* buf = allocate(0);
+        buf->size = std::uint32_t(text.size());
+        buf->capacity = buf->size;
+        buf->data = text.data();
+        return adopt(buf);
+    }
+
+    void str::own()
+    {
+        auto* buf = heap();
+        if (!buf || !buf->is_borrowed())
+            return;
+
+        auto* copy = allocate(buf->size);
+        std::copy(buf->data, buf->data + buf->size, copy->own_data());
+        buf->data = copy->data;
+        buf->source = copy;
+    }
+
+    void* str::handle() const
+    {
+        return reinterpret_cast<void*>(_handle);
+    }
+
+    void* str::release()
+    {
+        return reinterpret_cast<void*>(std::exchange(_handle, 0));
+    }
+
+    str str::adopt(void* handle)
+    {
+        str result;
+        result._handle = reinterpret_cast<std::uintptr_t>(handle);
+        return result;
+    }
+
+    str str::share(const void* handle)
+    {
+        str result;
+        result._handle = reinterpret_cast<std::uintptr_t>(handle);
+        if (auto* buf = result.heap())
+            add_ref(buf);
+        return result;
+    }
+
+    std::u16string_view str::view(const void* handle, inline_buffer& scratch)
+    {
+        const auto bits = reinterpret_cast<std::uintptr_t>(handle);
+        if (!bits)
+            return {};
+        if (is_inline_handle(bits))
+        {
+            const auto size = inline_size(bits);
+            for (std::size_t i = 0; i < size; ++i)
+                scratch[i] = inline_char(bits, i);
+            return {scratch.data(), size};
+        }
+        const auto* buf = static_cast<const buffer*>(handle);
+        return {buf->data, buf->size};
+    }
+
+    std::size_t str::size(const void* handle)
+    {
+        const auto bits = reinterpret_cast<std::uintptr_t>(handle);
+        if (!bits || is_inline_handle(bits))
+            return inline_size(bits);
+        return static_cast<const buffer*>(handle)->size;
+    }
+
+    void* str::append(void* handle, std::u16string_view text)
+    {
+        if (text.empty())
+            return handle;
+
+        const auto bits = reinterpret_cast<std::uintptr_t>(handle);
+        buffer* buf = bits && !is_inline_handle(bits) ? static_cast<buffer*>(handle) : nullptr;
+        if (buf && !buf->source && buf->refs.load(std::memory_order_acquire) == 1 &&
+            buf->capacity - buf->size >= text.size())
+        {
+            std::copy(text.begin(), text.end(), buf->own_data() + buf->size);
+            buf->size += std::uint32_t(text.size());
+            buf->hash.store(0, std::memory_order_relaxed);
+            return handle;
+        }
+
+        inline_buffer scratch;
+        const auto current = view(handle, scratch);
+        str result;
+        if (fits_inline(current, text))
+        {
+            result = concat(current, text);
+        }
+        else
+        {
+            const auto size = current.size() + text.size();
+            auto* grown = allocate(size, 2 * size);
+            std::copy(current.begin(), current.end(), grown->own_data());
+            std::copy(text.begin(), text.end(), grown->own_data() + current.size());
+            result = adopt(grown);
+        }
+
+        // `text` may point into the old buffer, so it's only released once copied
+        if (buf)
+            release_ref(buf);
+        return result.release();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    /// `str::builder` class
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    str::builder::builder(std::size_t size)
+    {
+        if (size > max_inline)
+            _buffer = allocate(size);
+    }
+
+    str::builder::~builder()
+    {
+        if (_buffer)
+            release_ref(_buffer);
+    }
+
+    void str::builder::append(std::u16string_view text)
+    {
+        char16_t* out = _buffer ? _buffer->own_data() : _chars.data();
+        std::copy(text.begin(), text.end(), out + _size);
+        _size += text.size();
+    }
+
+    void str::builder::append(const void* handle)
+    {
+        inline_buffer scratch;
+        append(view(handle, scratch));
+    }
+
+    str str::builder::finish()
+    {
+        if (!_buffer)
+            return str(std::u16string_view(_chars.data(), _size));
+        _buffer->size = std::uint32_t(_size);
+        return adopt(std::exchange(_buffer, nullptr));
+    }
+} // namespace tone::core
\ No newline at end of file
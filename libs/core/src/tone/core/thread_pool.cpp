@@ -0,0 +1,141 @@
+#include "tone/core/thread_pool.hpp"
+
+#include <algorithm>
+
+namespace tone::core {
+    namespace {
+        // The pool and queue of the worker this thread is, if any
+        thread_local const thread_pool* current_pool = nullptr;
+        thread_local std::size_t current_worker = 0;
+    } // namespace
+
+    std::size_t thread_pool::default_thread_count()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    thread_pool::thread_pool(std::size_t thread_count)
+    {
+        for (std::size_t i = 0; i < thread_count; ++i)
+            _queues.push_back(std::make_unique<queue>());
+        for (std::size_t i = 0; i < thread_count; ++i)
+            _threads.emplace_back([this, i] { work(i); });
+    }
+
+    thread_pool::~thread_pool()
+    {
+        {
+            std::lock_guard lock(_wake_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    std::size_t thread_pool::thread_count() const
+    {
+        return _threads.size();
+    }
+
+    void thread_pool::run(std::span<const task> tasks)
+    {
+        batch b;
+        b.remaining = tasks.size();
+        b.errors.resize(tasks.size());
+
+        if (_queues.empty())
+        {
+            for (std::size_t i = 0; i < tasks.size(); ++i)
+                execute({&tasks[i], &b, i});
+        }
+        else
+        {
+            // A worker keeps what it spawns in its own queue, where it's likely still in cache;
+            // anyone else deals the tasks out
+            const bool is_worker = current_pool == this;
+            for (std::size_t i = 0; i < tasks.size(); ++i)
+            {
+                const auto index = is_worker ? current_worker : i % _queues.size();
+                std::lock_guard lock(_queues[index]->mutex);
+                _queues[index]->jobs.push_back({&tasks[i], &b, i});
+            }
+            {
+                std::lock_guard lock(_wake_mutex);
+                _queued += tasks.size();
+            }
+            _wake.notify_all();
+
+            job j;
+            while (take(is_worker ? current_worker : 0, is_worker, j))
+                execute(j);
+        }
+
+        std::unique_lock lock(b.mutex);
+        b.done.wait(lock, [&] { return b.remaining == 0; });
+        for (const auto& error : b.errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    void thread_pool::work(std::size_t index)
+    {
+        current_pool = this;
+        current_worker = index;
+        for (;;)
+        {
+            job j;
+            if (take(index, true, j))
+            {
+                execute(j);
+                continue;
+            }
+            std::unique_lock lock(_wake_mutex);
+            _wake.wait(lock, [&] { return _stopping || _queued > 0; });
+            if (_stopping)
+                return;
+        }
+    }
+
+    bool thread_pool::take(std::size_t first, bool own, job& out)
+    {
+        for (std::size_t n = 0; n < _queues.size(); ++n)
+        {
+            auto& q = *_queues[(first + n) % _queues.size()];
+            std::lock_guard lock(q.mutex);
+            if (q.jobs.empty())
+                continue;
+            if (own && n == 0)
+            {
+                out = q.jobs.back();
+                q.jobs.pop_back();
+            }
+            else
+            {
+                out = q.jobs.front();
+                q.jobs.pop_front();
+            }
+            --_queued;
+            return true;
+        }
+        return false;
+    }
+
+    void thread_pool::execute(const job& j)
+    {
+        try
+        {
+            (*j.fn)();
+        }
+        catch (...)
+        {
+            j.owner->errors[j.index] = std::current_exception();
+        }
+        // Under the lock, so the batch can't end and be destroyed before this is done with it
+        std::lock_guard lock(j.owner->mutex);
+        if (--j.owner->remaining == 0)
+            j.owner->done.notify_all();
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -65,7 +65,10 @@ namespace tone::core {
                     return type_registry::get_str_handle();
                 return type_handle(nullptr);
             },
-            [this](const auto& t) { return &(*(_types.insert(t).first)); }
+            [this](const auto& t) {
+                std::lock_guard lock(_mutex);
+                return &(*(_types.insert(t).first));
+            }
         },t);
         // clang-format on
     }
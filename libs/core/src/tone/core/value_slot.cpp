@@ -0,0 +1,101 @@
+#include "tone/core/value_slot.hpp"
+#include "tone/core/array.hpp"
+#include "tone/core/str.hpp"
+#include "tone/core/variant_helpers.hpp"
+
+#include <fmt/format.h>
+
+#include <stdexcept>
+
+namespace tone::core {
+    namespace {
+        const char* tag_name(value_tag tag)
+        {
+            switch (tag)
+            {
+            case value_tag::none:
+                return "none";
+            case value_tag::int_value:
+                return "int";
+            case value_tag::real_value:
+                return "real";
+            case value_tag::bool_value:
+                return "bool";
+            case value_tag::str_value:
+                return "str";
+            case value_tag::array_value:
+                return "array";
+            }
+            return "?";
+        }
+    } // namespace
+
+    value_tag tag_of(type_handle type_id)
+    {
+        if (type_id == type_registry::get_int_handle())
+            return value_tag::int_value;
+        if (type_id == type_registry::get_real_handle())
+            return value_tag::real_value;
+        if (type_id == type_registry::get_bool_handle())
+            return value_tag::bool_value;
+        if (type_id == type_registry::get_str_handle())
+            return value_tag::str_value;
+        if (type_id && std::holds_alternative<array_type>(*type_id))
+            return value_tag::array_value;
+        return value_tag::none;
+    }
+
+    void throw_tag_mismatch(value_tag expected, value_tag actual)
+    {
+        throw std::logic_error(fmt::format("Value slot read as {} holds {}", tag_name(expected),
+                                           tag_name(actual)));
+    }
+
+    value_slot make_slot(const runtime_value& value)
+    {
+        value_slot slot{};
+        // clang-format off
+        std::visit(overloaded {
+            [&](std::int64_t value) { slot.set_int(value); },
+            [&](double value) { slot.set_real(value); },
+            [&](bool value) { slot.set_bool(value); },
+            [&](const str& value) { slot.set_str(str(value).release()); },
+            [&](const array& value) { slot.set_array(array(value).release()); }
+        }, value);
+        // clang-format on
+        return slot;
+    }
+
+    runtime_value slot_value(const value_slot& slot, type_handle type_id)
+    {
+        switch (tag_of(type_id))
+        {
+        case value_tag::real_value:
+            return slot.as_real();
+        case value_tag::bool_value:
+            return slot.as_bool();
+        case value_tag::str_value:
+            return str::share(slot.as_str());
+        case value_tag::array_value:
+            return array::share(slot.as_array());
+        default:
+            // Nothing is stored for a `void` result, such as a call of a `void` host function
+            if (type_id == type_registry::get_void_handle())
+                return std::int64_t(0);
+            return slot.as_int();
+        }
+    }
+
+    type_handle runtime_type(const runtime_value& value)
+    {
+        // clang-format off
+        return std::visit(overloaded {
+            [](std::int64_t) { return type_registry::get_int_handle(); },
+            [](double) { return type_registry::get_real_handle(); },
+            [](bool) { return type_registry::get_bool_handle(); },
+            [](const str&) { return type_registry::get_str_handle(); },
+            [](const array& value) { return value.type_id(); }
+        }, value);
+        // clang-format on
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "tone/core/view_scope.hpp"
+
+#include <stdexcept>
+
+namespace tone::core {
+    view_scope::~view_scope()
+    {
+        end();
+    }
+
+    array view_scope::view(type_handle type_id, std::span<const std::int64_t> elements)
+    {
+        return borrow(type_id, element_kind::int_element,
+                      const_cast<std::int64_t*>(elements.data()), elements.size(), true);
+    }
+
+    array view_scope::view(type_handle type_id, std::span<const double> elements)
+    {
+        return borrow(type_id, element_kind::real_element, const_cast<double*>(elements.data()),
+                      elements.size(), true);
+    }
+
+    array view_scope::writable_view(type_handle type_id, std::span<std::int64_t> elements)
+    {
+        return borrow(type_id, element_kind::int_element, elements.data(), elements.size(),
+                      false);
+    }
+
+    array view_scope::writable_view(type_handle type_id, std::span<double> elements)
+    {
+        return borrow(type_id, element_kind::real_element, elements.data(), elements.size(),
+                      false);
+    }
+
+    str view_scope::view(std::u16string_view text)
+    {
+        auto result = str::borrow(text);
+        if (result.is_borrowed())
+            _strs.push_back(result);
+        return result;
+    }
+
+    void view_scope::end()
+    {
+        // Only the values held elsewhere are copied
+        for (auto& arr : _arrays)
+        {
+            if (!arr.is_unique())
+                arr.own();
+        }
+        for (auto& s : _strs)
+        {
+            if (!s.is_unique())
+                s.own();
+        }
+        _arrays.clear();
+        _strs.clear();
+    }
+
+    array view_scope::borrow(type_handle type_id, element_kind kind, void* data,
+                             std::size_t size, bool read_only)
+    {
+        if (element_kind_of(type_id) != kind)
+            throw std::invalid_argument("Array type doesn't match the elements");
+        auto result = array::borrow(type_id, data, size, read_only);
+        _arrays.push_back(result);
+        return result;
+    }
+} // namespace tone::core
\ No newline at end of file
@@ -0,0 +1,996 @@
+#include "tone/core/vm.hpp"
+#include "tone/core/conversion_rules.hpp"
+#include "tone/core/errors.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace tone::core {
+    namespace {
+        constexpr std::size_t stack_capacity = 1 << 14;
+        // Runs nested in a VM at once; each also takes native stack, which gives out long
+        // before the value stack does when small functions recurse
+        constexpr std::size_t max_depth = 1000;
+
+        class value_stack
+        {
+        public:
+            value_slot* push(std::size_t count)
+            {
+                if (_values.empty())
+                    _values.resize(stack_capacity);
+                if (_values.size() - _top < count)
+                    throw runtime_error("Stack overflow", 0, 0);
+                value_slot* frame = _values.data() + _top;
+                _top += count;
+                return frame;
+            }
+
+            void pop(std::size_t count)
+            {
+                _top -= count;
+            }
+
+        private:
+            std::vector<value_slot> _values;
+            std::size_t _top = 0;
+        };
+
+        thread_local value_stack stack;
+
+        // The VM running code on this thread, see `vm::running`
+        thread_local vm* running_vm = nullptr;
+
+        // Makes a VM the running one until the run ends, restoring the one it was called from
+        class running_scope
+        {
+        public:
+            explicit running_scope(vm& machine)
+                : _outer(std::exchange(running_vm, &machine))
+            {}
+            ~running_scope()
+            {
+                running_vm = _outer;
+            }
+            running_scope(const running_scope&) = delete;
+            running_scope& operator=(const running_scope&) = delete;
+
+        private:
+            vm* _outer;
+        };
+
+        // Counts a run as nested in its VM until it ends
+        class depth_guard
+        {
+        public:
+            explicit depth_guard(std::size_t& depth)
+                : _depth(depth)
+            {
+                if (_depth == max_depth)
+                    throw runtime_error("Stack overflow", 0, 0);
+                ++_depth;
+            }
+            ~depth_guard()
+            {
+                --_depth;
+            }
+            depth_guard(const depth_guard&) = delete;
+            depth_guard& operator=(const depth_guard&) = delete;
+
+        private:
+            std::size_t& _depth;
+        };
+
+        // Frames start zeroed, which is the default value of every type but arrays, and release
+        // the strings and arrays left in their registers when they exit
+        class frame_guard
+        {
+        public:
+            frame_guard(const bytecode_view& code)
+                : _registers(stack.push(code.register_count))
+                , _code(code)
+            {
+                std::memset(static_cast<void*>(_registers), 0,
+                            code.register_count * sizeof(value_slot));
+            }
+            ~frame_guard()
+            {
+                for (const auto reg : _code.str_registers)
+                    str::adopt(_registers[reg].owned_str());
+                for (const auto reg : _code.array_registers)
+                    array::adopt(_registers[reg].owned_array());
+                stack.pop(_code.register_count);
+            }
+            frame_guard(const frame_guard&) = delete;
+            frame_guard& operator=(const frame_guard&) = delete;
+
+            [[nodiscard]] value_slot* registers() const
+            {
+                return _registers;
+            }
+
+        private:
+            value_slot* _registers;
+            const bytecode_view& _code;
+        };
+
+        // Replaces the str owned by `slot`; `value` is built before the old one is released, so
+        // it may have been computed from it
+        void store_str(value_slot& slot, str value)
+        {
+            str old = str::adopt(slot.owned_str());
+            slot.set_str(value.release());
+        }
+
+        // As `store_str`, for arrays
+        void store_array(value_slot& slot, array value)
+        {
+            array old = array::adopt(slot.owned_array());
+            slot.set_array(value.release());
+        }
+
+        // Negative indices wrap around to huge ones and fail the same check
+        bool in_bounds(const void* arr, std::int64_t index)
+        {
+            return std::uint64_t(index) < array::size(arr);
+        }
+
+        // An empty array for slots of array type, zero for the rest
+        value_slot default_slot(type_handle type_id)
+        {
+            value_slot slot{};
+            slot.mark_default(type_id);
+            if (tag_of(type_id) == value_tag::array_value)
+                slot.set_array(array(type_id).release());
+            return slot;
+        }
+
+        // A parameter's slot with another owner for its str or array
+        value_slot share_slot(const value_slot& slot, type_handle type_id)
+        {
+            switch (tag_of(type_id))
+            {
+            case value_tag::str_value: {
+                value_slot shared{};
+                shared.set_str(str::share(slot.as_str()).release());
+                return shared;
+            }
+            case value_tag::array_value: {
+                value_slot shared{};
+                shared.set_array(array::share(slot.as_array()).release());
+                return shared;
+            }
+            default:
+                return slot;
+            }
+        }
+
+        // Signed overflow wraps around instead of being undefined
+        std::int64_t wrap_add(std::int64_t l, std::int64_t r)
+        {
+            return std::int64_t(std::uint64_t(l) + std::uint64_t(r));
+        }
+        std::int64_t wrap_sub(std::int64_t l, std::int64_t r)
+        {
+            return std::int64_t(std::uint64_t(l) - std::uint64_t(r));
+        }
+        std::int64_t wrap_mul(std::int64_t l, std::int64_t r)
+        {
+            return std::int64_t(std::uint64_t(l) * std::uint64_t(r));
+        }
+
+        // Formats on the stack, so short results become inline strings without allocating
+        template <typename T>
+        str format_str(T value)
+        {
+            char chars[64];
+            const auto end = fmt::format_to_n(chars, sizeof(chars), "{}", value).out;
+            char16_t text[64];
+            std::copy(chars, end, text);
+            return str(std::u16string_view(text, end - chars));
+        }
+
+#if TONE_THREADED_DISPATCH
+#define TONE_VM_CASE(name) \
+    case opcode::name:     \
+    op_##name
+#define TONE_VM_NEXT                                        \
+    if constexpr (Mode == dispatch_mode::threaded)          \
+    {                                                       \
+        i = ip++;                                           \
+        goto* handlers[std::size_t(i->op)];                 \
+    }                                                       \
+    else                                                    \
+        continue
+#else
+#define TONE_VM_CASE(name) case opcode::name
+#define TONE_VM_NEXT continue
+#endif
+
+        // Every handler ends in TONE_VM_NEXT. With switch dispatch that returns to the top of the
+        // loop; with threaded dispatch each handler jumps straight to the next one's label.
+        template <dispatch_mode Mode>
+        runtime_value interpret(const bytecode_view& code, value_slot* r,
+                                std::vector<value_slot>& globals)
+        {
+            value_slot* g = globals.data();
+#if TONE_THREADED_DISPATCH
+            // Must follow the declaration order of `opcode`
+            static const void* const handlers[] = {
+                    &&op_ret, &&op_jump, &&op_jump_if_false, &&op_jump_if_true, &&op_load_const,
+                    &&op_move, &&op_load_global, &&op_store_global, &&op_load_const_str,
+                    &&op_move_str, &&op_load_global_str, &&op_store_global_str, &&op_move_array,
+                    &&op_load_global_array, &&op_store_global_array, &&op_int_to_real,
+                    &&op_int_to_bool, &&op_int_to_str, &&op_real_to_int, &&op_real_to_bool,
+                    &&op_real_to_str, &&op_add_int, &&op_sub_int, &&op_mul_int, &&op_div_int,
+                    &&op_mod_int, &&op_neg_int, &&op_inc_int, &&op_dec_int, &&op_bitwise_not,
+                    &&op_bitwise_and, &&op_bitwise_or, &&op_bitwise_xor, &&op_shift_l, &&op_shift_r,
+                    &&op_add_real, &&op_sub_real, &&op_mul_real, &&op_div_real, &&op_mod_real,
+                    &&op_neg_real, &&op_inc_real, &&op_dec_real, &&op_concat_str, &&op_concat_n,
+                    &&op_append_str, &&op_append_global_str, &&op_index_int, &&op_index_real,
+                    &&op_index_bool, &&op_index_str, &&op_index_array, &&op_store_index_int,
+                    &&op_store_index_real, &&op_store_index_bool, &&op_store_index_str,
+                    &&op_store_index_array, &&op_call, &&op_equal_int, &&op_not_equal_int,
+                    &&op_less_int, &&op_greater_int, &&op_less_equal_int, &&op_greater_equal_int,
+                    &&op_equal_real, &&op_not_equal_real, &&op_less_real, &&op_greater_real,
+                    &&op_less_equal_real, &&op_greater_equal_real, &&op_logical_not, &&op_add_int_k,
+                    &&op_sub_int_k, &&op_mul_int_k, &&op_div_int_k, &&op_mod_int_k, &&op_add_real_k,
+                    &&op_sub_real_k, &&op_mul_real_k, &&op_div_real_k, &&op_mod_real_k,
+                    &&op_equal_int_k, &&op_not_equal_int_k, &&op_less_int_k, &&op_greater_int_k,
+                    &&op_less_equal_int_k, &&op_greater_equal_int_k, &&op_equal_real_k,
+                    &&op_not_equal_real_k, &&op_less_real_k, &&op_greater_real_k,
+                    &&op_less_equal_real_k, &&op_greater_equal_real_k, &&op_equal_int_branch,
+                    &&op_not_equal_int_branch, &&op_less_int_branch, &&op_greater_int_branch,
+                    &&op_less_equal_int_branch, &&op_greater_equal_int_branch,
+                    &&op_equal_real_branch, &&op_not_equal_real_branch, &&op_less_real_branch,
+                    &&op_greater_real_branch, &&op_less_equal_real_branch,
+                    &&op_greater_equal_real_branch, &&op_equal_int_k_branch,
+                    &&op_not_equal_int_k_branch, &&op_less_int_k_branch, &&op_greater_int_k_branch,
+                    &&op_less_equal_int_k_branch, &&op_greater_equal_int_k_branch,
+                    &&op_equal_real_k_branch, &&op_not_equal_real_k_branch, &&op_less_real_k_branch,
+                    &&op_greater_real_k_branch, &&op_less_equal_real_k_branch,
+                    &&op_greater_equal_real_k_branch};
+            static_assert(std::size(handlers) == opcode_count);
+#endif
+
+            const value_slot* k = code.constant_slots.data();
+            const instruction* const begin = code.code.data();
+            const instruction* ip = begin;
+            const instruction* i;
+
+            const auto fail = [&](const char* message) {
+                const auto& loc = code.locations[i - begin];
+                return runtime_error(message, loc.line_number, loc.char_index);
+            };
+
+#if TONE_THREADED_DISPATCH
+            if constexpr (Mode == dispatch_mode::threaded)
+            {
+                i = ip++;
+                goto* handlers[std::size_t(i->op)];
+            }
+#endif
+
+            for (;;)
+            {
+                i = ip++;
+                switch (i->op)
+                {
+                // Control flow
+                TONE_VM_CASE(ret):
+                    return slot_value(r[i->a], code.result_type_id);
+                TONE_VM_CASE(jump):
+                    ip = begin + i->a;
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(jump_if_false):
+                    if (!r[i->a].as_bool())
+                        ip = begin + i->b;
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(jump_if_true):
+                    if (r[i->a].as_bool())
+                        ip = begin + i->b;
+                    TONE_VM_NEXT;
+
+                // Data movement
+                TONE_VM_CASE(load_const):
+                    r[i->a] = k[i->b];
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(move):
+                    r[i->a] = r[i->b];
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(load_global):
+                    r[i->a] = g[i->b];
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(store_global):
+                    g[i->a] = r[i->b];
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(load_const_str):
+                    store_str(r[i->a], str::share(k[i->b].as_str()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(move_str):
+                    store_str(r[i->a], str::share(r[i->b].as_str()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(load_global_str):
+                    store_str(r[i->a], str::share(g[i->b].as_str()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(store_global_str):
+                    store_str(g[i->a], str::share(r[i->b].as_str()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(move_array):
+                    store_array(r[i->a], array::share(r[i->b].as_array()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(load_global_array):
+                    store_array(r[i->a], array::share(g[i->b].as_array()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(store_global_array):
+                    store_array(g[i->a], array::share(r[i->b].as_array()));
+                    TONE_VM_NEXT;
+
+                // Conversions
+                TONE_VM_CASE(int_to_real):
+                    r[i->a].set_real(double(r[i->b].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(int_to_bool):
+                    r[i->a].set_bool(r[i->b].as_int() != 0);
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(int_to_str):
+                    store_str(r[i->a], format_str(r[i->b].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(real_to_int):
+                    r[i->a].set_int(truncate_to_int(r[i->b].as_real()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(real_to_bool):
+                    r[i->a].set_bool(r[i->b].as_real() != 0.0);
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(real_to_str):
+                    store_str(r[i->a], format_str(r[i->b].as_real()));
+                    TONE_VM_NEXT;
+
+                // Integer arithmetic
+                TONE_VM_CASE(add_int):
+                    r[i->a].set_int(wrap_add(r[i->b].as_int(), r[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(sub_int):
+                    r[i->a].set_int(wrap_sub(r[i->b].as_int(), r[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mul_int):
+                    r[i->a].set_int(wrap_mul(r[i->b].as_int(), r[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(div_int): {
+                    const auto divisor = r[i->c].as_int();
+                    if (divisor == 0)
+                        throw fail("Division by zero");
+                    const auto dividend = r[i->b].as_int();
+                    r[i->a].set_int(divisor == -1 ? wrap_sub(0, dividend) : dividend / divisor);
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(mod_int): {
+                    const auto divisor = r[i->c].as_int();
+                    if (divisor == 0)
+                        throw fail("Division by zero");
+                    r[i->a].set_int(divisor == -1 ? std::int64_t(0) : r[i->b].as_int() % divisor);
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(neg_int):
+                    r[i->a].set_int(wrap_sub(0, r[i->b].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(inc_int):
+                    r[i->a].set_int(wrap_add(r[i->a].as_int(), 1));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(dec_int):
+                    r[i->a].set_int(wrap_sub(r[i->a].as_int(), 1));
+                    TONE_VM_NEXT;
+
+                // Integer bitwise
+                TONE_VM_CASE(bitwise_not):
+                    r[i->a].set_int(~r[i->b].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(bitwise_and):
+                    r[i->a].set_int(r[i->b].as_int() & r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(bitwise_or):
+                    r[i->a].set_int(r[i->b].as_int() | r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(bitwise_xor):
+                    r[i->a].set_int(r[i->b].as_int() ^ r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(shift_l):
+                    r[i->a].set_int(std::int64_t(std::uint64_t(r[i->b].as_int()) << (r[i->c].as_int() & 63)));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(shift_r):
+                    r[i->a].set_int(r[i->b].as_int() >> (r[i->c].as_int() & 63));
+                    TONE_VM_NEXT;
+
+                // Real arithmetic
+                TONE_VM_CASE(add_real):
+                    r[i->a].set_real(r[i->b].as_real() + r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(sub_real):
+                    r[i->a].set_real(r[i->b].as_real() - r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mul_real):
+                    r[i->a].set_real(r[i->b].as_real() * r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(div_real):
+                    r[i->a].set_real(r[i->b].as_real() / r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mod_real):
+                    r[i->a].set_real(std::fmod(r[i->b].as_real(), r[i->c].as_real()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(neg_real):
+                    r[i->a].set_real(-r[i->b].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(inc_real):
+                    r[i->a].set_real(r[i->a].as_real() + 1.0);
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(dec_real):
+                    r[i->a].set_real(r[i->a].as_real() - 1.0);
+                    TONE_VM_NEXT;
+
+                // String operations
+                TONE_VM_CASE(concat_str): {
+                    str::inline_buffer l;
+                    str::inline_buffer rr;
+                    store_str(r[i->a], str::concat(str::view(r[i->b].as_str(), l),
+                                                   str::view(r[i->c].as_str(), rr)));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(concat_n): {
+                    std::size_t size = 0;
+                    for (std::size_t n = 0; n < i->c; ++n)
+                        size += str::size(r[i->b + n].as_str());
+                    str::builder result(size);
+                    for (std::size_t n = 0; n < i->c; ++n)
+                        result.append(r[i->b + n].as_str());
+                    store_str(r[i->a], result.finish());
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(append_str): {
+                    str::inline_buffer scratch;
+                    const auto text = str::view(r[i->b].as_str(), scratch);
+                    r[i->a].set_str(str::append(r[i->a].owned_str(), text));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(append_global_str): {
+                    str::inline_buffer scratch;
+                    const auto text = str::view(r[i->b].as_str(), scratch);
+                    g[i->a].set_str(str::append(g[i->a].owned_str(), text));
+                    TONE_VM_NEXT;
+                }
+
+                // Array element access
+                TONE_VM_CASE(index_int): {
+                    const void* arr = r[i->b].as_array();
+                    const auto index = r[i->c].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    r[i->a].set_int(array::load_int(arr, index));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(index_real): {
+                    const void* arr = r[i->b].as_array();
+                    const auto index = r[i->c].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    r[i->a].set_real(array::load_real(arr, index));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(index_bool): {
+                    const void* arr = r[i->b].as_array();
+                    const auto index = r[i->c].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    r[i->a].set_bool(array::load_bool(arr, index));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(index_str): {
+                    const void* arr = r[i->b].as_array();
+                    const auto index = r[i->c].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    store_str(r[i->a], str::share(array::load_str(arr, index)));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(index_array): {
+                    const void* arr = r[i->b].as_array();
+                    const auto index = r[i->c].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    store_array(r[i->a], array::share(array::load_array(arr, index)));
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(store_index_int): {
+                    const void* arr = r[i->a].as_array();
+                    const auto index = r[i->b].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    if (array::is_read_only(arr))
+                        throw fail("Array is read-only");
+                    array::store_int(arr, index, r[i->c].as_int());
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(store_index_real): {
+                    const void* arr = r[i->a].as_array();
+                    const auto index = r[i->b].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    if (array::is_read_only(arr))
+                        throw fail("Array is read-only");
+                    array::store_real(arr, index, r[i->c].as_real());
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(store_index_bool): {
+                    const void* arr = r[i->a].as_array();
+                    const auto index = r[i->b].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    array::store_bool(arr, index, r[i->c].as_bool());
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(store_index_str): {
+                    const void* arr = r[i->a].as_array();
+                    const auto index = r[i->b].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    array::store_str(arr, index, str::share(r[i->c].as_str()).release());
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(store_index_array): {
+                    const void* arr = r[i->a].as_array();
+                    const auto index = r[i->b].as_int();
+                    if (!in_bounds(arr, index))
+                        throw fail("Index out of range");
+                    array::store_array(arr, index, array::share(r[i->c].as_array()).release());
+                    TONE_VM_NEXT;
+                }
+
+                // Host function calls
+                TONE_VM_CASE(call): {
+                    const auto& fn = *code.functions[ip->a];
+                    ++ip;
+                    value_slot result;
+                    try
+                    {
+                        result = fn(r + i->b);
+                    }
+                    catch (const error&)
+                    {
+                        throw;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        throw fail(e.what());
+                    }
+                    // A script function run by the call may have grown the globals
+                    g = globals.data();
+                    if (fn.result_tag() == value_tag::str_value)
+                        store_str(r[i->a], str::adopt(result.owned_str()));
+                    else if (fn.result_tag() == value_tag::array_value)
+                        store_array(r[i->a], array::adopt(result.owned_array()));
+                    else
+                        r[i->a] = result;
+                    TONE_VM_NEXT;
+                }
+
+                // Integer comparisons
+                TONE_VM_CASE(equal_int):
+                    r[i->a].set_bool(r[i->b].as_int() == r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(not_equal_int):
+                    r[i->a].set_bool(r[i->b].as_int() != r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_int):
+                    r[i->a].set_bool(r[i->b].as_int() < r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_int):
+                    r[i->a].set_bool(r[i->b].as_int() > r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_equal_int):
+                    r[i->a].set_bool(r[i->b].as_int() <= r[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_equal_int):
+                    r[i->a].set_bool(r[i->b].as_int() >= r[i->c].as_int());
+                    TONE_VM_NEXT;
+
+                // Real comparisons
+                TONE_VM_CASE(equal_real):
+                    r[i->a].set_bool(r[i->b].as_real() == r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(not_equal_real):
+                    r[i->a].set_bool(r[i->b].as_real() != r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_real):
+                    r[i->a].set_bool(r[i->b].as_real() < r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_real):
+                    r[i->a].set_bool(r[i->b].as_real() > r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_equal_real):
+                    r[i->a].set_bool(r[i->b].as_real() <= r[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_equal_real):
+                    r[i->a].set_bool(r[i->b].as_real() >= r[i->c].as_real());
+                    TONE_VM_NEXT;
+
+                // Logical operations
+                TONE_VM_CASE(logical_not):
+                    r[i->a].set_bool(!r[i->b].as_bool());
+                    TONE_VM_NEXT;
+
+                // Superinstructions - arithmetic with a constant operand
+                TONE_VM_CASE(add_int_k):
+                    r[i->a].set_int(wrap_add(r[i->b].as_int(), k[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(sub_int_k):
+                    r[i->a].set_int(wrap_sub(r[i->b].as_int(), k[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mul_int_k):
+                    r[i->a].set_int(wrap_mul(r[i->b].as_int(), k[i->c].as_int()));
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(div_int_k): {
+                    const auto divisor = k[i->c].as_int();
+                    if (divisor == 0)
+                        throw fail("Division by zero");
+                    const auto dividend = r[i->b].as_int();
+                    r[i->a].set_int(divisor == -1 ? wrap_sub(0, dividend) : dividend / divisor);
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(mod_int_k): {
+                    const auto divisor = k[i->c].as_int();
+                    if (divisor == 0)
+                        throw fail("Division by zero");
+                    r[i->a].set_int(divisor == -1 ? std::int64_t(0) : r[i->b].as_int() % divisor);
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(add_real_k):
+                    r[i->a].set_real(r[i->b].as_real() + k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(sub_real_k):
+                    r[i->a].set_real(r[i->b].as_real() - k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mul_real_k):
+                    r[i->a].set_real(r[i->b].as_real() * k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(div_real_k):
+                    r[i->a].set_real(r[i->b].as_real() / k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(mod_real_k):
+                    r[i->a].set_real(std::fmod(r[i->b].as_real(), k[i->c].as_real()));
+                    TONE_VM_NEXT;
+
+                // Superinstructions - comparison with a constant operand
+                TONE_VM_CASE(equal_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() == k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(not_equal_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() != k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() < k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() > k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_equal_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() <= k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_equal_int_k):
+                    r[i->a].set_bool(r[i->b].as_int() >= k[i->c].as_int());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(equal_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() == k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(not_equal_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() != k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() < k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() > k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(less_equal_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() <= k[i->c].as_real());
+                    TONE_VM_NEXT;
+                TONE_VM_CASE(greater_equal_real_k):
+                    r[i->a].set_bool(r[i->b].as_real() >= k[i->c].as_real());
+                    TONE_VM_NEXT;
+
+                // Superinstructions - comparison and conditional jump
+                // The second word holds the jump target and the value that takes the jump
+                TONE_VM_CASE(equal_int_branch): {
+                    const bool value = r[i->b].as_int() == r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(not_equal_int_branch): {
+                    const bool value = r[i->b].as_int() != r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_int_branch): {
+                    const bool value = r[i->b].as_int() < r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_int_branch): {
+                    const bool value = r[i->b].as_int() > r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_equal_int_branch): {
+                    const bool value = r[i->b].as_int() <= r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_equal_int_branch): {
+                    const bool value = r[i->b].as_int() >= r[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(equal_real_branch): {
+                    const bool value = r[i->b].as_real() == r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(not_equal_real_branch): {
+                    const bool value = r[i->b].as_real() != r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_real_branch): {
+                    const bool value = r[i->b].as_real() < r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_real_branch): {
+                    const bool value = r[i->b].as_real() > r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_equal_real_branch): {
+                    const bool value = r[i->b].as_real() <= r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_equal_real_branch): {
+                    const bool value = r[i->b].as_real() >= r[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+
+                // Superinstructions - comparison with a constant and conditional jump
+                // The second word holds the jump target and the value that takes the jump
+                TONE_VM_CASE(equal_int_k_branch): {
+                    const bool value = r[i->b].as_int() == k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(not_equal_int_k_branch): {
+                    const bool value = r[i->b].as_int() != k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_int_k_branch): {
+                    const bool value = r[i->b].as_int() < k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_int_k_branch): {
+                    const bool value = r[i->b].as_int() > k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_equal_int_k_branch): {
+                    const bool value = r[i->b].as_int() <= k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_equal_int_k_branch): {
+                    const bool value = r[i->b].as_int() >= k[i->c].as_int();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(equal_real_k_branch): {
+                    const bool value = r[i->b].as_real() == k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(not_equal_real_k_branch): {
+                    const bool value = r[i->b].as_real() != k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_real_k_branch): {
+                    const bool value = r[i->b].as_real() < k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_real_k_branch): {
+                    const bool value = r[i->b].as_real() > k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(less_equal_real_k_branch): {
+                    const bool value = r[i->b].as_real() <= k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                TONE_VM_CASE(greater_equal_real_k_branch): {
+                    const bool value = r[i->b].as_real() >= k[i->c].as_real();
+                    r[i->a].set_bool(value);
+                    ip = value == bool(ip->b) ? begin + ip->a : ip + 1;
+                    TONE_VM_NEXT;
+                }
+                }
+            }
+        }
+
+#undef TONE_VM_CASE
+#undef TONE_VM_NEXT
+    } // namespace
+
+    vm::vm() = default;
+
+    vm::vm(vm&& other) noexcept = default;
+
+    vm& vm::operator=(vm&& other) noexcept
+    {
+        std::swap(_globals, other._globals);
+        std::swap(_global_types, other._global_types);
+        return *this;
+    }
+
+    vm::~vm()
+    {
+        for (std::size_t i = 0; i < _globals.size(); ++i)
+            reset_global(i, nullptr);
+    }
+
+    runtime_value vm::global(std::size_t index) const
+    {
+        return slot_value(_globals.at(index), _global_types.at(index));
+    }
+
+    void vm::set_global(std::size_t index, const runtime_value& value)
+    {
+        if (index >= _globals.size())
+        {
+            _globals.resize(index + 1);
+            _global_types.resize(index + 1, nullptr);
+        }
+        reset_global(index, nullptr);
+        _globals[index] = make_slot(value);
+        _global_types[index] = runtime_type(value);
+    }
+
+    std::size_t vm::global_count() const
+    {
+        return _globals.size();
+    }
+
+    type_handle vm::global_type(std::size_t index) const
+    {
+        return _global_types.at(index);
+    }
+
+    vm* vm::running()
+    {
+        return running_vm;
+    }
+
+    value_slot* vm::bind_globals(const bytecode_view& code)
+    {
+        return bind_globals(code.global_types);
+    }
+
+    value_slot* vm::bind_globals(std::span<const type_handle> global_types)
+    {
+        if (_globals.size() < global_types.size())
+        {
+            _globals.resize(global_types.size());
+            _global_types.resize(global_types.size(), nullptr);
+        }
+        for (std::size_t i = 0; i < global_types.size(); ++i)
+        {
+            const auto type_id = global_types[i];
+            if (type_id && _global_types[i] != type_id)
+                reset_global(i, type_id);
+        }
+        return _globals.data();
+    }
+
+    void vm::reset_global(std::size_t index, type_handle type_id)
+    {
+        if (_global_types[index] == type_registry::get_str_handle())
+            str::adopt(_globals[index].owned_str());
+        else if (tag_of(_global_types[index]) == value_tag::array_value)
+            array::adopt(_globals[index].owned_array());
+        _globals[index] = default_slot(type_id);
+        _global_types[index] = type_id;
+    }
+
+    runtime_value vm::run(const bytecode_view& code, std::span<const runtime_value> params,
+                          dispatch_mode mode)
+    {
+        bind_globals(code);
+        running_scope running(*this);
+        depth_guard depth(_depth);
+
+        frame_guard frame(code);
+        value_slot* r = frame.registers();
+        for (std::size_t i = 0; i < code.slot_types.size(); ++i)
+        {
+            const auto type_id = code.slot_types[i];
+            if (i < code.param_count && i < params.size() && type_id)
+            {
+                if (runtime_type(params[i]) != type_id)
+                    throw runtime_error("Parameter has the wrong type", 0, 0);
+                r[i] = make_slot(params[i]);
+            }
+            else
+            {
+                r[i] = default_slot(type_id);
+            }
+        }
+
+#if TONE_THREADED_DISPATCH
+        if (mode == dispatch_mode::threaded)
+            return interpret<dispatch_mode::threaded>(code, r, _globals);
+#endif
+        return interpret<dispatch_mode::switch_loop>(code, r, _globals);
+    }
+
+    runtime_value vm::run_slots(const bytecode_view& code, std::span<const value_slot> params,
+                                dispatch_mode mode)
+    {
+        bind_globals(code);
+        running_scope running(*this);
+        depth_guard depth(_depth);
+
+        frame_guard frame(code);
+        value_slot* r = frame.registers();
+        for (std::size_t i = 0; i < code.slot_types.size(); ++i)
+        {
+            const auto type_id = code.slot_types[i];
+            if (i < code.param_count && i < params.size() && type_id)
+                r[i] = share_slot(params[i], type_id);
+            else
+                r[i] = default_slot(type_id);
+        }
+
+#if TONE_THREADED_DISPATCH
+        if (mode == dispatch_mode::threaded)
+            return interpret<dispatch_mode::threaded>(code, r, _globals);
+#endif
+        return interpret<dispatch_mode::switch_loop>(code, r, _globals);
+    }
+} // namespace tone::core
\ No newline at end of file
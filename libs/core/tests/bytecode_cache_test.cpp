@@ -0,0 +1,114 @@
+#include "check.hpp"
+
+#include "tone/core/bytecode_cache.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/vm.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace tone::core;
+
+// Files of the on-disk cache are found again by other caches on the same directory, and any
+// that go missing, are cut short, hold another key's code or were compiled against other
+// declarations are compiled again and replaced.
+
+namespace {
+    const auto int_handle = type_registry::get_int_handle();
+    const expression_param params[] = {{"x", int_handle}};
+
+    void check_stats(const bytecode_cache& cache, std::uint64_t hits, std::uint64_t misses,
+                     std::string_view what)
+    {
+        const auto stats = cache.stats();
+        TONE_CHECK_EQUAL(std::int64_t(stats.hits), std::int64_t(hits),
+                         fmt::format("hits {}", what));
+        TONE_CHECK_EQUAL(std::int64_t(stats.misses), std::int64_t(misses),
+                         fmt::format("misses {}", what));
+        TONE_CHECK_EQUAL(std::int64_t(stats.write_failures), std::int64_t(0),
+                         fmt::format("write failures {}", what));
+    }
+
+    runtime_value run(bytecode_cache& cache, std::string_view source, std::int64_t x)
+    {
+        vm machine;
+        const runtime_value args[] = {x};
+        return machine.run(cache.get(source, params).view(), args);
+    }
+
+    // The files of `directory`, which only ever holds images once writes are done
+    std::vector<std::filesystem::path> files(const std::filesystem::path& directory)
+    {
+        std::vector<std::filesystem::path> result;
+        for (const auto& file : std::filesystem::directory_iterator(directory))
+            result.push_back(file.path());
+        return result;
+    }
+
+    void check_cache(const std::filesystem::path& directory)
+    {
+        compile_context context;
+        bytecode_cache cache(context, directory);
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 2), std::int64_t(6), "the first compile");
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 4), std::int64_t(12), "a hit");
+        check_stats(cache, 1, 1, "after a hit");
+        TONE_CHECK_EQUAL(std::int64_t(files(directory).size()), std::int64_t(1), "files");
+
+        // Another process using the directory
+        {
+            compile_context other_context;
+            bytecode_cache other(other_context, directory);
+            TONE_CHECK_EQUAL(run(other, "x * 3", 5), std::int64_t(15), "another cache");
+            check_stats(other, 1, 0, "in another cache");
+        }
+
+        // A file that goes is compiled again
+        std::filesystem::remove(files(directory).front());
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 1), std::int64_t(3), "a removed file");
+        check_stats(cache, 1, 2, "after removing the file");
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 1), std::int64_t(3), "a file stored again");
+        check_stats(cache, 2, 2, "after storing it again");
+
+        // As is one cut short
+        const auto file = files(directory).front();
+        std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 1), std::int64_t(3), "a file cut short");
+        check_stats(cache, 2, 3, "after cutting the file short");
+
+        // And one holding another key's code, as on a hash collision
+        TONE_CHECK_EQUAL(run(cache, "x - 3", 1), std::int64_t(-2), "a second source");
+        for (const auto& path : files(directory))
+        {
+            if (path != file)
+                std::filesystem::copy_file(path, file,
+                                           std::filesystem::copy_options::overwrite_existing);
+        }
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 1), std::int64_t(3), "another key's file");
+        check_stats(cache, 2, 5, "after replacing the file");
+
+        // Declaring a global changes every key, so nothing compiled before is found
+        context.create_identifier("g", int_handle, false);
+        TONE_CHECK_EQUAL(run(cache, "x * 3", 1), std::int64_t(3), "a new declaration");
+        check_stats(cache, 2, 6, "after declaring a global");
+        TONE_CHECK_EQUAL(std::int64_t(files(directory).size()), std::int64_t(3),
+                         "files after declaring a global");
+    }
+} // namespace
+
+int main()
+{
+    const auto directory = std::filesystem::temp_directory_path() /
+                           fmt::format("bytecode_cache_test_{}", std::random_device{}());
+    try
+    {
+        check_cache(directory);
+    }
+    catch (const std::exception& err)
+    {
+        TONE_FAIL(fmt::format("threw: {}", err.what()));
+    }
+    std::filesystem::remove_all(directory);
+    return test::failures;
+}
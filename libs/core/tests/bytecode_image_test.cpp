@@ -0,0 +1,246 @@
+#include "check.hpp"
+
+#include "tone/core/bytecode_image.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/compiled_expression.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/vm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+
+using namespace tone::core;
+
+// Code saved to an image and loaded again runs as the code saved did, and images that are cut
+// short, corrupted or compiled against other declarations are refused when loaded.
+
+namespace {
+    const auto int_handle = type_registry::get_int_handle();
+
+    std::int64_t twice(std::int64_t value)
+    {
+        return 2 * value;
+    }
+
+    const char* const sources[] = {
+            "twice(x) + y * g",
+            "x > 3 || y - 1 < 2 && g != 0",
+            "x / (y - 3) + g",
+            "(g += x), g * twice(y)",
+            "\"ab\" + \"cd\"",
+    };
+
+    // Declares what every source is compiled against
+    void declare(compile_context& context)
+    {
+        context.bind<&twice>("twice");
+        context.create_identifier("g", int_handle, false);
+    }
+
+    struct outcome
+    {
+        std::optional<runtime_value> result;
+        std::string error;
+        runtime_value g;
+    };
+
+    outcome run(const bytecode_view& code, const compile_context& context, std::int64_t x,
+                std::int64_t y)
+    {
+        vm machine;
+        const auto g = context.find("g")->index();
+        machine.set_global(g, std::int64_t(5));
+        const runtime_value args[] = {x, y};
+        outcome out;
+        try
+        {
+            out.result = machine.run(code, args);
+        }
+        catch (const error& err)
+        {
+            out.error = err.what();
+        }
+        out.g = machine.global(g);
+        return out;
+    }
+
+    void check_same_runs(const bytecode_view& loaded, const bytecode_view& code,
+                         const compile_context& context, const std::string& what)
+    {
+        for (std::int64_t x = -2; x <= 4; ++x)
+        {
+            for (std::int64_t y = 1; y <= 4; ++y)
+            {
+                const auto expected = run(code, context, x, y);
+                const auto actual = run(loaded, context, x, y);
+                const auto on = fmt::format("{} with x = {}, y = {}", what, x, y);
+                TONE_CHECK(actual.result.has_value() == expected.result.has_value());
+                if (actual.result && expected.result)
+                    TONE_CHECK_EQUAL(*actual.result, *expected.result, on);
+                TONE_CHECK(actual.error == expected.error);
+                TONE_CHECK_EQUAL(actual.g, expected.g, on + " (g afterwards)");
+            }
+        }
+    }
+
+    // Loading either works or throws `std::invalid_argument`, never anything else
+    bool loads(std::span<const std::byte> bytes, compile_context& context,
+               const std::string& what)
+    {
+        try
+        {
+            bytecode_image::copy(bytes, context);
+            return true;
+        }
+        catch (const std::invalid_argument&)
+        {
+            return false;
+        }
+        catch (const std::exception& err)
+        {
+            TONE_FAIL(fmt::format("{} threw '{}'", what, err.what()));
+            return false;
+        }
+    }
+
+    void check_round_trip(const std::string& source, const std::filesystem::path& file)
+    {
+        compile_context context;
+        declare(context);
+        const compiled_expression expression(context, {{"x", int_handle}, {"y", int_handle}},
+                                             source);
+        const auto bytes = save_bytecode_image(expression.code(), source);
+
+        const auto copied = bytecode_image::copy(bytes, context);
+        TONE_CHECK(copied.tag() == source);
+        TONE_CHECK(!copied.has_globals());
+        check_same_runs(copied.view(), expression.code(), context, "'" + source + "' copied");
+
+        {
+            std::ofstream out(file, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+        }
+        const auto mapped = bytecode_image::map_file(file.string(), context);
+        check_same_runs(mapped.view(), expression.code(), context, "'" + source + "' mapped");
+
+        // Another context declaring the same, as another process would
+        compile_context other;
+        declare(other);
+        const auto elsewhere = bytecode_image::copy(bytes, other);
+        check_same_runs(elsewhere.view(), expression.code(), context,
+                        "'" + source + "' loaded elsewhere");
+    }
+
+    void check_rejected(const std::string& source)
+    {
+        compile_context context;
+        declare(context);
+        const compiled_expression expression(context, {{"x", int_handle}, {"y", int_handle}},
+                                             source);
+        const auto bytes = save_bytecode_image(expression.code());
+        const auto what = "'" + source + "'";
+
+        for (std::size_t size = 0; size < bytes.size(); ++size)
+        {
+            if (loads(std::span(bytes).first(size), context, what + " cut short"))
+                TONE_FAIL(fmt::format("{} loaded when cut to {} bytes", what, size));
+        }
+
+        auto bad = bytes;
+        bad[0] ^= std::byte{1};
+        TONE_CHECK(!loads(bad, context, what + " with a bad magic number"));
+        bad = bytes;
+        bad[8] ^= std::byte{1};
+        TONE_CHECK(!loads(bad, context, what + " of another version"));
+
+        // Instructions are used in place, so they're found by their bytes
+        const auto& code = expression.code().code;
+        const auto* first = reinterpret_cast<const std::byte*>(code.data());
+        const auto at = std::search(bytes.begin(), bytes.end(), first,
+                                    first + code.size() * sizeof(instruction));
+        if (at == bytes.end())
+        {
+            TONE_FAIL(what + " has no instructions in its image");
+        }
+        else
+        {
+            const auto offset = std::size_t(at - bytes.begin());
+            bad = bytes;
+            bad[offset + offsetof(instruction, op)] = std::byte{0xFF};
+            TONE_CHECK(!loads(bad, context, what + " with an unknown opcode"));
+            bad = bytes;
+            std::memset(&bad[offset + offsetof(instruction, a)], 0xFF, sizeof(std::uint16_t));
+            TONE_CHECK(!loads(bad, context, what + " with a register out of the frame"));
+        }
+
+        // Images are used in place only when aligned
+        std::vector<std::uint64_t> words(bytes.size() / 8 + 1);
+        auto* unaligned = reinterpret_cast<std::byte*>(words.data()) + 1;
+        std::memcpy(unaligned, bytes.data(), bytes.size() - 1);
+        try
+        {
+            bytecode_image image({unaligned, bytes.size() - 1}, context);
+            TONE_FAIL(what + " loaded unaligned");
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+
+        // Flipping bits past the magic number and version either leaves a loadable image or
+        // one that's refused; the loader never reads out of bounds
+        std::mt19937 random(1);
+        std::size_t refused = 0;
+        for (int n = 0; n < 2000; ++n)
+        {
+            bad = bytes;
+            for (int flips = 1 + int(random() % 3); flips > 0; --flips)
+                bad[16 + random() % (bad.size() - 16)] ^= std::byte(1u << (random() % 8));
+            refused += !loads(bad, context, what + " corrupted");
+        }
+        TONE_CHECK(refused > 0);
+    }
+
+    void check_declarations()
+    {
+        compile_context context;
+        declare(context);
+        const compiled_expression expression(context, {{"x", int_handle}}, "twice(x) + g");
+        const auto bytes = save_bytecode_image(expression.code());
+
+        compile_context no_function;
+        no_function.create_identifier("g", int_handle, false);
+        TONE_CHECK(!loads(bytes, no_function, "an image without its host function"));
+
+        compile_context retyped;
+        retyped.bind<&twice>("twice");
+        retyped.create_identifier("g", type_registry::get_real_handle(), false);
+        TONE_CHECK(!loads(bytes, retyped, "an image with a global of another type"));
+    }
+} // namespace
+
+int main()
+{
+    const auto file = std::filesystem::temp_directory_path() /
+                      fmt::format("bytecode_image_test_{}.tbc", std::random_device{}());
+    for (const auto* source : sources)
+    {
+        try
+        {
+            check_round_trip(source, file);
+            check_rejected(source);
+        }
+        catch (const std::exception& err)
+        {
+            TONE_FAIL(fmt::format("'{}' threw: {}", source, err.what()));
+        }
+    }
+    std::filesystem::remove(file);
+    check_declarations();
+    return test::failures;
+}
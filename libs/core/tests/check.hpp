@@ -0,0 +1,41 @@
+#pragma once
+
+#include "tone/core/runtime_value.hpp"
+
+#include <fmt/format.h>
+
+#include <string>
+#include <string_view>
+
+namespace tone::core::test {
+    // Checks that fail are printed and counted, and `main` returns the count
+    inline int failures = 0;
+
+    inline void fail(std::string_view what, const char* file, int line)
+    {
+        ++failures;
+        fmt::print("{}:{}: {}\n", file, line, what);
+    }
+
+    inline void check(bool passed, std::string_view what, const char* file, int line)
+    {
+        if (!passed)
+            fail(fmt::format("check failed: {}", what), file, line);
+    }
+
+    inline void check_equal(const runtime_value& actual, const runtime_value& expected,
+                            std::string_view what, const char* file, int line)
+    {
+        if (actual != expected)
+        {
+            fail(fmt::format("{} gave {}, expected {}", what, dump_runtime_value(actual),
+                             dump_runtime_value(expected)),
+                 file, line);
+        }
+    }
+} // namespace tone::core::test
+
+#define TONE_FAIL(what) ::tone::core::test::fail((what), __FILE__, __LINE__)
+#define TONE_CHECK(condition) ::tone::core::test::check((condition), #condition, __FILE__, __LINE__)
+#define TONE_CHECK_EQUAL(actual, expected, what)                                                   \
+    ::tone::core::test::check_equal((actual), (expected), (what), __FILE__, __LINE__)
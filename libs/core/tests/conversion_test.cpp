@@ -0,0 +1,115 @@
+#include "check.hpp"
+
+#include "tone/core/batch.hpp"
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/compiled_expression.hpp"
+#include "tone/core/conversion_rules.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_parser.hpp"
+#include "tone/core/jit.hpp"
+#include "tone/core/tokenizer.hpp"
+#include "tone/core/vm.hpp"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+using namespace tone::core;
+
+// A real converted to int truncates toward zero, saturates at the ends of the int range and
+// gives 0 for NaN, the same in the VM, the JIT, batches and literals folded by the compiler.
+// The AOT compiler is compared against the VM in `aot_test`.
+
+namespace {
+    constexpr auto int_max = std::numeric_limits<std::int64_t>::max();
+    constexpr auto int_min = std::numeric_limits<std::int64_t>::min();
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+
+    const std::pair<double, std::int64_t> cases[] = {
+            {2.75, 2},
+            {-2.75, -2},
+            {0.0, 0},
+            {std::nan(""), 0},
+            {inf, int_max},
+            {-inf, int_min},
+            {1e300, int_max},
+            {-1e300, int_min},
+            {9223372036854775808.0, int_max},
+            {-9223372036854775808.0, int_min},
+            {9223372036854774784.0, 9223372036854774784},
+    };
+
+    constexpr std::array dispatch_modes = {
+#if TONE_THREADED_DISPATCH
+            dispatch_mode::threaded,
+#endif
+            dispatch_mode::switch_loop,
+    };
+
+    node_ptr parse(compile_context& context, const std::string& source)
+    {
+        std::istringstream ss(source);
+        character_source_t input = [&ss]() {
+            return ss.get();
+        };
+        push_back_stream strm(input);
+        token_iterator it(strm);
+        return parse_expression_tree(context, it, type_registry::get_void_handle(), false, true,
+                                     false);
+    }
+} // namespace
+
+int main()
+{
+    compile_context context;
+    context.enter_function();
+    context.create_param("x", type_registry::get_real_handle());
+    const auto root = parse(context, "0 + x");
+    const auto code = compile_bytecode(context, *root);
+    const auto native = compile_native(context, *root);
+    TONE_CHECK(native.has_value() == jit_available);
+    const batch_expression batch(*root);
+
+    vm machine;
+    for (const auto& [real, expected] : cases)
+    {
+        TONE_CHECK_EQUAL(truncate_to_int(real), expected, fmt::format("truncate_to_int({})", real));
+
+        const runtime_value args[] = {real};
+        for (const auto mode : dispatch_modes)
+        {
+            TONE_CHECK_EQUAL(machine.run(code, args, mode), expected,
+                             fmt::format("VM on {}", real));
+        }
+        if (native)
+            TONE_CHECK_EQUAL((*native)(args, nullptr), expected, fmt::format("JIT on {}", real));
+
+        const double column[] = {real};
+        std::int64_t out[1] = {};
+        batch.evaluate({{"x", std::span<const double>(column)}}, 1, std::span<std::int64_t>(out));
+        TONE_CHECK_EQUAL(out[0], expected, fmt::format("batch on {}", real));
+    }
+
+    // Folded when compiling; NaN and the infinities can't be written as literals
+    const std::pair<const char*, std::int64_t> folded_cases[] = {
+            {"0 + 1e300", int_max},
+            {"0 + -1e300", int_min},
+            {"0 + 2.75", 2},
+    };
+    for (const auto& [source, expected] : folded_cases)
+    {
+        try
+        {
+            compile_context literals;
+            compiled_expression folded(literals, {}, source);
+            TONE_CHECK_EQUAL(machine.run(folded.code()), expected, source);
+        }
+        catch (const error& err)
+        {
+            TONE_FAIL(fmt::format("'{}' threw: {}", source, err.what()));
+        }
+    }
+    return test::failures;
+}
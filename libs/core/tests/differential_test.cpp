@@ -0,0 +1,347 @@
+#include "check.hpp"
+
+#include "tone/core/aot.hpp"
+#include "tone/core/batch.hpp"
+#include "tone/core/bytecode_compiler.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_parser.hpp"
+#include "tone/core/jit.hpp"
+#include "tone/core/tokenizer.hpp"
+#include "tone/core/vm.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+using namespace tone::core;
+
+// Runs the same expressions on every backend over the same arguments and globals: the VM with
+// each dispatch loop, with and without fused instructions, the JIT, batches and code built by
+// `tone_aot_compiler` when its path is given. All must give the VM's result and leave the same
+// globals, side effects inside operands included, or stop at the same error.
+
+namespace {
+    struct entry
+    {
+        const char* source;
+        // Whether the JIT and batches compile it; they must refuse it otherwise
+        bool native;
+        bool batch;
+    };
+
+    const entry entries[] = {
+            {"i * 3 + j - 7", true, true},
+            {"i / (j - 2) + i % 3", false, true},
+            {"i / 3 - j % -2", true, true},
+            {"(i << 2) ^ (j >> 1) | ~i & 255", true, true},
+            {"x * 1.5 - i / 4.0", false, true},
+            {"i < j && x > 0.5 || gb", true, true},
+            {"!(i == j) && !gb", true, true},
+            {"gi * 2 + i * gr", true, true},
+            {"i + x / 0.0", true, true},
+            {"i - x * 1e300", true, true},
+            {"(i, j, x * 2.0)", true, true},
+            {"i + (i = 5)", false, false},
+            {"i + i++", false, false},
+            {"i * (i += 1)", false, false},
+            {"i - --i", false, false},
+            {"gi + (gi = 5)", false, false},
+            {"gi + gi++", false, false},
+            {"gi += (gi -= i)", false, false},
+            {"gi *= (gi += 2) - i", false, false},
+            {"(gr += (gr *= 2.0)), gr", false, false},
+            {"x += (x = 0.25) + i", false, false},
+            {"gi %= (gi = 4), gi", false, false},
+            {"(gi = i, gr = x, gb = i > j), gi + j", false, false},
+    };
+
+    constexpr std::int64_t first_row = -3;
+    constexpr std::size_t row_count = 13;
+
+    // The arguments and globals of each row
+    std::array<runtime_value, 3> row_args(std::int64_t i)
+    {
+        return {i, std::int64_t(7 - i), double(i) * 0.75};
+    }
+    std::int64_t row_gi(std::int64_t i)
+    {
+        return i * 3 - 4;
+    }
+    double row_gr(std::int64_t i)
+    {
+        return double(i) / 4;
+    }
+    bool row_gb(std::int64_t i)
+    {
+        return i % 2 == 0;
+    }
+
+    node_ptr parse(compile_context& context, const std::string& source)
+    {
+        std::istringstream ss(source);
+        character_source_t input = [&ss]() {
+            return ss.get();
+        };
+        push_back_stream strm(input);
+        token_iterator it(strm);
+        return parse_expression_tree(context, it, type_registry::get_void_handle(), false, true,
+                                     false);
+    }
+
+    void set_globals(vm& machine, const compile_context& context, std::int64_t i)
+    {
+        machine.set_global(context.find("gi")->index(), row_gi(i));
+        machine.set_global(context.find("gr")->index(), row_gr(i));
+        machine.set_global(context.find("gb")->index(), row_gb(i));
+    }
+
+    using run_function = std::function<runtime_value(vm& machine)>;
+
+    // Runs `actual` against the VM's `expected` on row `i`, each on a machine of its own
+    void check_same(const compile_context& context, std::int64_t i, const std::string& what,
+                    const run_function& expected, const run_function& actual)
+    {
+        vm reference;
+        vm other;
+        set_globals(reference, context, i);
+        set_globals(other, context, i);
+
+        std::optional<runtime_value> result;
+        std::string message;
+        try
+        {
+            result = expected(reference);
+        }
+        catch (const error& err)
+        {
+            message = err.what();
+        }
+
+        try
+        {
+            const auto value = actual(other);
+            if (!result)
+            {
+                TONE_FAIL(fmt::format("{} threw '{}' on the VM only", what, message));
+                return;
+            }
+            TONE_CHECK_EQUAL(value, *result, what);
+            for (const auto name : {"gi", "gr", "gb"})
+            {
+                const auto index = context.find(name)->index();
+                TONE_CHECK_EQUAL(other.global(index), reference.global(index),
+                                 fmt::format("{} ({} afterwards)", what, name));
+            }
+        }
+        catch (const error& err)
+        {
+            if (result)
+                TONE_FAIL(fmt::format("{} threw '{}' on the VM only", what, err.what()));
+            else
+                TONE_CHECK(std::string_view(err.what()) == message);
+        }
+    }
+
+    // Evaluates `batch` over every row at once, which must match the VM row by row or throw
+    // when the VM does on any row
+    void check_batch(const compile_context& context, const batch_expression& batch,
+                     const bytecode& code, const std::string& source)
+    {
+        std::array<std::int64_t, row_count> i{}, j{}, gi{};
+        std::array<double, row_count> x{}, gr{};
+        bool gb[row_count] = {};
+        for (std::size_t row = 0; row < row_count; ++row)
+        {
+            const auto n = first_row + std::int64_t(row);
+            const auto args = row_args(n);
+            i[row] = std::get<std::int64_t>(args[0]);
+            j[row] = std::get<std::int64_t>(args[1]);
+            x[row] = std::get<double>(args[2]);
+            gi[row] = row_gi(n);
+            gr[row] = row_gr(n);
+            gb[row] = row_gb(n);
+        }
+        const column_bindings columns = {
+                {"i", std::span<const std::int64_t>(i)},
+                {"j", std::span<const std::int64_t>(j)},
+                {"x", std::span<const double>(x)},
+                {"gi", std::span<const std::int64_t>(gi)},
+                {"gr", std::span<const double>(gr)},
+                {"gb", std::span<const bool>(gb)},
+        };
+
+        std::vector<runtime_value> expected;
+        bool throws = false;
+        for (std::size_t row = 0; row < row_count && !throws; ++row)
+        {
+            vm machine;
+            const auto n = first_row + std::int64_t(row);
+            set_globals(machine, context, n);
+            try
+            {
+                expected.push_back(machine.run(code, row_args(n)));
+            }
+            catch (const error&)
+            {
+                throws = true;
+            }
+        }
+
+        std::array<std::int64_t, row_count> ints{};
+        std::array<double, row_count> reals{};
+        bool bools[row_count] = {};
+        const auto type_id = batch.result_type();
+        try
+        {
+            if (type_id == type_registry::get_int_handle())
+                batch.evaluate(columns, row_count, std::span<std::int64_t>(ints));
+            else if (type_id == type_registry::get_real_handle())
+                batch.evaluate(columns, row_count, std::span<double>(reals));
+            else
+                batch.evaluate(columns, row_count, std::span<bool>(bools));
+        }
+        catch (const error& err)
+        {
+            if (!throws)
+                TONE_FAIL(fmt::format("'{}' threw '{}' in a batch only", source, err.what()));
+            return;
+        }
+        if (throws)
+        {
+            TONE_FAIL(fmt::format("'{}' threw on the VM only", source));
+            return;
+        }
+
+        for (std::size_t row = 0; row < row_count; ++row)
+        {
+            const runtime_value value = type_id == type_registry::get_int_handle()
+                                                ? runtime_value(ints[row])
+                                        : type_id == type_registry::get_real_handle()
+                                                ? runtime_value(reals[row])
+                                                : runtime_value(bools[row]);
+            TONE_CHECK_EQUAL(value, expected[row],
+                             fmt::format("'{}' in a batch, row {}", source, row));
+        }
+    }
+
+    std::optional<aot_library> build_library(const char* tool, const std::string& directory)
+    {
+        const std::string module_path = directory + "/differential_test.tone";
+        const std::string library_path = directory + "/differential_test.so";
+        {
+            std::ofstream module(module_path, std::ios::trunc);
+            module << "global gi int\nglobal gr real\nglobal gb bool\n"
+                      "param i int\nparam j int\nparam x real\n";
+            for (std::size_t n = 0; n < std::size(entries); ++n)
+                module << fmt::format("entry e{} = {}\n", n, entries[n].source);
+        }
+        const auto command =
+                fmt::format("\"{}\" \"{}\" -o \"{}\"", tool, module_path, library_path);
+        if (std::system(command.c_str()) != 0)
+        {
+            TONE_FAIL(fmt::format("'{}' failed", command));
+            return std::nullopt;
+        }
+        return std::optional<aot_library>(std::in_place, library_path);
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc != 1 && argc != 3)
+    {
+        fmt::print("usage: differential_test [<tone_aot_compiler> <scratch directory>]\n");
+        return 1;
+    }
+    std::optional<aot_library> library;
+    if (argc == 3)
+    {
+        library = build_library(argv[1], argv[2]);
+        if (!library)
+            return test::failures;
+    }
+
+    compile_context context;
+    const auto int_handle = type_registry::get_int_handle();
+    context.create_identifier("gi", int_handle, false);
+    context.create_identifier("gr", type_registry::get_real_handle(), false);
+    context.create_identifier("gb", type_registry::get_bool_handle(), false);
+    context.enter_function();
+    context.create_param("i", int_handle);
+    context.create_param("j", int_handle);
+    context.create_param("x", type_registry::get_real_handle());
+
+    for (std::size_t n = 0; n < std::size(entries); ++n)
+    {
+        const auto& e = entries[n];
+        const auto tree = parse(context, e.source);
+        const auto code = compile_bytecode(context, *tree);
+        const auto unfused = compile_bytecode(context, *tree, fusion_options{false, false});
+        const auto native = compile_native(context, *tree);
+        TONE_CHECK_EQUAL(native.has_value(), e.native && jit_available,
+                         fmt::format("'{}' compiled by the JIT", e.source));
+
+        std::unique_ptr<batch_expression> batch;
+        try
+        {
+            batch = std::make_unique<batch_expression>(*tree);
+        }
+        catch (const error&)
+        {
+        }
+        TONE_CHECK_EQUAL(batch != nullptr, e.batch,
+                         fmt::format("'{}' planned as a batch", e.source));
+        if (batch)
+            check_batch(context, *batch, code, e.source);
+
+        std::optional<aot_function> compiled;
+        if (library)
+        {
+            compiled = library->find(fmt::format("e{}", n));
+            if (!compiled)
+                TONE_FAIL(fmt::format("No entry for '{}'", e.source));
+        }
+
+        for (std::size_t row = 0; row < row_count; ++row)
+        {
+            const auto i = first_row + std::int64_t(row);
+            const auto args = row_args(i);
+            const auto reference = [&](vm& machine) {
+                return machine.run(code, args, dispatch_mode::switch_loop);
+            };
+            const auto on = [&](std::string_view backend) {
+                return fmt::format("'{}' with i = {} on {}", e.source, i, backend);
+            };
+
+#if TONE_THREADED_DISPATCH
+            check_same(context, i, on("threaded dispatch"), reference, [&](vm& machine) {
+                return machine.run(code, args, dispatch_mode::threaded);
+            });
+            check_same(context, i, on("threaded dispatch unfused"), reference, [&](vm& machine) {
+                return machine.run(unfused, args, dispatch_mode::threaded);
+            });
+#endif
+            check_same(context, i, on("the switch loop unfused"), reference, [&](vm& machine) {
+                return machine.run(unfused, args, dispatch_mode::switch_loop);
+            });
+            if (native)
+            {
+                check_same(context, i, on("the JIT"), reference, [&](vm& machine) {
+                    return (*native)(args, machine.bind_globals(code));
+                });
+            }
+            if (compiled)
+            {
+                check_same(context, i, on("AOT code"), reference, [&](vm& machine) {
+                    return (*compiled)(machine, args);
+                });
+            }
+        }
+    }
+    return test::failures;
+}
@@ -0,0 +1,73 @@
+#include "check.hpp"
+
+#include "tone/core/compile_context.hpp"
+#include "tone/core/compiled_expression.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/vm.hpp"
+
+#include <array>
+
+using namespace tone::core;
+
+namespace {
+    std::int64_t bump(std::int64_t& value)
+    {
+        value += 10;
+        return 0;
+    }
+
+    constexpr std::array dispatch_modes = {
+#if TONE_THREADED_DISPATCH
+            dispatch_mode::threaded,
+#endif
+            dispatch_mode::switch_loop,
+    };
+
+    // Evaluates `source` with `i` at 7, once as a parameter and once as a global, which must
+    // agree. Every operand is read when it's reached going left to right.
+    void check_order(std::string_view source, const runtime_value& expected)
+    {
+        const auto int_handle = type_registry::get_int_handle();
+        for (const auto mode : dispatch_modes)
+        try
+        {
+            // The contexts own the types of the machine's globals, so they outlive it
+            compile_context params;
+            compile_context globals;
+            vm machine;
+
+            params.bind<&bump>("bump");
+            compiled_expression as_param(params, {{"i", int_handle}}, source);
+            const runtime_value args[] = {std::int64_t(7)};
+            TONE_CHECK_EQUAL(machine.run(as_param.code(), args, mode), expected,
+                             fmt::format("'{}' on a parameter", source));
+
+            globals.bind<&bump>("bump");
+            const auto i = globals.create_identifier("i", int_handle, false);
+            compiled_expression as_global(globals, {}, source);
+            machine.set_global(i->index(), std::int64_t(7));
+            TONE_CHECK_EQUAL(machine.run(as_global.code(), {}, mode), expected,
+                             fmt::format("'{}' on a global", source));
+        }
+        catch (const error& err)
+        {
+            TONE_FAIL(fmt::format("'{}' threw: {}", source, err.what()));
+        }
+    }
+} // namespace
+
+int main()
+{
+    check_order("i + (i = 5)", std::int64_t(12));
+    check_order("i + i++", std::int64_t(14));
+    check_order("i * (i += 1)", std::int64_t(56));
+    check_order("i - (i -= 2)", std::int64_t(2));
+    check_order("i + ++i", std::int64_t(15));
+    check_order("(i += (i = 5))", std::int64_t(12));
+    check_order("i < (i = 9)", true);
+    check_order("i + bump(&i)", std::int64_t(7));
+    check_order("(i += bump(&i)), i", std::int64_t(7));
+    // Nothing on the right writes `i`, so it's read in place
+    check_order("i + (i + 1) * 2", std::int64_t(23));
+    return test::failures;
+}
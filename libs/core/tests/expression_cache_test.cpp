@@ -0,0 +1,134 @@
+#include "check.hpp"
+
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_cache.hpp"
+#include "tone/core/vm.hpp"
+
+#include <type_traits>
+
+using namespace tone::core;
+
+namespace {
+    const auto int_handle = type_registry::get_int_handle();
+
+    void check_stats(const expression_cache& cache, expression_cache_stats expected,
+                     std::string_view what)
+    {
+        const auto stats = cache.stats();
+        TONE_CHECK_EQUAL(std::int64_t(stats.hits), std::int64_t(expected.hits),
+                         fmt::format("hits {}", what));
+        TONE_CHECK_EQUAL(std::int64_t(stats.misses), std::int64_t(expected.misses),
+                         fmt::format("misses {}", what));
+        TONE_CHECK_EQUAL(std::int64_t(stats.evictions), std::int64_t(expected.evictions),
+                         fmt::format("evictions {}", what));
+        TONE_CHECK_EQUAL(std::int64_t(stats.size), std::int64_t(expected.size),
+                         fmt::format("size {}", what));
+    }
+
+    // The least recently used expression goes first, and stays usable while it's held
+    void check_eviction()
+    {
+        compile_context context;
+        vm machine;
+        expression_cache cache(context, {2, 1});
+        const expression_param params[] = {{"x", int_handle}};
+        const runtime_value args[] = {std::int64_t(4)};
+
+        const auto a = cache.get("x + 1", params);
+        const auto b = cache.get("x * 2", params);
+        TONE_CHECK(cache.get("x + 1", params) == a);
+        check_stats(cache, {1, 2, 0, 2}, "before evicting");
+
+        cache.get("x - 3", params);
+        check_stats(cache, {1, 3, 1, 2}, "after evicting");
+        TONE_CHECK(cache.get("x + 1", params) == a);
+        TONE_CHECK_EQUAL(machine.run(b->code(), args), std::int64_t(8), "an evicted expression");
+
+        const auto b_again = cache.get("x * 2", params);
+        TONE_CHECK(b_again != b);
+        check_stats(cache, {2, 4, 2, 2}, "after compiling the evicted expression again");
+        TONE_CHECK_EQUAL(machine.run(b_again->code(), args), std::int64_t(8),
+                         "a recompiled expression");
+
+        // Parameters named or typed differently are other keys
+        const expression_param renamed[] = {{"y", int_handle}};
+        const expression_param retyped[] = {{"x", type_registry::get_real_handle()}};
+        TONE_CHECK(cache.get("1", renamed) != cache.get("1", retyped));
+
+        cache.clear();
+        check_stats(cache, {2, 6, 4, 0}, "after clearing");
+    }
+
+    // Declaring a global drops what was compiled before it
+    void check_declaration()
+    {
+        compile_context context;
+        expression_cache cache(context);
+        const auto before = cache.get("2 + 3", {});
+        context.create_identifier("g", int_handle, false);
+        TONE_CHECK_EQUAL(std::int64_t(cache.stats().size), std::int64_t(1), "size before");
+
+        const auto after = cache.get("2 + 3", {});
+        TONE_CHECK(after != before);
+        check_stats(cache, {0, 2, 0, 1}, "after declaring");
+        TONE_CHECK(cache.get("g + 1", {}) != nullptr);
+    }
+
+    template <typename T>
+    value_slot constant(const host_function& self, value_slot*)
+    {
+        const auto value = *static_cast<const std::int64_t*>(self.target());
+        value_slot result{};
+        if constexpr (std::is_same_v<T, double>)
+            result.set_real(double(value));
+        else
+            result.set_int(value);
+        return result;
+    }
+
+    // Redefining a function drops what was compiled to call the one replaced, even once it's
+    // given back its old signature
+    void check_redefinition()
+    {
+        compile_context context;
+        vm machine;
+        expression_cache cache(context);
+        const auto int_fn = context.get_type_handle(function_type{int_handle, {}});
+        const auto real_fn =
+                context.get_type_handle(function_type{type_registry::get_real_handle(), {}});
+        const std::int64_t first = 1, second = 2, third = 3;
+
+        const auto info =
+                context.create_function(host_function("f", int_fn, &constant<int>, &first));
+        const auto before = cache.get("f()", {});
+        TONE_CHECK_EQUAL(machine.run(before->code()), std::int64_t(1), "the first definition");
+
+        auto replaced = context.redefine_function(
+                *info, host_function("f", real_fn, &constant<double>, &second));
+        TONE_CHECK_EQUAL(machine.run(cache.get("f()", {})->code()), 2.0, "a new signature");
+
+        auto replaced_again = context.redefine_function(
+                *info, host_function("f", int_fn, &constant<int>, &third));
+        replaced.reset();
+        replaced_again.reset();
+        const auto after = cache.get("f()", {});
+        TONE_CHECK(after != before);
+        TONE_CHECK_EQUAL(machine.run(after->code()), std::int64_t(3), "the old signature again");
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        check_eviction();
+        check_declaration();
+        check_redefinition();
+    }
+    catch (const error& err)
+    {
+        TONE_FAIL(fmt::format("threw: {}", err.what()));
+    }
+    return test::failures;
+}
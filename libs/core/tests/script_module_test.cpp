@@ -0,0 +1,149 @@
+#include "check.hpp"
+
+#include "tone/core/compile_context.hpp"
+#include "tone/core/epoch.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/script_module.hpp"
+#include "tone/core/vm.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace tone::core;
+
+// Reloading a module while calls to it run: a call that started before the reload finishes on
+// the code it started with, even once `retire_replaced` has been called, and what the reload
+// replaced is only freed after the last such call returns.
+
+namespace {
+    std::atomic<bool> entered = false;
+    std::atomic<bool> released = false;
+
+    // Keeps a call in flight until the test lets it go
+    std::int64_t hold(std::int64_t value)
+    {
+        entered = true;
+        entered.notify_all();
+        released.wait(false);
+        return value;
+    }
+
+    std::string version(int n)
+    {
+        // Odd versions give `callee` another signature, so the reload redeclares it
+        const auto callee = n % 2 ? fmt::format("fn int callee(int x) {{ x + {} }}", n)
+                                  : fmt::format("fn int callee(real x) {{ {} }}", n);
+        return callee + "\nfn int caller(int x) { callee(x) }\n"
+                        "fn int slow(int x) { hold(x) + callee(x) }\n";
+    }
+
+    // The result of `caller(5)` in version `n`
+    std::int64_t caller_result(int n)
+    {
+        return n % 2 ? 5 + n : n;
+    }
+
+    void check_in_flight()
+    {
+        compile_context context;
+        context.bind<&hold>("hold");
+        script_module module(context, version(1));
+        vm machine;
+        const runtime_value args[] = {std::int64_t(5)};
+        TONE_CHECK_EQUAL(module.call(machine, "caller", args), std::int64_t(6), "version 1");
+
+        std::int64_t slow_result = 0;
+        std::thread caller([&] {
+            vm other;
+            slow_result = std::get<std::int64_t>(module.call(other, "slow", args));
+        });
+        entered.wait(false);
+
+        module.reload(version(2));
+        module.retire_replaced();
+        TONE_CHECK(epoch_guard::reclaim() > 0);
+        TONE_CHECK_EQUAL(module.call(machine, "caller", args), std::int64_t(2),
+                         "version 2 while a call to version 1 runs");
+
+        released = true;
+        released.notify_all();
+        caller.join();
+        TONE_CHECK_EQUAL(slow_result, std::int64_t(5 + 6), "the call begun before the reload");
+        TONE_CHECK_EQUAL(std::int64_t(epoch_guard::reclaim()), std::int64_t(0),
+                         "what's left once the call returned");
+        TONE_CHECK_EQUAL(module.call(machine, "slow", args), std::int64_t(5 + 2),
+                         "a call after the reload");
+    }
+
+    // Threads keep calling while the module is reloaded over and over
+    void check_concurrent_reloads()
+    {
+        compile_context context;
+        context.bind<&hold>("hold");
+        script_module module(context, version(1));
+
+        std::atomic<bool> stop = false;
+        // The version every call sees at least, and the last one a call may see
+        std::atomic<int> oldest = 1;
+        std::atomic<int> newest = 1;
+        std::atomic<long> calls = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; ++t)
+        {
+            threads.emplace_back([&] {
+                vm machine;
+                const runtime_value args[] = {std::int64_t(5)};
+                while (!stop)
+                {
+                    const auto before = oldest.load();
+                    try
+                    {
+                        const auto result = module.call(machine, "caller", args);
+                        const auto after = newest.load();
+                        bool known = false;
+                        for (int n = before; n <= after; ++n)
+                            known = known || result == runtime_value(caller_result(n));
+                        if (!known)
+                            TONE_FAIL(fmt::format("Unexpected {}", dump_runtime_value(result)));
+                    }
+                    catch (const std::exception& err)
+                    {
+                        TONE_FAIL(fmt::format("A call threw '{}'", err.what()));
+                    }
+                    ++calls;
+                }
+            });
+        }
+
+        for (int n = 2; n <= 40; ++n)
+        {
+            newest = n;
+            module.reload(version(n));
+            oldest = n;
+            module.retire_replaced();
+            std::this_thread::yield();
+        }
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+        TONE_CHECK(calls > 0);
+        TONE_CHECK_EQUAL(std::int64_t(epoch_guard::reclaim()), std::int64_t(0),
+                         "what's left once every call returned");
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        check_in_flight();
+        check_concurrent_reloads();
+    }
+    catch (const std::exception& err)
+    {
+        TONE_FAIL(fmt::format("threw: {}", err.what()));
+    }
+    return test::failures;
+}
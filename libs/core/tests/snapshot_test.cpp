@@ -0,0 +1,202 @@
+#include "check.hpp"
+
+#include "tone/core/array.hpp"
+#include "tone/core/bytecode_image.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/compiled_expression.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/vm.hpp"
+
+#include <optional>
+#include <random>
+#include <stdexcept>
+
+using namespace tone::core;
+
+// A snapshot restores every global a VM held, strings and nested or shared arrays included,
+// into a context that hasn't declared them yet, and runs its code as it ran before saving.
+
+namespace {
+    std::int64_t twice(std::int64_t value)
+    {
+        return 2 * value;
+    }
+
+    const char* const main_source = "twice(a) + r + A[1] + M[0][1] + M[1][0]";
+    const char* const global_names[] = {"A", "M", "S", "B", "R", "a", "r", "s", "k"};
+
+    runtime_value run(vm& machine, compile_context& context, const char* source)
+    {
+        const compiled_expression expression(context, {}, source);
+        return machine.run(expression.code());
+    }
+
+    std::string dump_global(const vm& machine, const compile_context& context,
+                            const char* name)
+    {
+        const auto info = context.find(name);
+        return info ? dump_runtime_value(machine.global(info->index())) : "undeclared";
+    }
+
+    // Declares and initializes the globals the way a script's initialization would
+    void initialize(vm& machine, compile_context& context)
+    {
+        const auto int_handle = type_registry::get_int_handle();
+        const auto ints = context.get_type_handle(array_type{int_handle});
+        const auto nested = context.get_type_handle(array_type{ints});
+        const auto strs = context.get_type_handle(array_type{type_registry::get_str_handle()});
+        const auto bools = context.get_type_handle(array_type{type_registry::get_bool_handle()});
+        const auto reals = context.get_type_handle(array_type{type_registry::get_real_handle()});
+        const std::pair<const char*, type_handle> globals[] = {
+                {"A", ints},
+                {"M", nested},
+                {"S", strs},
+                {"B", bools},
+                {"R", reals},
+                {"a", int_handle},
+                {"r", type_registry::get_real_handle()},
+                {"s", type_registry::get_str_handle()},
+                {"k", type_registry::get_bool_handle()},
+        };
+        for (const auto& [name, type_id] : globals)
+            context.create_identifier(name, type_id, false);
+
+        array a(ints);
+        for (int i = 0; i < 5; ++i)
+            a.push_int(i * 10);
+        array m(nested);
+        m.push_array(a);
+        array sevens(ints, 3);
+        sevens.set_int(0, 7);
+        m.push_array(sevens);
+        m.push_array(a.slice(1, 2));
+        array s(strs);
+        s.push_str(str(u"one"));
+        s.push_str(str(u"two two"));
+        array b(bools, 130);
+        b.set_bool(1, true);
+        b.set_bool(64, true);
+        b.set_bool(129, true);
+        array r(reals);
+        r.push_real(1.5);
+        r.push_real(-2.25);
+        machine.set_global(context.find("A")->index(), a);
+        machine.set_global(context.find("M")->index(), m);
+        machine.set_global(context.find("S")->index(), s);
+        machine.set_global(context.find("B")->index(), b);
+        machine.set_global(context.find("R")->index(), r);
+
+        run(machine, context, "a = 5");
+        run(machine, context, "r = 2.5 * a");
+        run(machine, context, "s = \"hello\" + \" world\"");
+        run(machine, context, "k = true");
+    }
+
+    void check_round_trip(std::span<const std::byte> bytes, const vm& saved,
+                          const compile_context& saved_context, const runtime_value& expected)
+    {
+        compile_context context;
+        context.bind<&twice>("twice");
+        vm machine;
+        std::optional<bytecode_image> image(bytecode_image::copy(bytes, context));
+        TONE_CHECK(image->has_globals());
+        TONE_CHECK(image->tag() == "snapshot");
+        image->restore_globals(machine);
+
+        for (const auto* name : global_names)
+        {
+            TONE_CHECK(dump_global(machine, context, name) ==
+                       dump_global(saved, saved_context, name));
+        }
+        TONE_CHECK_EQUAL(machine.run(image->view()), expected, "the snapshot's code");
+
+        // Arrays shared when saved are shared once restored
+        run(machine, context, "M[0][1] = 77");
+        TONE_CHECK_EQUAL(run(machine, context, "A[1]"), std::int64_t(77), "a shared array");
+        TONE_CHECK_EQUAL(run(machine, context, "M[2][0]"), std::int64_t(10), "a slice");
+
+        // Strings lent from the image are kept when it goes
+        image.reset();
+        TONE_CHECK_EQUAL(run(machine, context, "s + S[1]"), str(u"hello worldtwo two"),
+                         "strings after the image went");
+    }
+
+    void check_rejected(std::span<const std::byte> bytes)
+    {
+        for (std::size_t size = 0; size < bytes.size(); ++size)
+        {
+            compile_context context;
+            context.bind<&twice>("twice");
+            try
+            {
+                bytecode_image::copy(bytes.first(size), context);
+                TONE_FAIL(fmt::format("A snapshot loaded when cut to {} bytes", size));
+            }
+            catch (const std::invalid_argument&)
+            {
+            }
+        }
+
+        // The context already declares a saved global with another type
+        compile_context retyped;
+        retyped.bind<&twice>("twice");
+        retyped.create_identifier("a", type_registry::get_real_handle(), false);
+        try
+        {
+            bytecode_image::copy(bytes, retyped);
+            TONE_FAIL("A snapshot loaded over a global of another type");
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+
+        // Corrupted globals are refused when loaded or restored, never read out of bounds
+        std::mt19937 random(1);
+        std::vector<std::byte> bad;
+        for (int n = 0; n < 1000; ++n)
+        {
+            bad.assign(bytes.begin(), bytes.end());
+            for (int flips = 1 + int(random() % 3); flips > 0; --flips)
+                bad[16 + random() % (bad.size() - 16)] ^= std::byte(1u << (random() % 8));
+            compile_context context;
+            context.bind<&twice>("twice");
+            try
+            {
+                auto image = bytecode_image::copy(bad, context);
+                vm machine;
+                image.restore_globals(machine);
+            }
+            catch (const std::invalid_argument&)
+            {
+            }
+            catch (const std::exception& err)
+            {
+                TONE_FAIL(fmt::format("A corrupted snapshot threw '{}'", err.what()));
+            }
+        }
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        compile_context context;
+        context.bind<&twice>("twice");
+        vm machine;
+        initialize(machine, context);
+
+        const compiled_expression expression(context, {}, main_source);
+        const auto expected = machine.run(expression.code());
+        const auto bytes =
+                save_bytecode_snapshot(expression.code(), machine, context, "snapshot");
+
+        check_round_trip(bytes, machine, context, expected);
+        check_rejected(bytes);
+    }
+    catch (const std::exception& err)
+    {
+        TONE_FAIL(fmt::format("threw: {}", err.what()));
+    }
+    return test::failures;
+}
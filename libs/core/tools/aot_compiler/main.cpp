@@ -0,0 +1,316 @@
+#include "tone/core/aot.hpp"
+#include "tone/core/compile_context.hpp"
+#include "tone/core/errors.hpp"
+#include "tone/core/expression_parser.hpp"
+#include "tone/core/tokenizer.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#if __has_include(<spawn.h>)
+#include <spawn.h>
+#include <sys/wait.h>
+#define TONE_HAS_SPAWN 1
+extern char** environ;
+#endif
+
+using namespace tone::core;
+
+// Builds a shared object from a module description. Each non-empty line of the description is
+// one of
+//
+//     global <name> <int|real|bool>
+//     param <name> <int|real|bool>
+//     entry <name> = <expression>
+//
+// and `#` starts a comment. Names are identifiers: a letter or `_`, then letters, digits and
+// `_`. Globals keep their declaration order as indices and params their positions, which is the
+// layout hosts have to use when calling the entries.
+
+namespace {
+    struct declaration
+    {
+        std::size_t line_number;
+        std::string kind;
+        std::string name;
+        std::string rest;
+    };
+
+    struct options
+    {
+        std::string input;
+        std::string output;
+        std::string source;
+        std::string compiler;
+    };
+
+    void usage()
+    {
+        fmt::print(stderr, "usage: tone_aot_compiler <module> -o <output.so> [--cc <compiler>] "
+                           "[--source <output.c>]\n");
+    }
+
+    bool parse_options(int argc, char** argv, options& opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            if ((arg == "-o" || arg == "--cc" || arg == "--source") && i + 1 < argc)
+            {
+                auto& value = arg == "-o"   ? opts.output
+                              : arg == "--cc" ? opts.compiler
+                                              : opts.source;
+                value = argv[++i];
+            }
+            else if (opts.input.empty() && !arg.starts_with('-'))
+            {
+                opts.input = arg;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if (opts.input.empty() || opts.output.empty())
+            return false;
+
+        if (opts.source.empty())
+            opts.source = opts.output + ".c";
+        if (opts.compiler.empty())
+        {
+            const char* cc = std::getenv("CC");
+            opts.compiler = cc ? cc : "cc";
+        }
+        return true;
+    }
+
+    bool is_identifier(std::string_view name)
+    {
+        const auto is_alpha = [](char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        };
+        return !name.empty() && is_alpha(name[0]) &&
+               std::all_of(name.begin(), name.end(),
+                           [&](char c) { return is_alpha(c) || (c >= '0' && c <= '9'); });
+    }
+
+    bool read_declarations(const std::string& path, std::vector<declaration>& declarations)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            fmt::print(stderr, "Can't open '{}'\n", path);
+            return false;
+        }
+
+        std::string line;
+        for (std::size_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            if (const auto comment = line.find('#'); comment != std::string::npos)
+                line.erase(comment);
+
+            std::istringstream ss(line);
+            declaration decl{};
+            decl.line_number = line_number;
+            if (!(ss >> decl.kind))
+                continue;
+
+            if (decl.kind == "entry")
+            {
+                const auto eq = line.find('=');
+                std::istringstream name(line.substr(0, eq));
+                name >> decl.kind >> decl.name;
+                if (eq == std::string::npos || decl.name.empty())
+                {
+                    fmt::print(stderr, "{}:{}: Expected 'entry <name> = <expression>'\n", path,
+                               line_number);
+                    return false;
+                }
+                decl.rest = line.substr(eq + 1);
+            }
+            else if (decl.kind == "global" || decl.kind == "param")
+            {
+                if (!(ss >> decl.name >> decl.rest))
+                {
+                    fmt::print(stderr, "{}:{}: Expected '{} <name> <type>'\n", path, line_number,
+                               decl.kind);
+                    return false;
+                }
+            }
+            else
+            {
+                fmt::print(stderr, "{}:{}: Unknown declaration '{}'\n", path, line_number,
+                           decl.kind);
+                return false;
+            }
+
+            // Entry names end up in the generated C
+            if (!is_identifier(decl.name))
+            {
+                fmt::print(stderr, "{}:{}: '{}' is not a valid name\n", path, line_number,
+                           decl.name);
+                return false;
+            }
+            declarations.push_back(std::move(decl));
+        }
+        return true;
+    }
+
+    // Runs `compiler` with `args` directly, without a shell in between. The compiler may be
+    // given with arguments of its own, such as `ccache cc`, which are split at spaces.
+    bool run_compiler(const std::string& compiler, const std::vector<std::string>& args)
+    {
+        std::vector<std::string> words;
+        std::istringstream ss(compiler);
+        for (std::string word; ss >> word;)
+            words.push_back(std::move(word));
+        if (words.empty())
+            return false;
+        words.insert(words.end(), args.begin(), args.end());
+
+#if TONE_HAS_SPAWN
+        std::vector<char*> argv;
+        for (auto& word : words)
+            argv.push_back(word.data());
+        argv.push_back(nullptr);
+
+        pid_t pid;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+            return false;
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
+                return false;
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+        fmt::print(stderr, "Running a compiler isn't supported on this platform\n");
+        return false;
+#endif
+    }
+
+    type_handle parse_type(std::string_view name)
+    {
+        if (name == "int")
+            return type_registry::get_int_handle();
+        if (name == "real")
+            return type_registry::get_real_handle();
+        if (name == "bool")
+            return type_registry::get_bool_handle();
+        return nullptr;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        usage();
+        return 2;
+    }
+
+    std::vector<declaration> declarations;
+    if (!read_declarations(opts.input, declarations))
+        return 1;
+
+    // Globals are declared first so that every entry shares them, then one parameter list
+    compile_context context;
+    for (const auto& kind : {"global", "param"})
+    {
+        if (std::string_view(kind) == "param")
+            context.enter_function();
+
+        for (const auto& decl : declarations)
+        {
+            if (decl.kind != kind)
+                continue;
+
+            const auto type_id = parse_type(decl.rest);
+            if (!type_id)
+            {
+                fmt::print(stderr, "{}:{}: Unknown type '{}'\n", opts.input, decl.line_number,
+                           decl.rest);
+                return 1;
+            }
+            if (decl.kind == "global")
+                context.create_identifier(decl.name, type_id, false);
+            else
+                context.create_param(decl.name, type_id);
+        }
+    }
+
+    std::vector<node_ptr> trees;
+    std::vector<aot_source_entry> entries;
+    for (const auto& decl : declarations)
+    {
+        if (decl.kind != "entry")
+            continue;
+
+        std::istringstream ss(decl.rest);
+        character_source_t input = [&ss]() {
+            return ss.get();
+        };
+        push_back_stream strm(input);
+        try
+        {
+            token_iterator it(strm);
+            trees.push_back(parse_expression_tree(context, it, type_registry::get_void_handle(),
+                                                  false, true, false));
+            if (!it->is_eof())
+                throw unexpected_syntax_error(it->dump(), it->get_line_number(),
+                                              it->get_char_index());
+            entries.push_back({decl.name, trees.back().get()});
+        }
+        catch (const error& err)
+        {
+            ss.clear();
+            ss.seekg(0);
+            fmt::print(stderr, "{}:{}: ", opts.input, decl.line_number);
+            print_error(err, input);
+            return 1;
+        }
+    }
+
+    std::string source;
+    try
+    {
+        source = generate_aot_source(context, entries);
+    }
+    catch (const error& err)
+    {
+        fmt::print(stderr, "{}\n", err.what());
+        return 1;
+    }
+
+    {
+        std::ofstream file(opts.source, std::ios::binary | std::ios::trunc);
+        file << source;
+        if (!file)
+        {
+            fmt::print(stderr, "Can't write '{}'\n", opts.source);
+            return 1;
+        }
+    }
+
+    const std::vector<std::string> args = {"-std=c99", "-O2", "-shared", "-fPIC",
+                                           "-fvisibility=hidden", "-o", opts.output,
+                                           opts.source, "-lm"};
+    if (!run_compiler(opts.compiler, args))
+    {
+        std::string command = opts.compiler;
+        for (const auto& arg : args)
+            command += " " + arg;
+        fmt::print(stderr, "Compiler failed: {}\n", command);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file